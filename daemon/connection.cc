@@ -63,6 +63,7 @@ Connection::Connection(SOCKET sfd, event_base* b)
       refcount(0),
       engine_storage(nullptr),
       next(nullptr),
+      pendingIo(false),
       thread(nullptr),
       parent_port(0),
       bucketIndex(0),
@@ -206,6 +206,18 @@ public:
         Connection::next = next;
     }
 
+    /**
+     * Is the connection in the pending io list of its thread? (protected
+     * by the thread lock)
+     */
+    bool isPendingIo() const {
+        return pendingIo;
+    }
+
+    void setPendingIo(bool pendingIo) {
+        Connection::pendingIo = pendingIo;
+    }
+
     LIBEVENT_THREAD* getThread() const {
         return thread.load(std::memory_order_relaxed);
     }
@@ -366,6 +378,9 @@ protected:
     /* Used for generating a list of Connection structures */
     Connection* next;
 
+    /** Set while the connection is in the pending io list */
+    bool pendingIo;
+
     /** Pointer to the thread object serving this connection */
     std::atomic<LIBEVENT_THREAD*> thread;
 
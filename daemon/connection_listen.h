@@ -36,7 +36,8 @@ public:
                      event_base* b,
                      in_port_t port,
                      sa_family_t fam,
-                     const struct interface &interf);
+                     const struct interface &interf,
+                     LIBEVENT_THREAD* worker);
 
     virtual ~ListenConnection();
 
@@ -54,6 +55,15 @@ public:
         return management;
     }
 
+    /**
+     * Get the worker thread accepting the clients on this (SO_REUSEPORT)
+     * socket, or nullptr if the clients are accepted by the dispatcher
+     * and handed to the workers.
+     */
+    LIBEVENT_THREAD* getWorkerThread() const {
+        return worker;
+    }
+
     /**
      * Get the details for this connection to put in the portnumber
      * file so that the test framework may pick up the port numbers
@@ -67,6 +77,7 @@ protected:
     const bool ssl;
     const bool management;
     const Protocol protocol;
+    LIBEVENT_THREAD* const worker;
 
     struct EventDeleter {
         void operator()(struct event* ev) {
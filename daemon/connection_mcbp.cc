@@ -128,7 +128,14 @@ bool McbpConnection::updateEvent(const short new_flags) {
         }
     }
 
-    if (ev_flags == new_flags) {
+    // With io_uring the input may already be here (see io_uring_backend.h)
+    const bool pendingInput = ioUringSocket != nullptr &&
+                              (new_flags & EV_READ) &&
+                              ioUringSocket->hasInput();
+
+    if (ev_flags == new_flags &&
+        (ioUringSocket == nullptr ||
+         event_get_events(&event) == libeventFlags(new_flags))) {
         // We do "cache" the current libevent state (using EV_PERSIST) to avoid
         // having to re-register it when it doesn't change (which it mostly don't).
         // In order to avoid having clients to falsely "time out" due to that they
@@ -144,6 +151,9 @@ bool McbpConnection::updateEvent(const short new_flags) {
             const int reinsert_time = settings.getConnectionIdleTime() / 2;
 
             if ((ev_insert_time + reinsert_time) > now) {
+                if (pendingInput) {
+                    event_active(&event, EV_READ, 0);
+                }
                 return true;
             } else {
                 LOG_DEBUG(this,
@@ -165,8 +175,8 @@ bool McbpConnection::updateEvent(const short new_flags) {
         return false;
     }
 
-    if (event_assign(&event, base, socketDescriptor, new_flags, event_handler,
-              reinterpret_cast<void*>(this)) == -1) {
+    if (event_assign(&event, base, socketDescriptor, libeventFlags(new_flags),
+                     event_handler, reinterpret_cast<void*>(this)) == -1) {
         LOG_WARNING(this,
                     "Failed to set up event notification. "
                     "Shutting down connection %s",
@@ -183,9 +193,86 @@ bool McbpConnection::updateEvent(const short new_flags) {
         return false;
     }
 
+    if (pendingInput) {
+        event_active(&event, EV_READ, 0);
+    }
+
+    return true;
+}
+
+bool McbpConnection::isIdle() const {
+    return getState() == conn_read && registered_in_libevent &&
+           !ewouldblock && getRefcount() == 1 &&
+           read.buf == nullptr && write.buf == nullptr &&
+           !isDCP() && !isTAP() && !ssl.isEnabled() &&
+           ioUringSocket == nullptr;
+}
+
+bool McbpConnection::moveToThread(LIBEVENT_THREAD* thread) {
+    if (!unregisterEvent()) {
+        return false;
+    }
+
+    if (event_assign(&event, thread->base, socketDescriptor, ev_flags,
+                     event_handler, reinterpret_cast<void*>(this)) == -1) {
+        LOG_WARNING(this, "%u: Failed to move connection to thread %u",
+                    getId(), thread->index);
+        if (!registerEvent()) {
+            initateShutdown();
+        }
+        return false;
+    }
+
+    base = thread->base;
+    setThread(thread);
     return true;
 }
 
+bool McbpConnection::attachIoUring(IoUring& ring) {
+    if (ssl.isEnabled() || !registered_in_libevent) {
+        return false;
+    }
+
+    ioUringSocket = ring.attach(this, socketDescriptor);
+    if (ioUringSocket == nullptr) {
+        return false;
+    }
+    if (!unregisterEvent()) {
+        ioUringSocket->detach(false);
+        ioUringSocket = nullptr;
+        return false;
+    }
+    if (event_assign(&event, base, socketDescriptor, libeventFlags(ev_flags),
+                     event_handler, reinterpret_cast<void*>(this)) == 0 &&
+        registerEvent()) {
+        return true;
+    }
+
+    LOG_WARNING(this, "%u: Failed to set up the event for io_uring",
+                getId());
+    ioUringSocket->detach(false);
+    ioUringSocket = nullptr;
+    if (event_assign(&event, base, socketDescriptor, ev_flags,
+                     event_handler, reinterpret_cast<void*>(this)) == -1 ||
+        !registerEvent()) {
+        initateShutdown();
+    }
+    return false;
+}
+
+void McbpConnection::detachIoUring() {
+    if (ioUringSocket != nullptr) {
+        ioUringSocket->detach();
+        ioUringSocket = nullptr;
+    }
+}
+
+void McbpConnection::activateEvent(short which) {
+    if (registered_in_libevent) {
+        event_active(&event, which, 0);
+    }
+}
+
 bool McbpConnection::reapplyEventmask() {
     return updateEvent(ev_flags);
 }
@@ -203,22 +290,21 @@ bool McbpConnection::initializeEvent() {
 }
 
 void McbpConnection::shrinkBuffers() {
-    if (read.size > READ_BUFFER_HIGHWAT && read.bytes < DATA_BUFFER_SIZE) {
-        if (read.curr != read.buf) {
-            /* Pack the buffer */
-            memmove(read.buf, read.curr, (size_t)read.bytes);
-        }
-
-        void* ptr = realloc(read.buf, DATA_BUFFER_SIZE);
-        char* newbuf = reinterpret_cast<char*>(ptr);
+    /* The read buffer is normally given back to the thread once it's
+     * empty, but TAP and DCP connections keep theirs */
+    if (read.buf != nullptr && read.bytes == 0 &&
+        read.size > READ_BUFFER_HIGHWAT && read.size > getReadBufferSize()) {
+        size_t size = getReadBufferSize();
+        char* newbuf = conn_get_read_buffer(this, size);
         if (newbuf) {
+            conn_put_read_buffer(this, read.buf, read.size);
             read.buf = newbuf;
-            read.size = DATA_BUFFER_SIZE;
+            read.size = uint32_t(size);
         } else {
             LOG_WARNING(this,
                         "%u: Failed to shrink read buffer down to %"
                             PRIu64
-                            " bytes.", getId(), DATA_BUFFER_SIZE);
+                            " bytes.", getId(), uint64_t(size));
         }
         read.curr = read.buf;
     }
@@ -312,7 +398,11 @@ int McbpConnection::recv(char* dest, size_t nbytes) {
             res = sslRead(dest, nbytes);
         }
     } else {
-        res = (int)::recv(socketDescriptor, dest, nbytes, 0);
+        if (ioUringSocket != nullptr) {
+            res = ioUringSocket->recv(dest, nbytes);
+        } else {
+            res = (int)::recv(socketDescriptor, dest, nbytes, 0);
+        }
         if (res > 0) {
             totalRecv += res;
         }
@@ -340,7 +430,11 @@ int McbpConnection::sendmsg(struct msghdr* m) {
         ssl.drainBioSendPipe(socketDescriptor);
         return res;
     } else {
-        res = int(::sendmsg(socketDescriptor, m, 0));
+        if (ioUringSocket != nullptr) {
+            res = ioUringSocket->sendmsg(m);
+        } else {
+            res = int(::sendmsg(socketDescriptor, m, 0));
+        }
         if (res > 0) {
             totalSend += res;
         }
@@ -446,34 +540,33 @@ McbpConnection::TryReadResult McbpConnection::tryReadNetwork() {
     int res;
     int num_allocs = 0;
 
-    if (read.curr != read.buf) {
-        if (read.bytes != 0) { /* otherwise there's nothing to copy */
-            memmove(read.buf, read.curr, read.bytes);
-        }
+    if (read.bytes == 0) {
         read.curr = read.buf;
     }
 
     while (1) {
-        int avail;
-        if (read.bytes >= read.size) {
+        int avail = int(read.buf + read.size - (read.curr + read.bytes));
+        if (avail == 0) {
             if (num_allocs == 4) {
+                recordInputSize(read.bytes);
                 return gotdata;
             }
             ++num_allocs;
-            char* new_rbuf = reinterpret_cast<char*>(realloc(read.buf,
-                                                             read.size * 2));
-            if (!new_rbuf) {
-                LOG_WARNING(this, "Couldn't realloc input buffer");
+            /* Move the fragment to the start of the buffer if it's less
+             * than half of it (and the buffer is as large as we want),
+             * otherwise move over to a larger buffer */
+            size_t size = std::max(size_t(read.bytes) * 2,
+                                   getReadBufferSize());
+            if (!growReadBuffer(size)) {
+                LOG_WARNING(this, "Couldn't grow input buffer");
                 read.bytes = 0; /* ignore what we read */
                 setState(conn_closing);
                 return TryReadResult::MemoryError;
             }
-            read.curr = read.buf = new_rbuf;
-            read.size *= 2;
+            continue;
         }
 
-        avail = read.size - read.bytes;
-        res = recv(read.buf + read.bytes, avail);
+        res = recv(read.curr + read.bytes, avail);
         if (res > 0) {
             get_thread_stats(this)->bytes_read += res;
             gotdata = TryReadResult::DataReceived;
@@ -501,9 +594,34 @@ McbpConnection::TryReadResult McbpConnection::tryReadNetwork() {
             return TryReadResult::SocketError;
         }
     }
+    if (gotdata == TryReadResult::DataReceived) {
+        recordInputSize(read.bytes);
+    }
     return gotdata;
 }
 
+bool McbpConnection::growReadBuffer(size_t size) {
+    if (size <= read.size) {
+        if (read.curr != read.buf) {
+            memmove(read.buf, read.curr, read.bytes);
+            read.curr = read.buf;
+        }
+        return true;
+    }
+
+    char* newbuf = conn_get_read_buffer(this, size);
+    if (newbuf == nullptr) {
+        return false;
+    }
+    if (read.bytes != 0) {
+        memcpy(newbuf, read.curr, read.bytes);
+    }
+    conn_put_read_buffer(this, read.buf, read.size);
+    read.buf = read.curr = newbuf;
+    read.size = uint32_t(size);
+    return true;
+}
+
 int McbpConnection::sslRead(char* dest, size_t nbytes) {
     int ret = 0;
 
@@ -908,6 +1026,8 @@ McbpConnection::McbpConnection(SOCKET sfd, event_base *b)
       commandContext(nullptr),
       totalRecv(0),
       totalSend(0),
+      ioUringSocket(nullptr),
+      inputEstimate(DATA_BUFFER_SIZE),
       cookie(this) {
     memset(&binary_header, 0, sizeof(binary_header));
     memset(&event, 0, sizeof(event));
@@ -954,6 +1074,8 @@ McbpConnection::McbpConnection(SOCKET sfd,
       commandContext(nullptr),
       totalRecv(0),
       totalSend(0),
+      ioUringSocket(nullptr),
+      inputEstimate(DATA_BUFFER_SIZE),
       cookie(this) {
 
     if (ifc.protocol != Protocol::Memcached) {
@@ -979,6 +1101,7 @@ McbpConnection::McbpConnection(SOCKET sfd,
 }
 
 McbpConnection::~McbpConnection() {
+    detachIoUring();
     free(read.buf);
     free(write.buf);
 
@@ -21,11 +21,14 @@
 #include "config.h"
 
 #include "dynamic_buffer.h"
+#include "io_uring_backend.h"
 #include "log_macros.h"
 #include "net_buf.h"
+#include "read_buffer_pool.h"
 #include "settings.h"
 #include "statemachine_mcbp.h"
 
+#include <algorithm>
 #include <cJSON.h>
 #include <cbsasl/cbsasl.h>
 #include <chrono>
@@ -348,10 +351,56 @@ public:
         return registered_in_libevent;
     }
 
+    /**
+     * Is the connection idle, waiting for the next command with nothing
+     * buffered and no command in flight, so that it may be moved over to
+     * another worker thread?
+     */
+    bool isIdle() const;
+
+    /**
+     * Move an idle connection over to another worker thread. The
+     * connection is removed from the event base of the current thread and
+     * bound to the event base of the new thread, but not registered in it
+     * (the new thread registers it when it runs it from its pending io
+     * list).
+     *
+     * @param thread the thread to move the connection to
+     * @return true if success, false otherwise (the connection is left
+     *         as it was)
+     */
+    bool moveToThread(LIBEVENT_THREAD* thread);
+
     short getEventFlags() const {
         return ev_flags;
     }
 
+    /**
+     * Serve the socket through the io_uring of the worker thread (see
+     * io_uring_backend.h). SSL connections can't be served through the
+     * ring.
+     *
+     * @param ring the ring of the thread the connection is bound to
+     * @return true if success, false if the connection stays with libevent
+     */
+    bool attachIoUring(IoUring& ring);
+
+    /**
+     * Stop serving the socket through the io_uring. Must be called before
+     * the socket is closed.
+     */
+    void detachIoUring();
+
+    bool isIoUring() const {
+        return ioUringSocket != nullptr;
+    }
+
+    /**
+     * Run the connection for the given events (from the next iteration of
+     * the event loop), if it's registered in libevent.
+     */
+    void activateEvent(short which);
+
     short getCurrentEvent() const {
         return currentEvent;
     }
@@ -380,6 +429,38 @@ public:
      */
     void shrinkBuffers();
 
+    /**
+     * Make sure there is room for (at least) size bytes from read.curr in
+     * the read buffer, by moving the unparsed input to the start of the
+     * buffer, or over to a larger buffer from the read buffer pool of the
+     * thread. read.curr is set to the start of the buffer.
+     *
+     * @return false if we're out of memory
+     */
+    bool growReadBuffer(size_t size);
+
+    /**
+     * The size of the read buffer wanted by the connection, based on the
+     * size of the requests (and the batches of them) received lately
+     */
+    size_t getReadBufferSize() const {
+        return ReadBufferPool::roundUp(std::min(inputEstimate,
+                                                size_t(READ_BUFFER_POOL_MAX_SIZE)));
+    }
+
+    /**
+     * Record the size of a request (or a batch of requests) received. The
+     * estimate follows a larger size immediately, and decays slowly
+     * towards smaller ones.
+     */
+    void recordInputSize(size_t size) {
+        if (size >= inputEstimate) {
+            inputEstimate = size;
+        } else {
+            inputEstimate -= (inputEstimate - size) / 16;
+        }
+    }
+
     /**
      * Receive data from the socket
      *
@@ -434,8 +515,10 @@ public:
 
     /**
      * read from network as much as we can, handle buffer overflow and
-     * connection close. Before reading, move the remaining incomplete fragment
-     * of a command (if any) to the beginning of the buffer.
+     * connection close. The input is read in after the unparsed input in the
+     * buffer, and the remaining incomplete fragment of a command (if any)
+     * is only moved (to the beginning of the buffer, or to a larger buffer)
+     * once the end of the buffer is reached.
      *
      * @return enum try_read_result
      */
@@ -674,6 +757,10 @@ public:
     bool havePendingInputData() {
         int block = (read.bytes > 0);
 
+        if (!block && ioUringSocket != nullptr) {
+            block = ioUringSocket->hasInput();
+        }
+
         if (!block && ssl.isEnabled()) {
             char dummy;
             block |= ssl.peek(&dummy, 1);
@@ -894,11 +981,24 @@ protected:
      */
     int sslPreConnection();
 
+    /**
+     * The flags to give libevent for the events the connection waits for
+     */
+    short libeventFlags(short flags) const {
+        return ioUringSocket ? ioUringSocket->eventFlags(flags) : flags;
+    }
+
     // Total number of bytes received on the network
     size_t totalRecv;
     // Total number of bytes sent to the network
     size_t totalSend;
 
+    /** The socket state if it's served through an io_uring */
+    IoUringSocket* ioUringSocket;
+
+    /** The estimated size of the input (see recordInputSize()) */
+    size_t inputEstimate;
+
     Cookie cookie;
 };
 
@@ -58,7 +58,8 @@ static ListenConnection* allocate_listen_connection(SOCKET sfd,
                                                     event_base* base,
                                                     in_port_t port,
                                                     sa_family_t family,
-                                                    const struct interface& interf);
+                                                    const struct interface& interf,
+                                                    LIBEVENT_THREAD* worker);
 
 static Connection *allocate_pipe_connection(int fd, event_base *base);
 static void release_connection(Connection *c);
@@ -85,6 +86,45 @@ int signal_idle_clients(LIBEVENT_THREAD *me, int bucket_idx, bool logging)
     return connected;
 }
 
+/*
+ * Keep track of the clients bound to each of the threads
+ */
+static void thread_add_connection(LIBEVENT_THREAD* thread, Connection* c) {
+    std::lock_guard<std::mutex> lock(thread->connections_mutex);
+    thread->connections.insert(c);
+}
+
+static void thread_remove_connection(LIBEVENT_THREAD* thread, Connection* c) {
+    std::lock_guard<std::mutex> lock(thread->connections_mutex);
+    thread->connections.erase(c);
+}
+
+Connection* conn_migrate_idle(LIBEVENT_THREAD* from, LIBEVENT_THREAD* to) {
+    Connection* moved = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(from->connections_mutex);
+        for (auto* c : from->connections) {
+            if (c->isPendingIo()) {
+                continue;
+            }
+            auto* mcbp = dynamic_cast<McbpConnection*>(c);
+            if (mcbp != nullptr && !mcbp->isPipeConnection() &&
+                mcbp->isIdle() && mcbp->moveToThread(to)) {
+                from->connections.erase(c);
+                moved = c;
+                break;
+            }
+        }
+    }
+
+    if (moved != nullptr) {
+        thread_add_connection(to, moved);
+        LOG_DEBUG(moved, "%u: Moved idle connection from worker thread %u "
+                  "to %u", moved->getId(), from->index, to->index);
+    }
+    return moved;
+}
+
 void assert_no_associations(int bucket_idx)
 {
     std::lock_guard<std::mutex> lock(connections.mutex);
@@ -110,6 +150,10 @@ void close_all_connections(void)
         std::lock_guard<std::mutex> lock(connections.mutex);
         for (auto* c : connections.conns) {
             if (!c->isSocketClosed()) {
+                auto* mcbp = dynamic_cast<McbpConnection*>(c);
+                if (mcbp != nullptr) {
+                    mcbp->detachIoUring();
+                }
                 safe_close(c->getSocketDescriptor());
                 c->setSocketDescriptor(INVALID_SOCKET);
             }
@@ -160,8 +204,10 @@ ListenConnection* conn_new_server(const SOCKET sfd,
                                   in_port_t parent_port,
                                   sa_family_t family,
                                   const struct interface& interf,
-                                  struct event_base* base) {
-    auto* c = allocate_listen_connection(sfd, base, parent_port, family, interf);
+                                  struct event_base* base,
+                                  LIBEVENT_THREAD* worker) {
+    auto* c = allocate_listen_connection(sfd, base, parent_port, family,
+                                         interf, worker);
     if (c == nullptr) {
         return nullptr;
     }
@@ -206,8 +252,18 @@ Connection* conn_new(const SOCKET sfd, in_port_t parent_port,
     associate_initial_bucket(c);
 
     c->setThread(thread);
+    if (thread != nullptr) {
+        thread_add_connection(thread, c);
+    }
     MEMCACHED_CONN_ALLOCATE(c->getId());
 
+    if (thread != nullptr && thread->io_uring != nullptr) {
+        auto* mcbp = dynamic_cast<McbpConnection*>(c);
+        if (mcbp != nullptr) {
+            mcbp->attachIoUring(*thread->io_uring);
+        }
+    }
+
     if (settings.getVerbose() > 1) {
         LOG_DEBUG(c, "<%d new client connection", sfd);
     }
@@ -271,6 +327,10 @@ static void conn_cleanup(Connection *c) {
     }
     c->setEngineStorage(nullptr);
 
+    if (c->getThread() != nullptr) {
+        thread_remove_connection(c->getThread(), c);
+        thread_connection_closed(c->getThread());
+    }
     c->setThread(nullptr);
     cb_assert(c->getNext() == nullptr);
     c->setSocketDescriptor(INVALID_SOCKET);
@@ -298,11 +358,11 @@ void conn_close(McbpConnection *c) {
         std::logic_error("conn_close: unable to obtain non-NULL thread from connection");
     }
     /* remove from pending-io list */
-    if (settings.getVerbose() > 1 && list_contains(thread->pending_io, c)) {
+    if (settings.getVerbose() > 1 && c->isPendingIo()) {
         LOG_WARNING(c,
                     "Current connection was in the pending-io list.. Nuking it");
     }
-    thread->pending_io = list_remove(thread->pending_io, c);
+    remove_conn_from_pending_io_list(c);
 
     conn_cleanup(c);
 
@@ -368,17 +428,29 @@ void conn_loan_buffers(Connection *connection) {
         return;
     }
 
-    auto res = conn_loan_single_buffer(c, &c->getThread()->read, &c->read);
     auto *ts = get_thread_stats(c);
-    if (res == BufferLoan::Allocated) {
-        ts->rbufs_allocated++;
-    } else if (res == BufferLoan::Loaned) {
-        ts->rbufs_loaned++;
-    } else if (res == BufferLoan::Existing) {
+    if (c->read.buf != NULL) {
+        /* Already have a (partial) buffer - nothing to do. */
         ts->rbufs_existing++;
+    } else {
+        size_t size = c->getReadBufferSize();
+        c->read.buf = conn_get_read_buffer(c, size);
+        if (c->read.buf == NULL) {
+            if (settings.getVerbose()) {
+                LOG_WARNING(c,
+                            "%u: Failed to allocate new read buffer.. closing"
+                                " connection",
+                            c->getId());
+            }
+            c->setState(conn_closing);
+        } else {
+            c->read.size = uint32_t(size);
+        }
+        c->read.curr = c->read.buf;
+        c->read.bytes = 0;
     }
 
-    res = conn_loan_single_buffer(c, &c->getThread()->write, &c->write);
+    auto res = conn_loan_single_buffer(c, &c->getThread()->write, &c->write);
     if (res == BufferLoan::Allocated) {
         ts->wbufs_allocated++;
     } else if (res == BufferLoan::Loaned) {
@@ -408,10 +480,47 @@ void conn_return_buffers(Connection *connection) {
         return;
     }
 
-    conn_return_single_buffer(c, &thread->read, &c->read);
+    if (c->read.buf != NULL && c->read.curr == c->read.buf &&
+        c->read.bytes == 0) {
+        /* Buffer clean, give it back to the thread. */
+        conn_put_read_buffer(c, c->read.buf, c->read.size);
+        c->read.buf = NULL;
+        c->read.curr = NULL;
+        c->read.size = 0;
+    }
     conn_return_single_buffer(c, &thread->write, &c->write);
 }
 
+char* conn_get_read_buffer(McbpConnection* c, size_t& size) {
+    auto* pool = c->getThread()->read_buffers;
+    auto* ts = get_thread_stats(c);
+    bool pooled = false;
+    char* ret;
+
+    if (pool == nullptr) {
+        size = ReadBufferPool::roundUp(size);
+        ret = reinterpret_cast<char*>(malloc(size));
+    } else {
+        ret = pool->get(size, pooled);
+    }
+
+    if (pooled) {
+        ts->rbufs_loaned++;
+    } else if (ret != nullptr) {
+        ts->rbufs_allocated++;
+    }
+    return ret;
+}
+
+void conn_put_read_buffer(McbpConnection* c, char* buf, size_t size) {
+    auto* pool = c->getThread()->read_buffers;
+    if (pool == nullptr) {
+        free(buf);
+    } else {
+        pool->put(buf, size);
+    }
+}
+
 /** Internal functions *******************************************************/
 
 /**
@@ -460,11 +569,12 @@ static ListenConnection* allocate_listen_connection(SOCKET sfd,
                                                     event_base* base,
                                                     in_port_t port,
                                                     sa_family_t family,
-                                                    const struct interface& interf) {
+                                                    const struct interface& interf,
+                                                    LIBEVENT_THREAD* worker) {
     ListenConnection *ret = nullptr;
 
     try {
-        ret = new ListenConnection(sfd, base, port, family, interf);
+        ret = new ListenConnection(sfd, base, port, family, interf, worker);
         std::lock_guard<std::mutex> lock(connections.mutex);
         connections.conns.push_back(ret);
         stats.conn_structs++;
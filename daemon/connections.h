@@ -43,11 +43,13 @@ void run_event_loop(Connection* c, short which);
  * If the connection doesn't already have read/write buffers, ensure that it
  * does.
  *
- * In the common case, only one read/write buffer is created per worker thread,
+ * In the common case, only one write buffer is created per worker thread,
  * and this buffer is loaned to the connection the worker is currently
- * handling. As long as the connection doesn't have a partial read/write (i.e.
- * the buffer is totally consumed) when it goes idle, the buffer is simply
- * returned back to the worker thread.
+ * handling. The read buffer is taken from the read buffer pool of the
+ * worker thread (of the size the connection wants, see
+ * McbpConnection::getReadBufferSize()). As long as the connection doesn't
+ * have a partial read/write (i.e. the buffer is totally consumed) when it
+ * goes idle, the buffers are simply returned back to the worker thread.
  *
  * If there is a partial read/write, then the buffer is left loaned to that
  * connection and the worker thread will allocate a new one.
@@ -63,6 +65,32 @@ void conn_loan_buffers(Connection *c);
  */
 void conn_return_buffers(Connection *c);
 
+/**
+ * Get a read buffer of (at least) size bytes for the connection from the
+ * read buffer pool of its thread.
+ *
+ * @param size the size wanted (updated to the size of the buffer)
+ * @return the buffer, or nullptr if we're out of memory
+ */
+char* conn_get_read_buffer(McbpConnection* c, size_t& size);
+
+/**
+ * Put a read buffer of the connection back in the read buffer pool of its
+ * thread
+ */
+void conn_put_read_buffer(McbpConnection* c, char* buf, size_t size);
+
+/**
+ * Move an idle client of a worker thread over to another worker thread.
+ * The caller must hold the lock of the thread the client is moved from,
+ * and put the client on the pending io list of the other thread.
+ *
+ * @param from the thread to move a client away from
+ * @param to the thread to move the client to
+ * @return the client moved, or nullptr if none of them were idle
+ */
+Connection* conn_migrate_idle(LIBEVENT_THREAD* from, LIBEVENT_THREAD* to);
+
 /**
  * Cerate a new client connection
  *
@@ -85,12 +113,15 @@ Connection* conn_new(const SOCKET sfd,
  * @param family the address family used for the port
  * @param interf the interface description
  * @param base the event base to use for the socket
+ * @param worker the worker thread accepting on the socket (if it is one
+ *               of its SO_REUSEPORT sockets), or nullptr for the dispatcher
  */
 ListenConnection* conn_new_server(const SOCKET sfd,
                                   in_port_t parent_port,
                                   sa_family_t family,
                                   const struct interface& interf,
-                                  struct event_base* base);
+                                  struct event_base* base,
+                                  LIBEVENT_THREAD* worker);
 
 /*
  * Creates a new connection to a pipe, e.g. stdin.
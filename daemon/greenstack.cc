@@ -313,9 +313,10 @@ static void handleMutation(GreenstackConnection* c, Greenstack::Message* message
         }
     }
 
-    item_info iteminfo;
+    item_info_holder holder;
+    item_info& iteminfo = holder.info;
     memset(&iteminfo, 0, sizeof(iteminfo));
-    iteminfo.nvalue = 1;
+    iteminfo.nvalue = IOV_MAX;
     ENGINE_ERROR_CODE ret = c->getAiostat();
 
     if (c->getItem() == nullptr) {
@@ -377,8 +378,8 @@ static void handleMutation(GreenstackConnection* c, Greenstack::Message* message
         }
 
         c->setItem(it);
-        cb_assert(iteminfo.value[0].iov_len >= value->getSize());
-        memcpy(iteminfo.value[0].iov_base, value->getData(), value->getSize());
+        cb_assert(iteminfo.nbytes >= value->getSize());
+        item_info_copy_in(iteminfo, value->getData(), value->getSize());
     }
 
     ENGINE_STORE_OPERATION op;
@@ -430,7 +431,7 @@ static void handleMutation(GreenstackConnection* c, Greenstack::Message* message
     case ENGINE_SUCCESS:
         /* Stored */
         memset(&iteminfo, 0, sizeof(iteminfo));
-        iteminfo.nvalue = 1;
+        iteminfo.nvalue = IOV_MAX;
         if (!c->getBucketEngine()->get_item_info(c->getBucketEngineAsV0(),
                                                  c, c->getItem(), &iteminfo)) {
             c->getBucketEngine()->release(c->getBucketEngineAsV0(),
@@ -509,19 +510,27 @@ static void handleGet(GreenstackConnection* c, Greenstack::Message* message) {
                                         request->getFlexHeader().getVbucketId());
     }
 
-    item_info info;
+    item_info_holder holder;
+    item_info& info = holder.info;
     memset(&info, 0, sizeof(info));
-    // @todo support more later on!
-    info.nvalue = 1;
+    info.nvalue = IOV_MAX;
 
     switch (ret) {
     case ENGINE_SUCCESS:
         if (c->getBucketEngine()->get_item_info(c->getBucketEngineAsV0(),
                                                 c, it, &info)) {
             auto docinfo = std::make_shared<Greenstack::DocumentInfo>();
-            auto value = std::make_shared<Greenstack::FixedByteArrayBuffer>(
-                static_cast<uint8_t*>(info.value[0].iov_base),
-                static_cast<size_t>(info.value[0].iov_len));
+            std::shared_ptr<Greenstack::FixedByteArrayBuffer> value;
+            if (info.nvalue == 1) {
+                value = std::make_shared<Greenstack::FixedByteArrayBuffer>(
+                    static_cast<uint8_t*>(info.value[0].iov_base),
+                    static_cast<size_t>(info.value[0].iov_len));
+            } else {
+                // Large values may be stored in more than one piece
+                value = std::make_shared<Greenstack::FixedByteArrayBuffer>(
+                    static_cast<size_t>(info.nbytes));
+                item_info_copy_out(info, value->getData());
+            }
             docinfo->setId(id);
             if (info.datatype & PROTOCOL_BINARY_DATATYPE_COMPRESSED) {
                 docinfo->setCompression(Greenstack::Compression::Snappy);
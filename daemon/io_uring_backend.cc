@@ -0,0 +1,903 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "io_uring_backend.h"
+#include "memcached.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+/* The buffer group of the receive buffers */
+#define IO_URING_BUFFER_GROUP 0
+
+/*
+ * What a request queued for a socket does. It's kept in the low bits of
+ * the user data of the request, next to the socket.
+ */
+static const uint64_t request_receive = 0;
+static const uint64_t request_write = 1;
+static const uint64_t request_cancel = 2;
+static const uint64_t request_timeout = 3;
+static const uint64_t request_sendmsg = 4;
+static const uint64_t request_mask = 7;
+
+/* The user data of the requests of IoUring::probe() (the sockets are
+ * aligned, so it can't be mistaken for one of theirs) */
+static const uint64_t probe_data = 1;
+
+/* The kernel copies the timeout when the request is submitted */
+static struct __kernel_timespec close_timeout = { IO_URING_CLOSE_TIMEOUT, 0 };
+
+static uint64_t user_data(IoUringSocket& socket, uint64_t request) {
+    return uint64_t(uintptr_t(&socket)) | request;
+}
+
+IoUringSocket::IoUringSocket(IoUring& r, SOCKET s, McbpConnection* c)
+    : ring(r),
+      sfd(s),
+      connection(c),
+      eof(false),
+      error(0),
+      receiving(false),
+      cancelling(false),
+      starved(false),
+      sendBuffer(-1),
+      sendOffset(0),
+      sendLength(0),
+      sendError(0),
+      sendBlocked(false),
+      sendmsgInflight(false),
+      sendmsgDone(false),
+      sendmsgResult(0),
+      closeTimeout(false),
+      inflight(0) {
+    memset(&sendMsg, 0, sizeof(sendMsg));
+}
+
+bool IoUringSocket::canReceive() const {
+    return connection != nullptr && !receiving && !starved && !eof &&
+           error == 0 && input.size() < IO_URING_INPUT_MAX_BUFFERS;
+}
+
+int IoUringSocket::recv(char* dest, size_t nbytes) {
+    if (input.empty()) {
+        if (error != 0) {
+            errno = error;
+            return -1;
+        }
+        if (eof) {
+            return 0;
+        }
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    // Copy straight out of the receive buffers, and hand back the ones
+    // we're done with
+    size_t n = 0;
+    while (n < nbytes && !input.empty()) {
+        auto& buffer = input.front();
+        const size_t count = std::min(size_t(buffer.length), nbytes - n);
+        memcpy(dest + n,
+               ring.recvBuffers + size_t(buffer.bid) * IO_URING_RECV_BUFFER_SIZE +
+               buffer.offset,
+               count);
+        n += count;
+        buffer.offset += uint32_t(count);
+        buffer.length -= uint32_t(count);
+        if (buffer.length == 0) {
+            ring.releaseRecvBuffer(buffer.bid);
+            input.pop_front();
+        }
+    }
+
+    // Start receiving again if we stopped because of the input the
+    // connection hadn't read
+    if (canReceive()) {
+        ring.armReceive(*this);
+    }
+
+    return int(n);
+}
+
+int IoUringSocket::sendmsg(struct msghdr* m) {
+    if (sendError != 0) {
+        errno = sendError;
+        return -1;
+    }
+
+    if (sendmsgDone) {
+        // The connection is back for the result of the message sent from
+        // its memory
+        if (size_t(m->msg_iovlen) != sendIov.size() ||
+            m->msg_iov[0].iov_base != sendIov[0].iov_base) {
+            throw std::logic_error("IoUringSocket::sendmsg: expected the "
+                                   "message in flight");
+        }
+        sendmsgDone = false;
+        if (sendmsgResult < 0) {
+            errno = -sendmsgResult;
+            return -1;
+        }
+        return sendmsgResult;
+    }
+
+    if (isSending()) {
+        sendBlocked = true;
+        ring.stats->send_blocked++;
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    size_t total = 0;
+    for (size_t ii = 0; ii < size_t(m->msg_iovlen); ++ii) {
+        total += m->msg_iov[ii].iov_len;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    if (total > IO_URING_SEND_BUFFER_SIZE || ring.freeSendBuffers.empty()) {
+        // Copying it isn't worth it (or there is nowhere to copy it to),
+        // so the ring sends it from the memory of the connection. The
+        // connection keeps it around until we report it sent.
+        sendIov.assign(m->msg_iov, m->msg_iov + m->msg_iovlen);
+        memset(&sendMsg, 0, sizeof(sendMsg));
+        sendMsg.msg_iov = sendIov.data();
+        sendMsg.msg_iovlen = sendIov.size();
+        sendBlocked = true;
+        ring.stats->send_direct++;
+        ring.queueSendmsg(*this);
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    sendBuffer = ring.freeSendBuffers.back();
+    ring.freeSendBuffers.pop_back();
+    char* dest = ring.sendBuffers +
+                 size_t(sendBuffer) * IO_URING_SEND_BUFFER_SIZE;
+    for (size_t ii = 0; ii < size_t(m->msg_iovlen); ++ii) {
+        memcpy(dest, m->msg_iov[ii].iov_base, m->msg_iov[ii].iov_len);
+        dest += m->msg_iov[ii].iov_len;
+    }
+    sendOffset = 0;
+    sendLength = total;
+    ring.stats->sends++;
+    ring.queueWrite(*this);
+
+    return int(total);
+}
+
+bool IoUringSocket::hasInput() const {
+    return !input.empty() || eof || error != 0;
+}
+
+short IoUringSocket::eventFlags(short flags) const {
+    flags &= ~EV_READ;
+    if (isSending()) {
+        // We're told when the write completes
+        flags &= ~EV_WRITE;
+    }
+    return flags;
+}
+
+void IoUringSocket::detach(bool closing) {
+    connection = nullptr;
+
+    // (The connection only keeps using the socket when it fails to attach,
+    // before any input is reaped)
+    for (const auto& buffer : input) {
+        ring.releaseRecvBuffer(buffer.bid);
+    }
+    input.clear();
+    if (starved) {
+        ring.starved.erase(this);
+        starved = false;
+    }
+
+    if (sendmsgInflight) {
+        ring.cancelSendmsg(*this);
+    }
+
+    if (!closing) {
+        // Nothing is sent through the ring until the connection runs
+    } else if (sendBuffer == -1) {
+        // The connection closes its descriptor, but the client won't see
+        // the close until ours is closed as well
+        ::shutdown(sfd, SHUT_RDWR);
+    } else {
+        // Let the write in flight complete (the response may be the last
+        // thing the client is told), but not forever
+        ring.queueCloseTimeout(*this);
+    }
+    if (receiving) {
+        ring.cancelReceive(*this);
+    }
+    ring.maybeRelease(*this);
+}
+
+IoUring::IoUring(LIBEVENT_THREAD& t)
+    : thread(t),
+      ring(new struct io_uring),
+      ringInitialized(false),
+      submitScheduled(false),
+      reapRegistered(false),
+      recvRing(nullptr),
+      recvBuffers(nullptr),
+      sendBuffers(nullptr),
+      stats(new io_uring_stats) {
+    memset(ring, 0, sizeof(*ring));
+    memset(&submitEvent, 0, sizeof(submitEvent));
+    memset(&reapEvent, 0, sizeof(reapEvent));
+}
+
+IoUring* IoUring::create(LIBEVENT_THREAD& thread) {
+    IoUring* ret;
+    try {
+        ret = new IoUring(thread);
+    } catch (const std::bad_alloc&) {
+        LOG_WARNING(nullptr, "Failed to allocate the io_uring of worker "
+                    "thread %u", thread.index);
+        return nullptr;
+    }
+
+    if (!ret->initialize()) {
+        LOG_WARNING(nullptr, "Worker thread %u uses libevent for the "
+                    "network io", thread.index);
+        delete ret;
+        return nullptr;
+    }
+    return ret;
+}
+
+bool IoUring::initialize() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // The multishot receives may complete a lot more often than we submit
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = IO_URING_ENTRIES * 4;
+
+    int ret = io_uring_queue_init_params(IO_URING_ENTRIES, ring, &params);
+    if (ret < 0) {
+        LOG_WARNING(nullptr, "Failed to create io_uring: %s", strerror(-ret));
+        return false;
+    }
+    ringInitialized = true;
+
+    recvBuffers = reinterpret_cast<char*>(
+        malloc(size_t(IO_URING_RECV_BUFFERS) * IO_URING_RECV_BUFFER_SIZE));
+    sendBuffers = reinterpret_cast<char*>(
+        malloc(size_t(IO_URING_SEND_BUFFERS) * IO_URING_SEND_BUFFER_SIZE));
+    if (recvBuffers == nullptr || sendBuffers == nullptr) {
+        LOG_WARNING(nullptr, "Failed to allocate the io_uring buffers");
+        return false;
+    }
+
+    recvRing = io_uring_setup_buf_ring(ring, IO_URING_RECV_BUFFERS,
+                                       IO_URING_BUFFER_GROUP, 0, &ret);
+    if (recvRing == nullptr) {
+        LOG_WARNING(nullptr, "Failed to register the io_uring receive "
+                    "buffers: %s", strerror(-ret));
+        return false;
+    }
+    const int mask = io_uring_buf_ring_mask(IO_URING_RECV_BUFFERS);
+    for (int ii = 0; ii < IO_URING_RECV_BUFFERS; ++ii) {
+        io_uring_buf_ring_add(recvRing,
+                              recvBuffers + size_t(ii) * IO_URING_RECV_BUFFER_SIZE,
+                              IO_URING_RECV_BUFFER_SIZE, ii, mask, ii);
+    }
+    io_uring_buf_ring_advance(recvRing, IO_URING_RECV_BUFFERS);
+
+    if (!probe()) {
+        return false;
+    }
+
+    std::vector<struct iovec> iov(IO_URING_SEND_BUFFERS);
+    for (int ii = 0; ii < IO_URING_SEND_BUFFERS; ++ii) {
+        iov[ii].iov_base = sendBuffers + size_t(ii) * IO_URING_SEND_BUFFER_SIZE;
+        iov[ii].iov_len = IO_URING_SEND_BUFFER_SIZE;
+    }
+    ret = io_uring_register_buffers(ring, iov.data(), unsigned(iov.size()));
+    if (ret < 0) {
+        LOG_WARNING(nullptr, "Failed to register the io_uring send "
+                    "buffers: %s", strerror(-ret));
+        return false;
+    }
+    freeSendBuffers.reserve(IO_URING_SEND_BUFFERS);
+    for (int ii = IO_URING_SEND_BUFFERS - 1; ii >= 0; --ii) {
+        freeSendBuffers.push_back(ii);
+    }
+
+    if (event_assign(&submitEvent, thread.base, -1, 0, submitCallback,
+                     this) == -1 ||
+        event_assign(&reapEvent, thread.base, ring->ring_fd,
+                     EV_READ | EV_PERSIST, reapCallback, this) == -1 ||
+        event_add(&reapEvent, nullptr) == -1) {
+        LOG_WARNING(nullptr, "Failed to add the io_uring to libevent");
+        return false;
+    }
+    reapRegistered = true;
+
+    return true;
+}
+
+bool IoUring::probe() {
+    struct io_uring_probe* ops = io_uring_get_probe_ring(ring);
+    if (ops == nullptr) {
+        LOG_WARNING(nullptr, "Failed to probe the io_uring operations");
+        return false;
+    }
+    const bool supported =
+        io_uring_opcode_supported(ops, IORING_OP_RECV) &&
+        io_uring_opcode_supported(ops, IORING_OP_SENDMSG) &&
+        io_uring_opcode_supported(ops, IORING_OP_WRITE_FIXED) &&
+        io_uring_opcode_supported(ops, IORING_OP_ASYNC_CANCEL) &&
+        io_uring_opcode_supported(ops, IORING_OP_TIMEOUT) &&
+        io_uring_opcode_supported(ops, IORING_OP_TIMEOUT_REMOVE);
+    io_uring_free_probe(ops);
+    if (!supported) {
+        LOG_WARNING(nullptr, "io_uring lacks some of the operations used "
+                    "for the network io");
+        return false;
+    }
+
+    // There is no opcode for the multishot receive, and a kernel without
+    // it fails the receives with EINVAL. Try one on a socket pair, and
+    // cancel it synchronously (as IoUringSocket::detach does).
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        LOG_WARNING(nullptr, "Failed to create a socket pair to probe "
+                    "io_uring: %s", strerror(errno));
+        return false;
+    }
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_recv_multishot(sqe, sv[0], nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IO_URING_BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, probe_data);
+
+    int ret = io_uring_submit(ring);
+    if (ret >= 0 && ::send(sv[1], "x", 1, 0) != 1) {
+        ret = -errno;
+    }
+
+    struct io_uring_cqe* cqe = nullptr;
+    if (ret >= 0) {
+        struct __kernel_timespec timeout = { 1, 0 };
+        ret = io_uring_wait_cqe_timeout(ring, &cqe, &timeout);
+    }
+    bool armed = false;
+    if (ret >= 0) {
+        ret = cqe->res;
+        if (ret > 0) {
+            releaseRecvBuffer(int(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            armed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        }
+        if (!armed && ret >= 0) {
+            // Completed like a single shot receive
+            ret = -EINVAL;
+        }
+        io_uring_cqe_seen(ring, cqe);
+    }
+
+    if (armed) {
+        struct io_uring_sync_cancel_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = probe_data;
+        reg.timeout.tv_sec = -1;
+        reg.timeout.tv_nsec = -1;
+        ret = io_uring_register_sync_cancel(ring, &reg);
+    }
+
+    // Drop the completion of the cancelled receive
+    while (io_uring_peek_cqe(ring, &cqe) == 0) {
+        io_uring_cqe_seen(ring, cqe);
+    }
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    if (ret < 0) {
+        LOG_WARNING(nullptr, "io_uring doesn't support the multishot "
+                    "receive (or cancelling it): %s", strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+IoUring::~IoUring() {
+    if (reapRegistered) {
+        event_del(&reapEvent);
+    }
+    if (submitScheduled) {
+        event_del(&submitEvent);
+    }
+    if (ringInitialized) {
+        if (recvRing != nullptr) {
+            io_uring_free_buf_ring(ring, recvRing, IO_URING_RECV_BUFFERS,
+                                   IO_URING_BUFFER_GROUP);
+        }
+        io_uring_queue_exit(ring);
+    }
+    for (auto* socket : sockets) {
+        ::close(socket->sfd);
+        delete socket;
+    }
+    free(recvBuffers);
+    free(sendBuffers);
+    delete ring;
+}
+
+const struct io_uring_stats& IoUring::getStats() const {
+    return *stats;
+}
+
+void IoUring::resetStats() {
+    stats->reset();
+}
+
+IoUringSocket* IoUring::attach(McbpConnection* connection, SOCKET sfd) {
+    SOCKET fd = dup(sfd);
+    if (fd == -1) {
+        LOG_WARNING(nullptr, "%u: Failed to duplicate the socket for "
+                    "io_uring: %s", connection->getId(), strerror(errno));
+        return nullptr;
+    }
+
+    IoUringSocket* socket;
+    try {
+        socket = new IoUringSocket(*this, fd, connection);
+        sockets.insert(socket);
+    } catch (const std::bad_alloc&) {
+        ::close(fd);
+        return nullptr;
+    }
+    armReceive(*socket);
+    return socket;
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    if (sqe == nullptr) {
+        // The submission queue is full
+        submit();
+        sqe = io_uring_get_sqe(ring);
+        if (sqe == nullptr) {
+            throw std::runtime_error("IoUring::getSqe: submission queue "
+                                     "is full");
+        }
+    }
+    stats->sqes++;
+    scheduleSubmit();
+    return sqe;
+}
+
+void IoUring::scheduleSubmit() {
+    if (!submitScheduled) {
+        submitScheduled = true;
+        event_active(&submitEvent, EV_WRITE, 0);
+    }
+}
+
+void IoUring::submit() {
+    submitScheduled = false;
+    stats->submits++;
+    const int ret = io_uring_submit(ring);
+    if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+        LOG_WARNING(nullptr, "Worker thread %u failed to submit to "
+                    "io_uring: %s", thread.index, strerror(-ret));
+    }
+}
+
+void IoUring::armReceive(IoUringSocket& socket) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_recv_multishot(sqe, socket.sfd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IO_URING_BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_receive));
+    socket.receiving = true;
+    socket.inflight++;
+}
+
+void IoUring::cancelReceive(IoUringSocket& socket) {
+    if (socket.cancelling) {
+        return;
+    }
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_cancel64(sqe, user_data(socket, request_receive), 0);
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_cancel));
+    socket.cancelling = true;
+    socket.inflight++;
+}
+
+void IoUring::queueWrite(IoUringSocket& socket) {
+    struct io_uring_sqe* sqe = getSqe();
+    char* buffer = sendBuffers +
+                   size_t(socket.sendBuffer) * IO_URING_SEND_BUFFER_SIZE;
+    io_uring_prep_write_fixed(sqe, socket.sfd, buffer + socket.sendOffset,
+                              unsigned(socket.sendLength - socket.sendOffset),
+                              0, socket.sendBuffer);
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_write));
+    socket.inflight++;
+}
+
+void IoUring::queueSendmsg(IoUringSocket& socket) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_sendmsg(sqe, socket.sfd, &socket.sendMsg, 0);
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_sendmsg));
+    socket.sendmsgInflight = true;
+    socket.inflight++;
+}
+
+void IoUring::cancelSendmsg(IoUringSocket& socket) {
+    // The message refers to the memory of the connection, so the kernel
+    // must be done with it before the connection goes on. The request may
+    // still be queued (and the synchronous cancel only finds the ones
+    // submitted).
+    submit();
+
+    struct io_uring_sync_cancel_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = user_data(socket, request_sendmsg);
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    const int ret = io_uring_register_sync_cancel(ring, &reg);
+    if (ret < 0 && ret != -ENOENT) {
+        // IoUring::probe() made sure this is supported
+        throw std::runtime_error(std::string("IoUring::cancelSendmsg: ") +
+                                 strerror(-ret));
+    }
+}
+
+void IoUring::queueCloseTimeout(IoUringSocket& socket) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_timeout(sqe, &close_timeout, 0, 0);
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_timeout));
+    socket.closeTimeout = true;
+    socket.inflight++;
+}
+
+void IoUring::cancelCloseTimeout(IoUringSocket& socket) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_timeout_remove(sqe, user_data(socket, request_timeout), 0);
+    io_uring_sqe_set_data64(sqe, user_data(socket, request_cancel));
+    socket.inflight++;
+}
+
+void IoUring::reap() {
+    struct io_uring_cqe* cqes[64];
+    unsigned int count;
+
+    while ((count = io_uring_peek_batch_cqe(ring, cqes, 64)) > 0) {
+        for (unsigned int ii = 0; ii < count; ++ii) {
+            complete(cqes[ii]);
+        }
+        io_uring_cq_advance(ring, count);
+        stats->cqes += count;
+    }
+}
+
+void IoUring::complete(struct io_uring_cqe* cqe) {
+    const uint64_t data = io_uring_cqe_get_data64(cqe);
+    auto* socket = reinterpret_cast<IoUringSocket*>(
+        uintptr_t(data & ~request_mask));
+
+    switch (data & request_mask) {
+    case request_receive:
+        completeReceive(*socket, cqe);
+        break;
+    case request_write:
+        completeWrite(*socket, cqe);
+        break;
+    case request_sendmsg:
+        completeSendmsg(*socket, cqe);
+        break;
+    case request_timeout:
+        completeCloseTimeout(*socket);
+        break;
+    default:
+        socket->inflight--;
+        break;
+    }
+
+    maybeRelease(*socket);
+}
+
+void IoUring::completeReceive(IoUringSocket& socket,
+                              struct io_uring_cqe* cqe) {
+    bool activate = false;
+
+    if (cqe->res > 0) {
+        cb_assert(cqe->flags & IORING_CQE_F_BUFFER);
+        const int bid = int(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (socket.connection != nullptr) {
+            // Held until the connection reads it
+            socket.input.push_back({bid, 0, uint32_t(cqe->res)});
+            activate = true;
+        } else {
+            releaseRecvBuffer(bid);
+        }
+        stats->recv_bytes += cqe->res;
+
+        if (socket.input.size() >= IO_URING_INPUT_MAX_BUFFERS &&
+            (cqe->flags & IORING_CQE_F_MORE)) {
+            cancelReceive(socket);
+        }
+    } else if (cqe->res == 0) {
+        socket.eof = true;
+        activate = true;
+    } else if (cqe->res == -ENOBUFS) {
+        // Re-armed once one of the buffers is handed back (re-arming now
+        // would just fail again)
+        stats->recv_no_buffers++;
+        if (socket.connection != nullptr && !socket.starved) {
+            socket.starved = true;
+            starved.insert(&socket);
+        }
+    } else if (cqe->res != -ECANCELED) {
+        socket.error = -cqe->res;
+        activate = true;
+    }
+
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+        socket.receiving = false;
+        socket.cancelling = false;
+        socket.inflight--;
+        if (socket.canReceive()) {
+            armReceive(socket);
+        }
+    }
+
+    if (activate && socket.connection != nullptr) {
+        socket.connection->activateEvent(EV_READ);
+    }
+}
+
+void IoUring::completeWrite(IoUringSocket& socket, struct io_uring_cqe* cqe) {
+    socket.inflight--;
+
+    if (cqe->res > 0) {
+        socket.sendOffset += cqe->res;
+        if (socket.sendOffset < socket.sendLength &&
+            socket.connection != nullptr) {
+            // Short write, send the rest
+            queueWrite(socket);
+            return;
+        }
+    } else {
+        socket.sendError = cqe->res == 0 ? EPIPE : -cqe->res;
+    }
+
+    freeSendBuffers.push_back(socket.sendBuffer);
+    socket.sendBuffer = -1;
+
+    if (socket.connection == nullptr) {
+        // The connection closed while the write was in flight
+        ::shutdown(socket.sfd, SHUT_RDWR);
+        if (socket.closeTimeout) {
+            cancelCloseTimeout(socket);
+        }
+        return;
+    }
+
+    if (socket.sendBlocked || socket.sendError != 0 ||
+        (socket.connection->getEventFlags() & EV_WRITE)) {
+        socket.sendBlocked = false;
+        socket.connection->activateEvent(EV_WRITE);
+    }
+}
+
+void IoUring::completeSendmsg(IoUringSocket& socket,
+                              struct io_uring_cqe* cqe) {
+    socket.inflight--;
+    socket.sendmsgInflight = false;
+
+    if (socket.connection == nullptr) {
+        // Cancelled as the connection closed
+        ::shutdown(socket.sfd, SHUT_RDWR);
+        return;
+    }
+
+    socket.sendmsgDone = true;
+    socket.sendmsgResult = cqe->res == 0 ? -EPIPE : cqe->res;
+    socket.sendBlocked = false;
+    socket.connection->activateEvent(EV_WRITE);
+}
+
+void IoUring::completeCloseTimeout(IoUringSocket& socket) {
+    socket.inflight--;
+    socket.closeTimeout = false;
+    if (socket.sendBuffer != -1) {
+        // The write is stuck (the client isn't reading), fail it
+        ::shutdown(socket.sfd, SHUT_RDWR);
+    }
+}
+
+void IoUring::releaseRecvBuffer(int bid) {
+    io_uring_buf_ring_add(recvRing,
+                          recvBuffers + size_t(bid) * IO_URING_RECV_BUFFER_SIZE,
+                          IO_URING_RECV_BUFFER_SIZE, bid,
+                          io_uring_buf_ring_mask(IO_URING_RECV_BUFFERS), 0);
+    io_uring_buf_ring_advance(recvRing, 1);
+
+    if (!starved.empty()) {
+        std::unordered_set<IoUringSocket*> waiting;
+        waiting.swap(starved);
+        for (auto* socket : waiting) {
+            socket->starved = false;
+            if (socket->canReceive()) {
+                armReceive(*socket);
+            }
+        }
+    }
+}
+
+void IoUring::maybeRelease(IoUringSocket& socket) {
+    if (socket.connection == nullptr && socket.inflight == 0) {
+        ::close(socket.sfd);
+        sockets.erase(&socket);
+        delete &socket;
+    }
+}
+
+void IoUring::submitCallback(evutil_socket_t, short, void* arg) {
+    reinterpret_cast<IoUring*>(arg)->submit();
+}
+
+void IoUring::reapCallback(evutil_socket_t, short, void* arg) {
+    reinterpret_cast<IoUring*>(arg)->reap();
+}
+
+#else
+
+/*
+ * Built without liburing: the threads never get a ring, so none of the
+ * sockets are ever served through one.
+ */
+IoUring* IoUring::create(LIBEVENT_THREAD& thread) {
+    LOG_WARNING(nullptr, "io_uring is not supported on this platform; "
+                "worker thread %u uses libevent for the network io",
+                thread.index);
+    return nullptr;
+}
+
+bool IoUring::probe() {
+    struct io_uring_probe* ops = io_uring_get_probe_ring(ring);
+    if (ops == nullptr) {
+        LOG_WARNING(nullptr, "Failed to probe the io_uring operations");
+        return false;
+    }
+    const bool supported =
+        io_uring_opcode_supported(ops, IORING_OP_RECV) &&
+        io_uring_opcode_supported(ops, IORING_OP_SENDMSG) &&
+        io_uring_opcode_supported(ops, IORING_OP_WRITE_FIXED) &&
+        io_uring_opcode_supported(ops, IORING_OP_ASYNC_CANCEL) &&
+        io_uring_opcode_supported(ops, IORING_OP_TIMEOUT) &&
+        io_uring_opcode_supported(ops, IORING_OP_TIMEOUT_REMOVE);
+    io_uring_free_probe(ops);
+    if (!supported) {
+        LOG_WARNING(nullptr, "io_uring lacks some of the operations used "
+                    "for the network io");
+        return false;
+    }
+
+    // There is no opcode for the multishot receive, and a kernel without
+    // it fails the receives with EINVAL. Try one on a socket pair, and
+    // cancel it synchronously (as IoUringSocket::detach does).
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        LOG_WARNING(nullptr, "Failed to create a socket pair to probe "
+                    "io_uring: %s", strerror(errno));
+        return false;
+    }
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_recv_multishot(sqe, sv[0], nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IO_URING_BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, probe_data);
+
+    int ret = io_uring_submit(ring);
+    if (ret >= 0 && ::send(sv[1], "x", 1, 0) != 1) {
+        ret = -errno;
+    }
+
+    struct io_uring_cqe* cqe = nullptr;
+    if (ret >= 0) {
+        struct __kernel_timespec timeout = { 1, 0 };
+        ret = io_uring_wait_cqe_timeout(ring, &cqe, &timeout);
+    }
+    bool armed = false;
+    if (ret >= 0) {
+        ret = cqe->res;
+        if (ret > 0) {
+            releaseRecvBuffer(int(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            armed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        }
+        if (!armed && ret >= 0) {
+            // Completed like a single shot receive
+            ret = -EINVAL;
+        }
+        io_uring_cqe_seen(ring, cqe);
+    }
+
+    if (armed) {
+        struct io_uring_sync_cancel_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = probe_data;
+        reg.timeout.tv_sec = -1;
+        reg.timeout.tv_nsec = -1;
+        ret = io_uring_register_sync_cancel(ring, &reg);
+    }
+
+    // Drop the completion of the cancelled receive
+    while (io_uring_peek_cqe(ring, &cqe) == 0) {
+        io_uring_cqe_seen(ring, cqe);
+    }
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    if (ret < 0) {
+        LOG_WARNING(nullptr, "io_uring doesn't support the multishot "
+                    "receive (or cancelling it): %s", strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+IoUring::~IoUring() {
+}
+
+const struct io_uring_stats& IoUring::getStats() const {
+    return *stats;
+}
+
+void IoUring::resetStats() {
+    stats->reset();
+}
+
+IoUringSocket* IoUring::attach(McbpConnection*, SOCKET) {
+    throw std::logic_error("IoUring::attach: io_uring is not supported");
+}
+
+int IoUringSocket::recv(char*, size_t) {
+    throw std::logic_error("IoUringSocket::recv: io_uring is not supported");
+}
+
+int IoUringSocket::sendmsg(struct msghdr*) {
+    throw std::logic_error(
+        "IoUringSocket::sendmsg: io_uring is not supported");
+}
+
+bool IoUringSocket::hasInput() const {
+    return false;
+}
+
+short IoUringSocket::eventFlags(short flags) const {
+    return flags;
+}
+
+void IoUringSocket::detach(bool) {
+}
+
+#endif
@@ -0,0 +1,285 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "config.h"
+
+#include <deque>
+#include <event.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * The io_uring backend (io_backend=io_uring) lets a worker thread perform
+ * the network io of its clients through an io_uring instead of calling
+ * recv and sendmsg on the sockets libevent reports as ready.
+ *
+ * Every client has a multishot receive armed, which picks a buffer from
+ * the receive buffers registered with the ring as data arrives. The socket
+ * holds on to the buffers filled for it until the connection reads them,
+ * and the connection is run (by activating its event) as if libevent
+ * reported the socket readable. McbpConnection::recv() copies the data
+ * straight from the buffers into the read buffer of the connection (and
+ * hands the buffers back to the kernel once they're read), so the state
+ * machine is the same for both of the backends.
+ *
+ * A response that fits in one of the registered send buffers is copied
+ * there and written from it, and McbpConnection::sendmsg() reports it as
+ * sent right away. A larger one (or any response when the send buffers
+ * are all in use) is sent with a sendmsg request straight from the memory
+ * of the connection, and sendmsg() reports it as blocked until the
+ * request completes (the connection is told through its event, as if
+ * libevent reported the socket writable). A client only has one write in
+ * flight at the time, so the responses can't be reordered.
+ *
+ * The ring uses its own descriptor for the socket (a dup of the one of
+ * the connection), and closes it once there are no requests in flight for
+ * the socket. The connection may close its descriptor as usual, and the
+ * number can't be reused by another client while the requests of this one
+ * are in flight.
+ *
+ * The requests queued while running the event loop are submitted with a
+ * single io_uring_enter, and libevent polls the ring to reap the
+ * completions. The libevent event of a connection is still used for the
+ * idle timeout (and for writing when sendmsg would block).
+ *
+ * SSL clients, and clients on a thread where the ring can't be created
+ * (io_uring isn't supported or allowed, or the kernel lacks some of the
+ * requests used, such as the multishot receive), use libevent.
+ */
+
+#define IO_URING_ENTRIES 1024
+#define IO_URING_RECV_BUFFERS 128
+#define IO_URING_RECV_BUFFER_SIZE (16 * 1024)
+#define IO_URING_SEND_BUFFERS 128
+#define IO_URING_SEND_BUFFER_SIZE (16 * 1024)
+
+/* Stop receiving for a client holding this many of the receive buffers
+ * with input the connection hasn't read yet (until it does) */
+#define IO_URING_INPUT_MAX_BUFFERS 16
+
+/* The # of seconds a write in flight when the connection closes may take
+ * before the socket is shut down */
+#define IO_URING_CLOSE_TIMEOUT 5
+
+struct io_uring;
+struct io_uring_buf_ring;
+struct io_uring_cqe;
+struct io_uring_stats;
+struct LIBEVENT_THREAD;
+class IoUring;
+class McbpConnection;
+
+/**
+ * The state of a client socket served through the io_uring of a worker
+ * thread. It is owned by the ring rather than the connection, as it has
+ * to stay around until the requests in flight for the socket complete.
+ */
+class IoUringSocket {
+public:
+    /**
+     * Read the input received for the socket (see recv(2)). Returns -1
+     * with errno set to EWOULDBLOCK if there is no input.
+     */
+    int recv(char* dest, size_t nbytes);
+
+    /**
+     * Send the message (see sendmsg(2)). Returns -1 with errno set to
+     * EWOULDBLOCK if the previous write is still in flight, or if the
+     * message is sent from the memory of the connection (the connection
+     * must call sendmsg() with the same message again once its event
+     * reports the socket writable, to get the number of bytes sent).
+     */
+    int sendmsg(struct msghdr* m);
+
+    /**
+     * Is there input (or an end of file or error) for recv()?
+     */
+    bool hasInput() const;
+
+    /**
+     * The flags to give libevent for a connection waiting for the
+     * given events (the ring takes care of the reads, and the writes
+     * while a write is in flight).
+     */
+    short eventFlags(short flags) const;
+
+    /**
+     * Detach the socket from the connection. The socket is shut down once
+     * the write in flight (if any) completes, or IO_URING_CLOSE_TIMEOUT
+     * seconds passed, and it's released (and its descriptor closed) once
+     * the requests in flight for it complete. A message sent from the
+     * memory of the connection is cancelled before this returns, as the
+     * connection is about to release it.
+     *
+     * The input the connection hasn't read is dropped.
+     *
+     * @param closing false if the connection keeps using the socket
+     *                (through libevent), so it must not be shut down
+     */
+    void detach(bool closing = true);
+
+private:
+    friend class IoUring;
+
+    IoUringSocket(IoUring& ring, SOCKET sfd, McbpConnection* connection);
+
+    /** Is a write (or a message sent from the connection) in flight? */
+    bool isSending() const {
+        return sendBuffer != -1 || sendmsgInflight;
+    }
+
+    /** Can the multishot receive be armed? */
+    bool canReceive() const;
+
+    IoUring& ring;
+    /** The descriptor of the ring for the socket */
+    const SOCKET sfd;
+    /** The connection served, nullptr once it is detached */
+    McbpConnection* connection;
+
+    /**
+     * The part of a receive buffer holding input the connection hasn't
+     * read yet
+     */
+    struct InputBuffer {
+        int bid;
+        uint32_t offset;
+        uint32_t length;
+    };
+    std::deque<InputBuffer> input;
+    /** Set when the client closed the socket, or we failed to receive */
+    bool eof;
+    int error;
+
+    /** Is the multishot receive armed (and are we cancelling it)? */
+    bool receiving;
+    bool cancelling;
+    /** Are we waiting for a receive buffer to be handed back to re-arm? */
+    bool starved;
+
+    /** The send buffer used by the write in flight (-1 if none) */
+    int sendBuffer;
+    size_t sendOffset;
+    size_t sendLength;
+    int sendError;
+    /** Did the connection try to send while the write was in flight? */
+    bool sendBlocked;
+
+    /** The message sent from the memory of the connection, if any (the
+     * ring refers to it until the request completes), and its result */
+    struct msghdr sendMsg;
+    std::vector<struct iovec> sendIov;
+    bool sendmsgInflight;
+    bool sendmsgDone;
+    int sendmsgResult;
+
+    /** Is the close timeout in flight? */
+    bool closeTimeout;
+
+    /** # of requests in flight for the socket */
+    unsigned int inflight;
+};
+
+/**
+ * The io_uring of a worker thread
+ */
+class IoUring {
+public:
+    /**
+     * Create the ring for the worker thread.
+     *
+     * @return the ring, or nullptr if it can't be created (the reason is
+     *         logged, and the thread uses libevent)
+     */
+    static IoUring* create(LIBEVENT_THREAD& thread);
+
+    ~IoUring();
+
+    /**
+     * Start serving the socket of the connection through the ring
+     */
+    IoUringSocket* attach(McbpConnection* connection, SOCKET sfd);
+
+    const struct io_uring_stats& getStats() const;
+
+    void resetStats();
+
+private:
+    friend class IoUringSocket;
+
+    IoUring(LIBEVENT_THREAD& thread);
+
+    bool initialize();
+
+    /** Check that the kernel supports the requests we use for the sockets */
+    bool probe();
+
+    /** Get a submission queue entry (submitting the queue if it's full) */
+    struct io_uring_sqe* getSqe();
+
+    /** Make sure the requests queued are submitted this loop iteration */
+    void scheduleSubmit();
+    void submit();
+
+    void armReceive(IoUringSocket& socket);
+    void cancelReceive(IoUringSocket& socket);
+    void queueWrite(IoUringSocket& socket);
+    void queueSendmsg(IoUringSocket& socket);
+    void cancelSendmsg(IoUringSocket& socket);
+    void queueCloseTimeout(IoUringSocket& socket);
+    void cancelCloseTimeout(IoUringSocket& socket);
+
+    /** Reap the completions */
+    void reap();
+    void complete(struct io_uring_cqe* cqe);
+    void completeReceive(IoUringSocket& socket, struct io_uring_cqe* cqe);
+    void completeWrite(IoUringSocket& socket, struct io_uring_cqe* cqe);
+    void completeSendmsg(IoUringSocket& socket, struct io_uring_cqe* cqe);
+    void completeCloseTimeout(IoUringSocket& socket);
+
+    /** Hand a receive buffer back to the kernel, and re-arm the receives
+     * which ran out of them */
+    void releaseRecvBuffer(int bid);
+
+    /** Release the socket if it's detached and idle */
+    void maybeRelease(IoUringSocket& socket);
+
+    static void submitCallback(evutil_socket_t, short, void* arg);
+    static void reapCallback(evutil_socket_t, short, void* arg);
+
+    LIBEVENT_THREAD& thread;
+    struct io_uring* ring;
+    bool ringInitialized;
+
+    struct event submitEvent;
+    bool submitScheduled;
+    struct event reapEvent;
+    bool reapRegistered;
+
+    struct io_uring_buf_ring* recvRing;
+    char* recvBuffers;
+    char* sendBuffers;
+    std::vector<int> freeSendBuffers;
+
+    std::unordered_set<IoUringSocket*> sockets;
+    /** The sockets waiting for a receive buffer to be handed back */
+    std::unordered_set<IoUringSocket*> starved;
+
+    std::unique_ptr<struct io_uring_stats> stats;
+};
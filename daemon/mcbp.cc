@@ -380,6 +380,7 @@ bool mcbp_response_handler(const void* key, uint16_t keylen,
 void mcbp_collect_timings(const McbpConnection* c) {
     hrtime_t now = gethrtime();
     const hrtime_t elapsed_ns = now - c->getStart();
+    thread_load_count_op(c->getThread());
     // aggregated timing for all buckets
     all_buckets[0].timings.collect(c->getCmd(), elapsed_ns);
 
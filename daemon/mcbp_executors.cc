@@ -115,36 +115,17 @@ static void bin_read_chunk(McbpConnection* c, uint32_t chunk) {
     offset =
         c->read.curr + sizeof(protocol_binary_request_header) - c->read.buf;
     if (c->getRlbytes() > c->read.size - offset) {
-        size_t nsize = c->read.size;
         size_t size = c->getRlbytes() + sizeof(protocol_binary_request_header);
 
-        while (size > nsize) {
-            nsize *= 2;
-        }
-
-        if (nsize != c->read.size) {
-            char* newm;
-            LOG_DEBUG(c, "%u: Need to grow buffer from %lu to %lu",
-                      c->getId(), (unsigned long)c->read.size,
-                      (unsigned long)nsize);
-            newm = reinterpret_cast<char*>(realloc(c->read.buf, nsize));
-            if (newm == NULL) {
-                LOG_WARNING(c, "%u: Failed to grow buffer.. closing connection",
-                            c->getId());
-                c->setState(conn_closing);
-                return;
-            }
-
-            c->read.buf = newm;
-            /* rcurr should point to the same offset in the packet */
-            c->read.curr =
-                c->read.buf + offset - sizeof(protocol_binary_request_header);
-            c->read.size = (int)nsize;
-        }
-        if (c->read.buf != c->read.curr) {
-            memmove(c->read.buf, c->read.curr, c->read.bytes);
-            c->read.curr = c->read.buf;
-            LOG_DEBUG(c, "%u: Repack input buffer", c->getId());
+        c->recordInputSize(size);
+        LOG_DEBUG(c, "%u: Need room for %lu bytes in buffer of %lu",
+                  c->getId(), (unsigned long)size,
+                  (unsigned long)c->read.size);
+        if (!c->growReadBuffer(size)) {
+            LOG_WARNING(c, "%u: Failed to grow buffer.. closing connection",
+                        c->getId());
+            c->setState(conn_closing);
+            return;
         }
     }
 
@@ -479,6 +460,9 @@ static void process_stat_settings(ADD_STAT add_stat_callback,
             checked_snprintf(interface + offset, sizeof(interface) - offset,
                              "-tcp_nodelay");
             add_stat(cookie, add_stat_callback, interface, ifce.tcp_nodelay);
+            checked_snprintf(interface + offset, sizeof(interface) - offset,
+                             "-reuseport");
+            add_stat(cookie, add_stat_callback, interface, ifce.reuseport);
             checked_snprintf(interface + offset, sizeof(interface) - offset,
                              "-management");
             add_stat(cookie, add_stat_callback, interface, ifce.management);
@@ -547,6 +531,10 @@ static void process_stat_settings(ADD_STAT add_stat_callback,
             settings.isDatatypeSupport() ? "true" : "false");
     add_stat(cookie, add_stat_callback, "dedupe_nmvb_maps",
             settings.isDedupeNmvbMaps() ? "true" : "false");
+    add_stat(cookie, add_stat_callback, "connection_migration",
+            settings.isConnectionMigration() ? "true" : "false");
+    add_stat(cookie, add_stat_callback, "io_backend",
+             to_string(settings.getIoBackend()));
     add_stat(cookie, add_stat_callback, "max_packet_size",
              std::to_string(settings.getMaxPacketSize()).c_str());
 }
@@ -575,8 +563,18 @@ static void process_bin_get(McbpConnection* c) {
     ret = c->getAiostat();
     c->setAiostat(ENGINE_SUCCESS);
     if (ret == ENGINE_SUCCESS) {
-        ret = bucket_get(c, &it, key, (int)nkey,
-                         c->binary_header.request.vbucket);
+        if (c->getCmd() == PROTOCOL_BINARY_CMD_GAT ||
+            c->getCmd() == PROTOCOL_BINARY_CMD_GATQ) {
+            // The expiration time is the only extra (see gat_validator)
+            auto* req = static_cast<protocol_binary_request_gat*>(
+                McbpConnection::getPacket(c->getCookieObject()));
+            ret = bucket_get_and_touch(c, &it, key, (int)nkey,
+                                       ntohl(req->message.body.expiration),
+                                       c->binary_header.request.vbucket);
+        } else {
+            ret = bucket_get(c, &it, key, (int)nkey,
+                             c->binary_header.request.vbucket);
+        }
     }
 
     item_info_holder info;
@@ -623,13 +621,15 @@ static void process_bin_get(McbpConnection* c) {
                                              PROTOCOL_BINARY_RESPONSE_SUCCESS,
                                              info.info.cas, c->getCookie())) {
                 mcbp_write_and_free(c, &c->getDynamicBuffer());
-                bucket_release_item(c, it);
             } else {
                 mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
             }
+            /* The value is copied to the dynamic buffer (if at all) */
+            bucket_release_item(c, it);
         } else {
             if (mcbp_add_header(c, 0, sizeof(rsp->message.body),
                                 keylen, bodylen, datatype) == -1) {
+                bucket_release_item(c, it);
                 c->setState(conn_closing);
                 return;
             }
@@ -2755,7 +2755,7 @@ static void add_set_replace_executor(McbpConnection* c, void* packet,
     uint32_t vlen = ntohl(req->message.header.request.bodylen) - nkey - extlen;
     item_info_holder info;
     info.info.clsid = 0;
-    info.info.nvalue = 1;
+    info.info.nvalue = IOV_MAX;
 
     if (req->message.header.request.cas != 0) {
         store_op = OPERATION_CAS;
@@ -2805,15 +2805,15 @@ static void add_set_replace_executor(McbpConnection* c, void* packet,
         }
 
         c->setItem(it);
-        cb_assert(info.info.value[0].iov_len == vlen);
-        memcpy(info.info.value[0].iov_base, key + nkey, vlen);
+        cb_assert(info.info.nbytes == vlen);
+        item_info_copy_in(info.info, key + nkey, vlen);
 
         if (!c->isSupportsDatatype()) {
             auto* validator = c->getThread()->validator;
 
             try {
-                auto* ptr = reinterpret_cast<uint8_t*>(info.info.value[0].iov_base);
-                if (validator->validate(ptr, info.info.value[0].iov_len)) {
+                auto* ptr = reinterpret_cast<uint8_t*>(key + nkey);
+                if (validator->validate(ptr, vlen)) {
                     info.info.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
                     if (!bucket_set_item_info(c, it, &info.info)) {
                         LOG_WARNING(c, "%u: Failed to set item info",
@@ -2843,7 +2843,7 @@ static void add_set_replace_executor(McbpConnection* c, void* packet,
     case ENGINE_SUCCESS:
         /* Stored */
         if (c->isSupportsMutationExtras()) {
-            info.info.nvalue = 1;
+            info.info.nvalue = IOV_MAX;
             if (!bucket_get_item_info(c, c->getItem(), &info.info)) {
                 bucket_release_item(c, c->getItem());
                 LOG_WARNING(c, "%u: Failed to get item info", c->getId());
@@ -2944,7 +2944,7 @@ static void append_prepend_executor(McbpConnection* c,
     uint32_t vlen = ntohl(req->message.header.request.bodylen) - nkey;
     item_info_holder info;
     info.info.clsid = 0;
-    info.info.nvalue = 1;
+    info.info.nvalue = IOV_MAX;
 
     if (c->getItem() == NULL) {
         item* it;
@@ -2978,14 +2978,14 @@ static void append_prepend_executor(McbpConnection* c,
         }
 
         c->setItem(it);
-        cb_assert(info.info.value[0].iov_len == vlen);
-        memcpy(info.info.value[0].iov_base, key + nkey, vlen);
+        cb_assert(info.info.nbytes == vlen);
+        item_info_copy_in(info.info, key + nkey, vlen);
 
         if (!c->isSupportsDatatype()) {
             auto* validator = c->getThread()->validator;
             try {
-                auto* ptr = reinterpret_cast<uint8_t*>(info.info.value[0].iov_base);
-                if (validator->validate(ptr, info.info.value[0].iov_len)) {
+                auto* ptr = reinterpret_cast<uint8_t*>(key + nkey);
+                if (validator->validate(ptr, vlen)) {
                     info.info.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
                     if (!bucket_set_item_info(c, it, &info.info)) {
                         LOG_WARNING(c, "%u: Failed to set item info",
@@ -3015,7 +3015,7 @@ static void append_prepend_executor(McbpConnection* c,
     case ENGINE_SUCCESS:
         /* Stored */
         if (c->isSupportsMutationExtras()) {
-            info.info.nvalue = 1;
+            info.info.nvalue = IOV_MAX;
             if (!bucket_get_item_info(c, c->getItem(), &info.info)) {
                 bucket_release_item(c, c->getItem());
                 LOG_WARNING(c, "%u: Failed to get item info", c->getId());
@@ -3097,6 +3097,17 @@ static void get_executor(McbpConnection* c, void* packet) {
     process_bin_get(c);
 }
 
+static void gat_executor(McbpConnection* c, void* packet) {
+    if (c->getBucketEngine()->get_and_touch == nullptr) {
+        // Let the engine deal with it as it always did
+        process_bin_unknown_packet(c);
+        return;
+    }
+
+    c->setNoReply(c->getCmd() == PROTOCOL_BINARY_CMD_GATQ);
+    process_bin_get(c);
+}
+
 /**
  * This is a very slow thing that you shouldn't use in production ;-)
  *
@@ -3250,6 +3261,124 @@ static ENGINE_ERROR_CODE stat_connections_executor(const std::string& arg,
     return ENGINE_SUCCESS;
 }
 
+/**
+ * Handler for the <code>stats accepts</code> command used to retrieve
+ * the number of clients accepted for each of the worker threads, and how
+ * long it took from accept() until the connection was created on the
+ * thread (the time spent in the dispatcher queue unless the interface use
+ * reuseport).
+ *
+ * @param arg - should be empty
+ * @param connection the connection that requested the operation
+ */
+static ENGINE_ERROR_CODE stat_accepts_executor(const std::string& arg,
+                                               McbpConnection& connection) {
+    if (!arg.empty()) {
+        return ENGINE_EINVAL;
+    }
+
+    const auto* cookie = connection.getCookie();
+    for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+        const auto& accepts = threads_accept_stats(ii);
+        const uint64_t accepted = accepts.accepted;
+        const uint64_t latency_ns = accepts.latency_ns;
+        const std::string prefix = "worker_" + std::to_string(ii) + "_";
+
+        add_stat(cookie, append_stats, (prefix + "accepted").c_str(),
+                 accepted);
+        add_stat(cookie, append_stats,
+                 (prefix + "reuseport_accepted").c_str(),
+                 uint64_t(accepts.reuseport_accepted));
+        add_stat(cookie, append_stats, (prefix + "accept_usec").c_str(),
+                 latency_ns / 1000);
+        add_stat(cookie, append_stats, (prefix + "accept_avg_usec").c_str(),
+                 accepted ? latency_ns / accepted / 1000 : 0);
+        add_stat(cookie, append_stats, (prefix + "accept_max_usec").c_str(),
+                 uint64_t(accepts.max_latency_ns) / 1000);
+    }
+    return ENGINE_SUCCESS;
+}
+
+/**
+ * Handler for the <code>stats threads</code> command used to retrieve
+ * the load of each of the worker threads: the clients bound to it, the
+ * commands it executed (and the rate over the last second), how late its
+ * event loop runs, the idle clients moved between the threads, how
+ * often it's woken up by the other threads and the io it performs
+ * through its io_uring (if any).
+ *
+ * @param arg - should be empty
+ * @param connection the connection that requested the operation
+ */
+static ENGINE_ERROR_CODE stat_threads_executor(const std::string& arg,
+                                               McbpConnection& connection) {
+    if (!arg.empty()) {
+        return ENGINE_EINVAL;
+    }
+
+    const auto* cookie = connection.getCookie();
+    for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+        const auto& load = threads_load(ii);
+        const std::string prefix = "worker_" + std::to_string(ii) + "_";
+
+        add_stat(cookie, append_stats, (prefix + "connections").c_str(),
+                 int32_t(load.connections));
+        add_stat(cookie, append_stats, (prefix + "ops").c_str(),
+                 uint64_t(load.ops));
+        add_stat(cookie, append_stats, (prefix + "ops_per_sec").c_str(),
+                 uint64_t(load.ops_per_sec));
+        add_stat(cookie, append_stats, (prefix + "loop_lag_usec").c_str(),
+                 uint64_t(load.loop_lag_usec));
+        add_stat(cookie, append_stats, (prefix + "max_loop_lag_usec").c_str(),
+                 uint64_t(load.max_loop_lag_usec));
+        add_stat(cookie, append_stats, (prefix + "migrated_in").c_str(),
+                 uint64_t(load.migrated_in));
+        add_stat(cookie, append_stats, (prefix + "migrated_out").c_str(),
+                 uint64_t(load.migrated_out));
+
+        const auto& notify = threads_notify_stats(ii);
+        add_stat(cookie, append_stats, (prefix + "io_completions").c_str(),
+                 uint64_t(notify.io_completions));
+        add_stat(cookie, append_stats, (prefix + "notifications").c_str(),
+                 uint64_t(notify.notifications));
+        add_stat(cookie, append_stats, (prefix + "notify_writes").c_str(),
+                 uint64_t(notify.notify_writes));
+        add_stat(cookie, append_stats, (prefix + "wakeups").c_str(),
+                 uint64_t(notify.wakeups));
+        add_stat(cookie, append_stats, (prefix + "pending_io").c_str(),
+                 uint64_t(notify.pending_io));
+        add_stat(cookie, append_stats, (prefix + "max_pending_io").c_str(),
+                 uint64_t(notify.max_pending_io));
+
+        const auto* uring = threads_io_uring_stats(ii);
+        add_stat(cookie, append_stats, (prefix + "io_backend").c_str(),
+                 uring ? "io_uring" : "libevent");
+        if (uring != nullptr) {
+            add_stat(cookie, append_stats, (prefix + "uring_submits").c_str(),
+                     uint64_t(uring->submits));
+            add_stat(cookie, append_stats, (prefix + "uring_sqes").c_str(),
+                     uint64_t(uring->sqes));
+            add_stat(cookie, append_stats, (prefix + "uring_cqes").c_str(),
+                     uint64_t(uring->cqes));
+            add_stat(cookie, append_stats,
+                     (prefix + "uring_recv_bytes").c_str(),
+                     uint64_t(uring->recv_bytes));
+            add_stat(cookie, append_stats,
+                     (prefix + "uring_recv_no_buffers").c_str(),
+                     uint64_t(uring->recv_no_buffers));
+            add_stat(cookie, append_stats, (prefix + "uring_sends").c_str(),
+                     uint64_t(uring->sends));
+            add_stat(cookie, append_stats,
+                     (prefix + "uring_send_blocked").c_str(),
+                     uint64_t(uring->send_blocked));
+            add_stat(cookie, append_stats,
+                     (prefix + "uring_send_direct").c_str(),
+                     uint64_t(uring->send_direct));
+        }
+    }
+    return ENGINE_SUCCESS;
+}
+
 /**
  * Handler for the <code>stats topkeys</code> command used to retrieve
  * the most popular keys in the attached bucket.
@@ -3365,6 +3494,8 @@ static void stat_executor(McbpConnection* c, void*) {
         {"bucket_details", {true, stat_bucket_details_executor}},
         {"aggregate", {false, stat_aggregate_executor}},
         {"connections", {false, stat_connections_executor}},
+        {"accepts", {false, stat_accepts_executor}},
+        {"threads", {false, stat_threads_executor}},
         {"topkeys", {false, stat_topkeys_executor}},
         {"topkeys_json", {false, stat_topkeys_json_executor}},
         {"subdoc_execute", {false, stat_subdoc_execute_executor}}
@@ -4467,6 +4598,8 @@ std::array<mcbp_package_execute, 0x100>& get_mcbp_executors(void) {
     executors[PROTOCOL_BINARY_CMD_GETQ] = get_executor;
     executors[PROTOCOL_BINARY_CMD_GETK] = get_executor;
     executors[PROTOCOL_BINARY_CMD_GETKQ] = get_executor;
+    executors[PROTOCOL_BINARY_CMD_GAT] = gat_executor;
+    executors[PROTOCOL_BINARY_CMD_GATQ] = gat_executor;
     executors[PROTOCOL_BINARY_CMD_DELETE] = delete_executor;
     executors[PROTOCOL_BINARY_CMD_DELETEQ] = delete_executor;
     executors[PROTOCOL_BINARY_CMD_STAT] = stat_executor;
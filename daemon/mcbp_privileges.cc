@@ -282,6 +282,10 @@ McbpPrivilegeChains::McbpPrivilegeChains() {
     /* ns_server - memcached internal communication */
     setup(PROTOCOL_BINARY_CMD_INIT_COMPLETE, require<Privilege::NodeManagement>);
 
+    /* Move a slab page between two slab classes */
+    setup(PROTOCOL_BINARY_CMD_SLAB_REASSIGN, require<Privilege::NodeManagement>);
+    setup(PROTOCOL_BINARY_CMD_SNAPSHOT, require<Privilege::NodeManagement>);
+
     if (getenv("MEMCACHED_UNIT_TESTS") != nullptr) {
         // The opcode used to set the clock by our extension
         setup(protocol_binary_command(0xe3), empty);
@@ -471,6 +471,23 @@ static protocol_binary_response_status get_validator(const Cookie& cookie)
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
+static protocol_binary_response_status gat_validator(const Cookie& cookie)
+{
+    auto req = static_cast<protocol_binary_request_gat*>(McbpConnection::getPacket(cookie));
+    uint16_t klen = ntohs(req->message.header.request.keylen);
+    uint32_t blen = ntohl(req->message.header.request.bodylen);
+    uint8_t extlen = req->message.header.request.extlen;
+
+    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
+        extlen != 4 || klen == 0 || (klen + extlen) != blen ||
+        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
+        req->message.header.request.cas != 0) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
 static protocol_binary_response_status delete_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
@@ -862,6 +879,8 @@ void McbpValidatorChains::initializeMcbpValidatorChains(McbpValidatorChains& cha
     chains.push_unique(PROTOCOL_BINARY_CMD_GETQ, get_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GETK, get_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GETKQ, get_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_GAT, gat_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_GATQ, gat_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DELETE, delete_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DELETEQ, delete_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_STAT, stat_validator);
@@ -410,6 +410,10 @@ void stats_reset(const void *void_cookie) {
     stats.total_conns.reset();
     stats.rejected_conns.reset();
     threadlocal_stats_reset(all_buckets[conn->getBucketIndex()].stats);
+    threads_accept_stats_reset();
+    threads_load_reset();
+    threads_notify_stats_reset();
+    threads_io_uring_stats_reset();
     bucket_reset_stats(conn);
 }
 
@@ -515,6 +519,7 @@ static void settings_init(void) {
     settings.setMaxBuckets(COUCHBASE_MAX_NUM_BUCKETS + 1);
     settings.setAdmin("_admin");
     settings.setDedupeNmvbMaps(false);
+    settings.setConnectionMigration(false);
 
     char *tmp = getenv("MEMCACHED_TOP_KEYS");
     settings.setTopkeysSize(20);
@@ -577,26 +582,64 @@ uint64_t get_listen_disabled_num(void) {
     return listen_state.num_disable;
 }
 
-static void disable_listen(void) {
-    Connection *next;
+/**
+ * Enable or disable the listen connections owned by a thread (the worker
+ * accepting on its reuseport sockets, or nullptr for the dispatcher) to
+ * match the listen state. The event of a listen connection is only ever
+ * added or deleted by the thread running its event base, as event_del
+ * waits for a callback running in another thread to complete.
+ */
+void update_listen_connections(LIBEVENT_THREAD* owner) {
+    bool enable;
     {
         std::lock_guard<std::mutex> guard(listen_state.mutex);
-        listen_state.disabled = true;
-        listen_state.count = 10;
-        ++listen_state.num_disable;
+        enable = !listen_state.disabled;
+    }
+
+    if (memcached_shutdown) {
+        if (owner == nullptr) {
+            // The dispatcher stops on the next event
+            return;
+        }
+        enable = false;
     }
 
+    Connection *next;
     for (next = listen_conn; next; next = next->getNext()) {
         auto* connection = dynamic_cast<ListenConnection*>(next);
         if (connection == nullptr) {
-            LOG_WARNING(next, "Internal error. Tried to disable listen on"
+            LOG_WARNING(next, "Internal error. Tried to update listen on"
                 " an illegal connection object");
             continue;
         }
-        connection->disable();
+        if (connection->getWorkerThread() != owner) {
+            continue;
+        }
+
+        if (enable) {
+            connection->enable();
+        } else {
+            connection->disable();
+        }
     }
 }
 
+/**
+ * Stop accepting clients (we ran out of file descriptors) until enough
+ * of the connections are closed. me is the thread owning the listen
+ * connection which failed (nullptr for the dispatcher).
+ */
+static void disable_listen(LIBEVENT_THREAD* me) {
+    {
+        std::lock_guard<std::mutex> guard(listen_state.mutex);
+        listen_state.disabled = true;
+        listen_state.count = 10;
+        ++listen_state.num_disable;
+    }
+
+    threads_notify_listen_state(me);
+}
+
 void safe_close(SOCKET sfd) {
     if (sfd != INVALID_SOCKET) {
         int rval;
@@ -789,6 +832,7 @@ bool conn_listening(ListenConnection *c)
     socklen_t addrlen = sizeof(addr);
     SOCKET sfd = accept(c->getSocketDescriptor(), (struct sockaddr*)&addr,
                         &addrlen);
+    const hrtime_t accepted = gethrtime();
 
     if (sfd == INVALID_SOCKET) {
         auto error = GetLastNetworkError();
@@ -802,7 +846,7 @@ bool conn_listening(ListenConnection *c)
             LOG_WARNING(c, "Too many open files. Current limit: %d",
                         limit.rlim_cur);
 #endif
-            disable_listen();
+            disable_listen(c->getWorkerThread());
         } else if (!is_blocking(error)) {
             log_socket_error(EXTENSION_LOG_WARNING, c,
                              "Failed to accept new client: %s");
@@ -847,7 +891,12 @@ bool conn_listening(ListenConnection *c)
         return false;
     }
 
-    dispatch_conn_new(sfd, c->getParentPort());
+    auto* worker = c->getWorkerThread();
+    if (worker == nullptr) {
+        dispatch_conn_new(sfd, c->getParentPort(), accepted);
+    } else {
+        accept_conn_new(worker, sfd, c->getParentPort(), accepted);
+    }
 
     return false;
 }
@@ -907,7 +956,7 @@ void event_handler(evutil_socket_t fd, short which, void *arg) {
      * object was scheduled to run in the dispatcher before the
      * callback for the worker thread is executed.
      */
-    thr->pending_io = list_remove(thr->pending_io, c);
+    remove_conn_from_pending_io_list(c);
 
     /* sanity */
     cb_assert(fd == c->getSocketDescriptor());
@@ -959,7 +1008,8 @@ void event_handler(evutil_socket_t fd, short which, void *arg) {
 /**
  * The listen_event_handler is the callback from libevent when someone is
  * connecting to one of the server sockets. It runs in the context of the
- * listen thread
+ * listen thread (or the worker thread owning the socket if the interface
+ * use reuseport)
  */
 void listen_event_handler(evutil_socket_t, short which, void *arg) {
     auto *c = reinterpret_cast<ListenConnection *>(arg);
@@ -970,6 +1020,13 @@ void listen_event_handler(evutil_socket_t, short which, void *arg) {
     }
 
     if (memcached_shutdown) {
+        if (c->getWorkerThread() != nullptr) {
+            // The worker thread stops once its clients are disconnected,
+            // we just need to stop accepting new ones
+            c->disable();
+            return;
+        }
+
         // Someone requested memcached to shut down. The listen thread should
         // be stopped immediately.
         LOG_NOTICE(NULL, "Stopping listen thread");
@@ -980,9 +1037,9 @@ void listen_event_handler(evutil_socket_t, short which, void *arg) {
     run_event_loop(c, which);
 }
 
-static void dispatch_event_handler(evutil_socket_t fd, short, void *) {
-    char buffer[80];
-    ssize_t nr = recv(fd, buffer, sizeof(buffer), 0);
+static void dispatch_event_handler(evutil_socket_t fd, short, void *arg) {
+    auto* me = reinterpret_cast<LIBEVENT_THREAD*>(arg);
+    const size_t nr = drain_notification_channel(fd);
 
     if (enable_common_ports.load()) {
         enable_common_ports.store(false);
@@ -990,28 +1047,23 @@ static void dispatch_event_handler(evutil_socket_t fd, short, void *) {
         LOG_NOTICE(NULL, "Initialization complete. Accepting clients.");
     }
 
-    if (nr != -1 && is_listen_disabled()) {
+    if (me->update_listen.exchange(false)) {
+        update_listen_connections(nullptr);
+    }
+
+    if (nr > 0 && is_listen_disabled()) {
         bool enable = false;
         {
             std::lock_guard<std::mutex> guard(listen_state.mutex);
-            listen_state.count -= nr;
-            if (listen_state.count <= 0) {
-                enable = true;
+            listen_state.count -= ssize_t(nr);
+            if (listen_state.disabled && listen_state.count <= 0) {
                 listen_state.disabled = false;
+                enable = true;
             }
         }
-        if (enable) {
-            Connection *next;
-            for (next = listen_conn; next; next = next->getNext()) {
-                auto* connection = dynamic_cast<ListenConnection*>(next);
-                if (connection == nullptr) {
-                    LOG_WARNING(next, "Internal error: tried to enable listen "
-                        "on an incorrect connection object type");
-                    continue;
-                }
 
-                connection->enable();
-            }
+        if (enable) {
+            threads_notify_listen_state(nullptr);
         }
     }
 }
@@ -1166,6 +1218,7 @@ static void add_listening_port(const struct interface *interf, in_port_t port, s
         }
 
         newport.tcp_nodelay = interf->tcp_nodelay;
+        newport.reuseport = interf->reuseport;
         newport.management = interf->management;
         newport.protocol = interf->protocol;
 
@@ -1180,6 +1233,85 @@ static void add_listening_port(const struct interface *interf, in_port_t port, s
     }
 }
 
+static bool set_reuseport(SOCKET sfd) {
+#ifdef SO_REUSEPORT
+    const int flags = 1;
+    if (setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT,
+                   reinterpret_cast<const void*>(&flags),
+                   sizeof(flags)) == 0) {
+        return true;
+    }
+    LOG_WARNING(NULL, "setsockopt(SO_REUSEPORT): %s", strerror(errno));
+#else
+    LOG_WARNING(NULL, "SO_REUSEPORT is not supported on this platform");
+#endif
+    return false;
+}
+
+static void add_listen_conn(SOCKET sfd, in_port_t port, sa_family_t family,
+                            const struct interface* interf,
+                            struct event_base* base, LIBEVENT_THREAD* worker) {
+    auto* lconn = conn_new_server(sfd, port, family, *interf, base, worker);
+    if (lconn == nullptr) {
+        FATAL_ERROR(EXIT_FAILURE, "Failed to create listening connection");
+    }
+
+    lconn->setNext(listen_conn);
+    listen_conn = lconn;
+    stats.daemon_conns++;
+}
+
+/**
+ * Give each of the worker threads its own listen connection for an
+ * address of an interface with reuseport set. The first socket is
+ * already bound (with SO_REUSEPORT set), and the rest of them are bound
+ * to the same address and port so that the kernel spreads the clients
+ * across all of them, and every worker accept its own clients.
+ *
+ * @param sfd the socket bound to the address
+ * @param ai the address
+ * @param port the port number sfd is bound to
+ * @param interf the interface description
+ * @return false if we failed to create the sockets
+ */
+static bool server_socket_reuseport(SOCKET sfd, struct addrinfo* ai,
+                                    in_port_t port,
+                                    const struct interface* interf) {
+    // The port may have been picked by the OS
+    struct sockaddr_storage addr;
+    memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+    if (ai->ai_family == AF_INET) {
+        reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port = htons(port);
+    } else if (ai->ai_family == AF_INET6) {
+        reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port = htons(port);
+    }
+
+    for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+        if (ii > 0) {
+            sfd = new_server_socket(ai, interf->tcp_nodelay);
+            if (sfd == INVALID_SOCKET) {
+                log_socket_error(EXTENSION_LOG_WARNING, nullptr,
+                                 "Failed to create SO_REUSEPORT socket: %s");
+                return false;
+            }
+            if (!set_reuseport(sfd) ||
+                bind(sfd, reinterpret_cast<struct sockaddr*>(&addr),
+                     (socklen_t)ai->ai_addrlen) == SOCKET_ERROR) {
+                log_socket_error(EXTENSION_LOG_WARNING, nullptr,
+                                 "Failed to bind SO_REUSEPORT socket: %s");
+                safe_close(sfd);
+                return false;
+            }
+        }
+
+        auto* worker = get_worker_thread(ii);
+        add_listen_conn(sfd, port, ai->ai_addr->sa_family, interf,
+                        worker->base, worker);
+    }
+
+    return true;
+}
+
 /**
  * Create a socket and bind it to a specific port number
  * @param interface the interface to bind to
@@ -1234,6 +1366,10 @@ static int server_socket(const struct interface *interf) {
             continue;
         }
 
+        // Fall back to accept the clients in the dispatcher if we can't
+        // use SO_REUSEPORT
+        const bool reuseport = interf->reuseport && set_reuseport(sfd);
+
         in_port_t listenport = 0;
         if (bind(sfd, next->ai_addr, (socklen_t)next->ai_addrlen) == SOCKET_ERROR) {
             error = GetLastNetworkError();
@@ -1265,16 +1401,16 @@ static int server_socket(const struct interface *interf) {
             }
         }
 
-        auto* lconn = conn_new_server(sfd, listenport, next->ai_addr->sa_family,
-                                      *interf, main_base);
-        if (lconn == nullptr) {
-            FATAL_ERROR(EXIT_FAILURE, "Failed to create listening connection");
+        if (!reuseport) {
+            add_listen_conn(sfd, listenport, next->ai_addr->sa_family, interf,
+                            main_base, nullptr);
+        } else if (!server_socket_reuseport(sfd, next, listenport, interf)) {
+            freeaddrinfo(ai);
+            return 1;
         }
 
-        lconn->setNext(listen_conn);
-        listen_conn = lconn;
-
-        stats.daemon_conns++;
+        // The listen connections of an address only count once against
+        // maxconn, no matter how many workers accept on it
         stats.curr_conns.fetch_add(1, std::memory_order_relaxed);
         add_listening_port(interf, listenport, next->ai_addr->sa_family);
     }
@@ -2,7 +2,10 @@
 #ifndef MEMCACHED_H
 #define MEMCACHED_H
 
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <unordered_set>
 #include <vector>
 
 /** \file
@@ -25,12 +28,13 @@
 #include "executorpool.h"
 #include "log_macros.h"
 #include "net_buf.h"
+#include "read_buffer_pool.h"
 #include "settings.h"
 
 /** Maximum length of a key. */
 #define KEY_MAX_LENGTH 250
 
-#define DATA_BUFFER_SIZE 2048
+#define DATA_BUFFER_SIZE READ_BUFFER_POOL_MIN_SIZE
 #define UDP_MAX_PAYLOAD_SIZE 1400
 #define MAX_SENDBUF_SIZE (256 * 1024 * 1024)
 
@@ -70,12 +74,17 @@ enum class ThreadType {
 
 class Connection;
 class ConnectionQueue;
+class IoUring;
 
 struct LIBEVENT_THREAD {
     cb_thread_t thread_id;      /* unique ID of this thread */
     struct event_base *base;    /* libevent handle this thread uses */
     struct event notify_event;  /* listen event for notify pipe */
-    SOCKET notify[2];           /* notification pipes */
+    SOCKET notify[2];           /* notification pipes (or eventfd) */
+    /* Set when the thread is notified, and cleared when it wakes up */
+    std::atomic<bool> notify_pending;
+    /* Set when the thread should update its listen connections */
+    std::atomic<bool> update_listen;
     ConnectionQueue *new_conn_queue; /* queue of new connections to handle */
     cb_mutex_t mutex;      /* Mutex to lock protect access to the pending_io */
     bool is_locked;
@@ -85,7 +94,7 @@ struct LIBEVENT_THREAD {
 
     rel_time_t last_checked;
 
-    struct net_buf read; /** Shared read buffer for all connections serviced by this thread. */
+    ReadBufferPool* read_buffers; /** Read buffers for the connections serviced by this thread. */
     struct net_buf write; /** Shared write buffer for all connections serviced by this thread. */
 
     subdoc_OPERATION* subdoc_op; /** Shared sub-document operation for all
@@ -103,6 +112,19 @@ struct LIBEVENT_THREAD {
     int deleting_buckets;
 
     JSON_checker::Validator *validator;
+
+    struct event load_event;    /* timer used to measure the load */
+    hrtime_t load_timer_set;    /* when load_event was added */
+    hrtime_t load_rate_start;   /* start of the current ops rate interval */
+    uint64_t load_rate_ops;     /* ops executed at load_rate_start */
+    unsigned int load_ticks;
+
+    IoUring* io_uring;          /* the ring if io_backend is io_uring */
+
+    /* The clients bound to this thread, so that it can look for an idle
+     * one to migrate without going through all of the connections */
+    std::mutex connections_mutex;
+    std::unordered_set<Connection*> connections;
 };
 
 #define LOCK_THREAD(t) \
@@ -118,6 +140,7 @@ struct LIBEVENT_THREAD {
 extern void notify_thread(LIBEVENT_THREAD *thread);
 extern void notify_dispatcher(void);
 extern bool create_notification_pipe(LIBEVENT_THREAD *me);
+extern size_t drain_notification_channel(evutil_socket_t fd);
 
 #include "connection.h"
 #include "connection_greenstack.h"
@@ -130,6 +153,30 @@ typedef union {
     char bytes[sizeof(item_info) + ((IOV_MAX - 1) * sizeof(struct iovec))];
 } item_info_holder;
 
+/*
+ * Large values may be stored by the engine in more than one piece (see
+ * the nvalue field of item_info). Copy len bytes into (or out of) the
+ * value of an item.
+ */
+inline void item_info_copy_in(const item_info& info, const void* src,
+                              size_t len) {
+    auto* ptr = static_cast<const char*>(src);
+    for (uint16_t ii = 0; ii < info.nvalue && len > 0; ++ii) {
+        size_t n = std::min(len, size_t(info.value[ii].iov_len));
+        memcpy(info.value[ii].iov_base, ptr, n);
+        ptr += n;
+        len -= n;
+    }
+}
+
+inline void item_info_copy_out(const item_info& info, void* dest) {
+    auto* ptr = static_cast<char*>(dest);
+    for (uint16_t ii = 0; ii < info.nvalue; ++ii) {
+        memcpy(ptr, info.value[ii].iov_base, info.value[ii].iov_len);
+        ptr += info.value[ii].iov_len;
+    }
+}
+
 /* list of listening connections */
 extern Connection *listen_conn;
 
@@ -158,7 +205,20 @@ void thread_init(int nthreads, struct event_base *main_base,
 void threads_shutdown(void);
 void threads_cleanup(void);
 
-void dispatch_conn_new(SOCKET sfd, int parent_port);
+/*
+ * Hand a new client to the next worker thread. accepted is when the client
+ * was accepted (used for the accept stats), or 0.
+ */
+void dispatch_conn_new(SOCKET sfd, int parent_port, hrtime_t accepted = 0);
+
+/*
+ * Create the connection for a client the worker thread me accepted itself
+ * (on one of its SO_REUSEPORT sockets).
+ */
+void accept_conn_new(LIBEVENT_THREAD* me, SOCKET sfd, int parent_port,
+                     hrtime_t accepted);
+
+LIBEVENT_THREAD* get_worker_thread(int index);
 
 /* Lock wrappers for cache functions that are called from main loop. */
 int is_listen_thread(void);
@@ -166,6 +226,16 @@ int is_listen_thread(void);
 void STATS_LOCK(void);
 void STATS_UNLOCK(void);
 void threadlocal_stats_reset(struct thread_stats *thread_stats);
+const struct accept_stats& threads_accept_stats(int index);
+void threads_accept_stats_reset(void);
+const struct thread_load& threads_load(int index);
+void threads_load_reset(void);
+void thread_load_count_op(LIBEVENT_THREAD* thread);
+void thread_connection_closed(LIBEVENT_THREAD* thread);
+const struct notify_stats& threads_notify_stats(int index);
+void threads_notify_stats_reset(void);
+const struct io_uring_stats* threads_io_uring_stats(int index);
+void threads_io_uring_stats_reset(void);
 
 void notify_io_complete(const void *cookie, ENGINE_ERROR_CODE status);
 void safe_close(SOCKET sfd);
@@ -178,6 +248,7 @@ Connection *list_remove(Connection *h, Connection *n);
 bool load_extension(const char *soname, const char *config);
 
 int add_conn_to_pending_io_list(Connection *c);
+void remove_conn_from_pending_io_list(Connection *c);
 
 /* connection state machine */
 bool conn_listening(ListenConnection *c);
@@ -221,6 +292,8 @@ void update_topkeys(const char *key, size_t nkey, McbpConnection *c);
 void notify_thread_bucket_deletion(LIBEVENT_THREAD *me);
 
 void threads_notify_bucket_deletion(void);
+void threads_notify_listen_state(LIBEVENT_THREAD* me);
+void update_listen_connections(LIBEVENT_THREAD* owner);
 void threads_complete_bucket_deletion(void);
 void threads_initiate_bucket_deletion(void);
 
@@ -347,6 +420,17 @@ static inline ENGINE_ERROR_CODE bucket_get(McbpConnection* c,
                                      item_, key, nkey, vbucket);
 }
 
+static inline ENGINE_ERROR_CODE bucket_get_and_touch(McbpConnection* c,
+                                                     item** item_,
+                                                     const void* key,
+                                                     const int nkey,
+                                                     const rel_time_t exptime,
+                                                     uint16_t vbucket) {
+    return c->getBucketEngine()->get_and_touch(c->getBucketEngineAsV0(),
+                                               c->getCookie(), item_, key,
+                                               nkey, exptime, vbucket);
+}
+
 static inline void bucket_release_item(McbpConnection* c, item* it) {
     c->getBucketEngine()->release(c->getBucketEngineAsV0(),
                                   c->getCookie(), it);
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include "read_buffer_pool.h"
+
+#include <cstdlib>
+
+/**
+ * The size class of a buffer of the given size, or -1 if it's not the
+ * size of one of the classes
+ */
+static int size_class(size_t size) {
+    size_t csize = READ_BUFFER_POOL_MIN_SIZE;
+    for (int ii = 0; ii < READ_BUFFER_POOL_CLASSES; ++ii, csize <<= 1) {
+        if (size == csize) {
+            return ii;
+        }
+    }
+    return -1;
+}
+
+/** The max # of free buffers kept for the size class */
+static size_t class_max(int idx) {
+    return READ_BUFFER_POOL_CLASS_BYTES / (READ_BUFFER_POOL_MIN_SIZE << idx);
+}
+
+ReadBufferPool::ReadBufferPool() {
+    for (int ii = 0; ii < READ_BUFFER_POOL_CLASSES; ++ii) {
+        free[ii].reserve(class_max(ii));
+    }
+}
+
+ReadBufferPool::~ReadBufferPool() {
+    for (auto& buffers : free) {
+        for (auto* buf : buffers) {
+            ::free(buf);
+        }
+    }
+}
+
+size_t ReadBufferPool::roundUp(size_t size) {
+    size_t ret = READ_BUFFER_POOL_MIN_SIZE;
+    while (ret < size) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+char* ReadBufferPool::get(size_t& size, bool& pooled) {
+    size = roundUp(size);
+    int idx = size_class(size);
+    if (idx != -1 && !free[idx].empty()) {
+        char* ret = free[idx].back();
+        free[idx].pop_back();
+        pooled = true;
+        return ret;
+    }
+
+    pooled = false;
+    return reinterpret_cast<char*>(malloc(size));
+}
+
+void ReadBufferPool::put(char* buf, size_t size) {
+    int idx = size_class(size);
+    if (idx != -1 && free[idx].size() < class_max(idx)) {
+        free[idx].push_back(buf);
+    } else {
+        ::free(buf);
+    }
+}
+
+size_t ReadBufferPool::getBytes() const {
+    size_t ret = 0;
+    for (int ii = 0; ii < READ_BUFFER_POOL_CLASSES; ++ii) {
+        ret += free[ii].size() * (READ_BUFFER_POOL_MIN_SIZE << ii);
+    }
+    return ret;
+}
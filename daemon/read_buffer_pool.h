@@ -0,0 +1,88 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/** The size of the smallest read buffer (and the one a client starts with) */
+#define READ_BUFFER_POOL_MIN_SIZE 2048
+
+/** # of size classes (READ_BUFFER_POOL_MIN_SIZE << n bytes), up to 1MB */
+#define READ_BUFFER_POOL_CLASSES 10
+
+/** The size of the largest size class */
+#define READ_BUFFER_POOL_MAX_SIZE \
+    (READ_BUFFER_POOL_MIN_SIZE << (READ_BUFFER_POOL_CLASSES - 1))
+
+/** The max size of the free buffers kept for each of the size classes */
+#define READ_BUFFER_POOL_CLASS_BYTES (1024 * 1024)
+
+/**
+ * The read buffers a worker thread keeps for its connections.
+ *
+ * A connection gets a read buffer from the pool of its thread when it is
+ * run, and puts it back once all of the input is processed, so that the
+ * buffer may be used by the next connection served by the thread. The
+ * buffers are taken from a set of size classes (the sizes are powers of
+ * two), letting every connection use a buffer of the size it needs
+ * without allocating (or reallocating) a buffer for every batch of input
+ * read.
+ *
+ * A buffer may be put back to the pool of another thread than the one it
+ * was taken from (the connections can move between the threads), but the
+ * pool itself is only to be used by its thread.
+ */
+class ReadBufferPool {
+public:
+    ReadBufferPool();
+
+    ~ReadBufferPool();
+
+    ReadBufferPool(const ReadBufferPool&) = delete;
+
+    /**
+     * Get a read buffer
+     *
+     * @param size the size wanted (it's rounded up to the size of the
+     *             buffer returned)
+     * @param pooled set to true if the buffer was taken from the pool
+     *               rather than allocated
+     * @return the buffer, or nullptr if we're out of memory
+     */
+    char* get(size_t& size, bool& pooled);
+
+    /**
+     * Put the buffer (of the given size) back in the pool. It is freed if
+     * it is too large for the pool, or the pool is full.
+     */
+    void put(char* buf, size_t size);
+
+    /**
+     * The size of the buffer returned by get() for the given size
+     */
+    static size_t roundUp(size_t size);
+
+    /**
+     * The total size of the free buffers in the pool
+     */
+    size_t getBytes() const;
+
+private:
+    std::array<std::vector<char*>, READ_BUFFER_POOL_CLASSES> free;
+};
@@ -43,12 +43,14 @@ Settings::Settings()
       topkeys_size(0),
       stdin_listen(false),
       exit_on_connection_close(false),
+      io_backend(IoBackend::Libevent),
       maxconns(0),
       max_buckets(0) {
 
     verbose.store(0);
     connection_idle_time.reset();
     dedupe_nmvb_maps.store(false);
+    connection_migration.store(false);
 
     memset(&has, 0, sizeof(has));
     memset(&extensions, 0, sizeof(extensions));
@@ -409,6 +411,50 @@ static void handle_dedupe_nmvb_maps(Settings& s, cJSON* obj) {
     }
 }
 
+/**
+ * Handle the "connection_migration" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_connection_migration(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setConnectionMigration(true);
+    } else if (obj->type == cJSON_False) {
+        s.setConnectionMigration(false);
+    } else {
+        throw std::invalid_argument(
+            "\"connection_migration\" must be a boolean value");
+    }
+}
+
+/**
+ * Handle the "io_backend" tag in the settings
+ *
+ *  The value must be "libevent" or "io_uring"
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_io_backend(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_String) {
+        throw std::invalid_argument("\"io_backend\" must be a string");
+    }
+
+    std::string backend(obj->valuestring);
+
+    if (backend == "libevent") {
+        s.setIoBackend(IoBackend::Libevent);
+    } else if (backend == "io_uring") {
+        s.setIoBackend(IoBackend::IoUring);
+    } else {
+        throw std::invalid_argument(
+            "\"io_backend\" must be \"libevent\" or \"io_uring\"");
+    }
+}
+
 /**
  * Handle the "extensions" tag in the settings
  *
@@ -511,7 +557,9 @@ void Settings::reconfigure(const unique_cJSON_ptr& json) {
         {"stdin_listen",                 handle_stdin_listen},
         {"exit_on_connection_close",     handle_exit_on_connection_close},
         {"sasl_mechanisms",              handle_sasl_mechanisms},
-        {"dedupe_nmvb_maps",             handle_dedupe_nmvb_maps}
+        {"dedupe_nmvb_maps",             handle_dedupe_nmvb_maps},
+        {"connection_migration",         handle_connection_migration},
+        {"io_backend",                   handle_io_backend}
     };
 
     cJSON* obj = json->child;
@@ -598,6 +646,16 @@ static void handle_interface_tcp_nodelay(struct interface& ifc, cJSON* obj) {
     }
 }
 
+static void handle_interface_reuseport(struct interface& ifc, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        ifc.reuseport = true;
+    } else if (obj->type == cJSON_False) {
+        ifc.reuseport = false;
+    } else {
+        throw std::invalid_argument("\"reuseport\" must be a boolean value");
+    }
+}
+
 static void handle_interface_management(struct interface& ifc, cJSON* obj) {
     if (obj->type == cJSON_True) {
         ifc.management = true;
@@ -686,6 +744,7 @@ interface::interface(const cJSON* json)
         {"ipv4",        handle_interface_ipv4},
         {"ipv6",        handle_interface_ipv6},
         {"tcp_nodelay", handle_interface_tcp_nodelay},
+        {"reuseport",   handle_interface_reuseport},
         {"ssl",         handle_interface_ssl},
         {"management",  handle_interface_management},
         {"protocol",    handle_interface_protocol},
@@ -785,6 +844,12 @@ void Settings::updateSettings(const Settings& other, bool apply) {
                 "sasl_mechanisms can't be changed dynamically");
         }
     }
+    if (other.has.io_backend) {
+        if (other.io_backend != io_backend) {
+            throw std::invalid_argument(
+                "io_backend can't be changed dynamically");
+        }
+    }
 
     if (other.has.interfaces) {
         if (other.interfaces.size() != interfaces.size()) {
@@ -807,6 +872,7 @@ void Settings::updateSettings(const Settings& other, bool apply) {
             if ((i1.host != i2.host) || (i1.port != i2.port) ||
                 (i1.ipv4 != i2.ipv4) || (i1.ipv6 != i2.ipv6) ||
                 (i1.protocol != i2.protocol) ||
+                (i1.reuseport != i2.reuseport) ||
                 (i1.management != i2.management)) {
                 throw std::invalid_argument(
                     "interfaces can't be changed dynamically");
@@ -939,6 +1005,14 @@ void Settings::updateSettings(const Settings& other, bool apply) {
             setDedupeNmvbMaps(other.dedupe_nmvb_maps.load());
         }
     }
+    if (other.has.connection_migration) {
+        if (other.connection_migration != connection_migration) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "%s migration of idle connections",
+                  other.connection_migration.load() ? "Enable" : "Disable");
+            setConnectionMigration(other.connection_migration.load());
+        }
+    }
 
     if (other.has.interfaces) {
         // validate that we haven't changed stuff in the entries
@@ -1112,3 +1186,13 @@ BreakpadSettings::BreakpadSettings(const cJSON* json) {
         content = BreakpadContent::Default;
     }
 }
+
+const char* to_string(const IoBackend& backend) {
+    switch (backend) {
+    case IoBackend::Libevent:
+        return "libevent";
+    case IoBackend::IoUring:
+        return "io_uring";
+    }
+    return "unknown";
+}
@@ -52,6 +52,7 @@ struct interface {
           ipv6(true),
           ipv4(true),
           tcp_nodelay(true),
+          reuseport(false),
           management(false),
           protocol(Protocol::Memcached) {
     }
@@ -69,6 +70,11 @@ struct interface {
     bool ipv6;
     bool ipv4;
     bool tcp_nodelay;
+    /**
+     * Let every worker thread accept on its own SO_REUSEPORT socket
+     * instead of having the dispatcher accept all of the clients
+     */
+    bool reuseport;
     bool management;
     Protocol protocol;
 };
@@ -99,6 +105,18 @@ struct extension_settings {
     std::string config;
 };
 
+/**
+ * How the worker threads perform the network io for the clients
+ */
+enum class IoBackend {
+    /** Wait for the sockets to be ready with libevent, and use recv/sendmsg */
+    Libevent,
+    /** Receive and send through an io_uring per worker thread */
+    IoUring
+};
+
+const char* to_string(const IoBackend& backend);
+
 /**
  * What information should breakpad minidumps contain?
  */
@@ -739,6 +757,48 @@ public:
         notify_changed("dedupe_nmvb_maps");
     }
 
+    /**
+     * Should idle clients be moved from a busy worker thread over to a
+     * less loaded one.
+     *
+     * @return true if the idle clients may be moved between the threads
+     */
+    const bool isConnectionMigration() const {
+        return connection_migration.load();
+    }
+
+    /**
+     * Set if idle clients should be moved from a busy worker thread over
+     * to a less loaded one.
+     *
+     * @param connection_migration true if the idle clients may be moved
+     */
+    void setConnectionMigration(const bool& connection_migration) {
+        Settings::connection_migration.store(connection_migration);
+        has.connection_migration = true;
+        notify_changed("connection_migration");
+    }
+
+    /**
+     * Get the backend the worker threads use for the network io
+     *
+     * @return the io backend
+     */
+    const IoBackend getIoBackend() const {
+        return io_backend;
+    }
+
+    /**
+     * Set the backend the worker threads use for the network io
+     *
+     * @param io_backend the io backend to use
+     */
+    void setIoBackend(const IoBackend& io_backend) {
+        Settings::io_backend = io_backend;
+        has.io_backend = true;
+        notify_changed("io_backend");
+    }
+
     /**
      * Get the breakpad settings
      *
@@ -906,6 +966,16 @@ protected:
      */
     std::atomic_bool dedupe_nmvb_maps;
 
+    /**
+     * Should we move idle clients over to less loaded worker threads
+     */
+    std::atomic_bool connection_migration;
+
+    /**
+     * The backend used for the network io
+     */
+    IoBackend io_backend;
+
 public:
     /**
      * Flags for each of the above config options, indicating if they were
@@ -939,6 +1009,8 @@ public:
         bool exit_on_connection_close;
         bool sasl_mechanisms;
         bool dedupe_nmvb_maps;
+        bool connection_migration;
+        bool io_backend;
     } has;
 
 protected:
@@ -476,6 +476,7 @@ bool conn_immediate_close(McbpConnection *c) {
 bool conn_closing(McbpConnection *c) {
     /* We don't want any network notifications anymore.. */
     c->unregisterEvent();
+    c->detachIoUring();
     safe_close(c->getSocketDescriptor());
     c->setSocketDescriptor(INVALID_SOCKET);
 
@@ -154,7 +154,8 @@ struct thread_stats {
 
     /* # of read buffers allocated. */
     Couchbase::RelaxedAtomic<uint64_t> rbufs_allocated;
-    /* # of read buffers which could be loaned (and hence didn't need to be allocated). */
+    /* # of read buffers which could be taken from the read buffer pool of the
+       thread (and hence didn't need to be allocated). */
     Couchbase::RelaxedAtomic<uint64_t> rbufs_loaned;
     /* # of read buffers which already existed (with partial data) on the connection
        (and hence didn't need to be allocated). */
@@ -174,6 +175,134 @@ struct thread_stats {
     Couchbase::RelaxedAtomic<int> msgused_high_watermark;
 };
 
+/**
+ * The clients accepted for a worker thread, either by the dispatcher or
+ * by the worker itself on its own SO_REUSEPORT sockets.
+ */
+struct accept_stats {
+    accept_stats() {
+        reset();
+    }
+
+    void reset() {
+        accepted = 0;
+        reuseport_accepted = 0;
+        latency_ns = 0;
+        max_latency_ns = 0;
+    }
+
+    /* # of clients handed to the thread */
+    Couchbase::RelaxedAtomic<uint64_t> accepted;
+    /* # of those accepted by the thread itself */
+    Couchbase::RelaxedAtomic<uint64_t> reuseport_accepted;
+    /* Time from accept() until the connection was created on the thread */
+    Couchbase::RelaxedAtomic<uint64_t> latency_ns;
+    Couchbase::RelaxedAtomic<uint64_t> max_latency_ns;
+};
+
+/**
+ * The load of a worker thread. New clients are placed on the least loaded
+ * thread, and idle clients may be moved away from a busy thread (see
+ * connection_migration).
+ */
+struct thread_load {
+    thread_load() {
+        connections = 0;
+        ops = 0;
+        ops_per_sec = 0;
+        loop_lag_usec = 0;
+        reset();
+    }
+
+    void reset() {
+        max_loop_lag_usec = 0;
+        migrated_in = 0;
+        migrated_out = 0;
+    }
+
+    /* # of clients bound to the thread (or on their way to it) */
+    Couchbase::RelaxedAtomic<int> connections;
+    /* # of commands executed, and the rate over the last second */
+    Couchbase::RelaxedAtomic<uint64_t> ops;
+    Couchbase::RelaxedAtomic<uint64_t> ops_per_sec;
+    /* How late the event loop runs the timers (a moving average) */
+    Couchbase::RelaxedAtomic<uint64_t> loop_lag_usec;
+    Couchbase::RelaxedAtomic<uint64_t> max_loop_lag_usec;
+    /* # of idle clients moved over from / to other threads */
+    Couchbase::RelaxedAtomic<uint64_t> migrated_in;
+    Couchbase::RelaxedAtomic<uint64_t> migrated_out;
+};
+
+/**
+ * How the worker threads are woken up by the other threads. A thread is
+ * only woken up once for all of the notifications sent to it until it
+ * gets to run, so the wakeups should be (a lot) fewer than the io
+ * completions when the thread is busy.
+ */
+struct notify_stats {
+    notify_stats() {
+        reset();
+    }
+
+    void reset() {
+        io_completions = 0;
+        notifications = 0;
+        notify_writes = 0;
+        wakeups = 0;
+        pending_io = 0;
+        max_pending_io = 0;
+    }
+
+    /* # of cookies completed by notify_io_complete */
+    Couchbase::RelaxedAtomic<uint64_t> io_completions;
+    /* # of times the thread was notified, and the writes it took */
+    Couchbase::RelaxedAtomic<uint64_t> notifications;
+    Couchbase::RelaxedAtomic<uint64_t> notify_writes;
+    /* # of times the thread ran the notifications */
+    Couchbase::RelaxedAtomic<uint64_t> wakeups;
+    /* # of connections run from the pending io list (and the most in a
+     * single wakeup) */
+    Couchbase::RelaxedAtomic<uint64_t> pending_io;
+    Couchbase::RelaxedAtomic<uint64_t> max_pending_io;
+};
+
+/**
+ * The network io performed through the io_uring of a worker thread (see
+ * io_backend).
+ */
+struct io_uring_stats {
+    io_uring_stats() {
+        reset();
+    }
+
+    void reset() {
+        submits = 0;
+        sqes = 0;
+        cqes = 0;
+        recv_bytes = 0;
+        recv_no_buffers = 0;
+        sends = 0;
+        send_blocked = 0;
+        send_direct = 0;
+    }
+
+    /* # of io_uring_enter calls to submit, and the requests submitted */
+    Couchbase::RelaxedAtomic<uint64_t> submits;
+    Couchbase::RelaxedAtomic<uint64_t> sqes;
+    /* # of completions reaped */
+    Couchbase::RelaxedAtomic<uint64_t> cqes;
+    /* bytes received, and # of times we ran out of receive buffers */
+    Couchbase::RelaxedAtomic<uint64_t> recv_bytes;
+    Couchbase::RelaxedAtomic<uint64_t> recv_no_buffers;
+    /* # of responses sent from a registered buffer, the times the
+     * connection had to wait for the previous one to complete, and the
+     * ones sent from the memory of the connection (too large, or out of
+     * registered buffers) */
+    Couchbase::RelaxedAtomic<uint64_t> sends;
+    Couchbase::RelaxedAtomic<uint64_t> send_blocked;
+    Couchbase::RelaxedAtomic<uint64_t> send_direct;
+};
+
 /**
  * Listening port.
  */
@@ -193,6 +322,7 @@ struct listening_port {
     bool ipv6;
     bool ipv4;
     bool tcp_nodelay;
+    bool reuseport;
     bool management;
     Protocol protocol;
 };
@@ -395,12 +395,6 @@ get_document_for_searching(McbpConnection * c, const item* item,
         return PROTOCOL_BINARY_RESPONSE_EINTERNAL;
     }
 
-    // Need to have the complete document in a single iovec.
-    if (info.info.nvalue != 1) {
-        LOG_WARNING(c, "%u: More than one iovec in document", c->getId());
-        return PROTOCOL_BINARY_RESPONSE_EINTERNAL;
-    }
-
     // Check CAS matches (if specified by the user)
     if ((in_cas != 0) && in_cas != info.info.cas) {
         return PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS;
@@ -410,19 +404,38 @@ get_document_for_searching(McbpConnection * c, const item* item,
     cas = info.info.cas;
     flags = info.info.flags;
 
+    // Need to have the complete document in a single buffer. Large
+    // documents may be stored in more than one piece, in which case we
+    // copy them into the connections' dynamic buffer.
+    const char* value_buf = static_cast<char*>(info.info.value[0].iov_base);
+    size_t value_len = info.info.value[0].iov_len;
+    if (info.info.nvalue != 1) {
+        if (!c->growDynamicBuffer(info.info.nbytes)) {
+            LOG_WARNING(c,
+                        "<%u ERROR: Failed to grow dynamic buffer to %"
+                            PRIu32 " for document.",
+                        c->getId(), info.info.nbytes);
+            return PROTOCOL_BINARY_RESPONSE_E2BIG;
+        }
+        auto &dbuf = c->getDynamicBuffer();
+        item_info_copy_out(info.info, dbuf.getCurrent());
+        value_buf = dbuf.getCurrent();
+        value_len = info.info.nbytes;
+        dbuf.moveOffset(value_len);
+    }
+
     switch (info.info.datatype) {
     case PROTOCOL_BINARY_DATATYPE_JSON:
         // Good to go using original buffer.
-        document.buf = static_cast<char*>(info.info.value[0].iov_base);
-        document.len = info.info.value[0].iov_len;
+        document.buf = value_buf;
+        document.len = value_len;
         return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 
     case PROTOCOL_BINARY_DATATYPE_COMPRESSED_JSON:
         {
             // Need to expand before attempting to extract from it.
-            const char* compressed_buf =
-                    static_cast<char*>(info.info.value[0].iov_base);
-            const size_t compressed_len = info.info.value[0].iov_len;
+            const char* compressed_buf = value_buf;
+            const size_t compressed_len = value_len;
             size_t uncompressed_len;
             if (snappy_uncompressed_length(compressed_buf, compressed_len,
                                            &uncompressed_len) != SNAPPY_OK) {
@@ -800,18 +813,33 @@ ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext* context,
         bucket_item_set_cas(c, new_doc, context->in_cas);
 
         // Obtain the item info (and it's iovectors)
-        item_info new_doc_info;
-        new_doc_info.nvalue = IOV_MAX;
-        if (!bucket_get_item_info(c, new_doc, &new_doc_info)) {
+        item_info_holder new_doc_info;
+        new_doc_info.info.nvalue = IOV_MAX;
+        if (!bucket_get_item_info(c, new_doc, &new_doc_info.info)) {
             mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
             return ENGINE_FAILED;
         }
 
-        // Copy the new document into the item.
-        char* write_ptr = static_cast<char*>(new_doc_info.value[0].iov_base);
+        // Copy the new document into the item (which may be stored in
+        // more than one piece).
+        uint16_t iov = 0;
+        size_t iov_offset = 0;
         for (auto& loc : context->ops.back().result.newdoc()) {
-            std::copy(loc.at, loc.at + loc.length, write_ptr);
-            write_ptr += loc.length;
+            const char* read_ptr = loc.at;
+            size_t remaining = loc.length;
+            while (remaining > 0) {
+                const auto& dest = new_doc_info.info.value[iov];
+                size_t n = std::min(remaining, dest.iov_len - iov_offset);
+                std::copy(read_ptr, read_ptr + n,
+                          static_cast<char*>(dest.iov_base) + iov_offset);
+                read_ptr += n;
+                remaining -= n;
+                iov_offset += n;
+                if (iov_offset == dest.iov_len) {
+                    ++iov;
+                    iov_offset = 0;
+                }
+            }
         }
     }
 
@@ -824,16 +852,16 @@ ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext* context,
         // Record the UUID / Seqno if MUTATION_SEQNO feature is enabled so
         // we can include it in the response.
         if (c->isSupportsMutationExtras()) {
-            item_info info;
-            info.nvalue = 1;
-            if (!bucket_get_item_info(c, context->out_doc, &info)) {
+            item_info_holder info;
+            info.info.nvalue = IOV_MAX;
+            if (!bucket_get_item_info(c, context->out_doc, &info.info)) {
                 LOG_WARNING(c, "%u: Subdoc: Failed to get item info",
                             c->getId());
                 mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
                 return ENGINE_FAILED;
             }
-            context->vbucket_uuid = info.vbucket_uuid;
-            context->sequence_no = info.seqno;
+            context->vbucket_uuid = info.info.vbucket_uuid;
+            context->sequence_no = info.info.seqno;
         }
 
         c->setCAS(new_cas);
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "memcached.h"
 #include "connections.h"
+#include "io_uring_backend.h"
 
 #include <atomic>
 #include <stdio.h>
@@ -15,26 +16,43 @@
 #include <stdint.h>
 #include <signal.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 #include <platform/platform.h>
 #include <platform/strerror.h>
+#include <algorithm>
 #include <queue>
 #include <memory>
 
 #define ITEMS_PER_ALLOC 64
 
+/* How often the worker threads measure their event loop lag, and how many
+ * of those intervals the ops rate is measured over */
+#define LOAD_INTERVAL_MS 100
+#define LOAD_RATE_TICKS 10
+
+/* Idle clients are only moved away from a thread executing at least this
+ * many ops/sec, and with at least twice the load of the least loaded
+ * thread */
+#define LOAD_MIGRATE_MIN_OPS 1000
+
 static char devnull[8192];
 extern std::atomic<bool> memcached_shutdown;
 
 /* An item in the connection queue. */
 struct ConnectionQueueItem {
-    ConnectionQueueItem(SOCKET sock, in_port_t port)
+    ConnectionQueueItem(SOCKET sock, in_port_t port, hrtime_t time)
         : sfd(sock),
-          parent_port(port) {
+          parent_port(port),
+          accepted(time) {
         // empty
     }
 
     SOCKET sfd;
     in_port_t parent_port;
+    /* When the client was accepted (0 if it wasn't) */
+    hrtime_t accepted;
 };
 
 class ConnectionQueue {
@@ -80,6 +98,21 @@ static int nthreads;
 static LIBEVENT_THREAD *threads;
 static cb_thread_t *thread_ids;
 
+/*
+ * The clients accepted for each of the worker threads (see accept_stats)
+ */
+static accept_stats *thread_accept_stats;
+
+/*
+ * The load of each of the worker threads (see thread_load)
+ */
+static thread_load *thread_loads;
+
+/*
+ * How each of the worker threads is notified (see notify_stats)
+ */
+static notify_stats *thread_notify_stats;
+
 /*
  * Number of worker threads that have finished setting themselves up.
  */
@@ -88,6 +121,7 @@ static cb_mutex_t init_lock;
 static cb_cond_t init_cond;
 
 static void thread_libevent_process(evutil_socket_t fd, short which, void *arg);
+static void thread_load_tick(evutil_socket_t fd, short which, void *arg);
 
 /*
  * Creates a worker thread.
@@ -104,8 +138,33 @@ static void create_worker(void (*func)(void *), void *arg, cb_thread_t *id,
 
 /****************************** LIBEVENT THREADS *****************************/
 
+static void add_load_timer(LIBEVENT_THREAD *me) {
+    struct timeval tv = {0, LOAD_INTERVAL_MS * 1000};
+
+    me->load_timer_set = gethrtime();
+    if (evtimer_add(&me->load_event, &tv) == -1) {
+        LOG_WARNING(nullptr, "Failed to add the load timer of worker thread %u",
+                    me->index);
+    }
+}
+
+/*
+ * Creates the channel other threads use to wake up the thread. On Linux
+ * this is an eventfd (so both ends are the same descriptor), which only
+ * holds a counter no matter how many times it's written to.
+ */
 bool create_notification_pipe(LIBEVENT_THREAD *me)
 {
+#ifdef HAVE_SYS_EVENTFD_H
+    me->notify[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (me->notify[0] == -1) {
+        log_system_error(EXTENSION_LOG_WARNING, NULL,
+                         "Can't create notify eventfd: %s");
+        return false;
+    }
+    me->notify[1] = me->notify[0];
+    return true;
+#else
     int j;
 
 #ifdef WIN32
@@ -141,12 +200,24 @@ bool create_notification_pipe(LIBEVENT_THREAD *me)
         }
     }
     return true;
+#endif
+}
+
+/*
+ * Closes the notification channel of a thread
+ */
+static void close_notification_pipe(LIBEVENT_THREAD *me) {
+    if (me->notify[1] != me->notify[0]) {
+        safe_close(me->notify[1]);
+    }
+    safe_close(me->notify[0]);
 }
 
 static void setup_dispatcher(struct event_base *main_base,
                              void (*dispatcher_callback)(evutil_socket_t, short, void *))
 {
-    memset(&dispatcher_thread, 0, sizeof(dispatcher_thread));
+    // dispatcher_thread has static storage duration, so it is already
+    // zeroed (it can't be memset as it holds a std::atomic)
     dispatcher_thread.type = ThreadType::DISPATCHER;
     dispatcher_thread.base = main_base;
 	dispatcher_thread.thread_id = cb_thread_self();
@@ -160,7 +231,7 @@ static void setup_dispatcher(struct event_base *main_base,
                       dispatcher_thread.notify[0],
                       EV_READ | EV_PERSIST,
                       dispatcher_callback,
-                      nullptr) == -1) ||
+                      &dispatcher_thread) == -1) ||
         (event_add(&dispatcher_thread.notify_event, 0) == -1)) {
         FATAL_ERROR(EXIT_FAILURE, "Can't monitor libevent notify pipe");
     }
@@ -195,12 +266,29 @@ static void setup_thread(LIBEVENT_THREAD *me) {
         FATAL_ERROR(EXIT_FAILURE, "Can't monitor libevent notify pipe");
     }
 
+    /* Measure the load of the thread */
+    if (evtimer_assign(&me->load_event, me->base, thread_load_tick, me) == -1) {
+        FATAL_ERROR(EXIT_FAILURE, "Can't set up the load timer");
+    }
+    me->load_rate_start = gethrtime();
+    add_load_timer(me);
+
+    if (settings.getIoBackend() == IoBackend::IoUring) {
+        me->io_uring = IoUring::create(*me);
+    }
+
     try {
         me->new_conn_queue = new ConnectionQueue;
     } catch (std::bad_alloc&) {
         FATAL_ERROR(EXIT_FAILURE, "Failed to allocate memory for connection queue");
     }
 
+    try {
+        me->read_buffers = new ReadBufferPool;
+    } catch (std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE, "Failed to allocate memory for read buffers");
+    }
+
     cb_mutex_initialize(&me->mutex);
 
     // Initialize threads' sub-document parser / handler
@@ -234,27 +322,51 @@ static void worker_libevent(void *arg) {
     ERR_remove_state(0);
 }
 
-static int number_of_pending(Connection *c, Connection *list) {
-    int rv = 0;
-    for (; list; list = list->getNext()) {
-        if (list == c) {
-            rv ++;
+/*
+ * Drains the notification channel, and returns the number of times the
+ * thread was notified since the last time it was drained.
+ */
+size_t drain_notification_channel(evutil_socket_t fd)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    eventfd_t count;
+    if (eventfd_read(fd, &count) == -1) {
+        if (!is_blocking(GetLastNetworkError())) {
+            log_system_error(EXTENSION_LOG_WARNING, NULL,
+                             "Can't read from notify eventfd: %s");
         }
+        return 0;
     }
-    return rv;
-}
-
-static void drain_notification_channel(evutil_socket_t fd)
-{
+    return size_t(count);
+#else
+    size_t total = 0;
     int nread;
-    while ((nread = recv(fd, devnull, sizeof(devnull), 0)) == (int)sizeof(devnull)) {
-        /* empty */
+    while ((nread = recv(fd, devnull, sizeof(devnull), 0)) > 0) {
+        total += nread;
+        if (nread != (int)sizeof(devnull)) {
+            break;
+        }
     }
 
-    if (nread == -1) {
+    if (nread == -1 && !is_blocking(GetLastNetworkError())) {
         log_socket_error(EXTENSION_LOG_WARNING, NULL,
                          "Can't read from libevent pipe: %s");
     }
+    return total;
+#endif
+}
+
+static void count_accept(LIBEVENT_THREAD* me, hrtime_t accepted,
+                         bool reuseport) {
+    auto& counters = thread_accept_stats[me->index];
+    const hrtime_t latency = gethrtime() - accepted;
+
+    counters.accepted++;
+    if (reuseport) {
+        counters.reuseport_accepted++;
+    }
+    counters.latency_ns += latency;
+    counters.max_latency_ns.setIfGreater(latency);
 }
 
 void dispatch_new_connections(LIBEVENT_THREAD* me) {
@@ -270,10 +382,151 @@ void dispatch_new_connections(LIBEVENT_THREAD* me) {
             LOG_WARNING(nullptr, "Failed to dispatch event for socket %ld",
                         long(item->sfd));
             safe_close(item->sfd);
+            thread_loads[me->index].connections--;
+        } else if (item->accepted != 0) {
+            count_accept(me, item->accepted, false);
         }
     }
 }
 
+/*
+ * Creates the connection for a client accepted by a worker thread on one
+ * of its own SO_REUSEPORT sockets. This is only ever called from the
+ * worker thread itself, so there is no need to go through its queue.
+ */
+void accept_conn_new(LIBEVENT_THREAD* me, SOCKET sfd, int parent_port,
+                     hrtime_t accepted) {
+    Connection* c = conn_new(sfd, parent_port, me->base, me);
+    if (c == nullptr) {
+        LOG_WARNING(nullptr, "Failed to create connection for socket %ld",
+                    long(sfd));
+        safe_close(sfd);
+        return;
+    }
+
+    MEMCACHED_CONN_DISPATCH(sfd, (uintptr_t)me->thread_id);
+    thread_loads[me->index].connections++;
+    count_accept(me, accepted, true);
+}
+
+/* The total ops/sec and clients of the worker threads */
+struct load_totals {
+    uint64_t ops_per_sec;
+    uint64_t connections;
+};
+
+static load_totals thread_load_totals(void) {
+    load_totals totals = {0, 0};
+    for (int ii = 0; ii < nthreads; ++ii) {
+        const int connections = thread_loads[ii].connections;
+        totals.ops_per_sec += thread_loads[ii].ops_per_sec;
+        totals.connections += uint64_t(std::max(connections, 0));
+    }
+    return totals;
+}
+
+/*
+ * The load of a worker thread as a single number: its share (per mille)
+ * of the ops/sec executed by all of the threads plus its share of the
+ * clients. Both terms are relative, so neither of them outweighs the other
+ * however busy the server is. The loop lag isn't part of it: it stays at
+ * zero until a thread is saturated, and its share would swing on noise.
+ */
+static uint64_t thread_load_score(int index, const load_totals& totals) {
+    const auto& load = thread_loads[index];
+    const int connections = load.connections;
+
+    return load.ops_per_sec * 1000 / std::max(totals.ops_per_sec, uint64_t(1)) +
+           uint64_t(std::max(connections, 0)) * 1000 /
+           std::max(totals.connections, uint64_t(1));
+}
+
+/*
+ * Move an idle client from this thread over to the least loaded thread if
+ * we're a lot busier than it. The client is run from the pending io list
+ * of the other thread, which registers it in its event base.
+ */
+static void migrate_idle_connection(LIBEVENT_THREAD *me) {
+    if (thread_loads[me->index].ops_per_sec < LOAD_MIGRATE_MIN_OPS) {
+        return;
+    }
+
+    const load_totals totals = thread_load_totals();
+    int target = -1;
+    uint64_t least = 0;
+    for (int ii = 0; ii < nthreads; ++ii) {
+        if (ii != me->index) {
+            const uint64_t score = thread_load_score(ii, totals);
+            if (target == -1 || score < least) {
+                target = ii;
+                least = score;
+            }
+        }
+    }
+
+    if (target == -1 || thread_load_score(me->index, totals) < least * 2) {
+        return;
+    }
+
+    LIBEVENT_THREAD* thread = threads + target;
+    LOCK_THREAD(me);
+    Connection* c = conn_migrate_idle(me, thread);
+    UNLOCK_THREAD(me);
+    if (c == nullptr) {
+        return;
+    }
+
+    thread_loads[me->index].connections--;
+    thread_loads[me->index].migrated_out++;
+    thread_loads[target].connections++;
+    thread_loads[target].migrated_in++;
+
+    LOCK_THREAD(thread);
+    const int notify = add_conn_to_pending_io_list(c);
+    UNLOCK_THREAD(thread);
+    if (notify) {
+        notify_thread(thread);
+    }
+}
+
+/*
+ * Measures how late the event loop runs the timer, and every
+ * LOAD_RATE_TICKS the ops rate of the thread (and try to move an idle
+ * client away if we're too busy).
+ */
+static void thread_load_tick(evutil_socket_t, short, void *arg) {
+    auto* me = reinterpret_cast<LIBEVENT_THREAD*>(arg);
+    auto& load = thread_loads[me->index];
+    const hrtime_t now = gethrtime();
+    const hrtime_t due = me->load_timer_set + LOAD_INTERVAL_MS * 1000000ULL;
+    const uint64_t lag = now > due ? (now - due) / 1000 : 0;
+
+    load.loop_lag_usec = (load.loop_lag_usec * 7 + lag) / 8;
+    load.max_loop_lag_usec.setIfGreater(lag);
+
+    if (++me->load_ticks % LOAD_RATE_TICKS == 0) {
+        const uint64_t ops = load.ops;
+        load.ops_per_sec = (ops - me->load_rate_ops) * 1000000000ULL /
+                           (now - me->load_rate_start);
+        me->load_rate_ops = ops;
+        me->load_rate_start = now;
+
+        if (settings.isConnectionMigration() && !memcached_shutdown) {
+            migrate_idle_connection(me);
+        }
+    }
+
+    add_load_timer(me);
+}
+
+void thread_load_count_op(LIBEVENT_THREAD *thread) {
+    thread_loads[thread->index].ops++;
+}
+
+void thread_connection_closed(LIBEVENT_THREAD *thread) {
+    thread_loads[thread->index].connections--;
+}
+
 /*
  * Processes an incoming "handle a new connection" item. This is called when
  * input arrives on the libevent wakeup pipe.
@@ -282,12 +535,17 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
     LIBEVENT_THREAD* me = reinterpret_cast<LIBEVENT_THREAD*>(arg);
 
     cb_assert(me->type == ThreadType::GENERAL);
-    // Start by draining the notification channel before doing any work.
-    // By doing so we know that we'll be notified again if someone
-    // tries to notify us while we're doing the work below (so we don't have
-    // to care about race conditions for stuff people try to notify us
-    // about.
+    // Start by draining the notification channel and then clearing the
+    // pending flag before doing any work. By doing so we know that we'll
+    // be notified again if someone tries to notify us while we're doing
+    // the work below (so we don't have to care about race conditions for
+    // stuff people try to notify us about). The order matters: if the
+    // flag was cleared first, a notification sent in between would be
+    // drained while leaving the flag set, and no one would ever write to
+    // the channel again.
     drain_notification_channel(fd);
+    me->notify_pending.store(false);
+    thread_notify_stats[me->index].wakeups++;
 
     if (memcached_shutdown) {
         // Someone requested memcached to shut down. The listen thread should
@@ -307,14 +565,21 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
 
     dispatch_new_connections(me);
 
+    if (me->update_listen.exchange(false)) {
+        update_listen_connections(me);
+    }
+
     LOCK_THREAD(me);
     Connection* pending = me->pending_io;
     me->pending_io = NULL;
+    uint64_t npending = 0;
     while (pending != NULL) {
         Connection *c = pending;
         cb_assert(me == c->getThread());
         pending = pending->getNext();
         c->setNext(nullptr);
+        c->setPendingIo(false);
+        ++npending;
 
         auto *mcbp = dynamic_cast<McbpConnection*>(c);
         if (mcbp != nullptr) {
@@ -335,6 +600,12 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
         run_event_loop(c, EV_READ|EV_WRITE);
     }
 
+    if (npending > 0) {
+        auto& counters = thread_notify_stats[me->index];
+        counters.pending_io += npending;
+        counters.max_pending_io.setIfGreater(npending);
+    }
+
     /*
      * I could look at all of the connection objects bound to dying buckets
      */
@@ -362,23 +633,6 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
 
 extern volatile rel_time_t current_time;
 
-static bool has_cycle(Connection *c) {
-    Connection *slowNode, *fastNode1, *fastNode2;
-
-    if (!c) {
-        return false;
-    }
-
-    slowNode = fastNode1 = fastNode2 = c;
-    while (slowNode && (fastNode1 = fastNode2->getNext()) && (fastNode2 = fastNode1->getNext())) {
-        if (slowNode == fastNode1 || slowNode == fastNode2) {
-            return true;
-        }
-        slowNode = slowNode->getNext();
-    }
-    return false;
-}
-
 bool list_contains(Connection *haystack, Connection *needle) {
     for (; haystack; haystack = haystack->getNext()) {
         if (needle == haystack) {
@@ -389,30 +643,29 @@ bool list_contains(Connection *haystack, Connection *needle) {
 }
 
 Connection * list_remove(Connection *haystack, Connection *needle) {
-    if (!haystack) {
-        return NULL;
-    }
-
     if (haystack == needle) {
         Connection *rv = needle->getNext();
         needle->setNext(nullptr);
         return rv;
     }
 
-    haystack->setNext(list_remove(haystack->getNext(), needle));
+    for (Connection *c = haystack; c; c = c->getNext()) {
+        if (c->getNext() == needle) {
+            c->setNext(needle->getNext());
+            needle->setNext(nullptr);
+            break;
+        }
+    }
 
     return haystack;
 }
 
-static void enlist_conn(Connection *c, Connection **list) {
-    LIBEVENT_THREAD *thr = c->getThread();
-    cb_assert(list == &thr->pending_io);
-    cb_assert(!list_contains(thr->pending_io, c));
-    cb_assert(c->getNext() == nullptr);
-    c->setNext(*list);
-    *list = c;
-    cb_assert(list_contains(*list, c));
-    cb_assert(!has_cycle(*list));
+void remove_conn_from_pending_io_list(Connection *c) {
+    if (c->isPendingIo()) {
+        auto thread = c->getThread();
+        thread->pending_io = list_remove(thread->pending_io, c);
+        c->setPendingIo(false);
+    }
 }
 
 void notify_io_complete(const void *void_cookie, ENGINE_ERROR_CODE status)
@@ -444,6 +697,8 @@ void notify_io_complete(const void *void_cookie, ENGINE_ERROR_CODE status)
         LOG_DEBUG(NULL, "Got notify from %u, status 0x%x",
                   connection->getId(), status);
 
+        thread_notify_stats[thr->index].io_completions++;
+
         LOCK_THREAD(thr);
         reinterpret_cast<McbpConnection*>(connection)->setAiostat(status);
         notify = add_conn_to_pending_io_list(connection);
@@ -465,14 +720,28 @@ static int last_thread = -1;
  * Dispatches a new connection to another thread. This is only ever called
  * from the main thread, or because of an incoming connection.
  */
-void dispatch_conn_new(SOCKET sfd, int parent_port) {
-    int tid = (last_thread + 1) % settings.getNumWorkerThreads();
+void dispatch_conn_new(SOCKET sfd, int parent_port, hrtime_t accepted) {
+    // Pick the least loaded thread. Start looking after the thread we
+    // picked last time so that the clients are spread round-robin across
+    // threads with the same load.
+    const int num = settings.getNumWorkerThreads();
+    const load_totals totals = thread_load_totals();
+    int tid = -1;
+    uint64_t least = 0;
+    for (int ii = 1; ii <= num; ++ii) {
+        const int candidate = (last_thread + ii) % num;
+        const uint64_t score = thread_load_score(candidate, totals);
+        if (tid == -1 || score < least) {
+            tid = candidate;
+            least = score;
+        }
+    }
     LIBEVENT_THREAD* thread = threads + tid;
     last_thread = tid;
 
     try {
         std::unique_ptr<ConnectionQueueItem> item(
-            new ConnectionQueueItem(sfd, parent_port));
+            new ConnectionQueueItem(sfd, parent_port, accepted));
         thread->new_conn_queue->push(item);
     } catch (std::bad_alloc& e) {
         LOG_WARNING(nullptr,
@@ -482,6 +751,9 @@ void dispatch_conn_new(SOCKET sfd, int parent_port) {
         return ;
     }
 
+    // Count it right away so that a burst of clients is spread
+    // across the threads
+    thread_loads[tid].connections++;
     MEMCACHED_CONN_DISPATCH(sfd, (uintptr_t)thread->thread_id);
     notify_thread(thread);
 }
@@ -497,6 +769,11 @@ void notify_dispatcher(void) {
     notify_thread(&dispatcher_thread);
 }
 
+LIBEVENT_THREAD* get_worker_thread(int index) {
+    cb_assert(index >= 0 && index < nthreads);
+    return threads + index;
+}
+
 /******************************* GLOBAL STATS ******************************/
 
 void threadlocal_stats_reset(struct thread_stats *thread_stats) {
@@ -505,6 +782,55 @@ void threadlocal_stats_reset(struct thread_stats *thread_stats) {
     }
 }
 
+const struct accept_stats& threads_accept_stats(int index) {
+    cb_assert(index >= 0 && index < nthreads);
+    return thread_accept_stats[index];
+}
+
+void threads_accept_stats_reset(void) {
+    for (int ii = 0; ii < nthreads; ++ii) {
+        thread_accept_stats[ii].reset();
+    }
+}
+
+const struct thread_load& threads_load(int index) {
+    cb_assert(index >= 0 && index < nthreads);
+    return thread_loads[index];
+}
+
+void threads_load_reset(void) {
+    for (int ii = 0; ii < nthreads; ++ii) {
+        thread_loads[ii].reset();
+    }
+}
+
+const struct notify_stats& threads_notify_stats(int index) {
+    cb_assert(index >= 0 && index < nthreads);
+    return thread_notify_stats[index];
+}
+
+void threads_notify_stats_reset(void) {
+    for (int ii = 0; ii < nthreads; ++ii) {
+        thread_notify_stats[ii].reset();
+    }
+}
+
+const struct io_uring_stats* threads_io_uring_stats(int index) {
+    cb_assert(index >= 0 && index < nthreads);
+    if (threads[index].io_uring == nullptr) {
+        return nullptr;
+    }
+    return &threads[index].io_uring->getStats();
+}
+
+void threads_io_uring_stats_reset(void) {
+    for (int ii = 0; ii < nthreads; ++ii) {
+        if (threads[ii].io_uring != nullptr) {
+            threads[ii].io_uring->resetStats();
+        }
+    }
+}
+
 /*
  * Initializes the thread subsystem, creating various worker threads.
  *
@@ -520,15 +846,24 @@ void thread_init(int nthr, struct event_base *main_base,
     cb_mutex_initialize(&init_lock);
     cb_cond_initialize(&init_cond);
 
-    threads = reinterpret_cast<LIBEVENT_THREAD*>(calloc(nthreads,
-                                                        sizeof(LIBEVENT_THREAD)));
-    if (threads == nullptr) {
+    try {
+        // Value-initialize the descriptors (they hold a std::atomic, so
+        // they can't be calloc'ed)
+        threads = new LIBEVENT_THREAD[nthreads]();
+    } catch (std::bad_alloc&) {
         FATAL_ERROR(EXIT_FAILURE, "Can't allocate thread descriptors");
     }
     thread_ids = reinterpret_cast<cb_thread_t*>(calloc(nthreads, sizeof(cb_thread_t)));
     if (thread_ids == nullptr) {
         FATAL_ERROR(EXIT_FAILURE, "Can't allocate thread descriptors");
     }
+    try {
+        thread_accept_stats = new accept_stats[nthreads];
+        thread_loads = new thread_load[nthreads];
+        thread_notify_stats = new notify_stats[nthreads];
+    } catch (std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE, "Can't allocate thread stats");
+    }
 
     setup_dispatcher(main_base, dispatcher_callback);
 
@@ -570,11 +905,11 @@ void threads_cleanup(void)
 {
     int ii;
     for (ii = 0; ii < nthreads; ++ii) {
-        safe_close(threads[ii].notify[0]);
-        safe_close(threads[ii].notify[1]);
+        close_notification_pipe(&threads[ii]);
+        delete threads[ii].io_uring;
         event_base_free(threads[ii].base);
 
-        free(threads[ii].read.buf);
+        delete threads[ii].read_buffers;
         free(threads[ii].write.buf);
         subdoc_op_free(threads[ii].subdoc_op);
         delete threads[ii].validator;
@@ -582,7 +917,10 @@ void threads_cleanup(void)
     }
 
     free(thread_ids);
-    free(threads);
+    delete []threads;
+    delete []thread_accept_stats;
+    delete []thread_loads;
+    delete []thread_notify_stats;
 }
 
 void threads_notify_bucket_deletion(void)
@@ -593,6 +931,28 @@ void threads_notify_bucket_deletion(void)
     }
 }
 
+/*
+ * Have the threads owning listen connections (the dispatcher, and the
+ * workers accepting on reuseport sockets) update them to the new listen
+ * state. The calling thread (me, or nullptr for the dispatcher) updates
+ * its own listen connections right away.
+ */
+void threads_notify_listen_state(LIBEVENT_THREAD* me)
+{
+    update_listen_connections(me);
+    if (me != nullptr) {
+        dispatcher_thread.update_listen.store(true);
+        notify_dispatcher();
+    }
+    for (int ii = 0; ii < nthreads; ++ii) {
+        LIBEVENT_THREAD *thr = threads + ii;
+        if (thr != me) {
+            thr->update_listen.store(true);
+            notify_thread(thr);
+        }
+    }
+}
+
 void threads_complete_bucket_deletion(void)
 {
     for (int ii = 0; ii < nthreads; ++ii) {
@@ -613,22 +973,50 @@ void threads_initiate_bucket_deletion(void)
     }
 }
 
+/*
+ * Wakes up the thread. A worker thread is only written to if it isn't
+ * already about to wake up, so any number of notifications sent before
+ * it gets to run costs a single write (and a single wakeup). The
+ * dispatcher counts the notifications it gets, so it's written to every
+ * time.
+ */
 void notify_thread(LIBEVENT_THREAD *thread) {
+    if (thread->type == ThreadType::GENERAL) {
+        auto& counters = thread_notify_stats[thread->index];
+        counters.notifications++;
+        if (thread->notify_pending.exchange(true)) {
+            return;
+        }
+        counters.notify_writes++;
+    }
+
+#ifdef HAVE_SYS_EVENTFD_H
+    if (eventfd_write(thread->notify[1], 1) == -1) {
+        log_system_error(EXTENSION_LOG_WARNING, NULL,
+                         "Failed to notify thread: %s");
+        thread->notify_pending.store(false);
+    }
+#else
     if (send(thread->notify[1], "", 1, 0) != 1 &&
             !is_blocking(GetLastNetworkError())) {
         log_socket_error(EXTENSION_LOG_WARNING, NULL,
                          "Failed to notify thread: %s");
+        thread->notify_pending.store(false);
     }
+#endif
 }
 
 int add_conn_to_pending_io_list(Connection *c) {
     int notify = 0;
     auto thread = c->getThread();
-    if (number_of_pending(c, thread->pending_io) == 0) {
+    if (!c->isPendingIo()) {
+        cb_assert(c->getNext() == nullptr);
         if (thread->pending_io == NULL) {
             notify = 1;
         }
-        enlist_conn(c, &thread->pending_io);
+        c->setNext(thread->pending_io);
+        thread->pending_io = c;
+        c->setPendingIo(true);
     }
 
     return notify;
@@ -2,264 +2,788 @@
 /*
  * Hash table
  *
+ * Every bucket (engine instance) owns its own hash table. Modifications
+ * of the table are serialised by an array of lock stripes so that
+ * operations on different keys don't contend with each other.
+ *
+ * Each bucket is a cache line holding the tags and pointers of the first
+ * few items in it (see struct assoc_bucket). The items carry their full
+ * hash, so a rehash doesn't need to look at the keys.
+ *
+ * Lookups may also be performed without any locks (see
+ * assoc_find_optimistic). Each stripe carries a sequence number which is
+ * odd while the stripe is being modified, so a reader knows that the
+ * result of a lookup is valid if the sequence number didn't change
+ * while it looked. The items are never unmapped (they live in the slab
+ * pages), but the old table is freed after an expansion and slab pages
+ * may be handed to another slab class. That is only done after all
+ * readers which may have seen them have left (assoc_wait_for_readers).
  */
 #include "config.h"
 #include <fcntl.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <platform/platform.h>
-#include <platform/crc32c.h>
 
 #include "default_engine_internal.h"
+#include "atomics.h"
 
 #define hashsize(n) ((size_t)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
-/* One hashtable for all */
-static struct assoc* global_assoc = NULL;
+#define stripe_index(hash) ((hash) & (ASSOC_LOCK_STRIPES - 1))
+
+/* The position of an (old) bucket within the buckets of its stripe */
+#define stripe_position(bucket) ((bucket) / ASSOC_LOCK_STRIPES)
+
+static void assoc_maintenance_thread(void *arg);
+
+/*
+ * Allocate a zeroed table of 2^hashpower buckets aligned to a cache line.
+ * The pointer returned by calloc is stored right in front of the table.
+ */
+static struct assoc_bucket *assoc_table_alloc(unsigned int hashpower) {
+    char *ptr = calloc(1, hashsize(hashpower) * sizeof(struct assoc_bucket) +
+                       ASSOC_BUCKET_ALIGN);
+    struct assoc_bucket *table;
+    if (ptr == NULL) {
+        return NULL;
+    }
+    table = (void*)(((uintptr_t)ptr + ASSOC_BUCKET_ALIGN) &
+                    ~(uintptr_t)(ASSOC_BUCKET_ALIGN - 1));
+    ((void**)table)[-1] = ptr;
+    return table;
+}
+
+static void assoc_table_free(struct assoc_bucket *table) {
+    if (table != NULL) {
+        free(((void**)table)[-1]);
+    }
+}
+
+/* The tag of an item in a bucket. Zero is reserved for empty slots */
+static CB_INLINE uint8_t hash_tag(uint32_t hash) {
+    uint8_t tag = (uint8_t)(hash >> 24);
+    return tag ? tag : 1;
+}
+
+/*
+ * Compare all the tags in the bucket at once (SWAR). Sets the high bit
+ * in matches[ii] if the tag in slot ii may be a match; false positives
+ * are possible (and harmless, the items are verified anyway).
+ * Returns false if there is no match at all.
+ */
+static CB_INLINE bool assoc_match_tags(const struct assoc_bucket *bucket,
+                                       uint8_t tag, uint8_t matches[8]) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    uint64_t word;
+    memcpy(&word, bucket->tags, sizeof(word));
+    word ^= ones * tag;
+    /* the high bit of every byte which is zero is set */
+    word = (word - ones) & ~word & (ones << 7);
+    memcpy(matches, &word, sizeof(word));
+    return word != 0;
+}
+
+/* Does the item have the given hash and key? */
+static CB_INLINE bool assoc_item_matches(const hash_item *it, uint32_t hash,
+                                         const void *key, uint16_t nkey) {
+    return it->hash == hash && it->nkey == nkey &&
+        memcmp(key, item_get_key(it), nkey) == 0;
+}
+
+/*
+ * Add the item to the bucket. Returns true if it went to the overflow
+ * chain.
+ */
+static bool assoc_bucket_insert(struct assoc_bucket *bucket, hash_item *it) {
+    int ii;
+    for (ii = 0; ii < ASSOC_BUCKET_SLOTS; ++ii) {
+        if (bucket->slots[ii] == NULL) {
+            it->h_next = NULL;
+            bucket->slots[ii] = it;
+            bucket->tags[ii] = hash_tag(it->hash);
+            return false;
+        }
+    }
+    it->h_next = bucket->overflow;
+    bucket->overflow = it;
+    return true;
+}
 
 /* assoc factory. returns one new assoc or NULL if out-of-memory */
-static struct assoc* assoc_consruct(int hashpower) {
+static struct assoc* assoc_construct(int hashpower) {
     struct assoc* new_assoc = NULL;
     new_assoc = calloc(1, sizeof(struct assoc));
     if (new_assoc) {
+        int ii;
         new_assoc->hashpower = hashpower;
-        cb_mutex_initialize(&new_assoc->lock);
-        new_assoc->primary_hashtable = calloc(hashsize(hashpower),
-                                              sizeof(hash_item*));
+        new_assoc->primary_hashtable = assoc_table_alloc(hashpower);
 
         if (new_assoc->primary_hashtable == NULL) {
             /* rollback and return NULL */
             free(new_assoc);
-            new_assoc = NULL;
+            return NULL;
+        }
+
+        cb_mutex_initialize(&new_assoc->expand_lock);
+        cb_mutex_initialize(&new_assoc->readers_lock);
+        for (ii = 0; ii < ASSOC_LOCK_STRIPES; ++ii) {
+            cb_mutex_initialize(&new_assoc->stripes[ii].lock);
         }
     }
     return new_assoc;
 }
 
+/*
+ * Size the table so that the expected number of items don't trigger an
+ * expansion (see assoc_insert)
+ */
+static int assoc_initial_hashpower(struct default_engine *engine) {
+    size_t nitems = engine->config.expected_items;
+    int hashpower = ASSOC_DEFAULT_HASHPOWER;
+
+    if (nitems == 0) {
+        nitems = engine->config.maxbytes / ASSOC_ESTIMATED_ITEM_SIZE;
+    }
+
+    while (hashpower < ASSOC_MAX_HASHPOWER &&
+           hashsize(hashpower) * ASSOC_MAX_LOAD < nitems) {
+        ++hashpower;
+    }
+    return hashpower;
+}
+
 ENGINE_ERROR_CODE assoc_init(struct default_engine *engine) {
+    engine->assoc = assoc_construct(assoc_initial_hashpower(engine));
+    return (engine->assoc != NULL) ? ENGINE_SUCCESS : ENGINE_ENOMEM;
+}
+
+void assoc_destroy(struct default_engine *engine) {
+    struct assoc *assoc = engine->assoc;
+    int ii;
+
+    if (assoc == NULL) {
+        return;
+    }
 
     /*
-        construct and save away one assoc for use by all buckets.
-        For flexibility, the assoc code accesses the assoc via the engine handle.
-    */
-    if (global_assoc == NULL) {
-        global_assoc = assoc_consruct(16);
+     * Wait for a running expansion to complete. Nobody may access the
+     * engine at this point, so no new expansions may be scheduled.
+     */
+    if (assoc->expand_tid_valid) {
+        cb_join_thread(assoc->expand_tid);
+        assoc->expand_tid_valid = false;
     }
-    engine->assoc = global_assoc;
-    return (engine->assoc != NULL) ? ENGINE_SUCCESS : ENGINE_ENOMEM;
+
+    for (ii = 0; ii < ASSOC_LOCK_STRIPES; ++ii) {
+        cb_mutex_destroy(&assoc->stripes[ii].lock);
+    }
+    cb_mutex_destroy(&assoc->expand_lock);
+    cb_mutex_destroy(&assoc->readers_lock);
+    assoc_table_free(assoc->old_hashtable);
+    assoc_table_free(assoc->primary_hashtable);
+    free(assoc);
+    engine->assoc = NULL;
 }
 
-void assoc_destroy() {
-    if (global_assoc != NULL) {
-        while (global_assoc->expanding) {
-            usleep(250);
+static void stripe_write_begin(struct assoc_stripe *stripe) {
+    cb_mutex_enter(&stripe->lock);
+    de_atomic_store(&stripe->seq, stripe->seq + 1);
+    /* Readers bump the refcount before they read the sequence number */
+    de_memory_barrier();
+}
+
+static void stripe_write_end(struct assoc_stripe *stripe) {
+    de_write_barrier();
+    de_atomic_store(&stripe->seq, stripe->seq + 1);
+    cb_mutex_exit(&stripe->lock);
+}
+
+static void assoc_lock_all(struct assoc *assoc) {
+    int ii;
+    for (ii = 0; ii < ASSOC_LOCK_STRIPES; ++ii) {
+        stripe_write_begin(&assoc->stripes[ii]);
+    }
+}
+
+static void assoc_unlock_all(struct assoc *assoc) {
+    int ii;
+    for (ii = ASSOC_LOCK_STRIPES - 1; ii >= 0; --ii) {
+        stripe_write_end(&assoc->stripes[ii]);
+    }
+}
+
+void assoc_write_begin(struct default_engine *engine, uint32_t hash) {
+    stripe_write_begin(&engine->assoc->stripes[stripe_index(hash)]);
+}
+
+void assoc_write_end(struct default_engine *engine, uint32_t hash) {
+    stripe_write_end(&engine->assoc->stripes[stripe_index(hash)]);
+}
+
+struct assoc_reader *assoc_reader_enter(struct default_engine *engine) {
+    struct assoc *assoc = engine->assoc;
+    uintptr_t id = (uintptr_t)cb_thread_self();
+    const unsigned int slot = ((id >> 4) ^ (id >> 12)) & (ASSOC_READER_SLOTS - 1);
+    for (;;) {
+        const uint32_t phase = de_atomic_load(&assoc->reader_phase);
+        struct assoc_reader *reader = &assoc->readers[phase][slot];
+        /* full barrier; the phase and table pointers must be read after this */
+        de_atomic_incr_64(&reader->active);
+        if (de_atomic_load(&assoc->reader_phase) == phase) {
+            return reader;
         }
-        free(global_assoc->primary_hashtable);
-        free(global_assoc);
-        global_assoc = NULL;
+        /*
+         * The phase was flipped under our feet and the waiter may already
+         * have seen the slot empty; join the new phase instead.
+         */
+        de_atomic_decr_64(&reader->active);
     }
 }
 
-hash_item *assoc_find(struct default_engine *engine, uint32_t hash, const hash_key *key) {
-    hash_item *it;
+void assoc_reader_exit(struct assoc_reader *reader) {
+    de_atomic_decr_64(&reader->active);
+}
+
+/*
+ * Wait until no optimistic reader may reference a table (or an item)
+ * unpublished before the call. The readers present when we're called are
+ * all in the current phase, so flip it and wait for the slots of the old
+ * phase to drain. Readers arriving meanwhile join the new phase, so a
+ * busy slot can't keep us waiting forever; the readers only spend a few
+ * hundred nanoseconds in the table so that happens quickly.
+ */
+void assoc_wait_for_readers(struct default_engine *engine) {
+    struct assoc *assoc = engine->assoc;
+    uint32_t phase;
+    int ii;
+
+    cb_mutex_enter(&assoc->readers_lock);
+    phase = assoc->reader_phase;
+    de_atomic_store(&assoc->reader_phase, phase ^ 1);
+    /* the store must be visible before we look at the slots */
+    de_memory_barrier();
+    for (ii = 0; ii < ASSOC_READER_SLOTS; ++ii) {
+        struct assoc_reader *reader = &assoc->readers[phase][ii];
+        while (de_atomic_load(&reader->active) != 0) {
+            usleep(10);
+        }
+    }
+    cb_mutex_exit(&assoc->readers_lock);
+}
+
+/*
+    returns the bucket the hash belongs to.
+    The stripe lock for the hash is assumed to be held by the caller.
+*/
+static struct assoc_bucket* assoc_get_bucket(struct assoc *assoc, uint32_t hash) {
     unsigned int oldbucket;
-    hash_item *ret = NULL;
-    int depth = 0;
-    cb_mutex_enter(&engine->assoc->lock);
-    if (engine->assoc->expanding &&
-        (oldbucket = (hash & hashmask(engine->assoc->hashpower - 1))) >= engine->assoc->expand_bucket)
+
+    if (assoc->expanding &&
+        stripe_position(oldbucket = (hash & hashmask(assoc->hashpower - 1))) >=
+        assoc->stripes[stripe_index(hash)].expand_bucket)
     {
-        it = engine->assoc->old_hashtable[oldbucket];
-    } else {
-        it = engine->assoc->primary_hashtable[hash & hashmask(engine->assoc->hashpower)];
+        return &assoc->old_hashtable[oldbucket];
     }
+    return &assoc->primary_hashtable[hash & hashmask(assoc->hashpower)];
+}
 
-    while (it) {
-        const hash_key* it_key = item_get_key(it);
-        if ((hash_key_get_key_len(key) == hash_key_get_key_len(it_key)) &&
-            (memcmp(hash_key_get_key(key),
-                    hash_key_get_key(it_key),
-                    hash_key_get_key_len(key)) == 0)) {
-            ret = it;
-            break;
+/*
+    returns the address of the pointer to the item with the key in the
+    bucket (a slot or a link in the overflow chain), or NULL if the key
+    isn't there.
+    The stripe lock for the hash is assumed to be held by the caller.
+*/
+static hash_item** assoc_bucket_find(struct assoc_bucket *bucket,
+                                     uint32_t hash, const void *key,
+                                     uint16_t nkey, int *depth) {
+    uint8_t matches[8];
+    hash_item **pos;
+    int ii;
+
+    if (assoc_match_tags(bucket, hash_tag(hash), matches)) {
+        for (ii = 0; ii < ASSOC_BUCKET_SLOTS; ++ii) {
+            if ((matches[ii] & 0x80) && bucket->slots[ii] != NULL) {
+                ++*depth;
+                if (assoc_item_matches(bucket->slots[ii], hash, key, nkey)) {
+                    return &bucket->slots[ii];
+                }
+            }
         }
-        it = it->h_next;
-        ++depth;
     }
-    MEMCACHED_ASSOC_FIND(hash_key_get_key(key), hash_key_get_key_len(key), depth);
-    cb_mutex_exit(&engine->assoc->lock);
+
+    for (pos = &bucket->overflow; *pos != NULL; pos = &(*pos)->h_next) {
+        ++*depth;
+        if (assoc_item_matches(*pos, hash, key, nkey)) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+hash_item *assoc_find(struct default_engine *engine, uint32_t hash,
+                      const void *key, uint16_t nkey) {
+    struct assoc *assoc = engine->assoc;
+    cb_mutex_t *lock = &assoc->stripes[stripe_index(hash)].lock;
+    hash_item **pos;
+    hash_item *ret = NULL;
+    int depth = 0;
+
+    cb_mutex_enter(lock);
+    pos = assoc_bucket_find(assoc_get_bucket(assoc, hash), hash, key, nkey,
+                            &depth);
+    if (pos != NULL) {
+        ret = *pos;
+    }
+    MEMCACHED_ASSOC_FIND(key, nkey, depth);
+    cb_mutex_exit(lock);
     return ret;
 }
 
+bool assoc_contains(struct default_engine *engine, uint32_t hash,
+                    const hash_item *it) {
+    struct assoc *assoc = engine->assoc;
+    cb_mutex_t *lock = &assoc->stripes[stripe_index(hash)].lock;
+    struct assoc_bucket *bucket;
+    const hash_item *pos;
+    bool found = false;
+    int ii;
+
+    cb_mutex_enter(lock);
+    bucket = assoc_get_bucket(assoc, hash);
+    for (ii = 0; ii < ASSOC_BUCKET_SLOTS && !found; ++ii) {
+        found = bucket->slots[ii] == it;
+    }
+    for (pos = bucket->overflow; pos != NULL && !found; pos = pos->h_next) {
+        found = pos == it;
+    }
+    cb_mutex_exit(lock);
+    return found;
+}
+
+#ifndef USE_SYSTEM_MALLOC
 /*
-    returns the address of the item pointer before the key.  if *item == 0,
-    the item wasn't found
-    assoc->lock is assumed to be held by the caller.
+    returns the bucket the hash belongs to without holding the stripe
+    lock, or false if the table is in a state where we can't tell.
+    The caller must be registered as a reader.
 */
-static hash_item** _hashitem_before(struct default_engine *engine,
-                                    uint32_t hash,
-                                    const hash_key* key) {
-    hash_item **pos;
-    unsigned int oldbucket;
+static bool assoc_get_bucket_optimistic(struct assoc *assoc, uint32_t hash,
+                                        const struct assoc_bucket **bucket) {
+    /* The writer publishes the tables in the opposite order */
+    unsigned int hashpower = de_atomic_load(&assoc->hashpower);
+    struct assoc_bucket *primary = de_atomic_load(&assoc->primary_hashtable);
+
+    if (de_atomic_load(&assoc->expanding)) {
+        struct assoc_bucket *old = de_atomic_load(&assoc->old_hashtable);
+        unsigned int oldbucket = hash & hashmask(hashpower - 1);
+        if (old == NULL) {
+            return false;
+        }
+        if (stripe_position(oldbucket) >=
+            assoc->stripes[stripe_index(hash)].expand_bucket) {
+            *bucket = &old[oldbucket];
+            return true;
+        }
+    }
+    *bucket = &primary[hash & hashmask(hashpower)];
+    return true;
+}
 
-    if (engine->assoc->expanding &&
-        (oldbucket = (hash & hashmask(engine->assoc->hashpower - 1))) >= engine->assoc->expand_bucket)
-    {
-        pos = &engine->assoc->old_hashtable[oldbucket];
-    } else {
-        pos = &engine->assoc->primary_hashtable[hash & hashmask(engine->assoc->hashpower)];
+/*
+    Lock free version of assoc_bucket_find. Everything we look at may
+    change under our feet, so make sure we don't loop forever.
+*/
+static bool assoc_bucket_find_optimistic(const struct assoc_bucket *bucket,
+                                         uint32_t hash, const void *key,
+                                         uint16_t nkey, hash_item **item) {
+    uint8_t matches[8];
+    hash_item *it;
+    int ii;
+
+    if (assoc_match_tags(bucket, hash_tag(hash), matches)) {
+        for (ii = 0; ii < ASSOC_BUCKET_SLOTS; ++ii) {
+            if (matches[ii] & 0x80) {
+                it = bucket->slots[ii];
+                if (it != NULL && assoc_item_matches(it, hash, key, nkey)) {
+                    *item = it;
+                    return true;
+                }
+            }
+        }
     }
 
-    while (*pos) {
-        const hash_key* pos_key = item_get_key(*pos);
-        if ((hash_key_get_key_len(key) != hash_key_get_key_len(pos_key)) ||
-            (memcmp(hash_key_get_key(key),
-                    hash_key_get_key(pos_key),
-                    hash_key_get_key_len(key)))) {
-             pos = &(*pos)->h_next;
-        } else {
+    it = bucket->overflow;
+    for (ii = 0; it != NULL && ii < ASSOC_MAX_OPTIMISTIC_DEPTH; ++ii) {
+        if (assoc_item_matches(it, hash, key, nkey)) {
             break;
         }
+        it = it->h_next;
     }
+    if (ii == ASSOC_MAX_OPTIMISTIC_DEPTH) {
+        return false;
+    }
+    *item = it;
+    return true;
+}
+#endif
+
+bool assoc_find_optimistic(struct default_engine *engine, uint32_t hash,
+                           const void *key, uint16_t nkey,
+                           hash_item **item, uint32_t *seq) {
+#ifndef USE_SYSTEM_MALLOC
+    struct assoc *assoc = engine->assoc;
+    struct assoc_stripe *stripe = &assoc->stripes[stripe_index(hash)];
+    const struct assoc_bucket *bucket;
 
-    return pos;
+    /*
+     * The item we look at may be freed and reused while we look at it,
+     * so its key length can't be trusted. The slab pages have room for
+     * a full sized hash_key after the last chunk, so limit ourselves to
+     * keys which fit there.
+     */
+    if (nkey > sizeof(hash_key_sized)) {
+        return false;
+    }
+
+    *seq = de_atomic_load(&stripe->seq);
+    if (*seq & 1) {
+        return false;
+    }
+
+    if (!assoc_get_bucket_optimistic(assoc, hash, &bucket)) {
+        return false;
+    }
+    return assoc_bucket_find_optimistic(bucket, hash, key, nkey, item);
+#else
+    /* The items are returned to the system when they're freed */
+    return false;
+#endif
 }
 
-static void assoc_maintenance_thread(void *arg);
+bool assoc_validate(struct default_engine *engine, uint32_t hash,
+                    uint32_t seq) {
+    struct assoc_stripe *stripe = &engine->assoc->stripes[stripe_index(hash)];
+    de_memory_barrier();
+    return de_atomic_load(&stripe->seq) == seq;
+}
 
 /*
-    grows the hashtable to the next power of 2.
-    assoc->lock is assumed to be held by the caller.
+    Schedule a grow of the hashtable to the next power of 2. The actual
+    work is done by the maintenance thread.
+    No stripe locks may be held by the caller.
 */
 static void assoc_expand(struct default_engine *engine) {
-    engine->assoc->old_hashtable = engine->assoc->primary_hashtable;
-
-    engine->assoc->primary_hashtable = calloc(hashsize(engine->assoc->hashpower + 1),
-                                             sizeof(hash_item *));
-    if (engine->assoc->primary_hashtable) {
-        int ret = 0;
-        cb_thread_t tid;
-
-        engine->assoc->hashpower++;
-        engine->assoc->expanding = true;
-        engine->assoc->expand_bucket = 0;
-
-        /* start a thread to do the expansion */
-        if ((ret = cb_create_named_thread(&tid, assoc_maintenance_thread,
-                                          engine, 1, "mc:assoc_maint")) != 0)
-        {
-            EXTENSION_LOGGER_DESCRIPTOR *logger;
-            logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
-            logger->log(EXTENSION_LOG_WARNING, NULL,
-                        "Can't create thread: %s\n", strerror(ret));
-            engine->assoc->hashpower--;
-            engine->assoc->expanding = false;
-            free(engine->assoc->primary_hashtable);
-            engine->assoc->primary_hashtable = engine->assoc->old_hashtable;
-        }
+    struct assoc *assoc = engine->assoc;
+    int ret;
+
+    cb_mutex_enter(&assoc->expand_lock);
+    if (assoc->expand_started) {
+        cb_mutex_exit(&assoc->expand_lock);
+        return;
+    }
+
+    if (assoc->expand_tid_valid) {
+        /* Reap the thread which ran the previous expansion */
+        cb_join_thread(assoc->expand_tid);
+        assoc->expand_tid_valid = false;
+    }
+
+    /* start a thread to do the expansion */
+    if ((ret = cb_create_named_thread(&assoc->expand_tid,
+                                      assoc_maintenance_thread,
+                                      engine, 0, "mc:assoc_maint")) != 0)
+    {
+        EXTENSION_LOGGER_DESCRIPTOR *logger;
+        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't create thread: %s\n", strerror(ret));
     } else {
-        engine->assoc->primary_hashtable = engine->assoc->old_hashtable;
-        /* Bad news, but we can keep running. */
+        assoc->expand_started = true;
+        assoc->expand_tid_valid = true;
     }
+    cb_mutex_exit(&assoc->expand_lock);
 }
 
 /* Note: this isn't an assoc_update.  The key must not already exist to call this */
 int assoc_insert(struct default_engine *engine, uint32_t hash, hash_item *it) {
-    unsigned int oldbucket;
+    struct assoc *assoc = engine->assoc;
+    struct assoc_stripe *stripe = &assoc->stripes[stripe_index(hash)];
+    unsigned int stripe_items;
+    bool expand;
 
-    cb_assert(assoc_find(engine, hash, item_get_key(it)) == 0);  /* shouldn't have duplicately named things defined */
+    cb_assert(it->hash == hash);
+    cb_assert(assoc_find(engine, hash, item_get_key(it), it->nkey) == 0);  /* shouldn't have duplicately named things defined */
 
-    cb_mutex_enter(&engine->assoc->lock);
-    if (engine->assoc->expanding &&
-        (oldbucket = (hash & hashmask(engine->assoc->hashpower - 1))) >= engine->assoc->expand_bucket)
-    {
-        it->h_next = engine->assoc->old_hashtable[oldbucket];
-        engine->assoc->old_hashtable[oldbucket] = it;
-    } else {
-        it->h_next = engine->assoc->primary_hashtable[hash & hashmask(engine->assoc->hashpower)];
-        engine->assoc->primary_hashtable[hash & hashmask(engine->assoc->hashpower)] = it;
+    stripe_write_begin(stripe);
+    if (assoc_bucket_insert(assoc_get_bucket(assoc, hash), it)) {
+        stripe->overflow++;
     }
 
-    engine->assoc->hash_items++;
-    if (! engine->assoc->expanding && engine->assoc->hash_items > (hashsize(engine->assoc->hashpower) * 3) / 2) {
+    stripe_items = ++stripe->items;
+    /*
+     * Each stripe covers the same share of the buckets, so use the load of
+     * this stripe as the estimate for the load of the entire table.
+     */
+    expand = !assoc->expanding &&
+        stripe_items > (hashsize(assoc->hashpower) / ASSOC_LOCK_STRIPES) * ASSOC_MAX_LOAD;
+    stripe_write_end(stripe);
+
+    if (expand) {
         assoc_expand(engine);
     }
-    cb_mutex_exit(&engine->assoc->lock);
-    MEMCACHED_ASSOC_INSERT(hash_key_get_key(item_get_key(it)), hash_key_get_key_len(item_get_key(it)), engine->assoc->hash_items);
+
+    MEMCACHED_ASSOC_INSERT(item_get_key(it), it->nkey, stripe_items);
     return 1;
 }
 
-void assoc_delete(struct default_engine *engine, uint32_t hash, const hash_key *key) {
-    cb_mutex_enter(&engine->assoc->lock);
-    hash_item **before = _hashitem_before(engine, hash, key);
+void assoc_delete(struct default_engine *engine, uint32_t hash,
+                  const hash_item *item) {
+    struct assoc_stripe *stripe = &engine->assoc->stripes[stripe_index(hash)];
+    struct assoc_bucket *bucket;
+    hash_item **pos;
+    int depth = 0;
+
+    stripe_write_begin(stripe);
+    bucket = assoc_get_bucket(engine->assoc, hash);
+    pos = assoc_bucket_find(bucket, hash, item_get_key(item), item->nkey,
+                            &depth);
 
-    if (*before) {
-        hash_item *nxt;
-        engine->assoc->hash_items--;
+    if (pos != NULL) {
+        hash_item *it = *pos;
+        stripe->items--;
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
-        MEMCACHED_ASSOC_DELETE(hash_key_get_key(key),
-                               hash_key_get_key_len(key),
-                               engine->assoc->hash_items);
-        nxt = (*before)->h_next;
-        (*before)->h_next = 0;   /* probably pointless, but whatever. */
-        *before = nxt;
-        cb_mutex_exit(&engine->assoc->lock);
+        MEMCACHED_ASSOC_DELETE(item_get_key(item), item->nkey,
+                               stripe->items);
+        if (pos >= bucket->slots && pos < bucket->slots + ASSOC_BUCKET_SLOTS) {
+            const ptrdiff_t slot = pos - bucket->slots;
+            /* Keep the slots filled so the overflow chain stays short */
+            hash_item *next = bucket->overflow;
+            if (next != NULL) {
+                bucket->overflow = next->h_next;
+                next->h_next = NULL;
+                bucket->tags[slot] = hash_tag(next->hash);
+                stripe->overflow--;
+            } else {
+                bucket->tags[slot] = 0;
+            }
+            bucket->slots[slot] = next;
+        } else {
+            *pos = it->h_next;
+            stripe->overflow--;
+        }
+        it->h_next = 0;   /* probably pointless, but whatever. */
+        stripe_write_end(stripe);
         return;
     }
-    cb_mutex_exit(&engine->assoc->lock);
+    stripe_write_end(stripe);
     /* Note:  we never actually get here.  the callers don't delete things
        they can't find. */
-    cb_assert(*before != 0);
+    cb_assert(pos != NULL);
 }
 
 
 
-#define DEFAULT_HASH_BULK_MOVE 1
-int hash_bulk_move = DEFAULT_HASH_BULK_MOVE;
-
-static void assoc_maintenance_thread(void *arg) {
-    struct default_engine *engine = arg;
-    bool done = false;
-    do {
-        int ii;
-        cb_mutex_enter(&engine->assoc->lock);
-
-        for (ii = 0; ii < hash_bulk_move && engine->assoc->expanding; ++ii) {
+/*
+    Migrate the old buckets of a stripe to the new table. The stripe lock
+    is released every ASSOC_EXPAND_BATCH buckets to bound the time other
+    users of the stripe have to wait.
+*/
+static void assoc_migrate_stripe(struct assoc *assoc, unsigned int index) {
+    struct assoc_stripe *stripe = &assoc->stripes[index];
+    const unsigned int nbuckets = stripe_position(hashsize(assoc->hashpower - 1));
+
+    while (stripe->expand_bucket < nbuckets) {
+        unsigned int batch;
+
+        stripe_write_begin(stripe);
+        for (batch = 0;
+             batch < ASSOC_EXPAND_BATCH && stripe->expand_bucket < nbuckets;
+             ++batch) {
+            struct assoc_bucket *bucket = &assoc->old_hashtable[index +
+                stripe->expand_bucket * ASSOC_LOCK_STRIPES];
             hash_item *it, *next;
-            int bucket;
+            int ii;
 
-            for (it = engine->assoc->old_hashtable[engine->assoc->expand_bucket];
-                 NULL != it; it = next) {
-                next = it->h_next;
-                const hash_key* key = item_get_key(it);
-                bucket = crc32c(hash_key_get_key(key),
-                                hash_key_get_key_len(key),
-                                0) & hashmask(engine->assoc->hashpower);
-                it->h_next = engine->assoc->primary_hashtable[bucket];
-                engine->assoc->primary_hashtable[bucket] = it;
+            for (ii = 0; ii < ASSOC_BUCKET_SLOTS; ++ii) {
+                if ((it = bucket->slots[ii]) != NULL &&
+                    assoc_bucket_insert(&assoc->primary_hashtable[it->hash & hashmask(assoc->hashpower)], it)) {
+                    stripe->overflow++;
+                }
             }
-
-            engine->assoc->old_hashtable[engine->assoc->expand_bucket] = NULL;
-            engine->assoc->expand_bucket++;
-            if (engine->assoc->expand_bucket == hashsize(engine->assoc->hashpower - 1)) {
-                engine->assoc->expanding = false;
-                free(engine->assoc->old_hashtable);
-                if (engine->config.verbose > 1) {
-                    EXTENSION_LOGGER_DESCRIPTOR *logger;
-                    logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
-                    logger->log(EXTENSION_LOG_INFO, NULL,
-                                "Hash table expansion done\n");
+            for (it = bucket->overflow; NULL != it; it = next) {
+                next = it->h_next;
+                stripe->overflow--;
+                if (assoc_bucket_insert(&assoc->primary_hashtable[it->hash & hashmask(assoc->hashpower)], it)) {
+                    stripe->overflow++;
                 }
             }
+            memset(bucket, 0, sizeof(*bucket));
+            stripe->expand_bucket++;
         }
-        if (!engine->assoc->expanding) {
-            done = true;
+        stripe_write_end(stripe);
+    }
+}
+
+/*
+    Body of the threads performing an expansion: keep migrating stripes
+    until all of them are claimed.
+*/
+static void assoc_migration_thread(void *arg) {
+    struct assoc *assoc = arg;
+
+    for (;;) {
+        unsigned int index;
+        cb_mutex_enter(&assoc->expand_lock);
+        index = assoc->expand_next_stripe++;
+        cb_mutex_exit(&assoc->expand_lock);
+        if (index >= ASSOC_LOCK_STRIPES) {
+            return;
         }
-        cb_mutex_exit(&engine->assoc->lock);
-    } while (!done);
+        assoc_migrate_stripe(assoc, index);
+    }
+}
+
+static void assoc_maintenance_thread(void *arg) {
+    struct default_engine *engine = arg;
+    struct assoc *assoc = engine->assoc;
+    cb_thread_t helpers[ASSOC_EXPAND_THREADS - 1];
+    int nhelpers = 0;
+    struct assoc_bucket *new_table;
+    struct assoc_bucket *old_table;
+    hrtime_t duration;
+    int ii;
+
+    new_table = assoc_table_alloc(assoc->hashpower + 1);
+    if (new_table == NULL) {
+        /* Bad news, but we can keep running. */
+        cb_mutex_enter(&assoc->expand_lock);
+        assoc->expand_started = false;
+        cb_mutex_exit(&assoc->expand_lock);
+        return;
+    }
+
+    cb_mutex_enter(&assoc->expand_lock);
+    assoc->expand_next_stripe = 0;
+    assoc->expand_stats.started = gethrtime();
+    cb_mutex_exit(&assoc->expand_lock);
+
+    /*
+     * Swapping the tables requires exclusive access. Optimistic readers
+     * don't hold any locks, so publish the tables in an order where they
+     * never index past the end of a table.
+     */
+    assoc_lock_all(assoc);
+    for (ii = 0; ii < ASSOC_LOCK_STRIPES; ++ii) {
+        assoc->stripes[ii].expand_bucket = 0;
+    }
+    de_atomic_store(&assoc->old_hashtable, assoc->primary_hashtable);
+    de_atomic_store(&assoc->primary_hashtable, new_table);
+    de_atomic_store(&assoc->hashpower, assoc->hashpower + 1);
+    de_atomic_store(&assoc->expanding, true);
+    assoc_unlock_all(assoc);
+
+    /*
+     * Migrate the old buckets. An old bucket and the two new buckets it is
+     * split into share the same stripe, so the stripes may be migrated in
+     * parallel and independent of each other.
+     */
+    for (ii = 0; ii < ASSOC_EXPAND_THREADS - 1; ++ii) {
+        if (cb_create_named_thread(&helpers[nhelpers], assoc_migration_thread,
+                                   assoc, 0, "mc:assoc_migr") == 0) {
+            ++nhelpers;
+        }
+    }
+    assoc_migration_thread(assoc);
+    for (ii = 0; ii < nhelpers; ++ii) {
+        cb_join_thread(helpers[ii]);
+    }
+
+    assoc_lock_all(assoc);
+    de_atomic_store(&assoc->expanding, false);
+    old_table = assoc->old_hashtable;
+    de_atomic_store(&assoc->old_hashtable, NULL);
+    assoc_unlock_all(assoc);
+    assoc_wait_for_readers(engine);
+    assoc_table_free(old_table);
+
+    cb_mutex_enter(&assoc->expand_lock);
+    duration = gethrtime() - assoc->expand_stats.started;
+    assoc->expand_stats.expansions++;
+    assoc->expand_stats.last_duration = duration;
+    assoc->expand_stats.total_duration += duration;
+    cb_mutex_exit(&assoc->expand_lock);
+
+    if (engine->config.verbose > 1) {
+        EXTENSION_LOGGER_DESCRIPTOR *logger;
+        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+        logger->log(EXTENSION_LOG_INFO, NULL,
+                    "Hash table expansion done (%"PRIu64" us)\n",
+                    (uint64_t)(duration / 1000));
+    }
+
+    cb_mutex_enter(&assoc->expand_lock);
+    assoc->expand_started = false;
+    cb_mutex_exit(&assoc->expand_lock);
+}
+
+void assoc_stats(struct default_engine *engine,
+                 ADD_STAT add_stats, const void *cookie) {
+    struct assoc *assoc = engine->assoc;
+    uint64_t nitems = 0;
+    uint64_t overflow = 0;
+    uint64_t moved = 0;
+    unsigned int hashpower;
+    bool expanding;
+    int ii;
+
+    /*
+     * Locking the table would invalidate all optimistic readers, so
+     * accept that the numbers may be slightly off.
+     */
+    hashpower = de_atomic_load(&assoc->hashpower);
+    expanding = de_atomic_load(&assoc->expanding);
+    for (ii = 0; ii < ASSOC_LOCK_STRIPES; ++ii) {
+        nitems += assoc->stripes[ii].items;
+        overflow += assoc->stripes[ii].overflow;
+        moved += assoc->stripes[ii].expand_bucket;
+    }
+    moved *= ASSOC_LOCK_STRIPES;
+
+    add_statistics(cookie, add_stats, NULL, -1, "hash_power_level", "%u",
+                   hashpower);
+    add_statistics(cookie, add_stats, NULL, -1, "hash_bytes", "%"PRIu64,
+                   (uint64_t)(hashsize(hashpower) * sizeof(struct assoc_bucket)));
+    add_statistics(cookie, add_stats, NULL, -1, "hash_items", "%"PRIu64,
+                   nitems);
+    add_statistics(cookie, add_stats, NULL, -1, "hash_overflow_items",
+                   "%"PRIu64, overflow);
+    add_statistics(cookie, add_stats, NULL, -1, "hash_is_expanding", "%d",
+                   expanding ? 1 : 0);
+
+    cb_mutex_enter(&assoc->expand_lock);
+    if (expanding) {
+        add_statistics(cookie, add_stats, NULL, -1,
+                       "hash_expand_buckets_moved", "%"PRIu64, moved);
+        add_statistics(cookie, add_stats, NULL, -1,
+                       "hash_expand_buckets_total", "%"PRIu64,
+                       (uint64_t)hashsize(hashpower - 1));
+        add_statistics(cookie, add_stats, NULL, -1,
+                       "hash_expand_current_time_us", "%"PRIu64,
+                       (uint64_t)((gethrtime() - assoc->expand_stats.started) / 1000));
+    }
+    add_statistics(cookie, add_stats, NULL, -1, "hash_expansions", "%"PRIu64,
+                   assoc->expand_stats.expansions);
+    add_statistics(cookie, add_stats, NULL, -1, "hash_expand_last_time_us",
+                   "%"PRIu64,
+                   (uint64_t)(assoc->expand_stats.last_duration / 1000));
+    add_statistics(cookie, add_stats, NULL, -1, "hash_expand_total_time_us",
+                   "%"PRIu64,
+                   (uint64_t)(assoc->expand_stats.total_duration / 1000));
+    cb_mutex_exit(&assoc->expand_lock);
 }
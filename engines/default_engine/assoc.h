@@ -1,49 +1,212 @@
 #ifndef ASSOC_H
 #define ASSOC_H
 
+/*
+ * The hash table is protected by an array of mutexes ("lock stripes").
+ * A bucket is protected by the stripe selected by the low bits of the
+ * hash, so a bucket in the old table and the two buckets it splits into
+ * in the new table always share the same stripe. Must be a power of 2
+ * and not larger than half of the initial table.
+ */
+#define ASSOC_LOCK_STRIPES 1024
+
+/*
+ * The minimum initial number of buckets is 2^ASSOC_DEFAULT_HASHPOWER. The
+ * table is made larger up front if the configuration tells us that we'll
+ * store more items (expected_items, or cache_size divided by
+ * ASSOC_ESTIMATED_ITEM_SIZE), but never larger than 2^ASSOC_MAX_HASHPOWER.
+ */
+#define ASSOC_DEFAULT_HASHPOWER 14
+#define ASSOC_MAX_HASHPOWER 28
+#define ASSOC_ESTIMATED_ITEM_SIZE 512
+
+/*
+ * An expansion is performed by this many threads. Each thread migrates
+ * the buckets of one lock stripe at the time, and holds the stripe for
+ * at most ASSOC_EXPAND_BATCH buckets.
+ */
+#define ASSOC_EXPAND_THREADS 4
+#define ASSOC_EXPAND_BATCH 16
+
+/* The table is expanded once it holds this many items per bucket */
+#define ASSOC_MAX_LOAD 4
+
+/*
+ * Optimistic readers give up (and use the locked path) if the overflow
+ * chain they walk is longer than this. A chain that long is either a
+ * sign of a concurrent modification or of a table in desperate need of
+ * expansion.
+ */
+#define ASSOC_MAX_OPTIMISTIC_DEPTH 32
+
+/*
+ * A bucket occupies a single cache line. The first ASSOC_BUCKET_SLOTS
+ * items hashing to the bucket are stored in the slots along with a tag
+ * (8 bits of their hash), so that most non-matching items are skipped
+ * without touching them. Additional items are chained through
+ * hash_item::h_next from the overflow pointer.
+ */
+#define ASSOC_BUCKET_SLOTS 6
+#define ASSOC_BUCKET_ALIGN 64
+
+struct assoc_bucket {
+   /* zero for an empty slot; the unused tags stay zero */
+   uint8_t tags[8];
+   hash_item *slots[ASSOC_BUCKET_SLOTS];
+   hash_item *overflow;
+};
+
+/*
+ * Optimistic readers announce themselves in one of these slots (selected
+ * by the thread id) so that the maintenance thread knows when nobody may
+ * reference the old table any more. There is a set of slots for each of
+ * the two reader phases (see assoc_wait_for_readers).
+ */
+#define ASSOC_READER_SLOTS 64
+
+struct assoc_stripe {
+   /* serialise modifications of the chains covered by the stripe */
+   cb_mutex_t lock;
+
+   /*
+    * Sequence number for optimistic readers. Odd while the stripe is
+    * being modified, and bumped twice by every modification.
+    */
+   volatile uint32_t seq;
+
+   /*
+    * Number of items in the hash table covered by this stripe, so that
+    * insert and delete only touch the stripe they already hold.
+    */
+   unsigned int items;
+
+   /* Number of those items stored in the overflow chains */
+   unsigned int overflow;
+
+   /*
+    * During expansion the old buckets of the stripe are migrated in
+    * order; this is how many of them we've moved so far.
+    */
+   unsigned int expand_bucket;
+};
+
+struct assoc_reader {
+   /* the number of readers in the slot */
+   volatile uint64_t active;
+   /* keep each slot in its own cache line */
+   uint8_t padding[64 - sizeof(uint64_t)];
+};
+
 struct assoc {
    /* how many powers of 2's worth of buckets we use */
    unsigned int hashpower;
 
 
    /* Main hash table. This is where we look except during expansion. */
-   hash_item** primary_hashtable;
+   struct assoc_bucket* primary_hashtable;
 
    /*
     * Previous hash table. During expansion, we look here for keys that haven't
     * been moved over to the primary yet.
     */
-   hash_item** old_hashtable;
+   struct assoc_bucket* old_hashtable;
 
-   /* Number of items in the hash table. */
-   unsigned int hash_items;
-
-   /* Flag: Are we in the middle of expanding now? */
+   /*
+    * Flag: Are we in the middle of expanding now? Only modified while
+    * holding all of the lock stripes.
+    */
    bool expanding;
 
    /*
-    * During expansion we migrate values with bucket granularity; this is how
-    * far we've gotten so far. Ranges from 0 .. hashsize(hashpower - 1) - 1.
+    * Set while an expansion is scheduled or running (protected by
+    * expand_lock)
     */
-   unsigned int expand_bucket;
+   bool expand_started;
+   cb_mutex_t expand_lock;
+
+   /* The next stripe to be migrated by the expansion threads */
+   unsigned int expand_next_stripe;
 
+   /* Expansion statistics (protected by expand_lock) */
+   struct {
+      uint64_t expansions;
+      hrtime_t started;
+      hrtime_t last_duration;
+      hrtime_t total_duration;
+   } expand_stats;
+
+   /* The thread performing the last expansion (if any), to be joined */
+   cb_thread_t expand_tid;
+   bool expand_tid_valid;
 
    /*
-    * serialise access to the hashtable
+    * serialise access to the hashtable (see ASSOC_LOCK_STRIPES)
     */
-   cb_mutex_t lock;
+   struct assoc_stripe stripes[ASSOC_LOCK_STRIPES];
+
+   /*
+    * optimistic readers currently walking the table. New readers join
+    * the slots of reader_phase; assoc_wait_for_readers flips the phase
+    * (holding readers_lock) and waits for the slots of the old one.
+    */
+   struct assoc_reader readers[2][ASSOC_READER_SLOTS];
+   volatile uint32_t reader_phase;
+   cb_mutex_t readers_lock;
 };
 
 /* associative array */
 ENGINE_ERROR_CODE assoc_init(struct default_engine *engine);
-void assoc_destroy(void);
+void assoc_destroy(struct default_engine *engine);
+void assoc_stats(struct default_engine *engine,
+                 ADD_STAT add_stats, const void *cookie);
 hash_item *assoc_find(struct default_engine *engine, uint32_t hash,
-                      const hash_key* key);
+                      const void *key, uint16_t nkey);
+/*
+ * Is the item linked in the hash table? Unlike assoc_find this never
+ * looks at anything but the table itself, so the item may be stale.
+ */
+bool assoc_contains(struct default_engine *engine, uint32_t hash,
+                    const hash_item *item);
 int assoc_insert(struct default_engine *engine, uint32_t hash,
                  hash_item *item);
 void assoc_delete(struct default_engine *engine, uint32_t hash,
-                  const hash_key* key);
-int start_assoc_maintenance_thread(struct default_engine *engine);
-void stop_assoc_maintenance_thread(struct default_engine *engine);
+                  const hash_item *item);
+
+/*
+ * Optimistic readers must announce themselves for the duration of the
+ * lookup and for as long as they touch the item they found without
+ * holding a reference to it. assoc_wait_for_readers waits for everyone
+ * who entered before the call to leave.
+ */
+struct assoc_reader *assoc_reader_enter(struct default_engine *engine);
+void assoc_reader_exit(struct assoc_reader *reader);
+void assoc_wait_for_readers(struct default_engine *engine);
+
+/*
+ * Look up a key without taking any locks (the caller must have entered
+ * with assoc_reader_enter). Returns false if the lookup
+ * could not be performed optimistically (the caller should then use the
+ * locked path). Otherwise *item is set to the candidate (or NULL) and
+ * *seq to the value which must be passed to assoc_validate once the
+ * caller has grabbed a reference to the item.
+ */
+bool assoc_find_optimistic(struct default_engine *engine, uint32_t hash,
+                           const void *key, uint16_t nkey,
+                           hash_item **item, uint32_t *seq);
+
+/*
+ * Returns true if nothing covered by the hash was modified since the
+ * optimistic lookup which returned seq.
+ */
+bool assoc_validate(struct default_engine *engine, uint32_t hash,
+                    uint32_t seq);
+
+/*
+ * Get exclusive access to the chain covering hash, and invalidate all
+ * optimistic lookups in progress for it. Used when the content of a
+ * linked item is modified in place.
+ */
+void assoc_write_begin(struct default_engine *engine, uint32_t hash);
+void assoc_write_end(struct default_engine *engine, uint32_t hash);
 
 #endif
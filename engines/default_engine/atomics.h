@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Minimal set of atomic operations used by the parts of the default
+ * engine which are accessed without holding a lock (the optimistic
+ * read path). The engine is written in C so we can't use std::atomic.
+ */
+#ifndef DEFAULT_ENGINE_ATOMICS_H
+#define DEFAULT_ENGINE_ATOMICS_H
+
+#include <stdint.h>
+#include <platform/platform.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+static CB_INLINE uint16_t de_atomic_incr_16(volatile uint16_t *ptr) {
+    return (uint16_t)_InterlockedIncrement16((volatile short*)ptr);
+}
+
+static CB_INLINE uint16_t de_atomic_decr_16(volatile uint16_t *ptr) {
+    return (uint16_t)_InterlockedDecrement16((volatile short*)ptr);
+}
+
+static CB_INLINE bool de_atomic_cas_16(volatile uint16_t *ptr,
+                                       uint16_t expected, uint16_t desired) {
+    return (uint16_t)_InterlockedCompareExchange16((volatile short*)ptr,
+                                                   desired, expected) == expected;
+}
+
+static CB_INLINE uint64_t de_atomic_incr_64(volatile uint64_t *ptr) {
+    return (uint64_t)_InterlockedIncrement64((volatile __int64*)ptr);
+}
+
+static CB_INLINE uint64_t de_atomic_decr_64(volatile uint64_t *ptr) {
+    return (uint64_t)_InterlockedDecrement64((volatile __int64*)ptr);
+}
+
+static CB_INLINE uint64_t de_atomic_add_64(volatile uint64_t *ptr, uint64_t val) {
+    return (uint64_t)_InterlockedExchangeAdd64((volatile __int64*)ptr,
+                                               (__int64)val) + val;
+}
+
+static CB_INLINE uint16_t de_atomic_or_16(volatile uint16_t *ptr, uint16_t val) {
+    return (uint16_t)_InterlockedOr16((volatile short*)ptr, val) | val;
+}
+
+static CB_INLINE uint16_t de_atomic_and_16(volatile uint16_t *ptr, uint16_t val) {
+    return (uint16_t)_InterlockedAnd16((volatile short*)ptr, val) & val;
+}
+
+#define de_atomic_load(ptr) (MemoryBarrier(), *(ptr))
+#define de_atomic_store(ptr, val) do { MemoryBarrier(); *(ptr) = (val); } while (0)
+#define de_read_barrier() MemoryBarrier()
+#define de_write_barrier() MemoryBarrier()
+#define de_memory_barrier() MemoryBarrier()
+
+#else
+
+static CB_INLINE uint16_t de_atomic_incr_16(volatile uint16_t *ptr) {
+    return __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint16_t de_atomic_decr_16(volatile uint16_t *ptr) {
+    return __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE bool de_atomic_cas_16(volatile uint16_t *ptr,
+                                       uint16_t expected, uint16_t desired) {
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint64_t de_atomic_incr_64(volatile uint64_t *ptr) {
+    return __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint64_t de_atomic_decr_64(volatile uint64_t *ptr) {
+    return __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint64_t de_atomic_add_64(volatile uint64_t *ptr, uint64_t val) {
+    return __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint16_t de_atomic_or_16(volatile uint16_t *ptr, uint16_t val) {
+    return __atomic_or_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static CB_INLINE uint16_t de_atomic_and_16(volatile uint16_t *ptr, uint16_t val) {
+    return __atomic_and_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+#define de_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define de_atomic_store(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define de_read_barrier() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define de_write_barrier() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define de_memory_barrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Transparent compression of the values (see compress.h)
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <snappy-c.h>
+
+#include "default_engine_internal.h"
+#include "atomics.h"
+
+static EXTENSION_LOGGER_DESCRIPTOR *get_logger(struct default_engine *engine) {
+    return (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+}
+
+bool compress_init(struct default_engine *engine) {
+    const char *algorithm = engine->config.compression;
+
+    memset(&engine->compress, 0, sizeof(engine->compress));
+    if (algorithm == NULL || strcmp(algorithm, "off") == 0) {
+        engine->compress.algorithm = COMPRESS_NONE;
+    } else if (strcmp(algorithm, "snappy") == 0) {
+        engine->compress.algorithm = COMPRESS_SNAPPY;
+    } else {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Invalid value for compression: \"%s\" "
+                                "(only snappy is supported)\n", algorithm);
+        return false;
+    }
+    return true;
+}
+
+bool compress_wanted(struct default_engine *engine, const hash_item *it,
+                     ENGINE_STORE_OPERATION operation) {
+    /* The value appended (or prepended) must stay as it is */
+    return engine->compress.algorithm != COMPRESS_NONE &&
+           operation != OPERATION_APPEND && operation != OPERATION_PREPEND &&
+           (it->datatype & PROTOCOL_BINARY_DATATYPE_COMPRESSED) == 0 &&
+           it->nbytes >= engine->config.compression_min_size;
+}
+
+/* The largest value which fits in a slab chunk with the item */
+static size_t compress_max_length(struct default_engine *engine,
+                                  const hash_item *it) {
+    size_t header = sizeof(hash_item) + it->nkey;
+    size_t chunk_max =
+        engine->slabs.slabclass[engine->slabs.power_largest].size;
+    if (engine->config.use_cas) {
+        header += sizeof(uint64_t);
+    }
+    return chunk_max - header;
+}
+
+/* The stats of the slab class a value of nbytes is allocated from */
+static struct compress_class *compress_class(struct default_engine *engine,
+                                             const hash_item *it,
+                                             size_t nbytes) {
+    size_t ntotal = sizeof(hash_item) + it->nkey + nbytes;
+    unsigned int id;
+
+    if (engine->config.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+    if ((id = slabs_clsid(engine, ntotal)) == 0) {
+        /* chunked */
+        id = engine->slabs.power_largest;
+    }
+    return &engine->compress.classes[id];
+}
+
+char *compress_value(struct default_engine *engine, const hash_item *it,
+                     size_t *length) {
+    struct compress_class *stats = compress_class(engine, it, it->nbytes);
+    const size_t nbytes = it->nbytes;
+    const hrtime_t start = gethrtime();
+    char *copy = NULL;
+    const char *value;
+    char *ret;
+
+    if ((item_iflag(it) & ITEM_CHUNKED) != 0) {
+        if ((copy = malloc(nbytes)) == NULL) {
+            return NULL;
+        }
+        item_copy_value_out(engine, it, copy);
+        value = copy;
+    } else {
+        value = item_get_data(it);
+    }
+
+    *length = snappy_max_compressed_length(nbytes);
+    if ((ret = malloc(*length)) != NULL &&
+        snappy_compress(value, nbytes, ret, length) != SNAPPY_OK) {
+        free(ret);
+        ret = NULL;
+    }
+    free(copy);
+
+    if (ret != NULL && (*length > nbytes - nbytes / COMPRESS_MIN_SAVING ||
+                        *length > compress_max_length(engine, it))) {
+        free(ret);
+        ret = NULL;
+    }
+
+    if (ret != NULL) {
+        de_atomic_incr_64(&stats->compressed);
+        de_atomic_add_64(&stats->bytes_in, nbytes);
+        de_atomic_add_64(&stats->bytes_out, *length);
+    } else {
+        de_atomic_incr_64(&stats->rejected);
+    }
+    de_atomic_add_64(&stats->compress_ns, gethrtime() - start);
+    return ret;
+}
+
+char *compress_inflate(struct default_engine *engine, const hash_item *it,
+                       size_t *length) {
+    const hrtime_t start = gethrtime();
+    char *copy = NULL;
+    const char *value;
+    char *ret = NULL;
+
+    if ((item_iflag(it) & ITEM_CHUNKED) != 0) {
+        if ((copy = malloc(it->nbytes)) == NULL) {
+            return NULL;
+        }
+        item_copy_value_out(engine, it, copy);
+        value = copy;
+    } else {
+        value = item_get_data(it);
+    }
+
+    if (snappy_uncompressed_length(value, it->nbytes, length) == SNAPPY_OK &&
+        (ret = malloc(*length ? *length : 1)) != NULL &&
+        snappy_uncompress(value, it->nbytes, ret, length) != SNAPPY_OK) {
+        free(ret);
+        ret = NULL;
+    }
+    free(copy);
+
+    if (ret != NULL) {
+        struct compress_class *stats = compress_class(engine, it, *length);
+        de_atomic_incr_64(&stats->inflated);
+        de_atomic_add_64(&stats->inflate_ns, gethrtime() - start);
+    }
+    return ret;
+}
+
+void compress_stats(struct default_engine *engine,
+                    ADD_STAT add_stat, const void *cookie) {
+    uint64_t compressed = 0, rejected = 0, bytes_in = 0, bytes_out = 0;
+    uint64_t compress_ns = 0, inflated = 0, inflate_ns = 0;
+    unsigned int ii;
+
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        struct compress_class *p = &engine->compress.classes[ii];
+        const uint64_t in = de_atomic_load(&p->bytes_in);
+        const uint64_t out = de_atomic_load(&p->bytes_out);
+
+        if (de_atomic_load(&p->compressed) == 0 &&
+            de_atomic_load(&p->rejected) == 0 &&
+            de_atomic_load(&p->inflated) == 0) {
+            continue;
+        }
+        add_statistics(cookie, add_stat, NULL, ii, "compressed", "%"PRIu64,
+                       de_atomic_load(&p->compressed));
+        add_statistics(cookie, add_stat, NULL, ii, "rejected", "%"PRIu64,
+                       de_atomic_load(&p->rejected));
+        add_statistics(cookie, add_stat, NULL, ii, "bytes_in", "%"PRIu64, in);
+        add_statistics(cookie, add_stat, NULL, ii, "bytes_out", "%"PRIu64,
+                       out);
+        add_statistics(cookie, add_stat, NULL, ii, "ratio", "%.2f",
+                       out ? (double)in / out : 0.0);
+        add_statistics(cookie, add_stat, NULL, ii, "compress_usec",
+                       "%"PRIu64, de_atomic_load(&p->compress_ns) / 1000);
+        add_statistics(cookie, add_stat, NULL, ii, "inflated", "%"PRIu64,
+                       de_atomic_load(&p->inflated));
+        add_statistics(cookie, add_stat, NULL, ii, "inflate_usec", "%"PRIu64,
+                       de_atomic_load(&p->inflate_ns) / 1000);
+
+        compressed += de_atomic_load(&p->compressed);
+        rejected += de_atomic_load(&p->rejected);
+        bytes_in += in;
+        bytes_out += out;
+        compress_ns += de_atomic_load(&p->compress_ns);
+        inflated += de_atomic_load(&p->inflated);
+        inflate_ns += de_atomic_load(&p->inflate_ns);
+    }
+
+    add_statistics(cookie, add_stat, NULL, -1, "compression", "%s",
+                   engine->compress.algorithm == COMPRESS_SNAPPY ?
+                   "snappy" : "off");
+    add_statistics(cookie, add_stat, NULL, -1, "compression_min_size",
+                   "%"PRIu64, (uint64_t)engine->config.compression_min_size);
+    add_statistics(cookie, add_stat, NULL, -1, "total_compressed", "%"PRIu64,
+                   compressed);
+    add_statistics(cookie, add_stat, NULL, -1, "total_rejected", "%"PRIu64,
+                   rejected);
+    add_statistics(cookie, add_stat, NULL, -1, "total_bytes_in", "%"PRIu64,
+                   bytes_in);
+    add_statistics(cookie, add_stat, NULL, -1, "total_bytes_out", "%"PRIu64,
+                   bytes_out);
+    add_statistics(cookie, add_stat, NULL, -1, "total_ratio", "%.2f",
+                   bytes_out ? (double)bytes_in / bytes_out : 0.0);
+    add_statistics(cookie, add_stat, NULL, -1, "total_compress_usec",
+                   "%"PRIu64, compress_ns / 1000);
+    add_statistics(cookie, add_stat, NULL, -1, "total_inflated", "%"PRIu64,
+                   inflated);
+    add_statistics(cookie, add_stat, NULL, -1, "total_inflate_usec",
+                   "%"PRIu64, inflate_ns / 1000);
+}
+
+void compress_stats_reset(struct default_engine *engine) {
+    unsigned int ii;
+
+    for (ii = 0; ii < MAX_NUMBER_OF_SLAB_CLASSES; ++ii) {
+        struct compress_class *p = &engine->compress.classes[ii];
+        de_atomic_store(&p->compressed, 0);
+        de_atomic_store(&p->rejected, 0);
+        de_atomic_store(&p->bytes_in, 0);
+        de_atomic_store(&p->bytes_out, 0);
+        de_atomic_store(&p->compress_ns, 0);
+        de_atomic_store(&p->inflated, 0);
+        de_atomic_store(&p->inflate_ns, 0);
+    }
+}
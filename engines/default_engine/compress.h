@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "default_engine_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The values may be compressed by the engine as they're stored
+ * (compression=snappy). Values of at least compression_min_size bytes are
+ * compressed outside of items.lock, and the compressed value is stored
+ * with PROTOCOL_BINARY_DATATYPE_COMPRESSED set if it saves at least
+ * 1/COMPRESS_MIN_SAVING of the size. Datatype aware clients get the value
+ * as it is stored, and the core inflates it for everybody else. The core
+ * can only inflate a contiguous value, so a value which doesn't fit in a
+ * single slab chunk when compressed is stored as it is.
+ *
+ * The engine itself only needs the uncompressed value to append or
+ * prepend to it. The work done (and the memory saved) is accounted to
+ * the slab class the uncompressed value was allocated from, see the
+ * "compression" stats.
+ */
+#define COMPRESS_MIN_SAVING 8
+
+enum compress_algorithm {
+    COMPRESS_NONE,
+    COMPRESS_SNAPPY
+};
+
+struct compress_class {
+    /* values stored compressed, and the ones which didn't compress well */
+    volatile uint64_t compressed;
+    volatile uint64_t rejected;
+    /* the size of the compressed values before and after */
+    volatile uint64_t bytes_in;
+    volatile uint64_t bytes_out;
+    volatile uint64_t compress_ns;
+    /* values inflated by the engine */
+    volatile uint64_t inflated;
+    volatile uint64_t inflate_ns;
+};
+
+struct compress {
+    enum compress_algorithm algorithm;
+    struct compress_class classes[MAX_NUMBER_OF_SLAB_CLASSES];
+};
+
+/**
+ * Check the compression configuration
+ * @param engine handle to the storage engine
+ * @return false if the configuration is invalid (the reason is logged)
+ */
+bool compress_init(struct default_engine *engine);
+
+/**
+ * Should the value of the item be compressed when it's stored?
+ * @param engine handle to the storage engine
+ * @param it the item about to be stored
+ * @param operation the store operation
+ */
+bool compress_wanted(struct default_engine *engine, const hash_item *it,
+                     ENGINE_STORE_OPERATION operation);
+
+/**
+ * Compress the value of an item
+ * @param engine handle to the storage engine
+ * @param it the item to compress the value of
+ * @param length where to store the length of the compressed value
+ * @return the compressed value (to be freed by the caller), or NULL if
+ *         the value doesn't compress well enough (or fit in a slab chunk)
+ */
+char *compress_value(struct default_engine *engine, const hash_item *it,
+                     size_t *length);
+
+/**
+ * Inflate the compressed value of an item
+ * @param engine handle to the storage engine
+ * @param it the item with PROTOCOL_BINARY_DATATYPE_COMPRESSED set
+ * @param length where to store the length of the value
+ * @return the value (to be freed by the caller), or NULL if the value
+ *         can't be inflated
+ */
+char *compress_inflate(struct default_engine *engine, const hash_item *it,
+                       size_t *length);
+
+/**
+ * Get the compression statistics of the slab classes
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void compress_stats(struct default_engine *engine,
+                    ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Reset the compression statistics
+ * @param engine handle to the storage engine
+ */
+void compress_stats_reset(struct default_engine *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,6 +11,7 @@
 #include <inttypes.h>
 
 #include "default_engine_internal.h"
+#include "atomics.h"
 #include "memcached/util.h"
 #include "memcached/config_parser.h"
 #include "engines/default_engine.h"
@@ -46,6 +47,13 @@ static ENGINE_ERROR_CODE default_get(ENGINE_HANDLE* handle,
                                      const void* key,
                                      const int nkey,
                                      uint16_t vbucket);
+static ENGINE_ERROR_CODE default_get_and_touch(ENGINE_HANDLE* handle,
+                                               const void* cookie,
+                                               item** item,
+                                               const void* key,
+                                               const int nkey,
+                                               const rel_time_t exptime,
+                                               uint16_t vbucket);
 static ENGINE_ERROR_CODE default_get_stats(ENGINE_HANDLE* handle,
                   const void *cookie,
                   const char *stat_key,
@@ -132,8 +140,10 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
 
     cb_mutex_initialize(&engine->slabs.lock);
     cb_mutex_initialize(&engine->items.lock);
-    cb_mutex_initialize(&engine->stats.lock);
+    cb_cond_initialize(&engine->items.maintainer_cond);
+    cb_cond_initialize(&engine->slabs.rebalance.cond);
     cb_mutex_initialize(&engine->scrubber.lock);
+    cb_mutex_initialize(&engine->snapshot.lock);
 
     engine->bucket_id = id;
     engine->engine.interface.interface = 1;
@@ -144,6 +154,7 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
     engine->engine.remove = default_item_delete;
     engine->engine.release = default_item_release;
     engine->engine.get = default_get;
+    engine->engine.get_and_touch = default_get_and_touch;
     engine->engine.get_stats = default_get_stats;
     engine->engine.reset_stats = default_reset_stats;
     engine->engine.store = default_store;
@@ -155,13 +166,17 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
     engine->engine.set_item_info = set_item_info;
     engine->config.use_cas = true;
     engine->config.verbose = 0;
-    engine->config.oldest_live = 0;
     engine->config.evict_to_free = true;
     engine->config.maxbytes = 64 * 1024 * 1024;
     engine->config.preallocate = false;
     engine->config.factor = 1.25;
     engine->config.chunk_size = 48;
     engine->config.item_size_max= 1024 * 1024;
+    engine->config.slab_page_size = 1024 * 1024;
+    engine->config.slab_automove = true;
+    engine->config.snapshot_threads = 4;
+    engine->config.compression_min_size = 1024;
+    engine->config.eviction_samples = 5;
     engine->info.engine.description = "Default engine v0.1";
     engine->info.engine.num_features = 1;
     engine->info.engine.features[0].feature = ENGINE_FEATURE_LRU;
@@ -192,7 +207,6 @@ ENGINE_ERROR_CODE create_instance(uint64_t interface,
 
 void destroy_engine() {
     engine_manager_shutdown();
-    assoc_destroy();
 }
 
 static struct default_engine* get_handle(ENGINE_HANDLE* handle) {
@@ -220,6 +234,13 @@ static ENGINE_ERROR_CODE default_initialize(ENGINE_HANDLE* handle,
        se->info.engine.features[se->info.engine.num_features++].feature = ENGINE_FEATURE_CAS;
    }
 
+   if (!compress_init(se)) {
+      return ENGINE_EINVAL;
+   }
+
+   /* The hash table should be large enough for the snapshot we load */
+   snapshot_init(se);
+
    ret = assoc_init(se);
    if (ret != ENGINE_SUCCESS) {
       return ret;
@@ -231,26 +252,53 @@ static ENGINE_ERROR_CODE default_initialize(ENGINE_HANDLE* handle,
       return ret;
    }
 
+   ret = item_init(se);
+   if (ret != ENGINE_SUCCESS) {
+      return ret;
+   }
+
+   snapshot_load(se);
+
    return ENGINE_SUCCESS;
 }
 
 static void default_destroy(ENGINE_HANDLE* handle, const bool force) {
-    (void)force;
-    engine_manager_delete_engine(get_handle(handle));
+    struct default_engine* engine = get_handle(handle);
+    if (!force && engine->config.snapshot_on_shutdown) {
+        snapshot_write(engine);
+    }
+    engine_manager_delete_engine(engine);
 }
 
 void destroy_engine_instance(struct default_engine* engine) {
     if (engine->initialized) {
+        /* Stop the snapshot being written (it walks the LRU) */
+        snapshot_destroy(engine);
+
+        /* Stop the LRU maintainer */
+        item_destroy(engine);
+
         /* Destory the slabs cache */
         slabs_destroy(engine);
 
+        /* and the hash table */
+        assoc_destroy(engine);
+
         free(engine->config.uuid);
+        free(engine->config.huge_pages);
+        free(engine->config.numa_policy);
+        free(engine->config.shm_file);
+        free(engine->config.snapshot_file);
+        free(engine->config.compression);
+        free(engine->config.eviction_policy);
 
         /* Clean up the mutexes */
+        cb_cond_destroy(&engine->items.maintainer_cond);
+        cb_cond_destroy(&engine->slabs.rebalance.cond);
         cb_mutex_destroy(&engine->items.lock);
-        cb_mutex_destroy(&engine->stats.lock);
         cb_mutex_destroy(&engine->slabs.lock);
         cb_mutex_destroy(&engine->scrubber.lock);
+        cb_mutex_destroy(&engine->snapshot.lock);
 
         engine->initialized = false;
     }
@@ -267,14 +315,13 @@ static ENGINE_ERROR_CODE default_item_allocate(ENGINE_HANDLE* handle,
                                                uint8_t datatype) {
    hash_item *it;
 
-   unsigned int id;
    struct default_engine* engine = get_handle(handle);
    size_t ntotal = sizeof(hash_item) + nkey + nbytes;
    if (engine->config.use_cas) {
       ntotal += sizeof(uint64_t);
    }
-   id = slabs_clsid(engine, ntotal);
-   if (id == 0) {
+   /* Items larger than the largest slab class are stored in chunks */
+   if (ntotal > engine->config.item_size_max) {
       return ENGINE_E2BIG;
    }
 
@@ -346,6 +393,25 @@ static ENGINE_ERROR_CODE default_get(ENGINE_HANDLE* handle,
    }
 }
 
+static ENGINE_ERROR_CODE default_get_and_touch(ENGINE_HANDLE* handle,
+                                               const void* cookie,
+                                               item** item,
+                                               const void* key,
+                                               const int nkey,
+                                               const rel_time_t exptime,
+                                               uint16_t vbucket) {
+   struct default_engine *engine = get_handle(handle);
+   VBUCKET_GUARD(engine, vbucket);
+
+   *item = touch_item(engine, cookie, key, (uint16_t)nkey,
+                      engine->server.core->realtime(exptime));
+   if (*item != NULL) {
+      return ENGINE_SUCCESS;
+   } else {
+      return ENGINE_KEY_ENOENT;
+   }
+}
+
 static ENGINE_ERROR_CODE default_get_stats(ENGINE_HANDLE* handle,
                                            const void* cookie,
                                            const char* stat_key,
@@ -359,26 +425,46 @@ static ENGINE_ERROR_CODE default_get_stats(ENGINE_HANDLE* handle,
       char val[128];
       int len;
 
-      cb_mutex_enter(&engine->stats.lock);
-      len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.evictions);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_EVICTIONS));
       add_stat("evictions", 9, val, len, cookie);
-      len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.curr_items);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_CURR_ITEMS));
       add_stat("curr_items", 10, val, len, cookie);
-      len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.total_items);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_TOTAL_ITEMS));
       add_stat("total_items", 11, val, len, cookie);
-      len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.curr_bytes);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_CURR_BYTES));
       add_stat("bytes", 5, val, len, cookie);
-      len = sprintf(val, "%"PRIu64, engine->stats.reclaimed);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_RECLAIMED));
       add_stat("reclaimed", 9, val, len, cookie);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_UPDATES_IN_PLACE));
+      add_stat("updates_in_place", 16, val, len, cookie);
+      len = sprintf(val, "%"PRIu64,
+                    engine_stats_get(engine, ENGINE_STAT_UPDATES_REALLOC));
+      add_stat("updates_realloc", 15, val, len, cookie);
       len = sprintf(val, "%"PRIu64, (uint64_t)engine->config.maxbytes);
       add_stat("engine_maxbytes", 15, val, len, cookie);
-      cb_mutex_exit(&engine->stats.lock);
+      add_stat("eviction_policy", 15,
+               engine->items.evict_policy == ITEM_EVICT_SAMPLED ?
+               "sampled" : "lru",
+               engine->items.evict_policy == ITEM_EVICT_SAMPLED ? 7 : 3,
+               cookie);
+      item_stats_expiry(engine, add_stat, cookie);
+      item_stats_flush(engine, add_stat, cookie);
    } else if (strncmp(stat_key, "slabs", 5) == 0) {
       slabs_stats(engine, add_stat, cookie);
    } else if (strncmp(stat_key, "items", 5) == 0) {
       item_stats(engine, add_stat, cookie);
    } else if (strncmp(stat_key, "sizes", 5) == 0) {
       item_stats_sizes(engine, add_stat, cookie);
+   } else if (strncmp(stat_key, "overhead", 8) == 0) {
+      item_stats_overhead(engine, add_stat, cookie);
+   } else if (strncmp(stat_key, "hash", 4) == 0) {
+      assoc_stats(engine, add_stat, cookie);
    } else if (strncmp(stat_key, "uuid", 4) == 0) {
        if (engine->config.uuid) {
            add_stat("uuid", 4, engine->config.uuid,
@@ -408,8 +494,16 @@ static ENGINE_ERROR_CODE default_get_stats(ENGINE_HANDLE* handle,
          add_stat("scrubber:visited", 16, val, len, cookie);
          len = sprintf(val, "%"PRIu64, engine->scrubber.cleaned);
          add_stat("scrubber:cleaned", 16, val, len, cookie);
+         len = sprintf(val, "%u", engine->scrubber.classes_done);
+         add_stat("scrubber:classes_done", 21, val, len, cookie);
+         len = sprintf(val, "%u", engine->scrubber.classes_total);
+         add_stat("scrubber:classes_total", 22, val, len, cookie);
       }
       cb_mutex_exit(&engine->scrubber.lock);
+   } else if (strncmp(stat_key, "snapshot", 8) == 0) {
+      snapshot_stats(engine, add_stat, cookie);
+   } else if (strncmp(stat_key, "compression", 11) == 0) {
+      compress_stats(engine, add_stat, cookie);
    } else {
       ret = ENGINE_KEY_ENOENT;
    }
@@ -462,11 +556,38 @@ static void default_reset_stats(ENGINE_HANDLE* handle, const void *cookie) {
    struct default_engine *engine = get_handle(handle);
    item_stats_reset(engine);
 
-   cb_mutex_enter(&engine->stats.lock);
-   engine->stats.evictions = 0;
-   engine->stats.reclaimed = 0;
-   engine->stats.total_items = 0;
-   cb_mutex_exit(&engine->stats.lock);
+   engine_stats_clear(engine, ENGINE_STAT_EVICTIONS);
+   engine_stats_clear(engine, ENGINE_STAT_RECLAIMED);
+   engine_stats_clear(engine, ENGINE_STAT_TOTAL_ITEMS);
+   engine_stats_clear(engine, ENGINE_STAT_UPDATES_IN_PLACE);
+   engine_stats_clear(engine, ENGINE_STAT_UPDATES_REALLOC);
+   compress_stats_reset(engine);
+}
+
+void engine_stats_add(struct default_engine *engine, enum engine_stat stat,
+                      int64_t delta) {
+   uintptr_t id = (uintptr_t)cb_thread_self();
+   struct engine_stats_slot *slot;
+   slot = &engine->stats.slots[((id >> 4) ^ (id >> 12)) & (ENGINE_STATS_SLOTS - 1)];
+   de_atomic_add_64(&slot->counters[stat], (uint64_t)delta);
+}
+
+uint64_t engine_stats_get(struct default_engine *engine, enum engine_stat stat) {
+   uint64_t sum = 0;
+   int ii;
+
+   for (ii = 0; ii < ENGINE_STATS_SLOTS; ++ii) {
+      sum += de_atomic_load(&engine->stats.slots[ii].counters[stat]);
+   }
+   return sum;
+}
+
+void engine_stats_clear(struct default_engine *engine, enum engine_stat stat) {
+   int ii;
+
+   for (ii = 0; ii < ENGINE_STATS_SLOTS; ++ii) {
+      de_atomic_store(&engine->stats.slots[ii].counters[stat], 0);
+   }
 }
 
 static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
@@ -476,7 +597,7 @@ static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
    se->config.vb0 = true;
 
    if (cfg_str != NULL) {
-       struct config_item items[13];
+       struct config_item items[27];
        int ii = 0;
 
        memset(&items, 0, sizeof(items));
@@ -520,6 +641,26 @@ static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
        items[ii].value.dt_size = &se->config.item_size_max;
        ++ii;
 
+       items[ii].key = "slab_page_size";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.slab_page_size;
+       ++ii;
+
+       items[ii].key = "huge_pages";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.huge_pages;
+       ++ii;
+
+       items[ii].key = "numa_policy";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.numa_policy;
+       ++ii;
+
+       items[ii].key = "shm_file";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.shm_file;
+       ++ii;
+
        items[ii].key = "ignore_vbucket";
        items[ii].datatype = DT_BOOL;
        items[ii].value.dt_bool = &se->config.ignore_vbucket;
@@ -539,9 +680,59 @@ static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
        items[ii].value.dt_string = &se->config.uuid;
        ++ii;
 
+       items[ii].key = "expected_items";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.expected_items;
+       ++ii;
+
+       items[ii].key = "slab_automove";
+       items[ii].datatype = DT_BOOL;
+       items[ii].value.dt_bool = &se->config.slab_automove;
+       ++ii;
+
+       items[ii].key = "snapshot_file";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.snapshot_file;
+       ++ii;
+
+       items[ii].key = "snapshot_threads";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.snapshot_threads;
+       ++ii;
+
+       items[ii].key = "snapshot_max_age";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.snapshot_max_age;
+       ++ii;
+
+       items[ii].key = "snapshot_on_shutdown";
+       items[ii].datatype = DT_BOOL;
+       items[ii].value.dt_bool = &se->config.snapshot_on_shutdown;
+       ++ii;
+
+       items[ii].key = "compression";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.compression;
+       ++ii;
+
+       items[ii].key = "compression_min_size";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.compression_min_size;
+       ++ii;
+
+       items[ii].key = "eviction_policy";
+       items[ii].datatype = DT_STRING;
+       items[ii].value.dt_string = &se->config.eviction_policy;
+       ++ii;
+
+       items[ii].key = "eviction_samples";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.eviction_samples;
+       ++ii;
+
        items[ii].key = NULL;
        ++ii;
-       cb_assert(ii == 13);
+       cb_assert(ii == 27);
        ret = se->server.core->parse_config(cfg_str, items, stderr);
    }
 
@@ -617,6 +808,70 @@ static bool scrub_cmd(struct default_engine *e,
                     res, 0, cookie);
 }
 
+static bool slab_reassign(struct default_engine *e, const void *cookie,
+                          protocol_binary_request_header *request,
+                          ADD_RESPONSE response) {
+    protocol_binary_request_slab_reassign *req = (void*)request;
+    protocol_binary_response_status res;
+    uint32_t src;
+    const char *msg = NULL;
+
+    if (request->request.extlen != 8 || request->request.keylen != 0 ||
+        ntohl(request->request.bodylen) != 8) {
+        return response(NULL, 0, NULL, 0, NULL, 0, PROTOCOL_BINARY_RAW_BYTES,
+                        PROTOCOL_BINARY_RESPONSE_EINVAL, 0, cookie);
+    }
+
+    src = ntohl(req->message.body.src);
+    switch (slabs_reassign(e, src == UINT32_MAX ? -1 : (int)src,
+                           ntohl(req->message.body.dst))) {
+    case REASSIGN_OK:
+        res = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        break;
+    case REASSIGN_RUNNING:
+        res = PROTOCOL_BINARY_RESPONSE_EBUSY;
+        break;
+    case REASSIGN_NOSPARE:
+        res = PROTOCOL_BINARY_RESPONSE_ENOMEM;
+        msg = "No slab class can spare a page";
+        break;
+    case REASSIGN_SRC_DST_SAME:
+        res = PROTOCOL_BINARY_RESPONSE_EINVAL;
+        msg = "Source and destination are the same";
+        break;
+    default:
+        res = PROTOCOL_BINARY_RESPONSE_EINVAL;
+        msg = "Invalid slab class";
+        break;
+    }
+
+    return response(NULL, 0, NULL, 0, msg, msg ? (uint32_t)strlen(msg) : 0,
+                    PROTOCOL_BINARY_RAW_BYTES, res, 0, cookie);
+}
+
+static bool snapshot_cmd(struct default_engine *e, const void *cookie,
+                         protocol_binary_request_header *request,
+                         ADD_RESPONSE response) {
+    protocol_binary_response_status res = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    const char *msg = NULL;
+
+    if (request->request.extlen != 0 || request->request.keylen != 0 ||
+        request->request.bodylen != 0) {
+        return response(NULL, 0, NULL, 0, NULL, 0, PROTOCOL_BINARY_RAW_BYTES,
+                        PROTOCOL_BINARY_RESPONSE_EINVAL, 0, cookie);
+    }
+
+    if (e->config.snapshot_file == NULL) {
+        res = PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED;
+        msg = "No snapshot_file configured";
+    } else if (!snapshot_start(e)) {
+        res = PROTOCOL_BINARY_RESPONSE_EBUSY;
+    }
+
+    return response(NULL, 0, NULL, 0, msg, msg ? (uint32_t)strlen(msg) : 0,
+                    PROTOCOL_BINARY_RAW_BYTES, res, 0, cookie);
+}
+
 static bool touch(struct default_engine *e, const void *cookie,
                   protocol_binary_request_header *request,
                   ADD_RESPONSE response) {
@@ -651,6 +906,22 @@ static bool touch(struct default_engine *e, const void *cookie,
         if (request->request.opcode == PROTOCOL_BINARY_CMD_TOUCH) {
             ret = response(NULL, 0, NULL, 0, NULL, 0, PROTOCOL_BINARY_RAW_BYTES,
                            PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, cookie);
+        } else if (item_iflag(item) & ITEM_CHUNKED) {
+            /* The response callback needs the value in one piece */
+            char *value = malloc(item->nbytes);
+            if (value == NULL) {
+                ret = response(NULL, 0, NULL, 0, NULL, 0,
+                               PROTOCOL_BINARY_RAW_BYTES,
+                               PROTOCOL_BINARY_RESPONSE_ENOMEM, 0, cookie);
+            } else {
+                item_copy_value_out(e, item, value);
+                ret = response(NULL, 0, &item->flags, sizeof(item->flags),
+                               value, item->nbytes,
+                               PROTOCOL_BINARY_RAW_BYTES,
+                               PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                               item_get_cas(item), cookie);
+                free(value);
+            }
         } else {
             ret = response(NULL, 0, &item->flags, sizeof(item->flags),
                            item_get_data(item), item->nbytes,
@@ -675,6 +946,12 @@ static ENGINE_ERROR_CODE default_unknown_command(ENGINE_HANDLE* handle,
     case PROTOCOL_BINARY_CMD_SCRUB:
         sent = scrub_cmd(e, cookie, request, response);
         break;
+    case PROTOCOL_BINARY_CMD_SLAB_REASSIGN:
+        sent = slab_reassign(e, cookie, request, response);
+        break;
+    case PROTOCOL_BINARY_CMD_SNAPSHOT:
+        sent = snapshot_cmd(e, cookie, request, response);
+        break;
     case PROTOCOL_BINARY_CMD_DEL_VBUCKET:
         sent = rm_vbucket(e, cookie, request, response);
         break;
@@ -705,7 +982,7 @@ static ENGINE_ERROR_CODE default_unknown_command(ENGINE_HANDLE* handle,
 
 uint64_t item_get_cas(const hash_item* item)
 {
-    if (item->iflag & ITEM_WITH_CAS) {
+    if (item_iflag(item) & ITEM_WITH_CAS) {
         return *(uint64_t*)(item + 1);
     }
     return 0;
@@ -715,25 +992,29 @@ void item_set_cas(ENGINE_HANDLE *handle, const void *cookie,
                   item* item, uint64_t val)
 {
     hash_item* it = get_real_item(item);
-    if (it->iflag & ITEM_WITH_CAS) {
+    if (item_iflag(it) & ITEM_WITH_CAS) {
         *(uint64_t*)(it + 1) = val;
     }
 }
 
-hash_key* item_get_key(const hash_item* item)
+char* item_get_key(const hash_item* item)
 {
     char *ret = (void*)(item + 1);
-    if (item->iflag & ITEM_WITH_CAS) {
+    if (item_iflag(item) & ITEM_WITH_CAS) {
         ret += sizeof(uint64_t);
     }
 
-    return (hash_key*)ret;
+    return ret;
 }
 
 char* item_get_data(const hash_item* item)
 {
-    const hash_key* key = item_get_key(item);
-    return ((char*)key->header.full_key) + hash_key_get_key_len(key);
+    char *ret = item_get_key(item) + item->nkey;
+    if (item_iflag(item) & ITEM_CHUNKED) {
+        /* skip the pointer to the chunks */
+        ret += sizeof(hash_item*);
+    }
+    return ret;
 }
 
 uint8_t item_get_clsid(const hash_item* item)
@@ -745,8 +1026,9 @@ static bool get_item_info(ENGINE_HANDLE *handle, const void *cookie,
                           const item* item, item_info *item_info)
 {
     hash_item* it = (hash_item*)item;
-    const hash_key* key = item_get_key(item);
-    if (item_info->nvalue < 1) {
+    int nvalue = item_get_value_iov(get_handle(handle), it, item_info->value,
+                                    item_info->nvalue);
+    if (nvalue < 0) {
         return false;
     }
     item_info->cas = item_get_cas(it);
@@ -756,11 +1038,9 @@ static bool get_item_info(ENGINE_HANDLE *handle, const void *cookie,
     item_info->nbytes = it->nbytes;
     item_info->flags = it->flags;
     item_info->clsid = it->slabs_clsid;
-    item_info->nkey = hash_key_get_client_key_len(key);
-    item_info->nvalue = 1;
-    item_info->key = hash_key_get_client_key(key);
-    item_info->value[0].iov_base = item_get_data(it);
-    item_info->value[0].iov_len = it->nbytes;
+    item_info->nkey = it->nkey;
+    item_info->nvalue = (uint16_t)nvalue;
+    item_info->key = item_get_key(it);
     item_info->datatype = it->datatype;
     return true;
 }
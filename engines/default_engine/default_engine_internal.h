@@ -24,6 +24,11 @@
 #define DONT_PREALLOC_SLABS
 #define MAX_NUMBER_OF_SLAB_CLASSES (POWER_LARGEST + 1)
 
+#ifdef VALGRIND
+// switch to malloc if VALGRIND so we can get some useful insight.
+#define USE_SYSTEM_MALLOC (1)
+#endif
+
 /** How long an object can reasonably be assumed to be locked before
     harvesting it on a low memory condition. */
 #define TAIL_REPAIR_TIME (3 * 3600)
@@ -36,6 +41,8 @@ struct default_engine;
 #include "items.h"
 #include "assoc.h"
 #include "slabs.h"
+#include "snapshot.h"
+#include "compress.h"
 
    /* Flags */
 #define ITEM_WITH_CAS 1
@@ -45,19 +52,45 @@ struct default_engine;
 /* temp */
 #define ITEM_SLABBED (2<<8)
 
+/* The item has been read since the LRU maintainer last looked at it */
+#define ITEM_ACTIVE (4<<8)
+
+/* The LRU segment (enum item_lru_segment) the item lives in */
+#define ITEM_LRU_SHIFT 11
+#define ITEM_LRU_MASK (3<<ITEM_LRU_SHIFT)
+
+/* The value of the item is stored in a chain of chunks (see items.c) */
+#define ITEM_CHUNKED (1<<13)
+
+/* The chunk holds a part of the value of an ITEM_CHUNKED item */
+#define ITEM_CHUNK (1<<14)
+
 struct config {
    bool use_cas;
    size_t verbose;
-   rel_time_t oldest_live;
    bool evict_to_free;
    size_t maxbytes;
    bool preallocate;
    float factor;
    size_t chunk_size;
    size_t item_size_max;
+   size_t slab_page_size;
+   char *huge_pages;
+   char *numa_policy;
+   char *shm_file;
    bool ignore_vbucket;
    bool vb0;
    char *uuid;
+   size_t expected_items;
+   bool slab_automove;
+   char *snapshot_file;
+   size_t snapshot_threads;
+   size_t snapshot_max_age;
+   bool snapshot_on_shutdown;
+   char *compression;
+   size_t compression_min_size;
+   char *eviction_policy;
+   size_t eviction_samples;
 };
 
 MEMCACHED_PUBLIC_API
@@ -66,23 +99,63 @@ void destroy_engine(void);
 /**
  * Statistic information collected by the default engine
  */
+enum engine_stat {
+   ENGINE_STAT_EVICTIONS = 0,
+   ENGINE_STAT_RECLAIMED,
+   ENGINE_STAT_CURR_BYTES,
+   ENGINE_STAT_CURR_ITEMS,
+   ENGINE_STAT_TOTAL_ITEMS,
+   /* append/prepend/incr/decr done in the item or with a new item */
+   ENGINE_STAT_UPDATES_IN_PLACE,
+   ENGINE_STAT_UPDATES_REALLOC,
+   ENGINE_STAT_COUNT
+};
+
+/*
+ * The counters are split up over ENGINE_STATS_SLOTS cache lines (a thread
+ * picks one by its thread id) and added up when they're read, so that the
+ * threads don't fight over a single cache line on every update. A slot's
+ * share of curr_bytes/curr_items may wrap around (below zero), the sum
+ * doesn't.
+ */
+#define ENGINE_STATS_SLOTS 16
+
+/*
+ * Keep each slot in its own cache line(s). The alignment rounds the size
+ * of the slot up to a multiple of the cache line size, however many
+ * counters there are. The engine struct must be allocated with (at least)
+ * this alignment for it to take effect (see engine_manager.cc).
+ */
+#define ENGINE_CACHE_LINE_SIZE 64
+#ifdef _MSC_VER
+#define ENGINE_CACHE_ALIGNED __declspec(align(64))
+#else
+#define ENGINE_CACHE_ALIGNED __attribute__((aligned(ENGINE_CACHE_LINE_SIZE)))
+#endif
+
+struct ENGINE_CACHE_ALIGNED engine_stats_slot {
+   volatile uint64_t counters[ENGINE_STAT_COUNT];
+};
+
 struct engine_stats {
-   cb_mutex_t lock;
-   uint64_t evictions;
-   uint64_t reclaimed;
-   uint64_t curr_bytes;
-   uint64_t curr_items;
-   uint64_t total_items;
+   struct engine_stats_slot slots[ENGINE_STATS_SLOTS];
 };
 
+void engine_stats_add(struct default_engine *engine, enum engine_stat stat,
+                      int64_t delta);
+uint64_t engine_stats_get(struct default_engine *engine, enum engine_stat stat);
+void engine_stats_clear(struct default_engine *engine, enum engine_stat stat);
+
 struct engine_scrubber {
    cb_mutex_t lock;
    uint64_t visited;
    uint64_t cleaned;
+   /* The slab classes scrubbed so far (they're scrubbed in parallel) */
+   uint32_t classes_done;
+   uint32_t classes_total;
    time_t started;
    time_t stopped;
    bool running;
-   bool force_delete;
 };
 
 struct vbucket_info {
@@ -113,6 +186,8 @@ struct default_engine {
    struct config config;
    struct engine_stats stats;
    struct engine_scrubber scrubber;
+   struct snapshot snapshot;
+   struct compress compress;
 
    union {
        engine_info engine;
@@ -127,7 +202,7 @@ struct default_engine {
 };
 
 char* item_get_data(const hash_item* item);
-hash_key* item_get_key(const hash_item* item);
+char* item_get_key(const hash_item* item);
 void item_set_cas(ENGINE_HANDLE *handle, const void *cookie,
                   item* item, uint64_t val);
 uint64_t item_get_cas(const hash_item* item);
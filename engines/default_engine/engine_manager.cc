@@ -19,8 +19,8 @@
     Engine manager provides methods for creating and deleting of engine handles/structs
     and the creation and safe teardown of the scrubber thread.
 
-    Note: A single scrubber exists for the purposes of running a user requested scrub
-    and for background deletion of bucket items when a bucket is destroyed.
+    Note: A single scrubber (with a few threads) exists for the purposes of running a
+    user requested scrub and for background deletion of a bucket when it is destroyed.
 */
 
 #include "engine_manager.h"
@@ -28,13 +28,19 @@
 #include "items.h"
 
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <vector>
 
 /**
     The scrubber task is charged with
@@ -44,6 +50,14 @@
     The common use-case is for bucket deletion performing tasks 1 and 2.
     The start_scrub command only performs 1.
 
+    A scrub is split up into a job per slab class, and the jobs are run by
+    a few threads, so one bucket's scrub doesn't hold up the others (the
+    jobs of a single bucket still take turns with its items.lock).
+
+    Bucket deletion doesn't walk the items at all. Once the scrub jobs
+    which already started are done, the engine is destroyed, which drops
+    the hash table and frees all of the slab pages in one go.
+
     Global destruction can safely join the task and allow the engine to
     safely unload the shared object.
 **/
@@ -59,9 +73,9 @@ public:
     void shutdown();
 
     /**
-        Join the thread running the scrubber (to be called after shutdown).
+        Join the threads running the scrubber (to be called after shutdown).
     **/
-    void joinThread();
+    void joinThreads();
 
     /**
         Place the engine on the threads work queue for item scrubbing.
@@ -76,15 +90,41 @@ public:
 
 private:
     /*
-       A queue of engine's to work on.
-       The second bool indicates if the engine is to be deleted when done.
+       Scrub a slab class of the engine, or destroy the engine if
+       clsid is destroyEngine.
+    */
+    struct Job {
+        struct default_engine* engine;
+        int clsid;
+    };
+    static const int destroyEngine = -1;
+
+    /*
+       The maximum number of threads to run the jobs.
     */
-    std::deque<std::pair<struct default_engine*, bool> > workQueue;
+    static const unsigned int maxThreads = 4;
+
+    /*
+       Book-keeping once a scrub job is done (called with lock held).
+       Queues up the destroy of the engine if it's been asked for.
+    */
+    void jobDone(const Job& job);
+
+    /*
+       A queue of jobs to work on.
+    */
+    std::deque<Job> workQueue;
+    /*
+       The number of jobs queued or running for each engine, and the
+       engines to destroy once they have none left.
+    */
+    std::unordered_map<struct default_engine*, int> pending;
+    std::unordered_set<struct default_engine*> destroying;
     std::atomic<bool> shuttingdown;
     EngineManager* engineManager;
     std::mutex lock;
     std::condition_variable cvar;
-    cb_thread_t scrubberThread;
+    std::vector<cb_thread_t> scrubberThreads;
 };
 
 /**
@@ -140,9 +180,20 @@ static void scrubber_task_main(void* arg) {
 ScrubberTask::ScrubberTask(EngineManager* manager)
   : shuttingdown(false),
     engineManager(manager) {
-    if (cb_create_named_thread(&scrubberThread, &scrubber_task_main, this, 0,
-                               "mc:item_scrub") != 0) {
-        throw std::runtime_error("Error creating 'mc:item_scrub' thread");
+    unsigned int nthreads = std::min(maxThreads,
+                                     std::thread::hardware_concurrency());
+    nthreads = std::max(nthreads, 1u);
+
+    for (unsigned int ii = 0; ii < nthreads; ++ii) {
+        cb_thread_t tid;
+        std::string name = "mc:item_scrub_" + std::to_string(ii);
+        if (cb_create_named_thread(&tid, &scrubber_task_main, this, 0,
+                                   name.c_str()) != 0) {
+            shutdown();
+            joinThreads();
+            throw std::runtime_error("Error creating '" + name + "' thread");
+        }
+        scrubberThreads.push_back(tid);
     }
 }
 
@@ -150,38 +201,92 @@ void ScrubberTask::shutdown() {
     shuttingdown = true;
     // Serialize with ::run
     std::lock_guard<std::mutex> lck(lock);
-    cvar.notify_one();
+    cvar.notify_all();
 }
 
-void ScrubberTask::joinThread() {
-    cb_join_thread(scrubberThread);
+void ScrubberTask::joinThreads() {
+    for (auto& tid : scrubberThreads) {
+        cb_join_thread(tid);
+    }
+    scrubberThreads.clear();
 }
 
 void ScrubberTask::placeOnWorkQueue(struct default_engine* engine, bool destroy) {
     if (!shuttingdown) {
         std::lock_guard<std::mutex> lck(lock);
-        engine->scrubber.force_delete = destroy;
-        workQueue.push_back(std::make_pair(engine, destroy));
+        int& count = pending[engine];
+        if (destroy) {
+            // Drop the scrub jobs which haven't started yet
+            auto end = std::remove_if(workQueue.begin(), workQueue.end(),
+                                      [engine](const Job& job) {
+                                          return job.engine == engine;
+                                      });
+            count -= int(workQueue.end() - end);
+            workQueue.erase(end, workQueue.end());
+
+            if (count == 0) {
+                workQueue.push_back({engine, destroyEngine});
+                count = 1;
+            } else {
+                // The last of the running jobs queues up the destroy
+                destroying.insert(engine);
+            }
+        } else {
+            for (int clsid = POWER_SMALLEST; clsid < POWER_LARGEST; ++clsid) {
+                workQueue.push_back({engine, clsid});
+                ++count;
+            }
+        }
+        cvar.notify_all();
+    }
+}
+
+void ScrubberTask::jobDone(const Job& job) {
+    auto iter = pending.find(job.engine);
+    if (--iter->second > 0) {
+        return;
+    }
+    if (destroying.erase(job.engine) != 0) {
+        workQueue.push_back({job.engine, destroyEngine});
+        iter->second = 1;
         cvar.notify_one();
+    } else {
+        pending.erase(iter);
     }
 }
 
 void ScrubberTask::run() {
+    std::unique_lock<std::mutex> lck(lock);
     while (true) {
-        std::unique_lock<std::mutex> lck(lock);
         if (!workQueue.empty()) {
-            auto engine = workQueue.front();
+            Job job = workQueue.front();
             workQueue.pop_front();
-            lck.unlock();
 
-            item_scrubber_main(engine.first);
-
-            if (engine.second) {
-                destroy_engine_instance(engine.first);
-                engineManager->deleteEngine(engine.first);
+            if (job.clsid == destroyEngine) {
+                // Forget about the engine before its memory is released
+                pending.erase(job.engine);
+                lck.unlock();
+                destroy_engine_instance(job.engine);
+                engineManager->deleteEngine(job.engine);
+            } else {
+                lck.unlock();
+                item_scrub_class(job.engine, job.clsid);
+                lck.lock();
+                if (pending[job.engine] == 1 &&
+                    destroying.count(job.engine) == 0) {
+                    // The last job of the scrub. The job is still counted
+                    // so the engine can't be destroyed under our feet.
+                    // (item_start_scrub holds the scrubber lock while
+                    // queueing, so don't hold ours while taking it)
+                    lck.unlock();
+                    item_scrubber_done(job.engine);
+                    lck.lock();
+                }
+                jobDone(job);
+                continue;
             }
 
-            lck.lock(); // relock so lck can safely unlock when destroyed at loop end.
+            lck.lock();
         } else if (!shuttingdown) {
             cvar.wait(lck);
         } else {
@@ -190,6 +295,38 @@ void ScrubberTask::run() {
     }
 }
 
+/*
+ * The engine struct needs to be cache line aligned for the stats slots
+ * (operator new doesn't honour the alignment of the type before C++17).
+ */
+static struct default_engine* allocate_engine() {
+    void* ptr;
+#ifdef WIN32
+    ptr = _aligned_malloc(sizeof(struct default_engine),
+                          ENGINE_CACHE_LINE_SIZE);
+#else
+    if (posix_memalign(&ptr, ENGINE_CACHE_LINE_SIZE,
+                       sizeof(struct default_engine)) != 0) {
+        ptr = nullptr;
+    }
+#endif
+    if (ptr != nullptr) {
+        std::memset(ptr, 0, sizeof(struct default_engine));
+    }
+    return reinterpret_cast<struct default_engine*>(ptr);
+}
+
+static void free_engine(struct default_engine* engine) {
+#ifdef WIN32
+    _aligned_free(engine);
+#else
+    free(engine);
+#endif
+}
+
+static_assert(sizeof(struct engine_stats_slot) % ENGINE_CACHE_LINE_SIZE == 0,
+              "engine_stats_slot must fill whole cache lines");
+
 EngineManager::EngineManager()
   : scrubberTask(this),
     shuttingdown(false) {}
@@ -202,7 +339,7 @@ struct default_engine* EngineManager::createEngine() {
     struct default_engine* newEngine = NULL;
 
     if (!shuttingdown) {
-        newEngine = new struct default_engine();
+        newEngine = allocate_engine();
     }
 
     if (newEngine) {
@@ -210,7 +347,7 @@ struct default_engine* EngineManager::createEngine() {
         static bucket_id_t bucket_id;
         if (bucket_id + 1 == 0) {
             // We've used all of the available id's
-            delete newEngine;
+            free_engine(newEngine);
             return nullptr;
         }
         default_engine_constructor(newEngine, bucket_id++);
@@ -223,7 +360,7 @@ struct default_engine* EngineManager::createEngine() {
 void EngineManager::deleteEngine(struct default_engine* engine) {
     std::lock_guard<std::mutex> lck(lock);
     engines.erase(engine);
-    delete engine;
+    free_engine(engine);
 }
 
 void EngineManager::requestDestroyEngine(struct default_engine* engine) {
@@ -244,10 +381,10 @@ void EngineManager::scrubEngine(struct default_engine* engine) {
 void EngineManager::shutdown() {
     shuttingdown = true;
     scrubberTask.shutdown();
-    scrubberTask.joinThread();
+    scrubberTask.joinThreads();
     std::lock_guard<std::mutex> lck(lock);
     for (auto engine : engines) {
-        delete engine;
+        free_engine(engine);
     }
 }
 
@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Timer wheel for the expiry of the items (see expiry.h)
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "default_engine_internal.h"
+
+#define EXPIRY_WHEEL_MASK (EXPIRY_WHEEL_SLOTS - 1)
+
+/* The furthest out (in seconds) the wheel reaches */
+#define EXPIRY_WHEEL_RANGE (1U << (EXPIRY_WHEEL_BITS * EXPIRY_WHEEL_LEVELS))
+
+/* The initial number of entries allocated for a slot */
+#define EXPIRY_SLOT_INITIAL_SIZE 16
+
+/*
+ * Weed out the stale entries once there are more than half again as many
+ * entries as there are items in the wheel (plus some slack).
+ */
+#define EXPIRY_COMPACT_SLACK 1024
+
+static struct expiry_slot *expiry_slot_for(struct expiry_wheel *wheel,
+                                           rel_time_t exptime) {
+    rel_time_t delta;
+    int level;
+
+    if (exptime < wheel->next) {
+        /* Already due */
+        exptime = wheel->next;
+    }
+    delta = exptime - wheel->next;
+    if (delta >= EXPIRY_WHEEL_RANGE) {
+        exptime = wheel->next + EXPIRY_WHEEL_RANGE - 1;
+        delta = EXPIRY_WHEEL_RANGE - 1;
+    }
+
+    for (level = 0; level < EXPIRY_WHEEL_LEVELS - 1; ++level) {
+        if (delta < (1U << (EXPIRY_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    return &wheel->slots[level][(exptime >> (EXPIRY_WHEEL_BITS * level)) &
+                                EXPIRY_WHEEL_MASK];
+}
+
+static bool expiry_slot_add(struct expiry_slot *slot,
+                            const struct expiry_entry *entry) {
+    if (slot->count == slot->size) {
+        uint32_t size = slot->size ? slot->size * 2 : EXPIRY_SLOT_INITIAL_SIZE;
+        struct expiry_entry *entries = realloc(slot->entries,
+                                               size * sizeof(*entries));
+        if (entries == NULL) {
+            return false;
+        }
+        slot->entries = entries;
+        slot->size = size;
+    }
+    slot->entries[slot->count++] = *entry;
+    return true;
+}
+
+static void expiry_slot_release(struct expiry_slot *slot) {
+    free(slot->entries);
+    memset(slot, 0, sizeof(*slot));
+}
+
+/* Put an entry (which is already counted in wheel->entries) back */
+static void expiry_reinsert(struct expiry_wheel *wheel,
+                            const struct expiry_entry *entry) {
+    if (!expiry_slot_add(expiry_slot_for(wheel, entry->exptime), entry)) {
+        wheel->entries--;
+        wheel->dropped++;
+    }
+}
+
+void expiry_init(struct expiry_wheel *wheel, rel_time_t current_time) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->next = current_time;
+    wheel->rate_time = current_time;
+}
+
+void expiry_destroy(struct expiry_wheel *wheel) {
+    int level;
+    int ii;
+
+    for (level = 0; level < EXPIRY_WHEEL_LEVELS; ++level) {
+        for (ii = 0; ii < EXPIRY_WHEEL_SLOTS; ++ii) {
+            expiry_slot_release(&wheel->slots[level][ii]);
+        }
+        expiry_slot_release(&wheel->cascading[level]);
+    }
+    wheel->entries = 0;
+}
+
+void expiry_insert(struct expiry_wheel *wheel, hash_item *it) {
+    struct expiry_entry entry;
+
+    entry.item = it;
+    entry.hash = it->hash;
+    entry.exptime = it->exptime;
+    if (expiry_slot_add(expiry_slot_for(wheel, it->exptime), &entry)) {
+        wheel->entries++;
+    } else {
+        wheel->dropped++;
+    }
+}
+
+/*
+ * Step to the next second. Every time a level wraps around, the next slot
+ * of the level above is queued up to be moved down.
+ */
+static void expiry_step(struct expiry_wheel *wheel) {
+    int level;
+
+    wheel->next++;
+    for (level = 1; level < EXPIRY_WHEEL_LEVELS; ++level) {
+        struct expiry_slot *slot;
+        if (((wheel->next >> (EXPIRY_WHEEL_BITS * (level - 1))) &
+             EXPIRY_WHEEL_MASK) != 0) {
+            break;
+        }
+        slot = &wheel->slots[level][(wheel->next >>
+                                     (EXPIRY_WHEEL_BITS * level)) &
+                                    EXPIRY_WHEEL_MASK];
+        if (slot->count == 0) {
+            continue;
+        }
+        if (wheel->cascading[level].count == 0) {
+            expiry_slot_release(&wheel->cascading[level]);
+            wheel->cascading[level] = *slot;
+            memset(slot, 0, sizeof(*slot));
+        } else {
+            /* We didn't get to finish the previous round */
+            while (slot->count > 0) {
+                if (!expiry_slot_add(&wheel->cascading[level],
+                                     &slot->entries[--slot->count])) {
+                    wheel->entries--;
+                    wheel->dropped++;
+                }
+            }
+            expiry_slot_release(slot);
+        }
+    }
+}
+
+int expiry_advance(struct expiry_wheel *wheel, rel_time_t current_time,
+                   struct expiry_entry *due, int max) {
+    int moves = max;
+    int ret = 0;
+
+    while (wheel->next <= current_time) {
+        struct expiry_slot *slot;
+        bool cascading = false;
+        int level;
+
+        /* Everything above must be moved down before we hand out a slot */
+        for (level = 1; level < EXPIRY_WHEEL_LEVELS; ++level) {
+            struct expiry_slot *from = &wheel->cascading[level];
+            while (from->count > 0 && moves > 0) {
+                expiry_reinsert(wheel, &from->entries[--from->count]);
+                --moves;
+            }
+            if (from->count > 0) {
+                cascading = true;
+            } else if (from->entries != NULL) {
+                expiry_slot_release(from);
+            }
+        }
+        if (cascading) {
+            return ret;
+        }
+
+        slot = &wheel->slots[0][wheel->next & EXPIRY_WHEEL_MASK];
+        while (slot->count > 0 && ret < max) {
+            due[ret++] = slot->entries[--slot->count];
+            wheel->entries--;
+        }
+        if (slot->count > 0) {
+            return ret;
+        }
+        expiry_slot_release(slot);
+        expiry_step(wheel);
+    }
+
+    return ret;
+}
+
+bool expiry_need_compact(const struct expiry_wheel *wheel) {
+    return wheel->entries >
+        wheel->items + wheel->items / 2 + EXPIRY_COMPACT_SLACK;
+}
+
+int expiry_compact(struct expiry_wheel *wheel,
+                   bool (*keep)(void *ctx, const struct expiry_entry *entry),
+                   void *ctx, int max) {
+    const int nslots = EXPIRY_WHEEL_LEVELS * EXPIRY_WHEEL_SLOTS;
+    int dropped = 0;
+    int visited;
+
+    /* Visit each slot at most once per call */
+    for (visited = 0; max > 0 && visited <= nslots; ++visited) {
+        struct expiry_slot *slot =
+            &wheel->slots[wheel->compact_level][wheel->compact_slot];
+
+        while (wheel->compact_index < slot->count && max > 0) {
+            struct expiry_entry *entry = &slot->entries[wheel->compact_index];
+            --max;
+            if (keep(ctx, entry)) {
+                wheel->compact_index++;
+            } else {
+                *entry = slot->entries[--slot->count];
+                wheel->entries--;
+                ++dropped;
+            }
+        }
+        if (max == 0) {
+            break;
+        }
+
+        wheel->compact_index = 0;
+        if (++wheel->compact_slot == EXPIRY_WHEEL_SLOTS) {
+            wheel->compact_slot = 0;
+            if (++wheel->compact_level == EXPIRY_WHEEL_LEVELS) {
+                wheel->compact_level = 0;
+            }
+        }
+    }
+
+    wheel->compacted += dropped;
+    return dropped;
+}
+
+bool expiry_pending(const struct expiry_wheel *wheel,
+                    rel_time_t current_time) {
+    return wheel->next <= current_time;
+}
+
+void expiry_reclaimed(struct expiry_wheel *wheel, unsigned int count,
+                      rel_time_t current_time) {
+    wheel->reclaimed += count;
+    if (current_time > wheel->rate_time) {
+        wheel->reclaimed_per_sec = (wheel->reclaimed - wheel->rate_reclaimed) /
+                                   (current_time - wheel->rate_time);
+        wheel->rate_reclaimed = wheel->reclaimed;
+        wheel->rate_time = current_time;
+    }
+}
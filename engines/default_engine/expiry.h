@@ -0,0 +1,130 @@
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include <stdbool.h>
+#include "memcached/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A hierarchical timer wheel of the items with an expiry time, so that
+ * they may be reclaimed (close to) when they expire instead of when
+ * someone stumbles over them.
+ *
+ * Each level has EXPIRY_WHEEL_SLOTS slots. A slot on level 0 covers a
+ * second, and a slot on the next level covers all of the slots of the
+ * level below. When the wheel has gone all the way around a level the
+ * next slot of the level above is spread out over it (a bit at a time,
+ * to bound the time spent holding the lock). Items which expire further
+ * out than the wheel reaches are kept in the last slot of the top level
+ * until they get closer.
+ *
+ * The wheel only holds a reference to the item (and its hash) which is
+ * dropped when the item's slot comes up. The item may have been
+ * deleted, replaced or touched since, so the owner must make sure that
+ * the entry still refers to a linked item (see assoc_contains) before
+ * looking at it. Such stale entries are weeded out by expiry_compact if
+ * they pile up. All of the functions must be called with items.lock
+ * held.
+ */
+#define EXPIRY_WHEEL_BITS 6
+#define EXPIRY_WHEEL_SLOTS (1 << EXPIRY_WHEEL_BITS)
+#define EXPIRY_WHEEL_LEVELS 4
+
+struct _hash_item;
+
+struct expiry_entry {
+    struct _hash_item *item;
+    uint32_t hash;
+    rel_time_t exptime;
+};
+
+struct expiry_slot {
+    struct expiry_entry *entries;
+    uint32_t count;
+    uint32_t size;
+};
+
+struct expiry_wheel {
+    struct expiry_slot slots[EXPIRY_WHEEL_LEVELS][EXPIRY_WHEEL_SLOTS];
+    /* The slots being moved down to the levels below */
+    struct expiry_slot cascading[EXPIRY_WHEEL_LEVELS];
+    /* The next second to hand out the entries for */
+    rel_time_t next;
+    /* The number of entries in the wheel */
+    uint64_t entries;
+    /* The number of linked items with an expiry time (kept by the owner) */
+    uint64_t items;
+    /* Where expiry_compact left off */
+    int compact_level;
+    int compact_slot;
+    uint32_t compact_index;
+    uint64_t compacted;
+    /* The number of items we couldn't add (out of memory) */
+    uint64_t dropped;
+    /* The number of items reclaimed when their slot came up */
+    uint64_t reclaimed;
+    /* The reclaim rate over the last second(s) the wheel moved */
+    uint64_t reclaimed_per_sec;
+    uint64_t rate_reclaimed;
+    rel_time_t rate_time;
+};
+
+/**
+ * Start the wheel at the given time
+ */
+void expiry_init(struct expiry_wheel *wheel, rel_time_t current_time);
+
+/**
+ * Release all of the memory used by the wheel
+ */
+void expiry_destroy(struct expiry_wheel *wheel);
+
+/**
+ * Add an item (which has an expiry time) to the wheel
+ */
+void expiry_insert(struct expiry_wheel *wheel, struct _hash_item *it);
+
+/**
+ * Move the wheel forward to current_time, and hand out (up to max of) the
+ * entries which are due. At most max entries are moved down from the
+ * higher levels per call, so the caller may have to call again even if
+ * no entries were handed out (see expiry_pending).
+ * @return the number of entries stored in due
+ */
+int expiry_advance(struct expiry_wheel *wheel, rel_time_t current_time,
+                   struct expiry_entry *due, int max);
+
+/**
+ * Is there more work to do for the wheel at current_time?
+ */
+bool expiry_pending(const struct expiry_wheel *wheel,
+                    rel_time_t current_time);
+
+/**
+ * Should the stale entries be weeded out?
+ */
+bool expiry_need_compact(const struct expiry_wheel *wheel);
+
+/**
+ * Look at (up to) max entries, starting where we left off the last time,
+ * and drop the ones keep returns false for.
+ * @return the number of entries dropped
+ */
+int expiry_compact(struct expiry_wheel *wheel,
+                   bool (*keep)(void *ctx, const struct expiry_entry *entry),
+                   void *ctx, int max);
+
+/**
+ * Report the number of items reclaimed, and update the reclaim rate
+ */
+void expiry_reclaimed(struct expiry_wheel *wheel, unsigned int count,
+                      rel_time_t current_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,16 +11,27 @@
 #include <platform/crc32c.h>
 #include "default_engine_internal.h"
 #include "engine_manager.h"
+#include "atomics.h"
 
 /* Forward Declarations */
 static void item_link_q(struct default_engine *engine, hash_item *it);
 static void item_unlink_q(struct default_engine *engine, hash_item *it);
+static void do_item_lru_move(struct default_engine *engine, hash_item *it,
+                             int segment, rel_time_t current_time);
+static int item_flush_sweep(struct default_engine *engine);
 static hash_item *do_item_alloc(struct default_engine *engine,
                                 const hash_key *key,
                                 const int flags, const rel_time_t exptime,
                                 const int nbytes,
                                 const void *cookie,
                                 uint8_t datatype);
+static hash_item *do_item_alloc_key(struct default_engine *engine,
+                                    uint32_t hash,
+                                    const void *key, uint16_t nkey,
+                                    const int flags, const rel_time_t exptime,
+                                    const int nbytes,
+                                    const void *cookie,
+                                    uint8_t datatype);
 static hash_item *do_item_get(struct default_engine *engine,
                               const hash_key* key);
 static int do_item_link(struct default_engine *engine, hash_item *it);
@@ -38,20 +49,177 @@ static bool hash_key_create(hash_key* hkey,
                             const void* cookie);
 
 static void hash_key_destroy(hash_key* hkey);
-static void hash_key_copy_to_item(hash_item* dst, const hash_key* src);
 
-/*
- * We only reposition items in the LRU queue if they haven't been repositioned
- * in this many seconds. That saves us from churning on frequently-accessed
- * items.
- */
-#define ITEM_UPDATE_INTERVAL 60
+static uint32_t hash_key_hash(const hash_key *key) {
+    return crc32c(hash_key_get_key(key), hash_key_get_key_len(key), 0);
+}
+
 /*
  * To avoid scanning through the complete cache in some circumstances we'll
  * just give up and return an error after inspecting a fixed number of objects.
  */
 static const int search_items = 50;
 
+/*
+ * The maximum share (in percent) of the items in a slab class the LRU
+ * maintainer lets stay in the hot and warm segments.
+ */
+#define ITEM_LRU_HOT_PERCENT 20
+#define ITEM_LRU_WARM_PERCENT 40
+
+/* Max number of items the LRU maintainer looks at per list and run */
+#define ITEM_LRU_MAINTAINER_BATCH 100
+
+/*
+ * The LRU maintainer sleeps shorter while it finds work to do and backs
+ * off (in ms) when it doesn't.
+ */
+#define ITEM_LRU_MAINTAINER_MIN_SLEEP 10
+#define ITEM_LRU_MAINTAINER_MAX_SLEEP 1000
+
+/*
+ * The LRU maintainer sweeps the items out of the LRU lists after a
+ * flush_all in steps of ITEM_FLUSH_SWEEP_BATCH items (with items.lock),
+ * and takes at most ITEM_FLUSH_SWEEP_MAX_BATCHES steps per run.
+ */
+#define ITEM_FLUSH_SWEEP_BATCH 1000
+#define ITEM_FLUSH_SWEEP_MAX_BATCHES 100
+
+/*
+ * The LRU maintainer reclaims the items from the expiry wheel in batches
+ * of ITEM_EXPIRY_BATCH (with items.lock), and handles at most
+ * ITEM_EXPIRY_MAX_BATCHES batches per run.
+ */
+#define ITEM_EXPIRY_BATCH 256
+#define ITEM_EXPIRY_MAX_BATCHES 64
+
+/*
+ * eviction_policy=sampled draws up to ITEM_EVICT_SAMPLE_ROUNDS samples
+ * before it falls back to the LRU lists (see do_item_evict_sampled).
+ */
+#define ITEM_EVICT_SAMPLE_ROUNDS 4
+
+/* The bounds of the width (counters per row) of the frequency sketch */
+#define ITEM_SKETCH_MIN_WIDTH 4096
+#define ITEM_SKETCH_MAX_WIDTH (1 << 24)
+
+/* The order we look for items to reclaim or evict in */
+static const int item_lru_evict_order[ITEM_LRU_SEGMENTS] = {
+    ITEM_LRU_COLD, ITEM_LRU_HOT, ITEM_LRU_WARM
+};
+
+static int item_lru_segment(const hash_item *it) {
+    return (item_iflag(it) & ITEM_LRU_MASK) >> ITEM_LRU_SHIFT;
+}
+
+static int item_lru_id(const hash_item *it) {
+    return item_lru_segment(it) * POWER_LARGEST + it->slabs_clsid;
+}
+
+/*
+ * Optimistic readers set ITEM_ACTIVE without items.lock, so all updates
+ * of iflag must be atomic read-modify-writes or we could lose their bit
+ * (or they could lose ours).
+ */
+static void item_set_lru_segment(hash_item *it, int segment) {
+    uint16_t iflag;
+    do {
+        iflag = item_iflag(it);
+    } while (!de_atomic_cas_16(&it->iflag, iflag,
+                               (uint16_t)((iflag & ~ITEM_LRU_MASK) |
+                                          (segment << ITEM_LRU_SHIFT))));
+}
+
+/*
+ * Readers only flag the item as active (the LRU maintainer does the list
+ * shuffling).
+ */
+static void item_mark_active(hash_item *it) {
+    if ((item_iflag(it) & ITEM_ACTIVE) == 0) {
+        de_atomic_or_16(&it->iflag, ITEM_ACTIVE);
+    }
+}
+
+/*
+ * The counter of the frequency sketch for the key hash in a row. The
+ * rows are laid out one after the other, and indexed by double hashing.
+ */
+static volatile uint8_t *item_sketch_counter(const struct item_sketch *sketch,
+                                             uint32_t hash, int row) {
+    const uint32_t step = (hash >> 17 | hash << 15) | 1;
+    return sketch->counters + (size_t)row * (sketch->mask + 1) +
+           ((hash + row * step) & sketch->mask);
+}
+
+/*
+ * Count an access to the key. This is done without items.lock on the
+ * read path and the increments aren't atomic, so concurrent readers may
+ * lose some of them. That is fine for an estimate.
+ */
+static void item_sketch_add(struct default_engine *engine, uint32_t hash) {
+    const struct item_sketch *sketch = &engine->items.sketch;
+    int row;
+
+    if (sketch->counters == NULL) {
+        return;
+    }
+    for (row = 0; row < ITEM_SKETCH_DEPTH; ++row) {
+        volatile uint8_t *counter = item_sketch_counter(sketch, hash, row);
+        if (*counter != UINT8_MAX) {
+            ++*counter;
+        }
+    }
+}
+
+/* How many times (give or take) the key was accessed recently */
+static unsigned int item_sketch_estimate(const struct item_sketch *sketch,
+                                         uint32_t hash) {
+    unsigned int ret = UINT8_MAX;
+    int row;
+
+    for (row = 0; row < ITEM_SKETCH_DEPTH; ++row) {
+        const unsigned int count = *item_sketch_counter(sketch, hash, row);
+        if (count < ret) {
+            ret = count;
+        }
+    }
+    return ret;
+}
+
+/* Halve the counters (run by the LRU maintainer) */
+static void item_sketch_age(struct item_sketch *sketch,
+                            rel_time_t current_time) {
+    const size_t ncounters = (size_t)ITEM_SKETCH_DEPTH * (sketch->mask + 1);
+    size_t ii;
+
+    for (ii = 0; ii < ncounters; ++ii) {
+        sketch->counters[ii] >>= 1;
+    }
+    sketch->aged = current_time;
+}
+
+/*
+ * Cursors are items without a key (or value) of their own, and we mark
+ * them with a key length no real key may have.
+ */
+#define ITEM_CURSOR_NKEY UINT16_MAX
+
+static bool item_is_cursor(const hash_item *it) {
+    return it->nkey == ITEM_CURSOR_NKEY && it->nbytes == 0;
+}
+
+/* Was the item linked before the last flush_all? */
+static bool item_is_flushed(struct default_engine *engine,
+                            const hash_item *it) {
+    return it->generation != de_atomic_load(&engine->items.generation);
+}
+
+static bool item_is_dead(struct default_engine *engine, const hash_item *it,
+                         rel_time_t current_time) {
+    return item_is_flushed(engine, it) ||
+           (it->exptime != 0 && it->exptime <= current_time);
+}
+
 void item_stats_reset(struct default_engine *engine) {
     cb_mutex_enter(&engine->items.lock);
     memset(engine->items.itemstats, 0, sizeof(engine->items.itemstats));
@@ -62,7 +230,7 @@ void item_stats_reset(struct default_engine *engine) {
 /* warning: don't use these macros with a function, as it evals its arg twice */
 static size_t ITEM_ntotal(struct default_engine *engine,
                           const hash_item *item) {
-    size_t ret = sizeof(*item) + hash_key_get_alloc_size(item_get_key(item)) + item->nbytes;
+    size_t ret = sizeof(*item) + item->nkey + item->nbytes;
     if (engine->config.use_cas) {
         ret += sizeof(uint64_t);
     }
@@ -70,83 +238,569 @@ static size_t ITEM_ntotal(struct default_engine *engine,
     return ret;
 }
 
+/*
+ * Values which don't fit in the largest slab class are stored in a chain
+ * of chunks. Such an item (flagged ITEM_CHUNKED) is allocated from the
+ * largest slab class, so that it is evicted from the LRU of that class
+ * to make room for more chunks. It holds the pointer to the first chunk
+ * right after the key, followed by as much of the value as fits.
+ *
+ * Every chunk starts with a hash_item header flagged ITEM_CHUNK, where
+ * prev points to the item, next to the next chunk and nbytes is the number
+ * of bytes of the value stored in the chunk. The last chunk is allocated
+ * from the smallest slab class it fits in (if possible), so that a value
+ * just above the size of the largest class doesn't waste a whole chunk.
+ */
+static bool item_is_chunked(const hash_item *it) {
+    return (item_iflag(it) & ITEM_CHUNKED) != 0;
+}
+
+static size_t item_chunk_max(struct default_engine *engine) {
+    return engine->slabs.slabclass[engine->slabs.power_largest].size;
+}
+
+/* The number of bytes the item uses in its own slab class */
+static size_t item_slab_ntotal(struct default_engine *engine,
+                               const hash_item *it) {
+    if (item_is_chunked(it)) {
+        return item_chunk_max(engine);
+    }
+    return ITEM_ntotal(engine, it);
+}
+
+/* The pointer to the chunks isn't aligned, so don't dereference it */
+static hash_item *item_get_chunks(const hash_item *it) {
+    hash_item *chunks;
+    memcpy(&chunks, item_get_data(it) - sizeof(chunks), sizeof(chunks));
+    return chunks;
+}
+
+static void item_set_chunks(hash_item *it, hash_item *chunks) {
+    memcpy(item_get_data(it) - sizeof(chunks), &chunks, sizeof(chunks));
+}
+
+/* A contiguous piece of the value of an item */
+struct item_segment {
+    char *data;
+    size_t len;
+    /* the chunk holding the next piece, or NULL */
+    hash_item *next;
+};
+
+static void item_first_segment(struct default_engine *engine,
+                               const hash_item *it,
+                               struct item_segment *seg) {
+    seg->data = item_get_data(it);
+    if (item_is_chunked(it)) {
+        seg->len = item_chunk_max(engine) - (seg->data - (char*)it);
+        seg->next = item_get_chunks(it);
+    } else {
+        seg->len = it->nbytes;
+        seg->next = NULL;
+    }
+}
+
+static bool item_next_segment(struct item_segment *seg) {
+    hash_item *chunk = seg->next;
+    if (chunk == NULL) {
+        return false;
+    }
+    seg->data = (char*)(chunk + 1);
+    seg->len = chunk->nbytes;
+    seg->next = chunk->next;
+    return true;
+}
+
+int item_get_value_iov(struct default_engine *engine, const hash_item *it,
+                       struct iovec *iov, int niov) {
+    struct item_segment seg;
+    int ii = 0;
+
+    item_first_segment(engine, it, &seg);
+    do {
+        if (ii == niov) {
+            return -1;
+        }
+        iov[ii].iov_base = seg.data;
+        iov[ii].iov_len = seg.len;
+        ++ii;
+    } while (item_next_segment(&seg));
+
+    return ii;
+}
+
+void item_copy_value_out(struct default_engine *engine, const hash_item *it,
+                         void *dest) {
+    struct item_segment seg;
+    char *ptr = dest;
+
+    item_first_segment(engine, it, &seg);
+    do {
+        memcpy(ptr, seg.data, seg.len);
+        ptr += seg.len;
+    } while (item_next_segment(&seg));
+}
+
+void item_copy_value_in(struct default_engine *engine, hash_item *it,
+                        const void *src) {
+    struct item_segment seg;
+    const char *ptr = src;
+
+    item_first_segment(engine, it, &seg);
+    do {
+        memcpy(seg.data, ptr, seg.len);
+        ptr += seg.len;
+    } while (item_next_segment(&seg));
+}
+
+/* Copy the value of src into the value of dst, starting at offset */
+static void item_copy_value(struct default_engine *engine, hash_item *dst,
+                            size_t offset, const hash_item *src) {
+    struct item_segment from, to;
+
+    item_first_segment(engine, src, &from);
+    item_first_segment(engine, dst, &to);
+    while (offset > 0 && offset >= to.len && to.next != NULL) {
+        offset -= to.len;
+        item_next_segment(&to);
+    }
+
+    while (from.len > 0 || item_next_segment(&from)) {
+        size_t len;
+        if (offset == to.len) {
+            if (!item_next_segment(&to)) {
+                break;
+            }
+            offset = 0;
+            continue;
+        }
+        len = from.len < to.len - offset ? from.len : to.len - offset;
+        memcpy(to.data + offset, from.data, len);
+        from.data += len;
+        from.len -= len;
+        offset += len;
+    }
+}
+
+static bool item_is_compressed(const hash_item *it) {
+    return (it->datatype & PROTOCOL_BINARY_DATATYPE_COMPRESSED) != 0;
+}
+
+/* A copy of the (uncompressed) value of the item, to be freed */
+static char *item_get_value_inflated(struct default_engine *engine,
+                                     const hash_item *it, size_t *length) {
+    char *ret;
+
+    if (item_is_compressed(it)) {
+        return compress_inflate(engine, it, length);
+    }
+    *length = it->nbytes;
+    if ((ret = malloc(it->nbytes ? it->nbytes : 1)) != NULL) {
+        item_copy_value_out(engine, it, ret);
+    }
+    return ret;
+}
+
+/* Give the chunks of a chunked item back to the slab allocator */
+static void item_free_chunks(struct default_engine *engine, hash_item *it) {
+    hash_item *chunk = item_get_chunks(it);
+    item_set_chunks(it, NULL);
+
+    while (chunk != NULL) {
+        hash_item *next = chunk->next;
+        unsigned int clsid = chunk->slabs_clsid;
+        size_t ntotal = sizeof(*chunk) + chunk->nbytes;
+        chunk->slabs_clsid = 0;
+        de_atomic_store(&chunk->iflag, ITEM_SLABBED);
+        slabs_free(engine, chunk, ntotal, clsid);
+        chunk = next;
+    }
+}
+
+#ifdef _MSC_VER
+#define ITEM_THREAD_LOCAL __declspec(thread)
+#else
+#define ITEM_THREAD_LOCAL __thread
+#endif
+
+/*
+ * The CAS ids are handed out to each thread in batches of ITEM_CAS_BATCH,
+ * so that the shared counter is only touched once per batch. The ids are
+ * unique (across all of the buckets), but an id handed out by one thread
+ * may be lower than one handed out earlier by another.
+ */
+#define ITEM_CAS_BATCH 256
+
+static uint64_t item_cas_id;
+static ITEM_THREAD_LOCAL uint64_t item_cas_next;
+static ITEM_THREAD_LOCAL uint64_t item_cas_end;
+
 /* Get the next CAS id for a new item. */
 static uint64_t get_cas_id(void) {
-    static uint64_t cas_id = 0;
-    return ++cas_id;
+    if (item_cas_next == item_cas_end) {
+        item_cas_end = de_atomic_add_64(&item_cas_id, ITEM_CAS_BATCH) + 1;
+        item_cas_next = item_cas_end - ITEM_CAS_BATCH;
+    }
+    return item_cas_next++;
 }
 
 /* Enable this for reference-count debugging. */
 #if 0
 # define DEBUG_REFCNT(it,op) \
                 fprintf(stderr, "item %p refcnt(%c) %d %c%c\n", \
-                        it, op, it->refcount, \
-                        (it->iflag & ITEM_LINKED) ? 'L' : ' ', \
-                        (it->iflag & ITEM_SLABBED) ? 'S' : ' ')
+                        it, op, de_atomic_load(&it->refcount), \
+                        (item_iflag(it) & ITEM_LINKED) ? 'L' : ' ', \
+                        (item_iflag(it) & ITEM_SLABBED) ? 'S' : ' ')
 #else
 # define DEBUG_REFCNT(it,op) while(0)
 #endif
 
 
+/*
+ * Try to find an expired item at the tail of the LRU for the slab class
+ * and steal its memory.
+ */
+static hash_item *do_item_reclaim(struct default_engine *engine,
+                                  unsigned int id, size_t ntotal,
+                                  rel_time_t current_time) {
+    int tries = search_items;
+    int ii;
+
+    for (ii = 0; ii < ITEM_LRU_SEGMENTS && tries > 0; ++ii) {
+        int lru = item_lru_evict_order[ii] * POWER_LARGEST + id;
+        hash_item *search;
+
+        for (search = engine->items.tails[lru];
+             tries > 0 && search != NULL;
+             tries--, search=search->prev) {
+            if (de_atomic_load(&search->refcount) == 0 &&
+                item_is_dead(engine, search, current_time)) {
+                hash_item *it = search;
+                /*
+                 * Hold a reference across the unlink so it isn't freed. An
+                 * optimistic reader may bump the refcount at any time, so
+                 * don't overwrite it.
+                 */
+                if (!de_atomic_cas_16(&it->refcount, 0, 1)) {
+                    continue;
+                }
+                /* I don't want to actually free the object, just steal
+                 * the item to avoid to grab the slab mutex twice ;-)
+                 */
+                engine_stats_add(engine, ENGINE_STAT_RECLAIMED, 1);
+                engine->items.itemstats[id].reclaimed++;
+                slabs_adjust_mem_requested(engine, it->slabs_clsid,
+                                           item_slab_ntotal(engine, it),
+                                           ntotal);
+                do_item_unlink(engine, it);
+                if (item_is_chunked(it)) {
+                    item_free_chunks(engine, it);
+                }
+                /* Initialize the item block: */
+                it->slabs_clsid = 0;
+                de_atomic_decr_16(&it->refcount);
+                return it;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Account for (and unlink) the item evicted from slab class id */
+static void do_item_evict_item(struct default_engine *engine, unsigned int id,
+                               hash_item *it, const void *cookie,
+                               rel_time_t current_time) {
+    engine->items.itemstats[id].evicted++;
+    engine->items.itemstats[id].evicted_time = current_time - it->time;
+    if (it->exptime != 0) {
+        engine->items.itemstats[id].evicted_nonzero++;
+    }
+    engine_stats_add(engine, ENGINE_STAT_EVICTIONS, 1);
+    engine->server.stat->evicting(cookie, item_get_key(it), it->nkey);
+    do_item_unlink(engine, it);
+}
+
+/*
+ * Evict an item from the slab class. Items which have been read since
+ * they were put in the LRU get a second chance (moved to the warm
+ * segment) unless we can't find anything else to evict.
+ *
+ * Returns true if an item was unlinked.
+ */
+static bool do_item_evict_lru(struct default_engine *engine, unsigned int id,
+                              const void *cookie, rel_time_t current_time) {
+    int pass;
+
+    for (pass = 0; pass < 2; ++pass) {
+        int ii;
+        for (ii = 0; ii < ITEM_LRU_SEGMENTS; ++ii) {
+            int lru = item_lru_evict_order[ii] * POWER_LARGEST + id;
+            int tries = search_items;
+            hash_item *search;
+            hash_item *prev;
+
+            for (search = engine->items.tails[lru];
+                 tries > 0 && search != NULL;
+                 tries--, search = prev) {
+                prev = search->prev;
+                if (de_atomic_load(&search->refcount) != 0) {
+                    continue;
+                }
+
+                if (search->exptime == 0 || search->exptime > current_time) {
+                    if (pass == 0 && (item_iflag(search) & ITEM_ACTIVE) != 0 &&
+                        !item_is_dead(engine, search, current_time)) {
+                        do_item_lru_move(engine, search, ITEM_LRU_WARM,
+                                         current_time);
+                        continue;
+                    }
+
+                    do_item_evict_item(engine, id, search, cookie,
+                                       current_time);
+                    return true;
+                }
+
+                engine->items.itemstats[id].reclaimed++;
+                engine_stats_add(engine, ENGINE_STAT_RECLAIMED, 1);
+                do_item_unlink(engine, search);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Evict the least valuable of eviction_samples items picked at random
+ * from the slab pages of the class, which takes the same time however
+ * many items are pinned (or moved around) at the tail of the LRU lists.
+ * The items are ranked by how often their key was accessed recently
+ * (see struct item_sketch), then by whether they were read since they
+ * were put in the LRU. The hot segment of the LRU is the admission
+ * window: of the items ranked the same, the ones still in it (and then
+ * the most recent ones) go last. A dead item is reclaimed as soon as we
+ * see it.
+ *
+ * We keep drawing samples while the best candidate is still worth
+ * keeping, up to ITEM_EVICT_SAMPLE_ROUNDS, and only fall back to the LRU
+ * lists if none of the items sampled could be evicted.
+ *
+ * Returns true if an item was unlinked.
+ */
+static bool do_item_evict_sampled(struct default_engine *engine,
+                                  unsigned int id, const void *cookie,
+                                  rel_time_t current_time) {
+    void *chunks[ITEM_EVICT_MAX_SAMPLES];
+    itemstats_t *stats = &engine->items.itemstats[id];
+    hash_item *victim = NULL;
+    unsigned int victim_rank = 0;
+    int round;
+
+    for (round = 0; round < ITEM_EVICT_SAMPLE_ROUNDS; ++round) {
+        int nchunks = slabs_sample(engine, id, chunks,
+                                   (int)engine->config.eviction_samples,
+                                   &engine->items.evict_seed);
+        int ii;
+
+        if (nchunks == 0) {
+            break;
+        }
+        stats->evict_samples += nchunks;
+
+        for (ii = 0; ii < nchunks; ++ii) {
+            hash_item *it = chunks[ii];
+            unsigned int rank;
+
+            /* Free chunks, chunks of a value and items in use */
+            if ((item_iflag(it) & ITEM_LINKED) == 0 || it->slabs_clsid != id ||
+                de_atomic_load(&it->refcount) != 0 || item_is_cursor(it)) {
+                continue;
+            }
+            if (item_is_dead(engine, it, current_time)) {
+                stats->reclaimed++;
+                engine_stats_add(engine, ENGINE_STAT_RECLAIMED, 1);
+                do_item_unlink(engine, it);
+                return true;
+            }
+
+            rank = item_sketch_estimate(&engine->items.sketch, it->hash) * 4;
+            if ((item_iflag(it) & ITEM_ACTIVE) != 0) {
+                rank += 2;
+            }
+            if (item_lru_segment(it) == ITEM_LRU_HOT) {
+                rank += 1;
+            }
+            if (victim == NULL || rank < victim_rank ||
+                (rank == victim_rank && it->time < victim->time)) {
+                victim = it;
+                victim_rank = rank;
+            }
+        }
+
+        /* Accessed at most once since the counters were last halved */
+        if (victim != NULL && victim_rank < 2 * 4) {
+            break;
+        }
+    }
+
+    if (victim != NULL) {
+        do_item_evict_item(engine, id, victim, cookie, current_time);
+        return true;
+    }
+
+    stats->evict_fallbacks++;
+    return do_item_evict_lru(engine, id, cookie, current_time);
+}
+
+static bool do_item_evict(struct default_engine *engine, unsigned int id,
+                          const void *cookie, rel_time_t current_time) {
+    if (engine->items.evict_policy == ITEM_EVICT_SAMPLED) {
+        return do_item_evict_sampled(engine, id, cookie, current_time);
+    }
+    return do_item_evict_lru(engine, id, cookie, current_time);
+}
+
+/*
+ * Initialize a chunk we got from the slab allocator (or reclaimed) as a new
+ * item, referenced by the caller.
+ */
+static void item_initialize(struct default_engine *engine, hash_item *it,
+                            unsigned int id, uint16_t iflag,
+                            uint32_t hash, const void *key, uint16_t nkey,
+                            const int flags, const rel_time_t exptime,
+                            const int nbytes, uint8_t datatype) {
+    cb_assert(it->slabs_clsid == 0);
+
+    it->slabs_clsid = id;
+    it->next = it->prev = it->h_next = 0;
+    /*
+     * the caller will have a reference. The count may be non-zero if an
+     * optimistic reader looked at the chunk after it was freed (it will
+     * drop its reference again). The reference must be visible before
+     * ITEM_SLABBED is cleared (see do_item_release).
+     */
+    de_atomic_incr_16(&it->refcount);
+    DEBUG_REFCNT(it, '*');
+    /* New items go in the hot segment of the LRU */
+    if (engine->config.use_cas) {
+        iflag |= ITEM_WITH_CAS;
+    }
+    de_atomic_store(&it->iflag, iflag);
+    item_set_lru_segment(it, ITEM_LRU_HOT);
+    it->nbytes = nbytes;
+    it->flags = flags;
+    it->datatype = datatype;
+    it->exptime = exptime;
+    it->hash = hash;
+    it->nkey = nkey;
+    memcpy(item_get_key(it), key, nkey);
+}
+
+/*
+ * Allocate the chain of chunks for the nbytes of the value of a chunked
+ * item which don't fit in the item itself. The chunks are allocated from
+ * the largest slab class, where we may evict items to make room.
+ */
+static bool do_item_alloc_chunks(struct default_engine *engine,
+                                 hash_item *it, size_t nbytes,
+                                 const void *cookie,
+                                 rel_time_t current_time) {
+    const unsigned int largest = engine->slabs.power_largest;
+    const size_t chunk_max = item_chunk_max(engine) - sizeof(hash_item);
+    hash_item *head = NULL;
+    hash_item *tail = NULL;
+
+    while (nbytes > 0) {
+        size_t len = nbytes < chunk_max ? nbytes : chunk_max;
+        size_t ntotal = sizeof(hash_item) + len;
+        unsigned int id = slabs_clsid(engine, ntotal);
+        hash_item *chunk = slabs_alloc(engine, ntotal, id);
+
+        if (chunk == NULL && id != largest) {
+            id = largest;
+            chunk = slabs_alloc(engine, ntotal, id);
+        }
+        if (chunk == NULL && engine->config.evict_to_free &&
+            do_item_evict(engine, largest, cookie, current_time)) {
+            chunk = slabs_alloc(engine, ntotal, id);
+        }
+        if (chunk == NULL) {
+            engine->items.itemstats[largest].outofmemory++;
+            item_set_chunks(it, head);
+            item_free_chunks(engine, it);
+            return false;
+        }
+
+        cb_assert(chunk->slabs_clsid == 0);
+        chunk->slabs_clsid = id;
+        chunk->next = chunk->h_next = NULL;
+        chunk->prev = it;
+        chunk->nbytes = (uint32_t)len;
+        chunk->nkey = 0;
+        de_atomic_store(&chunk->iflag, ITEM_CHUNK);
+        if (tail == NULL) {
+            head = chunk;
+        } else {
+            tail->next = chunk;
+        }
+        tail = chunk;
+        nbytes -= len;
+    }
+
+    item_set_chunks(it, head);
+    return true;
+}
+
 /*@null@*/
-hash_item *do_item_alloc(struct default_engine *engine,
-                         const hash_key *key,
-                         const int flags,
-                         const rel_time_t exptime,
-                         const int nbytes,
-                         const void *cookie,
-                         uint8_t datatype) {
+static hash_item *do_item_alloc_key(struct default_engine *engine,
+                                    uint32_t hash,
+                                    const void *key, uint16_t nkey,
+                                    const int flags,
+                                    const rel_time_t exptime,
+                                    const int nbytes,
+                                    const void *cookie,
+                                    uint8_t datatype) {
     hash_item *it = NULL;
-    int tries = search_items;
-    hash_item *search;
-    rel_time_t oldest_live;
     rel_time_t current_time;
     unsigned int id;
+    size_t inline_bytes = nbytes;
+    bool chunked = false;
+    int ii;
 
-    size_t ntotal = sizeof(hash_item) + hash_key_get_alloc_size(key) + nbytes;
+    size_t ntotal = sizeof(hash_item) + nkey + nbytes;
     if (engine->config.use_cas) {
         ntotal += sizeof(uint64_t);
     }
 
-    if ((id = slabs_clsid(engine, ntotal)) == 0) {
+    if (ntotal > item_chunk_max(engine)) {
+        /* The item takes a whole chunk, the rest goes in the chain */
+        chunked = true;
+        inline_bytes = item_chunk_max(engine) - sizeof(hash_item*) -
+                       (ntotal - nbytes);
+        ntotal = item_chunk_max(engine);
+        id = engine->slabs.power_largest;
+    } else if ((id = slabs_clsid(engine, ntotal)) == 0) {
         return 0;
     }
 
-    /* do a quick check if we have any expired items in the tail.. */
-    tries = search_items;
-    oldest_live = engine->config.oldest_live;
+    /*
+     * do a quick check if we have any expired items in the tail.. (the
+     * sampled eviction reclaims the dead items it comes across instead)
+     */
     current_time = engine->server.core->get_current_time();
-
-    for (search = engine->items.tails[id];
-         tries > 0 && search != NULL;
-         tries--, search=search->prev) {
-        if (search->refcount == 0 &&
-            ((search->time < oldest_live) || /* dead by flush */
-             (search->exptime != 0 && search->exptime < current_time))) {
-            it = search;
-            /* I don't want to actually free the object, just steal
-             * the item to avoid to grab the slab mutex twice ;-)
-             */
-            cb_mutex_enter(&engine->stats.lock);
-            engine->stats.reclaimed++;
-            cb_mutex_exit(&engine->stats.lock);
-            engine->items.itemstats[id].reclaimed++;
-            it->refcount = 1;
-            slabs_adjust_mem_requested(engine, it->slabs_clsid, ITEM_ntotal(engine, it), ntotal);
-            do_item_unlink(engine, it);
-            /* Initialize the item block: */
-            it->slabs_clsid = 0;
-            it->refcount = 0;
-            break;
-        }
+    if (engine->items.evict_policy == ITEM_EVICT_LRU) {
+        it = do_item_reclaim(engine, id, ntotal, current_time);
     }
 
     if (it == NULL && (it = slabs_alloc(engine, ntotal, id)) == NULL) {
+        bool empty = true;
+
         /*
         ** Could not find an expired item at the tail, and memory allocation
         ** failed. Try to evict some items!
         */
-        tries = search_items;
 
         /* If requested to not push old items out of cache when memory runs out,
          * we're out of luck at this point...
@@ -164,36 +818,17 @@ hash_item *do_item_alloc(struct default_engine *engine,
          * tries
          */
 
-        if (engine->items.tails[id] == 0) {
+        for (ii = 0; ii < ITEM_LRU_SEGMENTS; ++ii) {
+            if (engine->items.tails[ii * POWER_LARGEST + id] != NULL) {
+                empty = false;
+            }
+        }
+        if (empty) {
             engine->items.itemstats[id].outofmemory++;
             return NULL;
         }
 
-        for (search = engine->items.tails[id]; tries > 0 && search != NULL; tries--, search=search->prev) {
-            if (search->refcount == 0) {
-                if (search->exptime == 0 || search->exptime > current_time) {
-                    engine->items.itemstats[id].evicted++;
-                    engine->items.itemstats[id].evicted_time = current_time - search->time;
-                    if (search->exptime != 0) {
-                        engine->items.itemstats[id].evicted_nonzero++;
-                    }
-                    cb_mutex_enter(&engine->stats.lock);
-                    engine->stats.evictions++;
-                    cb_mutex_exit(&engine->stats.lock);
-                    const hash_key* search_key = item_get_key(search);
-                    engine->server.stat->evicting(cookie,
-                                                  hash_key_get_client_key(search_key),
-                                                  hash_key_get_client_key_len(search_key));
-                } else {
-                    engine->items.itemstats[id].reclaimed++;
-                    cb_mutex_enter(&engine->stats.lock);
-                    engine->stats.reclaimed++;
-                    cb_mutex_exit(&engine->stats.lock);
-                }
-                do_item_unlink(engine, search);
-                break;
-            }
-        }
+        do_item_evict(engine, id, cookie, current_time);
         it = slabs_alloc(engine, ntotal, id);
         if (it == 0) {
             engine->items.itemstats[id].outofmemory++;
@@ -204,13 +839,21 @@ hash_item *do_item_alloc(struct default_engine *engine,
              * three hours, so if we find one in the tail which is that old,
              * free it anyway.
              */
-            tries = search_items;
-            for (search = engine->items.tails[id]; tries > 0 && search != NULL; tries--, search=search->prev) {
-                if (search->refcount != 0 && search->time + TAIL_REPAIR_TIME < current_time) {
-                    engine->items.itemstats[id].tailrepairs++;
-                    search->refcount = 0;
-                    do_item_unlink(engine, search);
-                    break;
+            bool repaired = false;
+            for (ii = 0; ii < ITEM_LRU_SEGMENTS && !repaired; ++ii) {
+                int lru = item_lru_evict_order[ii] * POWER_LARGEST + id;
+                int tries = search_items;
+                hash_item *search;
+                for (search = engine->items.tails[lru]; tries > 0 && search != NULL; tries--, search=search->prev) {
+                    if (de_atomic_load(&search->refcount) != 0 &&
+                        !item_is_cursor(search) &&
+                        search->time + TAIL_REPAIR_TIME < current_time) {
+                        engine->items.itemstats[id].tailrepairs++;
+                        de_atomic_store(&search->refcount, 0);
+                        do_item_unlink(engine, search);
+                        repaired = true;
+                        break;
+                    }
                 }
             }
             it = slabs_alloc(engine, ntotal, id);
@@ -220,47 +863,66 @@ hash_item *do_item_alloc(struct default_engine *engine,
         }
     }
 
-    cb_assert(it->slabs_clsid == 0);
-
-    it->slabs_clsid = id;
-
-    cb_assert(it != engine->items.heads[it->slabs_clsid]);
-
-    it->next = it->prev = it->h_next = 0;
-    it->refcount = 1;     /* the caller will have a reference */
-    DEBUG_REFCNT(it, '*');
-    it->iflag = engine->config.use_cas ? ITEM_WITH_CAS : 0;
-    it->nbytes = nbytes;
-    it->flags = flags;
-    it->datatype = datatype;
-    it->exptime = exptime;
-    hash_key_copy_to_item(it, key);
+    cb_assert(it != engine->items.heads[id]);
+    item_initialize(engine, it, id, chunked ? ITEM_CHUNKED : 0,
+                    hash, key, nkey, flags, exptime, nbytes, datatype);
+    if (chunked) {
+        item_set_chunks(it, NULL);
+        if (!do_item_alloc_chunks(engine, it, nbytes - inline_bytes, cookie,
+                                  current_time)) {
+            do_item_release(engine, it);
+            return NULL;
+        }
+    }
     return it;
 }
 
+/*@null@*/
+hash_item *do_item_alloc(struct default_engine *engine,
+                         const hash_key *key,
+                         const int flags,
+                         const rel_time_t exptime,
+                         const int nbytes,
+                         const void *cookie,
+                         uint8_t datatype) {
+    return do_item_alloc_key(engine, hash_key_hash(key),
+                             hash_key_get_client_key(key),
+                             hash_key_get_client_key_len(key),
+                             flags, exptime, nbytes, cookie, datatype);
+}
+
 static void item_free(struct default_engine *engine, hash_item *it) {
-    size_t ntotal = ITEM_ntotal(engine, it);
+    size_t ntotal = item_slab_ntotal(engine, it);
     unsigned int clsid;
-    cb_assert((it->iflag & ITEM_LINKED) == 0);
-    cb_assert(it != engine->items.heads[it->slabs_clsid]);
-    cb_assert(it != engine->items.tails[it->slabs_clsid]);
-    cb_assert(it->refcount == 0 || engine->scrubber.force_delete);
+    cb_assert((item_iflag(it) & ITEM_LINKED) == 0);
+    cb_assert(it != engine->items.heads[item_lru_id(it)]);
+    cb_assert(it != engine->items.tails[item_lru_id(it)]);
+    /*
+     * Note that the refcount can't be verified here. An optimistic reader
+     * may hold a transient reference to the item, which is dropped again
+     * as it fails to validate its lookup.
+     */
+
+    if (item_is_chunked(it)) {
+        item_free_chunks(engine, it);
+    }
 
     /* so slab size changer can tell later if item is already free or not */
     clsid = it->slabs_clsid;
     it->slabs_clsid = 0;
-    it->iflag |= ITEM_SLABBED;
+    de_atomic_or_16(&it->iflag, ITEM_SLABBED);
     DEBUG_REFCNT(it, 'F');
     slabs_free(engine, it, ntotal, clsid);
 }
 
 static void item_link_q(struct default_engine *engine, hash_item *it) { /* item is the new head */
     hash_item **head, **tail;
+    int lru = item_lru_id(it);
     cb_assert(it->slabs_clsid < POWER_LARGEST);
-    cb_assert((it->iflag & ITEM_SLABBED) == 0);
+    cb_assert((item_iflag(it) & ITEM_SLABBED) == 0);
 
-    head = &engine->items.heads[it->slabs_clsid];
-    tail = &engine->items.tails[it->slabs_clsid];
+    head = &engine->items.heads[lru];
+    tail = &engine->items.tails[lru];
     cb_assert(it != *head);
     cb_assert((*head && *tail) || (*head == 0 && *tail == 0));
     it->prev = 0;
@@ -268,15 +930,16 @@ static void item_link_q(struct default_engine *engine, hash_item *it) { /* item
     if (it->next) it->next->prev = it;
     *head = it;
     if (*tail == 0) *tail = it;
-    engine->items.sizes[it->slabs_clsid]++;
+    engine->items.sizes[lru]++;
     return;
 }
 
 static void item_unlink_q(struct default_engine *engine, hash_item *it) {
     hash_item **head, **tail;
+    int lru = item_lru_id(it);
     cb_assert(it->slabs_clsid < POWER_LARGEST);
-    head = &engine->items.heads[it->slabs_clsid];
-    tail = &engine->items.tails[it->slabs_clsid];
+    head = &engine->items.heads[lru];
+    tail = &engine->items.tails[lru];
 
     if (*head == it) {
         cb_assert(it->prev == 0);
@@ -291,26 +954,53 @@ static void item_unlink_q(struct default_engine *engine, hash_item *it) {
 
     if (it->next) it->next->prev = it->prev;
     if (it->prev) it->prev->next = it->next;
-    engine->items.sizes[it->slabs_clsid]--;
+    engine->items.sizes[lru]--;
     return;
 }
 
+/*
+ * Move a linked item to the head of another segment of its LRU. Items
+ * moved to the warm segment have been used, so their access time and
+ * active flag is reset.
+ */
+static void do_item_lru_move(struct default_engine *engine, hash_item *it,
+                             int segment, rel_time_t current_time) {
+    itemstats_t *stats = &engine->items.itemstats[it->slabs_clsid];
+    int from = item_lru_segment(it);
+
+    item_unlink_q(engine, it);
+    if (segment == ITEM_LRU_WARM) {
+        de_atomic_and_16(&it->iflag, (uint16_t)~ITEM_ACTIVE);
+        it->time = current_time;
+        if (from == ITEM_LRU_WARM) {
+            stats->moves_within_lru++;
+        } else {
+            stats->moves_to_warm++;
+        }
+    } else if (segment == ITEM_LRU_COLD) {
+        stats->moves_to_cold++;
+    }
+    item_set_lru_segment(it, segment);
+    item_link_q(engine, it);
+}
+
 int do_item_link(struct default_engine *engine, hash_item *it) {
-    const hash_key* key = item_get_key(it);
-    MEMCACHED_ITEM_LINK(hash_key_get_client_key(key), hash_key_get_client_key_len(key), it->nbytes);
-    cb_assert((it->iflag & (ITEM_LINKED|ITEM_SLABBED)) == 0);
-    it->iflag |= ITEM_LINKED;
+    MEMCACHED_ITEM_LINK(item_get_key(it), it->nkey, it->nbytes);
+    cb_assert((item_iflag(it) & (ITEM_LINKED|ITEM_SLABBED)) == 0);
+    de_atomic_or_16(&it->iflag, ITEM_LINKED);
     it->time = engine->server.core->get_current_time();
+    it->generation = engine->items.generation;
+    item_sketch_add(engine, it->hash);
 
-    assoc_insert(engine, crc32c(hash_key_get_key(key),
-                                hash_key_get_key_len(key), 0),
-                 it);
+    assoc_insert(engine, it->hash, it);
+    if (it->exptime != 0) {
+        engine->items.expiry.items++;
+        expiry_insert(&engine->items.expiry, it);
+    }
 
-    cb_mutex_enter(&engine->stats.lock);
-    engine->stats.curr_bytes += ITEM_ntotal(engine, it);
-    engine->stats.curr_items += 1;
-    engine->stats.total_items += 1;
-    cb_mutex_exit(&engine->stats.lock);
+    engine_stats_add(engine, ENGINE_STAT_CURR_BYTES, ITEM_ntotal(engine, it));
+    engine_stats_add(engine, ENGINE_STAT_CURR_ITEMS, 1);
+    engine_stats_add(engine, ENGINE_STAT_TOTAL_ITEMS, 1);
 
     /* Allocate a new CAS ID on link. */
     item_set_cas(NULL, NULL, it, get_cas_id());
@@ -321,64 +1011,75 @@ int do_item_link(struct default_engine *engine, hash_item *it) {
 }
 
 void do_item_unlink(struct default_engine *engine, hash_item *it) {
-    const hash_key* key = item_get_key(it);
-    MEMCACHED_ITEM_UNLINK(hash_key_get_client_key(key),
-                          hash_key_get_client_key_len(key),
-                          it->nbytes);
-    if ((it->iflag & ITEM_LINKED) != 0) {
-        it->iflag &= ~ITEM_LINKED;
-        cb_mutex_enter(&engine->stats.lock);
-        engine->stats.curr_bytes -= ITEM_ntotal(engine, it);
-        engine->stats.curr_items -= 1;
-        cb_mutex_exit(&engine->stats.lock);
-        assoc_delete(engine, crc32c(hash_key_get_key(key),
-                                    hash_key_get_key_len(key), 0),
-                     key);
+    MEMCACHED_ITEM_UNLINK(item_get_key(it), it->nkey, it->nbytes);
+    if ((item_iflag(it) & ITEM_LINKED) != 0) {
+        /*
+         * item_release drops its reference without items.lock and only
+         * comes here to free the item if it doesn't see ITEM_LINKED; the
+         * barrier makes sure that either it sees the flag cleared or we
+         * see its reference gone.
+         */
+        de_atomic_and_16(&it->iflag, (uint16_t)~ITEM_LINKED);
+        de_memory_barrier();
+        engine_stats_add(engine, ENGINE_STAT_CURR_BYTES,
+                         -(int64_t)ITEM_ntotal(engine, it));
+        engine_stats_add(engine, ENGINE_STAT_CURR_ITEMS, -1);
+        assoc_delete(engine, it->hash, it);
+        if (it->exptime != 0) {
+            engine->items.expiry.items--;
+        }
         item_unlink_q(engine, it);
-        if (it->refcount == 0 || engine->scrubber.force_delete) {
+        if (de_atomic_load(&it->refcount) == 0) {
             item_free(engine, it);
         }
     }
 }
 
+/*
+ * Frees the item if it's no longer referenced nor linked. Must be called
+ * with items.lock held.
+ */
+static void do_item_free_unreferenced(struct default_engine *engine,
+                                      hash_item *it) {
+    /*
+     * The item may already be freed if the reference was a transient one
+     * held by an optimistic reader. item_alloc may reuse the chunk (without
+     * items.lock) as we look at it, but it takes its reference before it
+     * clears ITEM_SLABBED, so check the refcount again after the flags.
+     * The chunk may also have been reused as a part of a chunked item.
+     */
+    if ((item_iflag(it) &
+         (ITEM_LINKED|ITEM_SLABBED|ITEM_CHUNK)) == 0 &&
+        de_atomic_load(&it->refcount) == 0) {
+        item_free(engine, it);
+    }
+}
+
 void do_item_release(struct default_engine *engine, hash_item *it) {
-    MEMCACHED_ITEM_REMOVE(hash_key_get_client_key(item_get_key(it)),
-                          hash_key_get_client_key_len(item_get_key(it)),
-                          it->nbytes);
-    if (it->refcount != 0) {
-        it->refcount--;
+    MEMCACHED_ITEM_REMOVE(item_get_key(it), it->nkey, it->nbytes);
+    uint16_t refcount = de_atomic_load(&it->refcount);
+    if (refcount != 0) {
+        refcount = de_atomic_decr_16(&it->refcount);
         DEBUG_REFCNT(it, '-');
     }
-    if (it->refcount == 0 && (it->iflag & ITEM_LINKED) == 0) {
-        item_free(engine, it);
+    if (refcount == 0) {
+        do_item_free_unreferenced(engine, it);
     }
 }
 
 void do_item_update(struct default_engine *engine, hash_item *it) {
-    rel_time_t current_time = engine->server.core->get_current_time();
-    MEMCACHED_ITEM_UPDATE(hash_key_get_client_key(item_get_key(it)),
-                          hash_key_get_client_key_len(item_get_key(it)),
-                          it->nbytes);
-    if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
-        cb_assert((it->iflag & ITEM_SLABBED) == 0);
-
-        if ((it->iflag & ITEM_LINKED) != 0) {
-            item_unlink_q(engine, it);
-            it->time = current_time;
-            item_link_q(engine, it);
-        }
-    }
+    MEMCACHED_ITEM_UPDATE(item_get_key(it), it->nkey, it->nbytes);
+    cb_assert((item_iflag(it) & ITEM_SLABBED) == 0);
+    item_mark_active(it);
+    item_sketch_add(engine, it->hash);
 }
 
 int do_item_replace(struct default_engine *engine,
                     hash_item *it, hash_item *new_it) {
-    MEMCACHED_ITEM_REPLACE(hash_key_get_client_key(item_get_key(it)),
-                           hash_key_get_client_key_len(item_get_key(it)),
-                           it->nbytes,
-                           hash_key_get_client_key(item_get_key(new_it)),
-                           hash_key_get_client_key_len(item_get_key(new_it)),
+    MEMCACHED_ITEM_REPLACE(item_get_key(it), it->nkey, it->nbytes,
+                           item_get_key(new_it), new_it->nkey,
                            new_it->nbytes);
-    cb_assert((it->iflag & ITEM_SLABBED) == 0);
+    cb_assert((item_iflag(it) & ITEM_SLABBED) == 0);
 
     do_item_unlink(engine, it);
     return do_item_link(engine, new_it);
@@ -389,44 +1090,67 @@ static void do_item_stats(struct default_engine *engine,
     int i;
     rel_time_t current_time = engine->server.core->get_current_time();
     for (i = 0; i < POWER_LARGEST; i++) {
-        if (engine->items.tails[i] != NULL) {
-            const char *prefix = "items";
+        const char *prefix = "items";
+        hash_item *tail = NULL;
+        unsigned int number = 0;
+        int ii;
+
+        for (ii = 0; ii < ITEM_LRU_SEGMENTS; ++ii) {
+            int lru = item_lru_evict_order[ii] * POWER_LARGEST + i;
             int search = search_items;
             while (search > 0 &&
-                   engine->items.tails[i] != NULL &&
-                   ((engine->config.oldest_live != 0 && /* Item flushd */
-                     engine->config.oldest_live <= current_time &&
-                     engine->items.tails[i]->time <= engine->config.oldest_live) ||
-                    (engine->items.tails[i]->exptime != 0 && /* and not expired */
-                     engine->items.tails[i]->exptime < current_time))) {
+                   engine->items.tails[lru] != NULL &&
+                   item_is_dead(engine, engine->items.tails[lru],
+                                current_time)) {
                 --search;
-                if (engine->items.tails[i]->refcount == 0) {
-                    do_item_unlink(engine, engine->items.tails[i]);
+                if (de_atomic_load(&engine->items.tails[lru]->refcount) == 0) {
+                    do_item_unlink(engine, engine->items.tails[lru]);
                 } else {
                     break;
                 }
             }
-            if (engine->items.tails[i] == NULL) {
-                /* We removed all of the items in this slab class */
-                continue;
+            if (tail == NULL) {
+                tail = engine->items.tails[lru];
             }
+            number += engine->items.sizes[lru];
+        }
+
+        if (tail == NULL) {
+            /* We removed all of the items in this slab class */
+            continue;
+        }
 
-            add_statistics(c, add_stats, prefix, i, "number", "%u",
-                           engine->items.sizes[i]);
-            add_statistics(c, add_stats, prefix, i, "age", "%u",
-                           engine->items.tails[i]->time);
-            add_statistics(c, add_stats, prefix, i, "evicted",
-                           "%u", engine->items.itemstats[i].evicted);
-            add_statistics(c, add_stats, prefix, i, "evicted_nonzero",
-                           "%u", engine->items.itemstats[i].evicted_nonzero);
-            add_statistics(c, add_stats, prefix, i, "evicted_time",
-                           "%u", engine->items.itemstats[i].evicted_time);
-            add_statistics(c, add_stats, prefix, i, "outofmemory",
-                           "%u", engine->items.itemstats[i].outofmemory);
-            add_statistics(c, add_stats, prefix, i, "tailrepairs",
-                           "%u", engine->items.itemstats[i].tailrepairs);;
-            add_statistics(c, add_stats, prefix, i, "reclaimed",
-                           "%u", engine->items.itemstats[i].reclaimed);;
+        add_statistics(c, add_stats, prefix, i, "number", "%u", number);
+        add_statistics(c, add_stats, prefix, i, "number_hot", "%u",
+                       engine->items.sizes[ITEM_LRU_HOT * POWER_LARGEST + i]);
+        add_statistics(c, add_stats, prefix, i, "number_warm", "%u",
+                       engine->items.sizes[ITEM_LRU_WARM * POWER_LARGEST + i]);
+        add_statistics(c, add_stats, prefix, i, "number_cold", "%u",
+                       engine->items.sizes[ITEM_LRU_COLD * POWER_LARGEST + i]);
+        add_statistics(c, add_stats, prefix, i, "age", "%u", tail->time);
+        add_statistics(c, add_stats, prefix, i, "evicted",
+                       "%u", engine->items.itemstats[i].evicted);
+        add_statistics(c, add_stats, prefix, i, "evicted_nonzero",
+                       "%u", engine->items.itemstats[i].evicted_nonzero);
+        add_statistics(c, add_stats, prefix, i, "evicted_time",
+                       "%u", engine->items.itemstats[i].evicted_time);
+        add_statistics(c, add_stats, prefix, i, "outofmemory",
+                       "%u", engine->items.itemstats[i].outofmemory);
+        add_statistics(c, add_stats, prefix, i, "tailrepairs",
+                       "%u", engine->items.itemstats[i].tailrepairs);;
+        add_statistics(c, add_stats, prefix, i, "reclaimed",
+                       "%u", engine->items.itemstats[i].reclaimed);;
+        add_statistics(c, add_stats, prefix, i, "moves_to_cold",
+                       "%u", engine->items.itemstats[i].moves_to_cold);
+        add_statistics(c, add_stats, prefix, i, "moves_to_warm",
+                       "%u", engine->items.itemstats[i].moves_to_warm);
+        add_statistics(c, add_stats, prefix, i, "moves_within_lru",
+                       "%u", engine->items.itemstats[i].moves_within_lru);
+        if (engine->items.evict_policy == ITEM_EVICT_SAMPLED) {
+            add_statistics(c, add_stats, prefix, i, "evict_samples",
+                           "%"PRIu64, engine->items.itemstats[i].evict_samples);
+            add_statistics(c, add_stats, prefix, i, "evict_fallbacks",
+                           "%u", engine->items.itemstats[i].evict_fallbacks);
         }
     }
 }
@@ -444,7 +1168,7 @@ static void do_item_stats_sizes(struct default_engine *engine,
         int i;
 
         /* build the histogram */
-        for (i = 0; i < POWER_LARGEST; i++) {
+        for (i = 0; i < ITEM_LRU_LISTS; i++) {
             hash_item *iter = engine->items.heads[i];
             while (iter) {
                 size_t ntotal = ITEM_ntotal(engine, iter);
@@ -452,7 +1176,7 @@ static void do_item_stats_sizes(struct default_engine *engine,
                 if ((ntotal % 32) != 0) {
                     bucket++;
                 }
-                if (bucket < num_buckets) {
+                if (bucket < num_buckets && !item_is_cursor(iter)) {
                     histogram[bucket]++;
                 }
                 iter = iter->next;
@@ -476,14 +1200,69 @@ static void do_item_stats_sizes(struct default_engine *engine,
     }
 }
 
+/*
+ * Items used to carry a hash_key_header (the key length and a pointer to
+ * the key) and the bucket index in front of the key.
+ */
+#define ITEM_LEGACY_KEY_OVERHEAD (sizeof(hash_key_header) + sizeof(bucket_id_t))
+
+/**
+ * Report the per item overhead, and how much memory the current item
+ * layout saves compared to the legacy one (both in raw bytes and in the
+ * size of the slab chunks the items occupy).
+ */
+static void do_item_stats_overhead(struct default_engine *engine,
+                                   ADD_STAT add_stats, const void *c) {
+    const char *prefix = "overhead";
+    const size_t cas = engine->config.use_cas ? sizeof(uint64_t) : 0;
+    uint64_t items = 0;
+    uint64_t chunk_bytes_saved = 0;
+    int i;
+
+    for (i = 0; i < ITEM_LRU_LISTS; i++) {
+        hash_item *iter;
+        for (iter = engine->items.heads[i]; iter != NULL; iter = iter->next) {
+            size_t ntotal;
+            unsigned int legacy_id;
+
+            if (item_is_cursor(iter)) {
+                continue;
+            }
+            ++items;
+            if (item_is_chunked(iter)) {
+                /* Takes the largest chunk either way */
+                continue;
+            }
+            ntotal = ITEM_ntotal(engine, iter);
+            legacy_id = slabs_clsid(engine, ntotal + ITEM_LEGACY_KEY_OVERHEAD);
+            if (legacy_id == 0 ||
+                ntotal + ITEM_LEGACY_KEY_OVERHEAD > item_chunk_max(engine)) {
+                legacy_id = engine->slabs.power_largest;
+            }
+            chunk_bytes_saved += engine->slabs.slabclass[legacy_id].size -
+                engine->slabs.slabclass[iter->slabs_clsid].size;
+        }
+    }
+
+    add_statistics(c, add_stats, prefix, -1, "header_bytes", "%u",
+                   (unsigned int)(sizeof(hash_item) + cas));
+    add_statistics(c, add_stats, prefix, -1, "legacy_header_bytes", "%u",
+                   (unsigned int)(sizeof(hash_item) + cas +
+                                  ITEM_LEGACY_KEY_OVERHEAD));
+    add_statistics(c, add_stats, prefix, -1, "bytes_saved_per_item", "%u",
+                   (unsigned int)ITEM_LEGACY_KEY_OVERHEAD);
+    add_statistics(c, add_stats, prefix, -1, "items", "%"PRIu64, items);
+    add_statistics(c, add_stats, prefix, -1, "bytes_saved", "%"PRIu64,
+                   items * ITEM_LEGACY_KEY_OVERHEAD);
+    add_statistics(c, add_stats, prefix, -1, "chunk_bytes_saved", "%"PRIu64,
+                   chunk_bytes_saved);
+}
+
 /** wrapper around assoc_find which does the lazy expiration logic */
-hash_item *do_item_get(struct default_engine *engine,
-                       const hash_key *key) {
+static hash_item *do_item_find(struct default_engine *engine, uint32_t hash,
+                               const void *key, uint16_t nkey) {
     rel_time_t current_time = engine->server.core->get_current_time();
-    hash_item *it = assoc_find(engine,
-                               crc32c(hash_key_get_key(key),
-                                      hash_key_get_key_len(key), 0),
-                               key);
+    hash_item *it = assoc_find(engine, hash, key, nkey);
     int was_found = 0;
 
     if (engine->config.verbose > 2) {
@@ -491,21 +1270,17 @@ hash_item *do_item_get(struct default_engine *engine,
         logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
         if (it == NULL) {
             logger->log(EXTENSION_LOG_DEBUG, NULL,
-                        "> NOT FOUND in bucket %d, %s",
-                        hash_key_get_bucket_index(key),
-                        hash_key_get_client_key(key));
+                        "> NOT FOUND in bucket %d, %.*s",
+                        engine->bucket_id, nkey, (const char*)key);
         } else {
             logger->log(EXTENSION_LOG_DEBUG, NULL,
-                        "> FOUND KEY in bucket %d, %s",
-                        hash_key_get_bucket_index(item_get_key(it)),
-                        hash_key_get_client_key(item_get_key(it)));
+                        "> FOUND KEY in bucket %d, %.*s",
+                        engine->bucket_id, nkey, (const char*)key);
             was_found++;
         }
     }
 
-    if (it != NULL && engine->config.oldest_live != 0 &&
-        engine->config.oldest_live <= current_time &&
-        it->time <= engine->config.oldest_live) {
+    if (it != NULL && item_is_flushed(engine, it)) {
         do_item_unlink(engine, it);           /* MTSAFE - items.lock held */
         it = NULL;
     }
@@ -530,7 +1305,7 @@ hash_item *do_item_get(struct default_engine *engine,
     }
 
     if (it != NULL) {
-        it->refcount++;
+        de_atomic_incr_16(&it->refcount);
         DEBUG_REFCNT(it, '+');
         do_item_update(engine, it);
     }
@@ -538,6 +1313,142 @@ hash_item *do_item_get(struct default_engine *engine,
     return it;
 }
 
+hash_item *do_item_get(struct default_engine *engine,
+                       const hash_key *key) {
+    return do_item_find(engine, hash_key_hash(key),
+                        hash_key_get_client_key(key),
+                        hash_key_get_client_key_len(key));
+}
+
+/*
+ * Try to get exclusive access to the content of an item the caller holds
+ * a reference to, so that it may be modified in place. Optimistic readers
+ * grab their reference without items.lock, so the lookups in progress
+ * must be invalidated before we can trust the refcount.
+ *
+ * Returns false if someone else references the item.
+ */
+static bool do_item_lock_exclusive(struct default_engine *engine,
+                                   hash_item *it) {
+    assoc_write_begin(engine, it->hash);
+    if (de_atomic_load(&it->refcount) == 1) {
+        return true;
+    }
+    assoc_write_end(engine, it->hash);
+    return false;
+}
+
+static void do_item_unlock_exclusive(struct default_engine *engine,
+                                     hash_item *it) {
+    assoc_write_end(engine, it->hash);
+}
+
+/*
+ * Can the value of the item grow to nbytes without moving it? Items
+ * rarely fill their slab chunk, so the value may use the slack at the
+ * end of the chunk.
+ */
+static bool item_has_room(struct default_engine *engine, const hash_item *it,
+                          size_t nbytes) {
+    return !item_is_chunked(it) &&
+           ITEM_ntotal(engine, it) - it->nbytes + nbytes <=
+           engine->slabs.slabclass[it->slabs_clsid].size;
+}
+
+/*
+ * Change the size of the value of a linked item the caller has exclusive
+ * access to (see do_item_lock_exclusive and item_has_room).
+ */
+static void do_item_resize(struct default_engine *engine, hash_item *it,
+                           uint32_t nbytes) {
+    size_t old = ITEM_ntotal(engine, it);
+    it->nbytes = nbytes;
+    engine_stats_add(engine, ENGINE_STAT_CURR_BYTES,
+                     (int64_t)ITEM_ntotal(engine, it) - (int64_t)old);
+    slabs_adjust_mem_requested(engine, it->slabs_clsid, old,
+                               ITEM_ntotal(engine, it));
+}
+
+/*
+ * Append (or prepend) the value of it to old_it without moving old_it,
+ * if there is room for it in old_it's slab chunk.
+ *
+ * Returns false if old_it must be replaced by a new item instead.
+ */
+static bool do_item_append_in_place(struct default_engine *engine,
+                                    hash_item *old_it, const hash_item *it,
+                                    ENGINE_STORE_OPERATION operation) {
+    const uint32_t nbytes = old_it->nbytes;
+    char *data;
+
+    if (item_is_chunked(it) ||
+        item_is_compressed(old_it) || item_is_compressed(it) ||
+        !item_has_room(engine, old_it, nbytes + it->nbytes) ||
+        !do_item_lock_exclusive(engine, old_it)) {
+        return false;
+    }
+
+    do_item_resize(engine, old_it, nbytes + it->nbytes);
+    data = item_get_data(old_it);
+    if (operation == OPERATION_APPEND) {
+        memcpy(data + nbytes, item_get_data(it), it->nbytes);
+    } else {
+        memmove(data + it->nbytes, data, nbytes);
+        memcpy(data, item_get_data(it), it->nbytes);
+    }
+    old_it->datatype = it->datatype;
+    item_set_cas(NULL, NULL, old_it, get_cas_id());
+    do_item_unlock_exclusive(engine, old_it);
+    return true;
+}
+
+/*
+ * Append (or prepend) the value of it to the value of old_it when one of
+ * them is compressed: the values are inflated and concatenated, and the
+ * new item is stored uncompressed.
+ *
+ * Returns the new item, or NULL with the reason in *err.
+ */
+static hash_item *do_item_concat_inflated(struct default_engine *engine,
+                                          hash_item *old_it,
+                                          const hash_item *it,
+                                          ENGINE_STORE_OPERATION operation,
+                                          const void *cookie,
+                                          ENGINE_ERROR_CODE *err) {
+    const hash_item *first = operation == OPERATION_APPEND ? old_it : it;
+    const hash_item *second = operation == OPERATION_APPEND ? it : old_it;
+    hash_item *new_it = NULL;
+    size_t first_len, second_len;
+    char *first_value = item_get_value_inflated(engine, first, &first_len);
+    char *second_value = item_get_value_inflated(engine, second, &second_len);
+    char *value = NULL;
+
+    *err = ENGINE_NOT_STORED;
+    if (first_value != NULL && second_value != NULL) {
+        if (first_len + second_len > engine->config.item_size_max) {
+            *err = ENGINE_E2BIG;
+        } else if ((value = realloc(first_value,
+                                    first_len + second_len)) != NULL) {
+            first_value = NULL;
+            memcpy(value + first_len, second_value, second_len);
+            new_it = do_item_alloc_key(engine, it->hash, item_get_key(it),
+                                       it->nkey, old_it->flags,
+                                       old_it->exptime,
+                                       (int)(first_len + second_len), cookie,
+                                       it->datatype &
+                                       ~PROTOCOL_BINARY_DATATYPE_COMPRESSED);
+            if (new_it != NULL) {
+                item_copy_value_in(engine, new_it, value);
+            }
+        }
+    }
+
+    free(first_value);
+    free(second_value);
+    free(value);
+    return new_it;
+}
+
 /*
  * Stores an item in the cache according to the semantics of one of the set
  * commands. In threaded mode, this is protected by the cache lock.
@@ -549,8 +1460,8 @@ static ENGINE_ERROR_CODE do_store_item(struct default_engine *engine,
                                        ENGINE_STORE_OPERATION operation,
                                        const void *cookie,
                                        hash_item** stored_item) {
-    const hash_key* key = item_get_key(it);
-    hash_item *old_it = do_item_get(engine, key);
+    hash_item *old_it = do_item_find(engine, it->hash, item_get_key(it),
+                                     it->nkey);
     ENGINE_ERROR_CODE stored = ENGINE_NOT_STORED;
 
     hash_item *new_it = NULL;
@@ -607,30 +1518,50 @@ static ENGINE_ERROR_CODE do_store_item(struct default_engine *engine,
                     return ENGINE_E2BIG;
                 }
 
-                /* we have it and old_it here - alloc memory to hold both */
-                new_it = do_item_alloc(engine, key,
-                                       old_it->flags,
-                                       old_it->exptime,
-                                       it->nbytes + old_it->nbytes,
-                                       cookie, it->datatype);
-                if (new_it == NULL) {
-                    /* SERVER_ERROR out of memory */
-                    if (old_it != NULL) {
+                if (do_item_append_in_place(engine, old_it, it, operation)) {
+                    engine_stats_add(engine, ENGINE_STAT_UPDATES_IN_PLACE, 1);
+                    do_item_update(engine, old_it);
+                    *stored_item = old_it;
+                    do_item_release(engine, old_it);
+                    return ENGINE_SUCCESS;
+                }
+                engine_stats_add(engine, ENGINE_STAT_UPDATES_REALLOC, 1);
+
+                if (item_is_compressed(old_it) || item_is_compressed(it)) {
+                    ENGINE_ERROR_CODE err;
+                    new_it = do_item_concat_inflated(engine, old_it, it,
+                                                     operation, cookie, &err);
+                    if (new_it == NULL) {
                         do_item_release(engine, old_it);
+                        return err;
+                    }
+                } else {
+                    /* we have it and old_it here - alloc memory to hold both */
+                    new_it = do_item_alloc_key(engine, it->hash,
+                                               item_get_key(it), it->nkey,
+                                               old_it->flags,
+                                               old_it->exptime,
+                                               it->nbytes + old_it->nbytes,
+                                               cookie, it->datatype);
+                    if (new_it == NULL) {
+                        /* SERVER_ERROR out of memory */
+                        if (old_it != NULL) {
+                            do_item_release(engine, old_it);
+                        }
+
+                        return ENGINE_NOT_STORED;
                     }
 
-                    return ENGINE_NOT_STORED;
-                }
-
-                /* copy data from it and old_it to new_it */
+                    /* copy data from it and old_it to new_it */
 
-                if (operation == OPERATION_APPEND) {
-                    memcpy(item_get_data(new_it), item_get_data(old_it), old_it->nbytes);
-                    memcpy(item_get_data(new_it) + old_it->nbytes, item_get_data(it), it->nbytes);
-                } else {
-                    /* OPERATION_PREPEND */
-                    memcpy(item_get_data(new_it), item_get_data(it), it->nbytes);
-                    memcpy(item_get_data(new_it) + it->nbytes, item_get_data(old_it), old_it->nbytes);
+                    if (operation == OPERATION_APPEND) {
+                        item_copy_value(engine, new_it, 0, old_it);
+                        item_copy_value(engine, new_it, old_it->nbytes, it);
+                    } else {
+                        /* OPERATION_PREPEND */
+                        item_copy_value(engine, new_it, 0, it);
+                        item_copy_value(engine, new_it, it->nbytes, old_it);
+                    }
                 }
 
                 it = new_it;
@@ -716,17 +1647,26 @@ static ENGINE_ERROR_CODE do_add_delta(struct default_engine *engine,
         return ENGINE_EINVAL;
     }
 
-    if (it->refcount == 1 && res <= (int)it->nbytes) {
+    if ((res <= (int)it->nbytes || item_has_room(engine, it, res)) &&
+        do_item_lock_exclusive(engine, it)) {
         /* we can do inline replacement */
+        if (res > (int)it->nbytes) {
+            /* grow into the slack of the slab chunk */
+            do_item_resize(engine, it, res);
+        }
         memcpy(item_get_data(it), buf, res);
         memset(item_get_data(it) + res, ' ', it->nbytes - res);
         item_set_cas(NULL, NULL, it, get_cas_id());
+        do_item_unlock_exclusive(engine, it);
+        engine_stats_add(engine, ENGINE_STAT_UPDATES_IN_PLACE, 1);
         *ritem = it;
     } else {
-        hash_item *new_it = do_item_alloc(engine, item_get_key(it),
-                                          it->flags,
-                                          it->exptime, res,
-                                          cookie, it->datatype);
+        engine_stats_add(engine, ENGINE_STAT_UPDATES_REALLOC, 1);
+        hash_item *new_it = do_item_alloc_key(engine, it->hash,
+                                              item_get_key(it), it->nkey,
+                                              it->flags,
+                                              it->exptime, res,
+                                              cookie, it->datatype);
         if (new_it == NULL) {
             do_item_unlink(engine, it);
             return ENGINE_ENOMEM;
@@ -750,16 +1690,99 @@ hash_item *item_alloc(struct default_engine *engine,
                       uint8_t datatype) {
     hash_item *it;
     hash_key hkey;
+    struct assoc_reader *reader;
+    size_t ntotal;
+    unsigned int id;
+
     if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
         return NULL;
     }
-    cb_mutex_enter(&engine->items.lock);
-    it = do_item_alloc(engine, &hkey, flags, exptime, nbytes, cookie, datatype);
-    cb_mutex_exit(&engine->items.lock);
+
+    ntotal = sizeof(hash_item) + nkey + nbytes;
+    if (engine->config.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+
+    /*
+     * Try to get a free chunk without items.lock first, and only take the
+     * lock to reclaim or evict items if the slab class is out of memory.
+     * The slab rebalancer waits for the chunk to be initialized by waiting
+     * for the assoc readers. Chunked items are always allocated with the
+     * lock.
+     */
+    it = NULL;
+    if (ntotal <= item_chunk_max(engine)) {
+        id = slabs_clsid(engine, ntotal);
+        reader = assoc_reader_enter(engine);
+        it = slabs_alloc(engine, ntotal, id);
+        if (it != NULL) {
+            item_initialize(engine, it, id, 0, hash_key_hash(&hkey),
+                            key, (uint16_t)nkey, flags, exptime,
+                            nbytes, datatype);
+        }
+        assoc_reader_exit(reader);
+    }
+
+    if (it == NULL) {
+        cb_mutex_enter(&engine->items.lock);
+        it = do_item_alloc(engine, &hkey, flags, exptime, nbytes, cookie, datatype);
+        cb_mutex_exit(&engine->items.lock);
+    }
     hash_key_destroy(&hkey);
     return it;
 }
 
+/*
+ * Try to look up the item and grab a reference to it without holding
+ * items.lock. This only works for items which don't need any attention
+ * (lazy expiry), as that must be done under the lock.
+ *
+ * Returns false if the caller must use the locked path, otherwise *ret
+ * is the referenced item (or NULL if it doesn't exist).
+ */
+static bool item_get_optimistic(struct default_engine *engine,
+                                const hash_key *key,
+                                hash_item **ret) {
+    const uint32_t hash = hash_key_hash(key);
+    rel_time_t current_time;
+    hash_item *it;
+    uint32_t seq;
+
+    if (engine->config.verbose > 2 ||
+        !assoc_find_optimistic(engine, hash, hash_key_get_client_key(key),
+                               hash_key_get_client_key_len(key), &it, &seq)) {
+        return false;
+    }
+
+    if (it == NULL) {
+        *ret = NULL;
+        return assoc_validate(engine, hash, seq);
+    }
+
+    /*
+     * The item may have been unlinked and even reused since we found it.
+     * Grab the reference before validating, so that it stays alive if
+     * the lookup is still valid.
+     */
+    de_atomic_incr_16(&it->refcount);
+    if (!assoc_validate(engine, hash, seq)) {
+        item_release(engine, it);
+        return false;
+    }
+
+    current_time = engine->server.core->get_current_time();
+    if (item_is_dead(engine, it, current_time)) {
+        item_release(engine, it);
+        return false;
+    }
+
+    DEBUG_REFCNT(it, '+');
+    item_mark_active(it);
+    item_sketch_add(engine, hash);
+    *ret = it;
+    return true;
+}
+
 /*
  * Returns an item if it hasn't been marked as expired,
  * lazy-expiring as needed.
@@ -768,14 +1791,25 @@ hash_item *item_get(struct default_engine *engine,
                     const void *cookie,
                     const void *key,
                     const size_t nkey) {
+    struct assoc_reader *reader;
     hash_item *it;
     hash_key hkey;
+    bool found;
     if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
         return NULL;
     }
-    cb_mutex_enter(&engine->items.lock);
-    it = do_item_get(engine, &hkey);
-    cb_mutex_exit(&engine->items.lock);
+    /*
+     * Stay registered as a reader until we've got the reference (or given
+     * up), so that the chunk isn't moved to another slab class meanwhile.
+     */
+    reader = assoc_reader_enter(engine);
+    found = item_get_optimistic(engine, &hkey, &it);
+    assoc_reader_exit(reader);
+    if (!found) {
+        cb_mutex_enter(&engine->items.lock);
+        it = do_item_get(engine, &hkey);
+        cb_mutex_exit(&engine->items.lock);
+    }
     hash_key_destroy(&hkey);
     return it;
 }
@@ -783,10 +1817,24 @@ hash_item *item_get(struct default_engine *engine,
 /*
  * Decrements the reference count on an item and adds it to the freelist if
  * needed.
+ *
+ * items.lock is only needed if we drop the last reference to an item which
+ * isn't linked (anymore); a linked item is freed by the one unlinking it
+ * once the refcount is zero (see do_item_unlink).
  */
 void item_release(struct default_engine *engine, hash_item *item) {
+    MEMCACHED_ITEM_REMOVE(item_get_key(item), item->nkey, item->nbytes);
+    const uint16_t refcount = de_atomic_decr_16(&item->refcount);
+    DEBUG_REFCNT(item, '-');
+    if (refcount != 0) {
+        return;
+    }
+    de_memory_barrier();
+    if ((item_iflag(item) & ITEM_LINKED) != 0) {
+        return;
+    }
     cb_mutex_enter(&engine->items.lock);
-    do_item_release(engine, item);
+    do_item_free_unreferenced(engine, item);
     cb_mutex_exit(&engine->items.lock);
 }
 
@@ -814,169 +1862,865 @@ static ENGINE_ERROR_CODE do_arithmetic(struct default_engine *engine,
    hash_item *item = do_item_get(engine, key);
    ENGINE_ERROR_CODE ret;
 
-   if (item == NULL) {
-      if (!create) {
-         return ENGINE_KEY_ENOENT;
-      } else {
-         char buffer[128];
-         int len = snprintf(buffer, sizeof(buffer), "%"PRIu64,
-                            (uint64_t)initial);
-         if (len < 0 || len >= sizeof(buffer)) {
-             return ENGINE_ENOMEM;
-         }
+   if (item == NULL) {
+      if (!create) {
+         return ENGINE_KEY_ENOENT;
+      } else {
+         char buffer[128];
+         int len = snprintf(buffer, sizeof(buffer), "%"PRIu64,
+                            (uint64_t)initial);
+         if (len < 0 || len >= sizeof(buffer)) {
+             return ENGINE_ENOMEM;
+         }
+
+         item = do_item_alloc(engine, key, 0, exptime, len, cookie,
+                              datatype);
+         if (item == NULL) {
+            return ENGINE_ENOMEM;
+         }
+         memcpy((void*)item_get_data(item), buffer, len);
+         if ((ret = do_store_item(engine, item, OPERATION_ADD, cookie,
+                                  (hash_item**)result_item)) == ENGINE_SUCCESS) {
+             *result = initial;
+         } else {
+             do_item_release(engine, item);
+         }
+      }
+   } else {
+      ret = do_add_delta(engine, item, increment, delta, result_item, result,
+                         cookie);
+   }
+
+   return ret;
+}
+
+ENGINE_ERROR_CODE arithmetic(struct default_engine *engine,
+                             const void* cookie,
+                             const void* key,
+                             const int nkey,
+                             const bool increment,
+                             const bool create,
+                             const uint64_t delta,
+                             const uint64_t initial,
+                             const rel_time_t exptime,
+                             item **item,
+                             uint8_t datatype,
+                             uint64_t *result)
+{
+    ENGINE_ERROR_CODE ret;
+    hash_key hkey;
+    if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
+        return ENGINE_ENOMEM;
+    }
+    cb_mutex_enter(&engine->items.lock);
+    ret = do_arithmetic(engine, cookie, &hkey, increment,
+                        create, delta, initial, exptime, item,
+                        datatype, result);
+    cb_mutex_exit(&engine->items.lock);
+    hash_key_destroy(&hkey);
+    return ret;
+}
+
+/*
+ * Store the item, or a copy of it with the compressed value (if value is
+ * set) if we can allocate one. Called with items.lock held.
+ */
+static ENGINE_ERROR_CODE do_store_item_value(struct default_engine *engine,
+                                             hash_item *item,
+                                             const char *value,
+                                             size_t length, uint64_t *cas,
+                                             ENGINE_STORE_OPERATION operation,
+                                             const void *cookie) {
+    ENGINE_ERROR_CODE ret;
+    hash_item* stored_item = NULL;
+    hash_item *compressed = NULL;
+
+    if (value != NULL) {
+        /* Store a copy with the compressed value instead (if we can) */
+        compressed = do_item_alloc_key(engine, item->hash,
+                                       item_get_key(item), item->nkey,
+                                       item->flags, item->exptime,
+                                       (int)length, cookie,
+                                       item->datatype |
+                                       PROTOCOL_BINARY_DATATYPE_COMPRESSED);
+        if (compressed != NULL) {
+            memcpy(item_get_data(compressed), value, length);
+            item_set_cas(NULL, NULL, compressed, item_get_cas(item));
+            item = compressed;
+        }
+    }
+    ret = do_store_item(engine, item, operation, cookie, &stored_item);
+    if (ret == ENGINE_SUCCESS) {
+        *cas = item_get_cas(stored_item);
+    }
+    if (compressed != NULL) {
+        do_item_release(engine, compressed);
+    }
+    return ret;
+}
+
+/*
+ * Stores an item in the cache (high level, obeys set/add/replace semantics)
+ */
+ENGINE_ERROR_CODE store_item(struct default_engine *engine,
+                             hash_item *item, uint64_t *cas,
+                             ENGINE_STORE_OPERATION operation,
+                             const void *cookie) {
+    ENGINE_ERROR_CODE ret;
+    char *value = NULL;
+    size_t length = 0;
+
+    /* Compress the value before we take the lock (see compress.h) */
+    if (compress_wanted(engine, item, operation)) {
+        value = compress_value(engine, item, &length);
+    }
+
+    cb_mutex_enter(&engine->items.lock);
+    ret = do_store_item_value(engine, item, value, length, cas, operation,
+                              cookie);
+    cb_mutex_exit(&engine->items.lock);
+
+    free(value);
+    return ret;
+}
+
+void store_items(struct default_engine *engine, hash_item **items,
+                 int nitems, bool *stored) {
+    char *values[STORE_ITEMS_MAX];
+    size_t lengths[STORE_ITEMS_MAX];
+    uint64_t cas;
+    int ii;
+
+    cb_assert(nitems <= STORE_ITEMS_MAX);
+    for (ii = 0; ii < nitems; ++ii) {
+        values[ii] = NULL;
+        lengths[ii] = 0;
+        if (compress_wanted(engine, items[ii], OPERATION_SET)) {
+            values[ii] = compress_value(engine, items[ii], &lengths[ii]);
+        }
+    }
+
+    cb_mutex_enter(&engine->items.lock);
+    for (ii = 0; ii < nitems; ++ii) {
+        stored[ii] = do_store_item_value(engine, items[ii], values[ii],
+                                         lengths[ii], &cas, OPERATION_SET,
+                                         NULL) == ENGINE_SUCCESS;
+    }
+    cb_mutex_exit(&engine->items.lock);
+
+    for (ii = 0; ii < nitems; ++ii) {
+        free(values[ii]);
+    }
+}
+
+static hash_item *do_touch_item(struct default_engine *engine,
+                                const hash_key *hkey,
+                                uint32_t exptime)
+{
+   hash_item *item = do_item_get(engine, hkey);
+   if (item != NULL) {
+       /* The wheel moves items which expire later along by itself */
+       bool sooner = exptime != 0 &&
+           (item->exptime == 0 || exptime < item->exptime);
+       if (item->exptime == 0 && exptime != 0) {
+           engine->items.expiry.items++;
+       } else if (item->exptime != 0 && exptime == 0) {
+           engine->items.expiry.items--;
+       }
+       /* Optimistic readers look at the exptime without items.lock */
+       assoc_write_begin(engine, item->hash);
+       item->exptime = exptime;
+       assoc_write_end(engine, item->hash);
+       if (sooner) {
+           expiry_insert(&engine->items.expiry, item);
+       }
+   }
+   return item;
+}
+
+hash_item *touch_item(struct default_engine *engine,
+                      const void* cookie,
+                      const void* key,
+                      uint16_t nkey,
+                      uint32_t exptime)
+{
+    hash_item *ret;
+    hash_key hkey;
+    if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
+        return NULL;
+    }
+    cb_mutex_enter(&engine->items.lock);
+    ret = do_touch_item(engine, &hkey, exptime);
+    cb_mutex_exit(&engine->items.lock);
+    hash_key_destroy(&hkey);
+    return ret;
+}
+
+/*
+ * Flushes expired items after a flush_all call
+ */
+void item_flush_expired(struct default_engine *engine) {
+    cb_mutex_enter(&engine->items.lock);
+    slab_memory_set_generation(engine, engine->items.generation + 1);
+    de_atomic_store(&engine->items.generation,
+                    engine->items.generation + 1);
+
+    /* (Re)start the sweep from the first list */
+    if (engine->items.flush_cursor_linked) {
+        item_unlink_q(engine, &engine->items.flush_cursor);
+        engine->items.flush_cursor_linked = false;
+    }
+    engine->items.flush_list = 0;
+    cb_cond_signal(&engine->items.maintainer_cond);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+void item_stats(struct default_engine *engine,
+                   ADD_STAT add_stat, const void *cookie)
+{
+    cb_mutex_enter(&engine->items.lock);
+    do_item_stats(engine, add_stat, cookie);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+
+void item_stats_sizes(struct default_engine *engine,
+                      ADD_STAT add_stat, const void *cookie)
+{
+    cb_mutex_enter(&engine->items.lock);
+    do_item_stats_sizes(engine, add_stat, cookie);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+void item_stats_expiry(struct default_engine *engine,
+                       ADD_STAT add_stat, const void *cookie)
+{
+    struct expiry_wheel *wheel = &engine->items.expiry;
+    char val[32];
+    int len;
+
+    cb_mutex_enter(&engine->items.lock);
+    len = snprintf(val, sizeof(val), "%"PRIu64, wheel->entries);
+    add_stat("expiry_wheel_items", 18, val, len, cookie);
+    len = snprintf(val, sizeof(val), "%"PRIu64, wheel->dropped);
+    add_stat("expiry_wheel_dropped", 20, val, len, cookie);
+    len = snprintf(val, sizeof(val), "%"PRIu64, wheel->compacted);
+    add_stat("expiry_wheel_compacted", 22, val, len, cookie);
+    len = snprintf(val, sizeof(val), "%"PRIu64, wheel->reclaimed);
+    add_stat("expired_reclaimed", 17, val, len, cookie);
+    len = snprintf(val, sizeof(val), "%"PRIu64, wheel->reclaimed_per_sec);
+    add_stat("expired_reclaimed_per_sec", 25, val, len, cookie);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+void item_stats_flush(struct default_engine *engine,
+                      ADD_STAT add_stat, const void *cookie)
+{
+    char val[32];
+    int len;
+
+    cb_mutex_enter(&engine->items.lock);
+    len = snprintf(val, sizeof(val), "%u", engine->items.generation);
+    add_stat("flush_generation", 16, val, len, cookie);
+    len = snprintf(val, sizeof(val), "%"PRIu64, engine->items.flush_swept);
+    add_stat("flush_swept", 11, val, len, cookie);
+    if (engine->items.flush_list >= 0) {
+        add_stat("flush_sweep", 11, "running", 7, cookie);
+    } else {
+        add_stat("flush_sweep", 11, "stopped", 7, cookie);
+    }
+    cb_mutex_exit(&engine->items.lock);
+}
+
+void item_stats_overhead(struct default_engine *engine,
+                         ADD_STAT add_stat, const void *cookie)
+{
+    cb_mutex_enter(&engine->items.lock);
+    do_item_stats_overhead(engine, add_stat, cookie);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+/*
+ * Process the tail of one of the segments of the LRU for a slab class:
+ * expired items are unlinked (and their memory freed), active items are
+ * moved to the warm segment and the hot and warm segments are trimmed
+ * down to their share of the class by moving items to the cold segment.
+ *
+ * Returns the number of items unlinked or moved.
+ */
+static int do_item_lru_juggle(struct default_engine *engine, int clsid,
+                              int segment, rel_time_t current_time) {
+    const int lru = segment * POWER_LARGEST + clsid;
+    unsigned int total = 0;
+    unsigned int limit = 0;
+    int tries = ITEM_LRU_MAINTAINER_BATCH;
+    int moved = 0;
+    hash_item *search;
+    hash_item *prev;
+    int ii;
+
+    for (ii = 0; ii < ITEM_LRU_SEGMENTS; ++ii) {
+        total += engine->items.sizes[ii * POWER_LARGEST + clsid];
+    }
+    if (segment == ITEM_LRU_HOT) {
+        limit = (total * ITEM_LRU_HOT_PERCENT) / 100;
+    } else if (segment == ITEM_LRU_WARM) {
+        limit = (total * ITEM_LRU_WARM_PERCENT) / 100;
+    }
+
+    for (search = engine->items.tails[lru];
+         tries > 0 && search != NULL;
+         tries--, search = prev) {
+        prev = search->prev;
+        if (item_is_cursor(search)) {
+            continue;
+        }
+
+        if (item_is_dead(engine, search, current_time)) {
+            if (de_atomic_load(&search->refcount) == 0) {
+                engine->items.itemstats[clsid].reclaimed++;
+                engine_stats_add(engine, ENGINE_STAT_RECLAIMED, 1);
+            }
+            do_item_unlink(engine, search);
+            ++moved;
+            continue;
+        }
+
+        if (segment != ITEM_LRU_COLD &&
+            engine->items.sizes[lru] <= limit) {
+            break;
+        }
+
+        if ((item_iflag(search) & ITEM_ACTIVE) != 0) {
+            do_item_lru_move(engine, search, ITEM_LRU_WARM, current_time);
+            ++moved;
+        } else if (segment != ITEM_LRU_COLD) {
+            do_item_lru_move(engine, search, ITEM_LRU_COLD, current_time);
+            ++moved;
+        }
+    }
+
+    return moved;
+}
+
+/*
+ * Reclaim the items in a batch of entries from the expiry wheel. Entries
+ * for items which were touched since they were added are put back.
+ *
+ * Returns the number of items reclaimed.
+ */
+static unsigned int do_item_expire(struct default_engine *engine,
+                                   struct expiry_entry *entries, int count,
+                                   rel_time_t current_time) {
+    unsigned int reclaimed = 0;
+    int ii;
+
+    for (ii = 0; ii < count; ++ii) {
+        hash_item *it = entries[ii].item;
+
+        /* The item may have been deleted or replaced (and reused) since */
+        if (!assoc_contains(engine, entries[ii].hash, it) ||
+            it->exptime == 0) {
+            continue;
+        }
+
+        if (item_is_dead(engine, it, current_time)) {
+            engine->items.itemstats[it->slabs_clsid].reclaimed++;
+            do_item_unlink(engine, it);
+            ++reclaimed;
+        } else if (it->exptime != entries[ii].exptime) {
+            expiry_insert(&engine->items.expiry, it);
+        }
+    }
+
+    if (reclaimed > 0) {
+        engine_stats_add(engine, ENGINE_STAT_RECLAIMED, reclaimed);
+    }
+    return reclaimed;
+}
+
+/*
+ * An entry in the expiry wheel is worth keeping if it refers to a linked
+ * item which it fires for before (or when) the item expires.
+ */
+static bool item_expiry_keep(void *ctx, const struct expiry_entry *entry) {
+    struct default_engine *engine = ctx;
+    const hash_item *it = entry->item;
+    return assoc_contains(engine, entry->hash, it) && it->exptime != 0 &&
+        entry->exptime <= it->exptime;
+}
+
+/*
+ * Reclaim the items which have expired since the last run (or as many as
+ * we're allowed to in a run).
+ *
+ * Returns the number of items reclaimed.
+ */
+static int item_expire(struct default_engine *engine,
+                       rel_time_t current_time) {
+    struct expiry_entry entries[ITEM_EXPIRY_BATCH];
+    struct expiry_wheel *wheel = &engine->items.expiry;
+    unsigned int reclaimed = 0;
+    int batches;
+
+    for (batches = 0; batches < ITEM_EXPIRY_MAX_BATCHES; ++batches) {
+        unsigned int count;
+        bool more;
+        int nentries;
+
+        cb_mutex_enter(&engine->items.lock);
+        nentries = expiry_advance(wheel, current_time, entries,
+                                  ITEM_EXPIRY_BATCH);
+        count = do_item_expire(engine, entries, nentries, current_time);
+        reclaimed += count;
+        expiry_reclaimed(wheel, count, current_time);
+        more = expiry_pending(wheel, current_time);
+        cb_mutex_exit(&engine->items.lock);
+        if (!more) {
+            break;
+        }
+    }
+
+    /* Items which are deleted or replaced leave stale entries behind */
+    for (; batches < ITEM_EXPIRY_MAX_BATCHES; ++batches) {
+        bool more;
+        cb_mutex_enter(&engine->items.lock);
+        more = expiry_need_compact(wheel);
+        if (more) {
+            expiry_compact(wheel, item_expiry_keep, engine,
+                           ITEM_EXPIRY_BATCH);
+        }
+        cb_mutex_exit(&engine->items.lock);
+        if (!more) {
+            break;
+        }
+    }
+
+    return (int)reclaimed;
+}
+
+static void item_lru_maintainer_main(void *arg) {
+    struct default_engine *engine = arg;
+    unsigned int sleep_time = ITEM_LRU_MAINTAINER_MAX_SLEEP;
+
+    for (;;) {
+        rel_time_t current_time;
+        bool shutdown;
+        int moved = 0;
+        int ii;
+
+        cb_mutex_enter(&engine->items.lock);
+        if (!engine->items.maintainer_shutdown) {
+            cb_cond_timedwait(&engine->items.maintainer_cond,
+                              &engine->items.lock, sleep_time);
+        }
+        shutdown = engine->items.maintainer_shutdown;
+        cb_mutex_exit(&engine->items.lock);
+        if (shutdown) {
+            break;
+        }
+
+        current_time = engine->server.core->get_current_time();
+        moved += item_expire(engine, current_time);
+        moved += item_flush_sweep(engine);
+
+        if (engine->items.sketch.counters != NULL &&
+            current_time - engine->items.sketch.aged >= ITEM_SKETCH_HALF_LIFE) {
+            item_sketch_age(&engine->items.sketch, current_time);
+        }
+
+        /* Release the lock between each class to keep the hold times short */
+        for (ii = POWER_SMALLEST; ii < POWER_LARGEST; ++ii) {
+            int segment;
+            cb_mutex_enter(&engine->items.lock);
+            for (segment = 0; segment < ITEM_LRU_SEGMENTS; ++segment) {
+                moved += do_item_lru_juggle(engine, ii, segment,
+                                            current_time);
+            }
+            cb_mutex_exit(&engine->items.lock);
+        }
+
+        if (moved > 0) {
+            sleep_time /= 2;
+            if (sleep_time < ITEM_LRU_MAINTAINER_MIN_SLEEP) {
+                sleep_time = ITEM_LRU_MAINTAINER_MIN_SLEEP;
+            }
+        } else {
+            sleep_time *= 2;
+            if (sleep_time > ITEM_LRU_MAINTAINER_MAX_SLEEP) {
+                sleep_time = ITEM_LRU_MAINTAINER_MAX_SLEEP;
+            }
+        }
+    }
+}
+
+/* Set up the eviction policy (and its frequency sketch) */
+static ENGINE_ERROR_CODE item_evict_init(struct default_engine *engine) {
+    const char *policy = engine->config.eviction_policy;
+    EXTENSION_LOGGER_DESCRIPTOR *logger;
+    struct item_sketch *sketch = &engine->items.sketch;
+    size_t width = ITEM_SKETCH_MIN_WIDTH;
+
+    logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+    if (policy == NULL || strcmp(policy, "lru") == 0) {
+        engine->items.evict_policy = ITEM_EVICT_LRU;
+        return ENGINE_SUCCESS;
+    } else if (strcmp(policy, "sampled") != 0) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Invalid value for eviction_policy: \"%s\" "
+                    "(use lru or sampled)\n", policy);
+        return ENGINE_EINVAL;
+    }
+    if (engine->config.eviction_samples == 0 ||
+        engine->config.eviction_samples > ITEM_EVICT_MAX_SAMPLES) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Invalid value for eviction_samples: %"PRIu64
+                    " (use 1 to %d)\n",
+                    (uint64_t)engine->config.eviction_samples,
+                    ITEM_EVICT_MAX_SAMPLES);
+        return ENGINE_EINVAL;
+    }
+
+    /* About a counter per row for every 256 bytes of cache */
+    while (width < engine->config.maxbytes / 256 &&
+           width < ITEM_SKETCH_MAX_WIDTH) {
+        width <<= 1;
+    }
+    if ((sketch->counters = calloc(ITEM_SKETCH_DEPTH, width)) == NULL) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't allocate the frequency sketch\n");
+        return ENGINE_ENOMEM;
+    }
+    sketch->mask = (uint32_t)(width - 1);
+    sketch->aged = engine->server.core->get_current_time();
+    engine->items.evict_seed = (uint32_t)gethrtime() | 1;
+    engine->items.evict_policy = ITEM_EVICT_SAMPLED;
+    return ENGINE_SUCCESS;
+}
 
-         item = do_item_alloc(engine, key, 0, exptime, len, cookie,
-                              datatype);
-         if (item == NULL) {
-            return ENGINE_ENOMEM;
-         }
-         memcpy((void*)item_get_data(item), buffer, len);
-         if ((ret = do_store_item(engine, item, OPERATION_ADD, cookie,
-                                  (hash_item**)result_item)) == ENGINE_SUCCESS) {
-             *result = initial;
-         } else {
-             do_item_release(engine, item);
-         }
-      }
-   } else {
-      ret = do_add_delta(engine, item, increment, delta, result_item, result,
-                         cookie);
-   }
+ENGINE_ERROR_CODE item_init(struct default_engine *engine) {
+    ENGINE_ERROR_CODE err;
+    int ret;
 
-   return ret;
+    if ((err = item_evict_init(engine)) != ENGINE_SUCCESS) {
+        return err;
+    }
+    expiry_init(&engine->items.expiry,
+                engine->server.core->get_current_time());
+    /* The LRU maintainer mustn't get to the items before they're sorted out */
+    slabs_attach(engine);
+    engine->items.maintainer_shutdown = false;
+    engine->items.flush_list = -1;
+    if ((ret = cb_create_named_thread(&engine->items.maintainer_tid,
+                                      item_lru_maintainer_main,
+                                      engine, 0, "mc:lru_maint")) != 0) {
+        EXTENSION_LOGGER_DESCRIPTOR *logger;
+        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't create LRU maintainer thread: %s\n",
+                    strerror(ret));
+        return ENGINE_FAILED;
+    }
+    engine->items.maintainer_running = true;
+    return ENGINE_SUCCESS;
 }
 
-ENGINE_ERROR_CODE arithmetic(struct default_engine *engine,
-                             const void* cookie,
-                             const void* key,
-                             const int nkey,
-                             const bool increment,
-                             const bool create,
-                             const uint64_t delta,
-                             const uint64_t initial,
-                             const rel_time_t exptime,
-                             item **item,
-                             uint8_t datatype,
-                             uint64_t *result)
-{
-    ENGINE_ERROR_CODE ret;
-    hash_key hkey;
-    if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
-        return ENGINE_ENOMEM;
+void item_destroy(struct default_engine *engine) {
+    if (engine->items.maintainer_running) {
+        cb_mutex_enter(&engine->items.lock);
+        engine->items.maintainer_shutdown = true;
+        cb_cond_signal(&engine->items.maintainer_cond);
+        cb_mutex_exit(&engine->items.lock);
+        cb_join_thread(engine->items.maintainer_tid);
+        engine->items.maintainer_running = false;
     }
-    cb_mutex_enter(&engine->items.lock);
-    ret = do_arithmetic(engine, cookie, &hkey, increment,
-                        create, delta, initial, exptime, item,
-                        datatype, result);
-    cb_mutex_exit(&engine->items.lock);
-    hash_key_destroy(&hkey);
-    return ret;
+    expiry_destroy(&engine->items.expiry);
+    free((void*)engine->items.sketch.counters);
+    engine->items.sketch.counters = NULL;
 }
 
 /*
- * Stores an item in the cache (high level, obeys set/add/replace semantics)
+ * Empty a slab page which is being moved to another slab class (see
+ * slabs_reassign). The slab allocator no longer hands out (or takes back)
+ * chunks in the page, so every item linked in it is evicted. The chunks
+ * which were never handed out are marked as free, so that every chunk
+ * left without ITEM_SLABBED is in use by someone.
  */
-ENGINE_ERROR_CODE store_item(struct default_engine *engine,
-                             hash_item *item, uint64_t *cas,
-                             ENGINE_STORE_OPERATION operation,
-                             const void *cookie) {
-    ENGINE_ERROR_CODE ret;
-    hash_item* stored_item = NULL;
+int item_clear_slab_page(struct default_engine *engine, void *page,
+                         unsigned int size, unsigned int perslab,
+                         unsigned int *evicted) {
+    unsigned int ii;
+    int busy = 0;
 
     cb_mutex_enter(&engine->items.lock);
-    ret = do_store_item(engine, item, operation, cookie, &stored_item);
-    if (ret == ENGINE_SUCCESS) {
-        *cas = item_get_cas(stored_item);
+    for (ii = 0; ii < perslab; ++ii) {
+        hash_item *it = (hash_item*)((char*)page + (size_t)ii * size);
+        if ((item_iflag(it) & ITEM_CHUNK) != 0) {
+            /* Evict the item the chunk belongs to, which frees the chunk */
+            hash_item *owner = it->prev;
+            if ((item_iflag(owner) & ITEM_LINKED) != 0) {
+                do_item_unlink(engine, owner);
+                ++*evicted;
+            }
+            if ((item_iflag(it) & ITEM_SLABBED) == 0) {
+                ++busy;
+            }
+            continue;
+        }
+        if ((item_iflag(it) & ITEM_LINKED) != 0) {
+            do_item_unlink(engine, it);
+            ++*evicted;
+        }
+        if ((item_iflag(it) & ITEM_SLABBED) != 0) {
+            continue;
+        }
+        if (de_atomic_load(&it->refcount) != 0) {
+            /* in flight, or unlinked but still referenced */
+            ++busy;
+        } else {
+            it->slabs_clsid = 0;
+            de_atomic_store(&it->iflag, ITEM_SLABBED);
+        }
     }
     cb_mutex_exit(&engine->items.lock);
-    return ret;
+    return busy;
 }
 
-static hash_item *do_touch_item(struct default_engine *engine,
-                                const hash_key *hkey,
-                                uint32_t exptime)
-{
-   hash_item *item = do_item_get(engine, hkey);
-   if (item != NULL) {
-       item->exptime = exptime;
-   }
-   return item;
+static hash_item *item_attach_ptr(const struct item_attach *attach,
+                                  hash_item *ptr) {
+    return ptr == NULL ? NULL : (hash_item*)((char*)ptr + attach->delta);
 }
 
-hash_item *touch_item(struct default_engine *engine,
-                      const void* cookie,
-                      const void* key,
-                      uint16_t nkey,
-                      uint32_t exptime)
-{
-    hash_item *ret;
+/*
+ * Make sure the chunks of a chunked item in a re-attached cache are all
+ * there, before we follow the pointers for real. Every chunk but the
+ * last one is full (see do_item_alloc_chunks).
+ */
+static bool item_attach_chunks_valid(struct default_engine *engine,
+                                     hash_item *it,
+                                     const struct item_attach *attach) {
+    const size_t full = item_chunk_max(engine) - sizeof(hash_item);
+    struct item_segment seg;
+    hash_item *chunk;
+    size_t left;
+
+    item_first_segment(engine, it, &seg);
+    if (seg.len >= it->nbytes) {
+        return false;
+    }
+    left = it->nbytes - seg.len;
+    chunk = item_attach_ptr(attach, seg.next);
+    while (left > 0) {
+        unsigned int id = slab_memory_chunk_class(engine, chunk);
+        if (id == 0 || chunk->slabs_clsid != id ||
+            (item_iflag(chunk) & (ITEM_CHUNK|ITEM_LINKED|ITEM_SLABBED)) != ITEM_CHUNK ||
+            item_attach_ptr(attach, chunk->prev) != it ||
+            (chunk->nbytes != full && chunk->nbytes != left) ||
+            chunk->nbytes > left ||
+            sizeof(hash_item) + chunk->nbytes > engine->slabs.slabclass[id].size) {
+            return false;
+        }
+        left -= chunk->nbytes;
+        chunk = item_attach_ptr(attach, chunk->next);
+    }
+    return chunk == NULL;
+}
+
+/* Does the item in a re-attached cache look like one we stored? */
+static bool item_attach_valid(struct default_engine *engine, hash_item *it,
+                              unsigned int id,
+                              const struct item_attach *attach) {
     hash_key hkey;
-    if (!hash_key_create(&hkey, key, nkey, engine, cookie)) {
-        return NULL;
+    bool ret;
+
+    if (it->slabs_clsid != id || it->nkey == 0 ||
+        it->nbytes > engine->config.item_size_max ||
+        ((item_iflag(it) & ITEM_WITH_CAS) != 0) != engine->config.use_cas ||
+        item_lru_segment(it) >= ITEM_LRU_SEGMENTS) {
+        return false;
+    }
+    if (item_is_chunked(it)) {
+        if (id != engine->slabs.power_largest ||
+            ITEM_ntotal(engine, it) - it->nbytes + sizeof(hash_item*) >=
+            item_chunk_max(engine) ||
+            !item_attach_chunks_valid(engine, it, attach)) {
+            return false;
+        }
+    } else if (ITEM_ntotal(engine, it) > engine->slabs.slabclass[id].size) {
+        return false;
+    }
+
+    /* The hash covers the key (and the bucket it was stored in) */
+    if (!hash_key_create(&hkey, item_get_key(it), it->nkey, engine, NULL)) {
+        return false;
+    }
+    hash_key_set_bucket_index(&hkey, attach->bucket_id);
+    ret = hash_key_hash(&hkey) == it->hash;
+    if (ret) {
+        hash_key_set_bucket_index(&hkey, engine->bucket_id);
+        it->hash = hash_key_hash(&hkey);
     }
-    cb_mutex_enter(&engine->items.lock);
-    ret = do_touch_item(engine, &hkey, exptime);
-    cb_mutex_exit(&engine->items.lock);
     hash_key_destroy(&hkey);
     return ret;
 }
 
-/*
- * Flushes expired items after a flush_all call
- */
-void item_flush_expired(struct default_engine *engine) {
-    cb_mutex_enter(&engine->items.lock);
+/* Convert a time stored by the process which stored the items */
+static rel_time_t item_attach_time(struct default_engine *engine,
+                                   const struct item_attach *attach,
+                                   rel_time_t t) {
+    int64_t ret = (int64_t)t + (attach->time_base -
+                                engine->server.core->abstime(0));
+    return ret > 0 ? (rel_time_t)ret : 1;
+}
 
-    rel_time_t now = engine->server.core->get_current_time();
-    if (now > engine->config.oldest_live) {
-        engine->config.oldest_live = now - 1;
-    }
+/* Free a chunk in a re-attached cache (slabs_attach picks it up) */
+static void item_attach_free(hash_item *it) {
+    it->slabs_clsid = 0;
+    de_atomic_store(&it->refcount, 0);
+    de_atomic_store(&it->iflag, ITEM_SLABBED);
+}
 
-    for (int ii = 0; ii < POWER_LARGEST; ii++) {
-        hash_item *iter, *next;
+void item_attach_slab_page(struct default_engine *engine, void *page,
+                           unsigned int id, struct item_attach *attach) {
+    const slabclass_t *p = &engine->slabs.slabclass[id];
+    const rel_time_t current_time = engine->server.core->get_current_time();
+    unsigned int ii;
+
+    cb_mutex_enter(&engine->items.lock);
+    for (ii = 0; ii < p->perslab; ++ii) {
+        hash_item *it = (hash_item*)((char*)page + (size_t)ii * p->size);
+        hash_item *old;
+        uint16_t iflag = item_iflag(it);
+        uint64_t cas;
+
+        if ((iflag & ITEM_CHUNK) != 0) {
+            /* See item_attach_slab_chunks */
+            continue;
+        }
+        if ((iflag & (ITEM_LINKED|ITEM_SLABBED)) != ITEM_LINKED) {
+            item_attach_free(it);
+            continue;
+        }
         /*
-         * The LRU is sorted in decreasing time order, and an item's
-         * timestamp is never newer than its last access time, so we
-         * only need to walk back until we hit an item older than the
-         * oldest_live time.
-         * The oldest_live checking will auto-expire the remaining items.
+         * An item which was referenced when the process died may have been
+         * in the middle of an update (see do_item_lock_exclusive)
          */
-        for (iter = engine->items.heads[ii]; iter != NULL; iter = next) {
-            if (iter->time >= engine->config.oldest_live) {
-                next = iter->next;
-                if ((iter->iflag & ITEM_SLABBED) == 0) {
-                    do_item_unlink(engine, iter);
-                }
-            } else {
-                /* We've hit the first old item. Continue to the next queue. */
-                break;
+        if (de_atomic_load(&it->refcount) != 0 ||
+            !item_attach_valid(engine, it, id, attach)) {
+            attach->dropped++;
+            item_attach_free(it);
+            continue;
+        }
+        if (it->exptime != 0) {
+            it->exptime = item_attach_time(engine, attach, it->exptime);
+        }
+        if (it->generation != attach->generation ||
+            (it->exptime != 0 && it->exptime <= current_time)) {
+            attach->expired++;
+            item_attach_free(it);
+            continue;
+        }
+
+        /* We may die between linking a new version and unlinking the old */
+        cas = item_get_cas(it);
+        old = assoc_find(engine, it->hash, item_get_key(it), it->nkey);
+        if (old != NULL) {
+            attach->dropped++;
+            if (item_get_cas(old) >= cas) {
+                item_attach_free(it);
+                continue;
             }
+            de_atomic_incr_16(&old->refcount);
+            do_item_unlink(engine, old);
+            slabs_adjust_mem_requested(engine, old->slabs_clsid,
+                                       item_slab_ntotal(engine, old), 0);
+            item_attach_free(old);
+            attach->linked--;
+        }
+
+        if (item_is_chunked(it)) {
+            hash_item *chunk = item_attach_ptr(attach, item_get_chunks(it));
+            item_set_chunks(it, chunk);
+            for (; chunk != NULL; chunk = chunk->next) {
+                chunk->prev = it;
+                chunk->next = item_attach_ptr(attach, chunk->next);
+            }
+        }
+        de_atomic_store(&it->iflag, (uint16_t)(iflag & ~ITEM_LINKED));
+        do_item_link(engine, it);
+        /* Keep the CAS, the clients may still have it */
+        item_set_cas(NULL, NULL, it, cas);
+        if (cas > attach->max_cas) {
+            attach->max_cas = cas;
         }
+        slabs_adjust_mem_requested(engine, id, 0, item_slab_ntotal(engine, it));
+        attach->linked++;
     }
     cb_mutex_exit(&engine->items.lock);
+
+    /* Don't hand out the CAS ids of the items again */
+    if (de_atomic_load(&item_cas_id) < attach->max_cas) {
+        de_atomic_add_64(&item_cas_id,
+                         attach->max_cas - de_atomic_load(&item_cas_id));
+    }
 }
 
-void item_stats(struct default_engine *engine,
-                   ADD_STAT add_stat, const void *cookie)
-{
+void item_attach_slab_chunks(struct default_engine *engine, void *page,
+                             unsigned int id) {
+    const slabclass_t *p = &engine->slabs.slabclass[id];
+    unsigned int ii;
+
     cb_mutex_enter(&engine->items.lock);
-    do_item_stats(engine, add_stat, cookie);
+    for (ii = 0; ii < p->perslab; ++ii) {
+        hash_item *chunk = (hash_item*)((char*)page + (size_t)ii * p->size);
+        hash_item *owner = chunk->prev;
+        hash_item *next = NULL;
+
+        if ((item_iflag(chunk) & ITEM_CHUNK) == 0) {
+            continue;
+        }
+        /* The chunks of the items we linked are in their chain */
+        if (slab_memory_chunk_class(engine, owner) == engine->slabs.power_largest &&
+            (item_iflag(owner) & (ITEM_LINKED|ITEM_CHUNKED)) == (ITEM_LINKED|ITEM_CHUNKED)) {
+            for (next = item_get_chunks(owner); next != NULL && next != chunk;
+                 next = next->next) {
+                /* nothing */
+            }
+        }
+        if (next == chunk) {
+            slabs_adjust_mem_requested(engine, id, 0,
+                                       sizeof(hash_item) + chunk->nbytes);
+        } else {
+            item_attach_free(chunk);
+        }
+    }
     cb_mutex_exit(&engine->items.lock);
 }
 
-
-void item_stats_sizes(struct default_engine *engine,
-                      ADD_STAT add_stat, const void *cookie)
-{
+void item_get_evictions(struct default_engine *engine,
+                        uint64_t evicted[MAX_NUMBER_OF_SLAB_CLASSES]) {
+    int ii;
     cb_mutex_enter(&engine->items.lock);
-    do_item_stats_sizes(engine, add_stat, cookie);
+    evicted[0] = 0;
+    for (ii = POWER_SMALLEST; ii < POWER_LARGEST; ++ii) {
+        evicted[ii] = engine->items.itemstats[ii].evicted;
+    }
+    evicted[POWER_LARGEST] = 0;
     cb_mutex_exit(&engine->items.lock);
 }
 
+/*
+ * Link a cursor at the tail of one of the LRU lists (see ITEM_LRU_LISTS).
+ * Note that the LRU maintainer moves items between the lists, so a walk
+ * over all of the lists may miss (or see twice) items which are being
+ * moved while we're walking.
+ */
 static void do_item_link_cursor(struct default_engine *engine,
                                 hash_item *cursor, int ii)
 {
-    cursor->slabs_clsid = (uint8_t)ii;
+    cursor->slabs_clsid = (uint8_t)(ii % POWER_LARGEST);
+    cursor->nkey = ITEM_CURSOR_NKEY;
+    item_set_lru_segment(cursor, ii / POWER_LARGEST);
     cursor->next = NULL;
     cursor->prev = engine->items.tails[ii];
     engine->items.tails[ii]->next = cursor;
@@ -1005,7 +2749,7 @@ static bool do_item_walk_cursor(struct default_engine *engine,
         ++ii;
         item_unlink_q(engine, cursor);
 
-        if (ptr == engine->items.heads[cursor->slabs_clsid]) {
+        if (ptr == engine->items.heads[item_lru_id(cursor)]) {
             done = true;
             cursor->prev = NULL;
         } else {
@@ -1013,10 +2757,11 @@ static bool do_item_walk_cursor(struct default_engine *engine,
             cursor->prev = ptr->prev;
             cursor->prev->next = cursor;
             ptr->prev = cursor;
+            engine->items.sizes[item_lru_id(cursor)]++;
         }
 
         /* Ignore cursors */
-        if (item_get_key(ptr)->header.len == 0 && ptr->nbytes == 0) {
+        if (item_is_cursor(ptr)) {
             --ii;
         } else {
             *error = itemfunc(engine, ptr, itemdata);
@@ -1030,60 +2775,140 @@ static bool do_item_walk_cursor(struct default_engine *engine,
         }
     }
 
-    return (cursor->prev != NULL);
+    if (cursor->prev == NULL) {
+        /*
+         * The items in front of the cursor were unlinked (or moved to
+         * another segment of the LRU) since the last step.
+         */
+        item_unlink_q(engine, cursor);
+        return false;
+    }
+    return true;
+}
+
+static ENGINE_ERROR_CODE item_flush_unlink(struct default_engine *engine,
+                                           hash_item *item,
+                                           void *cookie) {
+    if (item_is_flushed(engine, item)) {
+        do_item_unlink(engine, item);
+        ++*(int*)cookie;
+    }
+    return ENGINE_SUCCESS;
+}
+
+/*
+ * Sweep the items made dead by flush_all out of the LRU lists. Returns
+ * the number of items unlinked.
+ */
+static int item_flush_sweep(struct default_engine *engine) {
+    hash_item *cursor = &engine->items.flush_cursor;
+    int swept = 0;
+    int batches;
+
+    for (batches = 0; batches < ITEM_FLUSH_SWEEP_MAX_BATCHES; ++batches) {
+        ENGINE_ERROR_CODE ret;
+        int count = 0;
+        bool stop;
+
+        cb_mutex_enter(&engine->items.lock);
+        if (!engine->items.flush_cursor_linked) {
+            /* Move on to the next list with items in it */
+            while (engine->items.flush_list >= 0 &&
+                   engine->items.heads[engine->items.flush_list] == NULL) {
+                if (++engine->items.flush_list == ITEM_LRU_LISTS) {
+                    engine->items.flush_list = -1;
+                }
+            }
+            if (engine->items.flush_list >= 0) {
+                cursor->refcount = 1;
+                do_item_link_cursor(engine, cursor,
+                                    engine->items.flush_list);
+                engine->items.flush_cursor_linked = true;
+            }
+        }
+
+        if (engine->items.flush_cursor_linked &&
+            !do_item_walk_cursor(engine, cursor, ITEM_FLUSH_SWEEP_BATCH,
+                                 item_flush_unlink, &count, &ret)) {
+            /* The cursor is unlinked at the end of the list */
+            engine->items.flush_cursor_linked = false;
+            if (++engine->items.flush_list == ITEM_LRU_LISTS) {
+                engine->items.flush_list = -1;
+            }
+        }
+        engine->items.flush_swept += count;
+        stop = engine->items.flush_list < 0;
+        cb_mutex_exit(&engine->items.lock);
+
+        swept += count;
+        if (stop) {
+            break;
+        }
+    }
+
+    return swept;
 }
 
+/*
+ * The items visited and cleaned while walking an LRU. Several threads may
+ * scrub (a class each), so they count locally and add the totals to the
+ * scrubber stats under scrubber.lock.
+ */
+struct scrub_counts {
+    uint64_t visited;
+    uint64_t cleaned;
+};
+
 static ENGINE_ERROR_CODE item_scrub(struct default_engine *engine,
                                     hash_item *item,
                                     void *cookie) {
     rel_time_t current_time = engine->server.core->get_current_time();
-    (void)cookie;
-    engine->scrubber.visited++;
+    struct scrub_counts *counts = cookie;
+    counts->visited++;
     /*
-        scrubber is used for generic bucket deletion and scrub_cmd
-        all expired or orphaned items are unlinked
+        scrubber is used for scrub_cmd, all expired or orphaned items are
+        unlinked (bucket deletion just drops the slab pages)
     */
-    if (engine->scrubber.force_delete && item->refcount > 0) {
-        // warn that someone isn't releasing items before deleting their bucket.
-        EXTENSION_LOGGER_DESCRIPTOR* logger;
-        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
-        logger->log(EXTENSION_LOG_WARNING, NULL,
-                    "Bucket (%d) deletion is removing an item with refcount %d",
-                     engine->bucket_id,
-                     item->refcount);
-    }
-
-    if (engine->scrubber.force_delete || (item->refcount == 0 &&
-       (item->exptime != 0 && item->exptime < current_time))) {
+    if (de_atomic_load(&item->refcount) == 0 &&
+        ((item->exptime != 0 && item->exptime < current_time) ||
+         item_is_flushed(engine, item))) {
         do_item_unlink(engine, item);
-        engine->scrubber.cleaned++;
+        counts->cleaned++;
     }
     return ENGINE_SUCCESS;
 }
 
-static void item_scrub_class(struct default_engine *engine,
-                             hash_item *cursor) {
+static void item_scrub_list(struct default_engine *engine,
+                            hash_item *cursor) {
 
     ENGINE_ERROR_CODE ret;
     bool more;
+    struct scrub_counts counts = {0, 0};
     do {
         cb_mutex_enter(&engine->items.lock);
-        more = do_item_walk_cursor(engine, cursor, 200, item_scrub, NULL, &ret);
+        more = do_item_walk_cursor(engine, cursor, 200, item_scrub, &counts,
+                                   &ret);
         cb_mutex_exit(&engine->items.lock);
         if (ret != ENGINE_SUCCESS) {
             break;
         }
     } while (more);
+
+    cb_mutex_enter(&engine->scrubber.lock);
+    engine->scrubber.visited += counts.visited;
+    engine->scrubber.cleaned += counts.cleaned;
+    cb_mutex_exit(&engine->scrubber.lock);
 }
 
-void item_scrubber_main(struct default_engine *engine)
+void item_scrub_class(struct default_engine *engine, int clsid)
 {
     hash_item cursor;
-    int ii;
+    int segment;
 
     memset(&cursor, 0, sizeof(cursor));
     cursor.refcount = 1;
-    for (ii = 0; ii < POWER_LARGEST; ++ii) {
+    for (segment = 0; segment < ITEM_LRU_SEGMENTS; ++segment) {
+        const int ii = segment * POWER_LARGEST + clsid;
         bool skip = false;
         cb_mutex_enter(&engine->items.lock);
         if (engine->items.heads[ii] == NULL) {
@@ -1095,10 +2920,17 @@ void item_scrubber_main(struct default_engine *engine)
         cb_mutex_exit(&engine->items.lock);
 
         if (!skip) {
-            item_scrub_class(engine, &cursor);
+            item_scrub_list(engine, &cursor);
         }
     }
 
+    cb_mutex_enter(&engine->scrubber.lock);
+    engine->scrubber.classes_done++;
+    cb_mutex_exit(&engine->scrubber.lock);
+}
+
+void item_scrubber_done(struct default_engine *engine)
+{
     cb_mutex_enter(&engine->scrubber.lock);
     engine->scrubber.stopped = time(NULL);
     engine->scrubber.running = false;
@@ -1120,6 +2952,8 @@ bool item_start_scrub(struct default_engine *engine)
         engine->scrubber.stopped = 0;
         engine->scrubber.visited = 0;
         engine->scrubber.cleaned = 0;
+        engine->scrubber.classes_done = 0;
+        engine->scrubber.classes_total = POWER_LARGEST - POWER_SMALLEST;
         engine->scrubber.running = true;
         engine_manager_scrub_engine(engine);
         ret = true;
@@ -1129,6 +2963,78 @@ bool item_start_scrub(struct default_engine *engine)
     return ret;
 }
 
+void item_walker_init(struct item_walker *walker) {
+    memset(walker, 0, sizeof(*walker));
+    walker->cursor.refcount = 1;
+    walker->list = ITEM_LRU_LISTS - 1;
+}
+
+struct item_walker_batch {
+    hash_item **items;
+    int count;
+    rel_time_t current_time;
+};
+
+static ENGINE_ERROR_CODE item_walker_collect(struct default_engine *engine,
+                                             hash_item *item,
+                                             void *cookie) {
+    struct item_walker_batch *batch = cookie;
+    if (!item_is_dead(engine, item, batch->current_time)) {
+        de_atomic_incr_16(&item->refcount);
+        DEBUG_REFCNT(item, '+');
+        batch->items[batch->count++] = item;
+    }
+    return ENGINE_SUCCESS;
+}
+
+int item_walker_next(struct default_engine *engine,
+                     struct item_walker *walker,
+                     hash_item **items, int max) {
+    struct item_walker_batch batch;
+
+    batch.items = items;
+    batch.count = 0;
+    while (batch.count == 0 && walker->list >= 0) {
+        ENGINE_ERROR_CODE ret;
+
+        batch.current_time = engine->server.core->get_current_time();
+        cb_mutex_enter(&engine->items.lock);
+        if (!walker->cursor_linked) {
+            /* Move on to the next list with items in it */
+            while (walker->list >= 0 &&
+                   engine->items.heads[walker->list] == NULL) {
+                --walker->list;
+            }
+            if (walker->list >= 0) {
+                do_item_link_cursor(engine, &walker->cursor, walker->list);
+                walker->cursor_linked = true;
+            }
+        }
+
+        if (walker->cursor_linked &&
+            !do_item_walk_cursor(engine, &walker->cursor, max,
+                                 item_walker_collect, &batch, &ret)) {
+            /* The cursor is unlinked at the end of the list */
+            walker->cursor_linked = false;
+            --walker->list;
+        }
+        cb_mutex_exit(&engine->items.lock);
+    }
+
+    return batch.count;
+}
+
+void item_walker_stop(struct default_engine *engine,
+                      struct item_walker *walker) {
+    cb_mutex_enter(&engine->items.lock);
+    if (walker->cursor_linked) {
+        item_unlink_q(engine, &walker->cursor);
+        walker->cursor_linked = false;
+    }
+    walker->list = -1;
+    cb_mutex_exit(&engine->items.lock);
+}
+
 struct tap_client {
     hash_item cursor;
     hash_item *it;
@@ -1139,7 +3045,7 @@ static ENGINE_ERROR_CODE item_tap_iterfunc(struct default_engine *engine,
                                     void *cookie) {
     struct tap_client *client = cookie;
     client->it = item;
-    ++client->it->refcount;
+    de_atomic_incr_16(&client->it->refcount);
     return ENGINE_SUCCESS;
 }
 
@@ -1168,7 +3074,7 @@ static tap_event_t do_item_tap_walker(struct default_engine *engine,
             /* find next slab class to look at.. */
             bool linked = false;
             int ii;
-            for (ii = client->cursor.slabs_clsid + 1; ii < POWER_LARGEST && !linked;  ++ii) {
+            for (ii = item_lru_id(&client->cursor) + 1; ii < ITEM_LRU_LISTS && !linked;  ++ii) {
                 if (engine->items.heads[ii] != NULL) {
                     /* add the item at the tail */
                     do_item_link_cursor(engine, &client->cursor, ii);
@@ -1212,7 +3118,7 @@ bool initialize_item_tap_walker(struct default_engine *engine,
     client->cursor.refcount = 1;
 
     /* Link the cursor! */
-    for (ii = 0; ii < POWER_LARGEST && !linked; ++ii) {
+    for (ii = 0; ii < ITEM_LRU_LISTS && !linked; ++ii) {
         cb_mutex_enter(&engine->items.lock);
         if (engine->items.heads[ii] != NULL) {
             /* add the item at the tail */
@@ -1234,7 +3140,7 @@ void link_dcp_walker(struct default_engine *engine,
     connection->cursor.refcount = 1;
 
     /* Link the cursor! */
-    for (ii = 0; ii < POWER_LARGEST && !linked; ++ii) {
+    for (ii = 0; ii < ITEM_LRU_LISTS && !linked; ++ii) {
         cb_mutex_enter(&engine->items.lock);
         if (engine->items.heads[ii] != NULL) {
             /* add the item at the tail */
@@ -1250,7 +3156,7 @@ static ENGINE_ERROR_CODE item_dcp_iterfunc(struct default_engine *engine,
                                            void *cookie) {
     struct dcp_connection *connection = cookie;
     connection->it = item;
-    ++connection->it->refcount;
+    de_atomic_incr_16(&connection->it->refcount);
     return ENGINE_SUCCESS;
 }
 
@@ -1267,7 +3173,7 @@ static ENGINE_ERROR_CODE do_item_dcp_step(struct default_engine *engine,
             /* find next slab class to look at.. */
             bool linked = false;
             int ii;
-            for (ii = connection->cursor.slabs_clsid + 1; ii < POWER_LARGEST && !linked;  ++ii) {
+            for (ii = item_lru_id(&connection->cursor) + 1; ii < ITEM_LRU_LISTS && !linked;  ++ii) {
                 if (engine->items.heads[ii] != NULL) {
                     /* add the item at the tail */
                     do_item_link_cursor(engine, &connection->cursor, ii);
@@ -1285,10 +3191,9 @@ static ENGINE_ERROR_CODE do_item_dcp_step(struct default_engine *engine,
         rel_time_t exptime = connection->it->exptime;
 
         if (exptime != 0 && exptime < current_time) {
-            const hash_key* key = item_get_key(connection->it);
             ret = producers->expiration(cookie, connection->opaque,
-                                        hash_key_get_client_key(key),
-                                        hash_key_get_client_key_len(key),
+                                        item_get_key(connection->it),
+                                        connection->it->nkey,
                                         item_get_cas(connection->it),
                                         0, 0, 0, NULL, 0);
             if (ret == ENGINE_SUCCESS) {
@@ -1348,14 +3253,3 @@ static void hash_key_destroy(hash_key* hkey) {
        free(hkey->header.full_key);
     }
 }
-
-/*
- * The item object stores a hash_key in a contiguous allocation
- * This method ensures correct copying into a contiguous hash_key
- */
-static void hash_key_copy_to_item(hash_item* dst, const hash_key* src) {
-    hash_key* key = item_get_key(dst);
-    memcpy(key, src, sizeof(hash_key_header));
-    key->header.full_key = (hash_key_data*)&key->key_storage;
-    memcpy(hash_key_get_key(key), hash_key_get_key(src), hash_key_get_key_len(src));
-}
@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stddef.h>
 #include "default_engine_internal.h"
+#include "atomics.h"
+#include "expiry.h"
 
 #ifndef ITEMS_H
 #define ITEMS_H
@@ -18,6 +20,7 @@ typedef struct _hash_item {
     struct _hash_item *next;
     struct _hash_item *prev;
     struct _hash_item *h_next; /* hash chain next */
+    uint32_t hash; /* crc32c of the hash_key */
     rel_time_t time;  /* least recent access */
     rel_time_t exptime; /**< When the item will expire (relative to process
                          * startup) */
@@ -29,10 +32,28 @@ typedef struct _hash_item {
     unsigned short refcount;
     uint8_t slabs_clsid;/* which slab class we're in */
     uint8_t datatype;/* to identify the type of the data */
+    uint16_t nkey; /* length of the client key stored after the header */
+    uint32_t generation; /* items.generation when the item was linked */
 } hash_item;
 
 /*
-    The structure of the key we hash with.
+ * The optimistic readers set ITEM_ACTIVE and test ITEM_LINKED without
+ * items.lock, so iflag is only ever read through this and updated with
+ * the de_atomic_* operations (also when holding the lock).
+ */
+static CB_INLINE uint16_t item_iflag(const hash_item *it) {
+    return de_atomic_load(&it->iflag);
+}
+
+/*
+ * The item header is followed by the cas (if ITEM_WITH_CAS), the client
+ * key (nkey bytes, not terminated) and the data. The bucket index isn't
+ * stored with the item; every engine instance has its own hash table,
+ * and it->hash (which covers the bucket index) is kept in the header.
+ */
+
+/*
+    The structure of the key we look up (and hash) with.
 
     This is a combination of the bucket index and the client's key.
 
@@ -98,14 +119,6 @@ static CB_INLINE void hash_key_set_client_key(hash_key* key,
     memcpy(key->header.full_key->client_key, client_key, client_key_len);
 }
 
-/*
- * return the bytes needed to store the hash_key structure
- * in a single contiguous allocation.
- */
-static CB_INLINE size_t hash_key_get_alloc_size(const hash_key* key) {
-    return offsetof(hash_key, key_storage) + hash_key_get_key_len(key);
-}
-
 typedef struct {
     unsigned int evicted;
     unsigned int evicted_nonzero;
@@ -113,19 +126,188 @@ typedef struct {
     unsigned int outofmemory;
     unsigned int tailrepairs;
     unsigned int reclaimed;
+    unsigned int moves_to_cold;
+    unsigned int moves_to_warm;
+    unsigned int moves_within_lru;
+    /* eviction_policy=sampled: candidates looked at, and LRU fallbacks */
+    uint64_t evict_samples;
+    unsigned int evict_fallbacks;
 } itemstats_t;
 
+/*
+ * Each slab class has a segmented LRU. New items enter the hot segment,
+ * items which are read while they're in the LRU get promoted to the warm
+ * segment and everything else ends up in the cold segment (which is where
+ * we evict from).
+ */
+enum item_lru_segment {
+    ITEM_LRU_HOT = 0,
+    ITEM_LRU_WARM = 1,
+    ITEM_LRU_COLD = 2
+};
+
+#define ITEM_LRU_SEGMENTS 3
+
+/*
+ * The lists are indexed by segment * POWER_LARGEST + slabs_clsid
+ */
+#define ITEM_LRU_LISTS (POWER_LARGEST * ITEM_LRU_SEGMENTS)
+
+/*
+ * How the item to evict from a slab class is picked (eviction_policy):
+ * from the tail of the LRU lists, or the least valuable of a sample of
+ * eviction_samples items picked at random from the slab pages (see
+ * do_item_evict_sampled).
+ */
+enum item_evict_policy {
+    ITEM_EVICT_LRU,
+    ITEM_EVICT_SAMPLED
+};
+
+#define ITEM_EVICT_MAX_SAMPLES 32
+
+/*
+ * Count-min sketch of how often the keys are accessed, which ranks the
+ * sampled eviction candidates (ITEM_SKETCH_DEPTH rows of mask + 1
+ * counters, indexed by it->hash). The counters saturate at 255 and are
+ * halved by the LRU maintainer every ITEM_SKETCH_HALF_LIFE seconds, so
+ * that it reflects recent popularity. It keeps counting for keys which
+ * were evicted, so a key which keeps coming back ranks higher.
+ */
+#define ITEM_SKETCH_DEPTH 4
+#define ITEM_SKETCH_HALF_LIFE 60
+
+struct item_sketch {
+   volatile uint8_t *counters;
+   uint32_t mask;
+   rel_time_t aged;
+};
+
 struct items {
-   hash_item *heads[POWER_LARGEST];
-   hash_item *tails[POWER_LARGEST];
+   hash_item *heads[ITEM_LRU_LISTS];
+   hash_item *tails[ITEM_LRU_LISTS];
    itemstats_t itemstats[POWER_LARGEST];
-   unsigned int sizes[POWER_LARGEST];
+   unsigned int sizes[ITEM_LRU_LISTS];
    /*
     * serialise access to the items data
    */
    cb_mutex_t lock;
+
+   /*
+    * The LRU maintainer moves items between the segments. It sleeps on
+    * maintainer_cond (with items.lock) between each run.
+    */
+   cb_cond_t maintainer_cond;
+   cb_thread_t maintainer_tid;
+   bool maintainer_running;
+   bool maintainer_shutdown;
+
+   /*
+    * The items with an expiry time, which the LRU maintainer reclaims
+    * as they expire
+    */
+   struct expiry_wheel expiry;
+
+   /*
+    * flush_all bumps the generation, which makes every item linked
+    * before it dead at once. The LRU maintainer then sweeps them out of
+    * the LRU lists (one list at a time, starting with flush_list) with
+    * flush_cursor. flush_list is -1 when there's nothing to sweep.
+    */
+   uint32_t generation;
+   hash_item flush_cursor;
+   bool flush_cursor_linked;
+   int flush_list;
+   uint64_t flush_swept;
+
+   enum item_evict_policy evict_policy;
+   struct item_sketch sketch;
+   /* picks the sampled eviction candidates (with items.lock) */
+   uint32_t evict_seed;
 };
 
+/**
+ * Start the LRU maintainer for the engine
+ * @param engine handle to the storage engine
+ * @return ENGINE_SUCCESS on success
+ */
+ENGINE_ERROR_CODE item_init(struct default_engine *engine);
+
+/**
+ * Stop the LRU maintainer for the engine
+ * @param engine handle to the storage engine
+ */
+void item_destroy(struct default_engine *engine);
+
+/**
+ * Evict all of the items stored in a slab page which is being moved to
+ * another slab class.
+ * @param engine handle to the storage engine
+ * @param page the start of the slab page
+ * @param size the chunk size of the page's slab class
+ * @param perslab the number of chunks in the page
+ * @param evicted incremented by the number of items evicted (OUT)
+ * @return the number of chunks in the page which are still in use
+ */
+int item_clear_slab_page(struct default_engine *engine, void *page,
+                         unsigned int size, unsigned int perslab,
+                         unsigned int *evicted);
+
+/*
+ * The items of a cache mapped from shm_file are linked again when the
+ * cache is re-attached after a restart (see slabs_attach). This is what
+ * we know about the process which stored them, and what we found.
+ */
+struct item_attach {
+    /* added to the pointers stored in the items (the mapping moved) */
+    intptr_t delta;
+    /* the bucket the hash of the items was computed for */
+    bucket_id_t bucket_id;
+    /* the flush_all generation of the items which are still alive */
+    uint32_t generation;
+    /* the absolute time of rel_time_t 0 in the process */
+    time_t time_base;
+
+    uint64_t linked;
+    /* items which expired or were flushed */
+    uint64_t expired;
+    /* items which didn't look right, or were still referenced */
+    uint64_t dropped;
+    /* the highest CAS id of the items linked */
+    uint64_t max_cas;
+};
+
+/**
+ * Link the items found in a slab page of a re-attached cache, once they
+ * are validated. Everything else in the page (except for the chunks of
+ * chunked items) is marked as free.
+ * @param engine handle to the storage engine
+ * @param page the start of the slab page
+ * @param id the slab class of the page
+ * @param attach the state of the cache (IN/OUT)
+ */
+void item_attach_slab_page(struct default_engine *engine, void *page,
+                           unsigned int id, struct item_attach *attach);
+
+/**
+ * Mark the chunks in a slab page of a re-attached cache which don't
+ * belong to an item linked by item_attach_slab_page as free. Must be
+ * called once every page is through item_attach_slab_page.
+ * @param engine handle to the storage engine
+ * @param page the start of the slab page
+ * @param id the slab class of the page
+ */
+void item_attach_slab_chunks(struct default_engine *engine, void *page,
+                             unsigned int id);
+
+/**
+ * Get the number of evictions for each slab class
+ * @param engine handle to the storage engine
+ * @param evicted where to store the counters (OUT)
+ */
+void item_get_evictions(struct default_engine *engine,
+                        uint64_t evicted[MAX_NUMBER_OF_SLAB_CLASSES]);
+
 
 /**
  * Allocate and initialize a new item structure
@@ -142,6 +324,36 @@ hash_item *item_alloc(struct default_engine *engine,
                       rel_time_t exptime, int nbytes, const void *cookie,
                       uint8_t datatype);
 
+/**
+ * Get the location of the value of an item. The value of an item which
+ * is larger than the largest slab class is split over multiple chunks.
+ * @param engine handle to the storage engine
+ * @param it the item
+ * @param iov where to store the location of the pieces of the value (OUT)
+ * @param niov the number of elements in iov
+ * @return the number of elements used in iov, or -1 if niov is too small
+ */
+int item_get_value_iov(struct default_engine *engine, const hash_item *it,
+                       struct iovec *iov, int niov);
+
+/**
+ * Copy the value of an item to a contiguous buffer
+ * @param engine handle to the storage engine
+ * @param it the item
+ * @param dest where to store the value (must hold it->nbytes bytes)
+ */
+void item_copy_value_out(struct default_engine *engine, const hash_item *it,
+                         void *dest);
+
+/**
+ * Copy a contiguous buffer into the value of an item
+ * @param engine handle to the storage engine
+ * @param it the item (not yet linked)
+ * @param src the value (it->nbytes bytes)
+ */
+void item_copy_value_in(struct default_engine *engine, hash_item *it,
+                        const void *src);
+
 /**
  * Get an item from the cache
  *
@@ -184,7 +396,39 @@ void item_stats_sizes(struct default_engine *engine,
                       ADD_STAT add_stat, const void *cookie);
 
 /**
- * Flush expired items from the cache
+ * Get the statistics of the expiry wheel
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_stats_expiry(struct default_engine *engine,
+                       ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Get the statistics of the flush sweeps
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_stats_flush(struct default_engine *engine,
+                      ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Get the per item memory overhead, and what the compact item layout
+ * saves compared to the legacy one
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_stats_overhead(struct default_engine *engine,
+                         ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Make all of the items in the cache dead. This doesn't touch the items,
+ * they're reclaimed by the LRU maintainer in the background.
  * @param engine handle to the storage engine
  */
 void  item_flush_expired(struct default_engine *engine);
@@ -235,6 +479,21 @@ ENGINE_ERROR_CODE store_item(struct default_engine *engine,
                              ENGINE_STORE_OPERATION operation,
                              const void *cookie);
 
+/* The most items store_items stores at the time */
+#define STORE_ITEMS_MAX 64
+
+/**
+ * Store a batch of items (with set semantics), taking items.lock once for
+ * all of them rather than once per item. Used to load snapshots, where
+ * the loader threads would otherwise contend for the lock on every item.
+ * @param engine handle to the storage engine
+ * @param items the items to store (at most STORE_ITEMS_MAX)
+ * @param nitems the number of items
+ * @param stored set to tell if each of the items was stored (OUT)
+ */
+void store_items(struct default_engine *engine, hash_item **items,
+                 int nitems, bool *stored);
+
 ENGINE_ERROR_CODE arithmetic(struct default_engine *engine,
                              const void* cookie,
                              const void* key,
@@ -250,10 +509,18 @@ ENGINE_ERROR_CODE arithmetic(struct default_engine *engine,
 
 
 /**
- * Run a single scrub loop for the engine.
+ * Scrub the LRU lists of a single slab class. The scrubber threads run
+ * this for all of the classes (in parallel) after item_start_scrub.
  * @param engine handle to the storage engine
+ * @param clsid the slab class to scrub
  */
-void item_scrubber_main(struct default_engine *engine);
+void item_scrub_class(struct default_engine *engine, int clsid);
+
+/**
+ * Mark the scrub started by item_start_scrub as done.
+ * @param engine handle to the storage engine
+ */
+void item_scrubber_done(struct default_engine *engine);
 
 /**
  * Start the item scrubber for the engine
@@ -262,6 +529,46 @@ void item_scrubber_main(struct default_engine *engine);
  */
 bool item_start_scrub(struct default_engine *engine);
 
+/*
+ * A walk over all of the items in the LRU lists which doesn't hold
+ * items.lock for more than a batch at a time. The cold segments are
+ * walked first, and each list from the least recently used item. Items
+ * moved between the lists while we walk may be missed or returned twice.
+ */
+struct item_walker {
+    hash_item cursor;
+    bool cursor_linked;
+    /* The list we're walking, -1 when we're done */
+    int list;
+};
+
+/**
+ * Start a walk over the LRU lists
+ * @param walker the walker to initialize
+ */
+void item_walker_init(struct item_walker *walker);
+
+/**
+ * Get the next (up to max) live items of the walk. The caller holds a
+ * reference to each of the items, and must item_release them.
+ * @param engine handle to the storage engine
+ * @param walker the walk to continue
+ * @param items where to store the items (OUT)
+ * @param max the number of elements in items
+ * @return the number of items stored in items, 0 when the walk is done
+ */
+int item_walker_next(struct default_engine *engine,
+                     struct item_walker *walker,
+                     hash_item **items, int max);
+
+/**
+ * Stop a walk which isn't done
+ * @param engine handle to the storage engine
+ * @param walker the walk to stop
+ */
+void item_walker_stop(struct default_engine *engine,
+                      struct item_walker *walker);
+
 /**
  * The tap walker to walk the hashtables
  */
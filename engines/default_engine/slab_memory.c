@@ -0,0 +1,642 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Backing memory for the slab pages mapped directly from the OS.
+ *
+ * By default the slab pages are allocated with malloc. With huge_pages or
+ * numa_policy set, the whole cache (cache_size) is instead reserved as a
+ * single mapping up front, and the slab pages are carved out of it as
+ * they are needed (just like with preallocate). The memory is only
+ * faulted in when it is first used, unless preallocate is set.
+ *
+ *   huge_pages=transparent  ask for transparent huge pages (madvise)
+ *   huge_pages=explicit     use the reserved huge pages (MAP_HUGETLB),
+ *                           falls back to transparent huge pages
+ *   numa_policy=interleave  interleave the memory over all the NUMA nodes
+ *                           the process is allowed to use
+ *   numa_policy=bind:<n>    only use memory from NUMA node n
+ *
+ * If the OS doesn't give us what we ask for we log a warning and carry
+ * on without it (see the slabs stats for what we got).
+ *
+ * With shm_file set the mapping is a shared mapping of the given file
+ * (typically in /dev/shm), which outlives the process. When the bucket
+ * is created again with the same configuration we re-attach to the cache
+ * in the file instead of starting out empty (see slabs_attach), so that
+ * a restart (or a crash) doesn't cost us the cache. The file starts with
+ * a header (padded to SLAB_MEMORY_ALIGN) telling us how to make sense of
+ * the pages following it:
+ *
+ *   struct slab_shm_header
+ *   the slab class each page is handed out to (uint8_t), 0 if none
+ *   the pages (carved out one after the other, see memory_allocate)
+ *
+ * The items are used as they are, so the file is only good for the same
+ * build on the same kind of host. Every item is validated before it is
+ * linked again, and the pointers in the items are relocated if we can't
+ * get the file mapped at the same address as the last time.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "default_engine_internal.h"
+
+/* The mapping is aligned to (and sized in) huge pages */
+#define SLAB_MEMORY_ALIGN (2 * 1024 * 1024)
+
+/* The highest NUMA node (+1) we may bind to */
+#define SLAB_MEMORY_MAX_NODES 1024
+
+/* "MCSH", which also tells us if the byte order is different */
+#define SLAB_SHM_MAGIC 0x4d435348
+#define SLAB_SHM_VERSION 1
+
+/*
+ * Buckets are deleted in the background, so the bucket which had the
+ * cache before may not have let go of shm_file yet. Wait for it for up
+ * to SLAB_SHM_LOCK_RETRIES * SLAB_SHM_LOCK_RETRY_SLEEP usec.
+ */
+#define SLAB_SHM_LOCK_RETRIES 500
+#define SLAB_SHM_LOCK_RETRY_SLEEP 10000
+
+struct slab_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    /* The layout of the cache, which must match the configuration */
+    uint64_t size;
+    uint64_t page_size;
+    uint64_t npages;
+    uint32_t item_header_size;
+    uint32_t use_cas;
+    uint32_t power_largest;
+    uint32_t chunk_sizes[MAX_NUMBER_OF_SLAB_CLASSES];
+    /* The state of the items (see struct item_attach) */
+    uint64_t base;
+    int64_t time_base;
+    uint32_t bucket_id;
+    uint32_t generation;
+};
+
+#ifdef __linux__
+/* From linux/mempolicy.h, which doesn't play well with the libc headers */
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_F_MEMS_ALLOWED
+#define MPOL_F_MEMS_ALLOWED (1 << 2)
+#endif
+#define SLAB_MEMORY_MASK_BITS (8 * sizeof(unsigned long))
+#endif
+
+static EXTENSION_LOGGER_DESCRIPTOR *get_logger(struct default_engine *engine) {
+    return (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+}
+
+static bool slab_memory_parse(struct default_engine *engine) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    const char *huge_pages = engine->config.huge_pages;
+    const char *numa = engine->config.numa_policy;
+
+    mem->huge_pages = SLAB_HUGE_PAGES_OFF;
+    if (huge_pages != NULL && strcmp(huge_pages, "off") != 0) {
+        if (strcmp(huge_pages, "transparent") == 0) {
+            mem->huge_pages = SLAB_HUGE_PAGES_TRANSPARENT;
+        } else if (strcmp(huge_pages, "explicit") == 0) {
+            mem->huge_pages = SLAB_HUGE_PAGES_EXPLICIT;
+        } else {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Invalid value for huge_pages: \"%s\"\n",
+                                    huge_pages);
+            return false;
+        }
+    }
+
+    mem->numa = SLAB_NUMA_DEFAULT;
+    mem->numa_node = -1;
+    if (numa != NULL && strcmp(numa, "default") != 0) {
+        if (strcmp(numa, "interleave") == 0) {
+            mem->numa = SLAB_NUMA_INTERLEAVE;
+        } else if (strncmp(numa, "bind:", 5) == 0) {
+            char *end;
+            long node = strtol(numa + 5, &end, 10);
+            if (end == numa + 5 || *end != '\0' || node < 0 ||
+                node >= SLAB_MEMORY_MAX_NODES) {
+                get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                        "Invalid NUMA node in numa_policy: \"%s\"\n",
+                                        numa);
+                return false;
+            }
+            mem->numa = SLAB_NUMA_BIND;
+            mem->numa_node = (int)node;
+        } else {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Invalid value for numa_policy: \"%s\"\n", numa);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#ifndef WIN32
+/* Map size bytes aligned to SLAB_MEMORY_ALIGN */
+static void *slab_memory_map_aligned(size_t size) {
+    size_t len = size + SLAB_MEMORY_ALIGN;
+    char *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    char *aligned;
+
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* Give back the unaligned head and the tail */
+    aligned = (char*)(((uintptr_t)ptr + SLAB_MEMORY_ALIGN - 1) &
+                      ~((uintptr_t)SLAB_MEMORY_ALIGN - 1));
+    if (aligned != ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    if (aligned + size != ptr + len) {
+        munmap(aligned + size, (ptr + len) - (aligned + size));
+    }
+    return aligned;
+}
+
+#ifdef __linux__
+static bool slab_memory_bind(struct default_engine *engine, void *ptr,
+                             size_t size) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    /* The kernel looks at one bit less than the number of nodes given */
+    unsigned long mask[SLAB_MEMORY_MAX_NODES / SLAB_MEMORY_MASK_BITS + 1];
+    int mode;
+
+    memset(mask, 0, sizeof(mask));
+    if (mem->numa == SLAB_NUMA_INTERLEAVE) {
+        int policy;
+        if (syscall(SYS_get_mempolicy, &policy, mask,
+                    (unsigned long)SLAB_MEMORY_MAX_NODES + 1, NULL,
+                    MPOL_F_MEMS_ALLOWED) != 0) {
+            return false;
+        }
+        mode = MPOL_INTERLEAVE;
+    } else {
+        mask[mem->numa_node / SLAB_MEMORY_MASK_BITS] |=
+            1UL << (mem->numa_node % SLAB_MEMORY_MASK_BITS);
+        mode = MPOL_BIND;
+    }
+
+    return syscall(SYS_mbind, ptr, size, mode, mask,
+                   (unsigned long)SLAB_MEMORY_MAX_NODES + 1, 0) == 0;
+}
+#endif
+
+/* Ask for transparent huge pages and set the NUMA policy as configured */
+static void slab_memory_advise(struct default_engine *engine, void *ptr,
+                               size_t size) {
+    struct slab_memory *mem = &engine->slabs.memory;
+
+    if (mem->backing == SLAB_HUGE_PAGES_TRANSPARENT) {
+#ifdef MADV_HUGEPAGE
+        if (madvise(ptr, size, MADV_HUGEPAGE) != 0)
+#endif
+        {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Transparent huge pages are not available\n");
+            mem->backing = SLAB_HUGE_PAGES_OFF;
+        }
+    }
+
+    if (mem->numa != SLAB_NUMA_DEFAULT) {
+#ifdef __linux__
+        if (!slab_memory_bind(engine, ptr, size))
+#endif
+        {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Can't set the NUMA policy of the cache: %s\n",
+                                    strerror(errno));
+            mem->numa = SLAB_NUMA_DEFAULT;
+        }
+    }
+}
+
+static void *slab_memory_map(struct default_engine *engine, size_t size) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    void *ptr = NULL;
+
+    mem->backing = mem->huge_pages;
+#ifdef MAP_HUGETLB
+    if (mem->backing == SLAB_HUGE_PAGES_EXPLICIT) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED) {
+            ptr = NULL;
+        }
+    }
+#endif
+    if (ptr == NULL) {
+        if (mem->backing == SLAB_HUGE_PAGES_EXPLICIT) {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Can't map the cache with huge pages (%s), "
+                                    "trying transparent huge pages\n",
+                                    strerror(errno));
+            mem->backing = SLAB_HUGE_PAGES_TRANSPARENT;
+        }
+        if ((ptr = slab_memory_map_aligned(size)) == NULL) {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Can't map memory for the cache: %s\n",
+                                    strerror(errno));
+            return NULL;
+        }
+    }
+
+    slab_memory_advise(engine, ptr, size);
+    return ptr;
+}
+#endif
+
+/* The distance between the pages carved out of the mapping */
+static size_t slab_memory_stride(struct default_engine *engine) {
+    size_t stride = engine->config.slab_page_size + SLAB_PAGE_GUARD_BYTES;
+    return (stride + CHUNK_ALIGN_BYTES - 1) & ~((size_t)CHUNK_ALIGN_BYTES - 1);
+}
+
+static uint8_t *slab_memory_page_classes(struct slab_memory *mem) {
+    return (uint8_t*)(mem->shm + 1);
+}
+
+#ifndef WIN32
+
+/* Was the cache in the file created with the configuration we've got? */
+static bool slab_memory_shm_matches(struct default_engine *engine,
+                                    const struct slab_shm_header *header,
+                                    size_t size, size_t npages) {
+    unsigned int ii;
+
+    if (header->magic != SLAB_SHM_MAGIC ||
+        header->version != SLAB_SHM_VERSION ||
+        header->size != size ||
+        header->page_size != engine->config.slab_page_size ||
+        header->npages != npages ||
+        header->item_header_size != sizeof(hash_item) ||
+        header->use_cas != (engine->config.use_cas ? 1 : 0) ||
+        header->power_largest != engine->slabs.power_largest) {
+        return false;
+    }
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        if (header->chunk_sizes[ii] != engine->slabs.slabclass[ii].size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void slab_memory_shm_create(struct default_engine *engine,
+                                   size_t npages) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    struct slab_shm_header *header = mem->shm;
+    unsigned int ii;
+
+    header->size = mem->size;
+    header->page_size = engine->config.slab_page_size;
+    header->npages = npages;
+    header->item_header_size = sizeof(hash_item);
+    header->use_cas = engine->config.use_cas ? 1 : 0;
+    header->power_largest = engine->slabs.power_largest;
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        header->chunk_sizes[ii] = engine->slabs.slabclass[ii].size;
+    }
+    header->base = (uintptr_t)mem->base;
+    header->time_base = engine->server.core->abstime(0);
+    header->bucket_id = engine->bucket_id;
+    header->generation = 0;
+    header->version = SLAB_SHM_VERSION;
+    header->magic = SLAB_SHM_MAGIC;
+}
+
+/*
+ * Map the file at hint if we can (where it was mapped the last time), or
+ * anywhere aligned to SLAB_MEMORY_ALIGN.
+ */
+static char *slab_memory_map_shared(int fd, size_t len, char *hint,
+                                    bool populate) {
+    int flags = MAP_SHARED;
+    char *reserved;
+    void *ptr;
+
+#ifdef MAP_POPULATE
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+
+    if (hint != NULL) {
+        ptr = mmap(hint, len, PROT_READ | PROT_WRITE, flags, fd, 0);
+        if (ptr == hint) {
+            return ptr;
+        }
+        if (ptr != MAP_FAILED) {
+            munmap(ptr, len);
+        }
+    }
+
+    if ((reserved = slab_memory_map_aligned(len)) == NULL) {
+        return NULL;
+    }
+    ptr = mmap(reserved, len, PROT_READ | PROT_WRITE, flags | MAP_FIXED,
+               fd, 0);
+    if (ptr == MAP_FAILED) {
+        munmap(reserved, len);
+        return NULL;
+    }
+    return ptr;
+}
+
+static ENGINE_ERROR_CODE slab_memory_map_file(struct default_engine *engine,
+                                              size_t size, bool populate) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    const char *file = engine->config.shm_file;
+    const size_t npages = size / slab_memory_stride(engine);
+    const size_t header_size =
+        (sizeof(struct slab_shm_header) + npages + SLAB_MEMORY_ALIGN - 1) &
+        ~((size_t)SLAB_MEMORY_ALIGN - 1);
+    struct slab_shm_header header;
+    struct stat st;
+    char *hint = NULL;
+    char *ptr;
+    bool matches = false;
+    bool locked;
+    int retries = 0;
+    int fd;
+
+    mem->backing = mem->huge_pages;
+    if (mem->backing == SLAB_HUGE_PAGES_EXPLICIT) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Can't map shm_file with huge pages, "
+                                "trying transparent huge pages\n");
+        mem->backing = SLAB_HUGE_PAGES_TRANSPARENT;
+    }
+
+    if ((fd = open(file, O_RDWR | O_CREAT, 0600)) == -1) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Can't open shm_file \"%s\": %s\n",
+                                file, strerror(errno));
+        return ENGINE_FAILED;
+    }
+    /* Only one bucket (or process) may use the cache at the time */
+    while (!(locked = (flock(fd, LOCK_EX | LOCK_NB) == 0)) &&
+           errno == EWOULDBLOCK && retries++ < SLAB_SHM_LOCK_RETRIES) {
+        usleep(SLAB_SHM_LOCK_RETRY_SLEEP);
+    }
+    if (!locked) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Can't lock shm_file \"%s\": %s\n",
+                                file, strerror(errno));
+        close(fd);
+        return ENGINE_FAILED;
+    }
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        matches = (size_t)st.st_size == header_size + size &&
+                  pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                  slab_memory_shm_matches(engine, &header, size, npages);
+        if (matches) {
+            hint = (char*)(uintptr_t)header.base - header_size;
+        } else {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Discarding the cache in shm_file \"%s\" "
+                                    "(it doesn't match the configuration)\n",
+                                    file);
+        }
+    }
+    if (!matches &&
+        (ftruncate(fd, 0) != 0 || ftruncate(fd, header_size + size) != 0)) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Can't resize shm_file \"%s\": %s\n",
+                                file, strerror(errno));
+        close(fd);
+        return ENGINE_FAILED;
+    }
+
+    if ((ptr = slab_memory_map_shared(fd, header_size + size, hint,
+                                      populate)) == NULL) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Can't map shm_file \"%s\": %s\n",
+                                file, strerror(errno));
+        close(fd);
+        return ENGINE_ENOMEM;
+    }
+
+    mem->shm = (struct slab_shm_header*)ptr;
+    mem->shm_header_size = header_size;
+    mem->shm_fd = fd;
+    mem->base = ptr + header_size;
+    mem->size = size;
+    if (matches) {
+        mem->attach.attached = true;
+    } else {
+        slab_memory_shm_create(engine, npages);
+    }
+    slab_memory_advise(engine, mem->base, size);
+
+    return ENGINE_SUCCESS;
+}
+#endif
+
+bool slab_memory_attach_state(struct default_engine *engine,
+                              struct item_attach *attach) {
+    struct slab_memory *mem = &engine->slabs.memory;
+
+    if (mem->shm == NULL || !mem->attach.attached) {
+        return false;
+    }
+    memset(attach, 0, sizeof(*attach));
+    attach->delta = (intptr_t)((uintptr_t)mem->base - mem->shm->base);
+    attach->bucket_id = mem->shm->bucket_id;
+    attach->generation = mem->shm->generation;
+    attach->time_base = (time_t)mem->shm->time_base;
+    return true;
+}
+
+void slab_memory_attach_done(struct default_engine *engine,
+                             const struct item_attach *attach) {
+    struct slab_memory *mem = &engine->slabs.memory;
+
+    mem->attach.items = attach->linked;
+    mem->attach.expired = attach->expired;
+    mem->attach.dropped = attach->dropped;
+    /* The items are ours now */
+    mem->shm->base = (uintptr_t)mem->base;
+    mem->shm->time_base = engine->server.core->abstime(0);
+    mem->shm->bucket_id = engine->bucket_id;
+}
+
+size_t slab_memory_pages(struct default_engine *engine) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    return mem->shm != NULL ? (size_t)mem->shm->npages : 0;
+}
+
+unsigned int slab_memory_page(struct default_engine *engine, size_t n,
+                              char **page) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    *page = (char*)mem->base + n * slab_memory_stride(engine);
+    return slab_memory_page_classes(mem)[n];
+}
+
+void slab_memory_set_page_class(struct default_engine *engine, void *page,
+                                unsigned int id) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    if (mem->shm != NULL) {
+        size_t n = ((char*)page - (char*)mem->base) / slab_memory_stride(engine);
+        slab_memory_page_classes(mem)[n] = (uint8_t)id;
+    }
+}
+
+unsigned int slab_memory_chunk_class(struct default_engine *engine,
+                                     const void *ptr) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    const size_t stride = slab_memory_stride(engine);
+    const char *base = mem->base;
+    const slabclass_t *p;
+    size_t offset;
+    size_t n;
+    unsigned int id;
+
+    if (mem->shm == NULL || (const char*)ptr < base ||
+        (const char*)ptr >= base + mem->shm->npages * stride) {
+        return 0;
+    }
+    offset = (const char*)ptr - base;
+    n = offset / stride;
+    offset -= n * stride;
+    id = slab_memory_page_classes(mem)[n];
+    if (id < POWER_SMALLEST || id > engine->slabs.power_largest) {
+        return 0;
+    }
+    p = &engine->slabs.slabclass[id];
+    if (offset % p->size != 0 || offset / p->size >= p->perslab) {
+        return 0;
+    }
+    return id;
+}
+
+void slab_memory_set_generation(struct default_engine *engine,
+                                uint32_t generation) {
+    if (engine->slabs.memory.shm != NULL) {
+        engine->slabs.memory.shm->generation = generation;
+    }
+}
+
+ENGINE_ERROR_CODE slab_memory_init(struct default_engine *engine,
+                                   size_t limit, bool populate) {
+    struct slab_memory *mem = &engine->slabs.memory;
+    size_t size;
+
+    if (!slab_memory_parse(engine)) {
+        return ENGINE_EINVAL;
+    }
+    if (mem->huge_pages == SLAB_HUGE_PAGES_OFF &&
+        mem->numa == SLAB_NUMA_DEFAULT && engine->config.shm_file == NULL) {
+        /* Use malloc */
+        return ENGINE_SUCCESS;
+    }
+
+#ifdef WIN32
+    get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                            "huge_pages, numa_policy and shm_file are not "
+                            "supported on this platform\n");
+    return ENGINE_ENOTSUP;
+#else
+    if (limit == 0) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "huge_pages, numa_policy and shm_file need a "
+                                "cache_size\n");
+        return ENGINE_EINVAL;
+    }
+
+    /* Every slab page is followed by a few guard bytes */
+    size = limit + (limit / engine->config.slab_page_size + 1) *
+           SLAB_PAGE_GUARD_BYTES;
+    size = (size + SLAB_MEMORY_ALIGN - 1) & ~((size_t)SLAB_MEMORY_ALIGN - 1);
+
+    if (engine->config.shm_file != NULL) {
+        return slab_memory_map_file(engine, size, populate);
+    }
+
+    if ((mem->base = slab_memory_map(engine, size)) == NULL) {
+        return ENGINE_ENOMEM;
+    }
+    mem->size = size;
+
+    if (populate) {
+        /* Fault in the memory now (after the NUMA policy is set) */
+        const long page = sysconf(_SC_PAGESIZE);
+        volatile char *ptr = mem->base;
+        size_t ii;
+        for (ii = 0; ii < size; ii += page) {
+            ptr[ii] = 0;
+        }
+    }
+
+    return ENGINE_SUCCESS;
+#endif
+}
+
+void slab_memory_destroy(struct default_engine *engine) {
+#ifndef WIN32
+    struct slab_memory *mem = &engine->slabs.memory;
+    if (mem->shm != NULL) {
+        /* The cache stays in the file for the next time */
+        munmap(mem->shm, mem->shm_header_size + mem->size);
+        close(mem->shm_fd);
+        mem->shm = NULL;
+        mem->base = NULL;
+        mem->size = 0;
+    } else if (mem->base != NULL) {
+        munmap(mem->base, mem->size);
+        mem->base = NULL;
+        mem->size = 0;
+    }
+#endif
+}
+
+void slab_memory_numa_policy(struct default_engine *engine,
+                             char *buffer, size_t size) {
+    switch (engine->slabs.memory.numa) {
+    case SLAB_NUMA_INTERLEAVE:
+        snprintf(buffer, size, "interleave");
+        break;
+    case SLAB_NUMA_BIND:
+        snprintf(buffer, size, "bind:%d", engine->slabs.memory.numa_node);
+        break;
+    default:
+        snprintf(buffer, size, "default");
+    }
+}
+
+const char *slab_memory_backing(struct default_engine *engine) {
+    switch (engine->slabs.memory.backing) {
+    case SLAB_HUGE_PAGES_TRANSPARENT:
+        return "transparent";
+    case SLAB_HUGE_PAGES_EXPLICIT:
+        return "explicit";
+    default:
+        return "off";
+    }
+}
@@ -1,11 +1,19 @@
 /* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
 /*
- * Slabs memory allocation, based on powers-of-N. Slabs are up to 1MB in size
- * and are divided into chunks. The chunk sizes start off at the size of the
- * "item" structure plus space for a small key and value. They increase by
- * a multiplier factor from there, up to half the maximum slab size. The last
- * slab size is always 1MB, since that's the maximum item size allowed by the
- * memcached protocol.
+ * Slabs memory allocation, based on powers-of-N. Slabs are slab_page_size
+ * (1MB by default) in size and are divided into chunks. The chunk sizes
+ * start off at the size of the "item" structure plus space for a small key
+ * and value. They increase by a multiplier factor from there, up to half
+ * the slab size. Larger items are stored in chunks of the largest class.
+ *
+ * All of the slab pages have the same size, so that a page may be moved
+ * from one slab class to another when the size of the items stored in
+ * the cache changes (see slabs_reassign).
+ *
+ * Every slab class has its own lock, and the threads keep a few free
+ * chunks of each class in a cache (see SLABS_CACHE_SLOTS), so that threads
+ * storing items of different (or the same) sizes don't serialise on a
+ * single lock.
  */
 #include "config.h"
 
@@ -17,18 +25,15 @@
 #include <inttypes.h>
 #include <stdarg.h>
 
-#ifdef VALGRIND
-// switch to malloc if VALGRIND so we can get some useful insight.
-#define USE_SYSTEM_MALLOC (1)
-#endif
-
 #include "default_engine_internal.h"
+#include "atomics.h"
 
 /*
  * Forward Declarations
  */
 static int do_slabs_newslab(struct default_engine *engine, const unsigned int id);
 static void *memory_allocate(struct default_engine *engine, size_t size);
+static void slabs_rebalancer_main(void *arg);
 
 #ifndef DONT_PREALLOC_SLABS
 /* Preallocate as many slab pages as possible (called from slabs_init)
@@ -90,29 +95,22 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
                              const bool prealloc) {
     int i = POWER_SMALLEST - 1;
     unsigned int size = sizeof(hash_item) + (unsigned int)engine->config.chunk_size;
+    /* Larger items are stored in chunks of the largest class (see items.c) */
+    const unsigned int chunk_max = (unsigned int)(engine->config.slab_page_size / 2);
+    unsigned int jj;
+    ENGINE_ERROR_CODE err;
 
     engine->slabs.mem_limit = limit;
 
-    if (prealloc) {
-        /* Allocate everything in a big chunk with malloc */
-        engine->slabs.mem_base = my_allocate(engine, engine->slabs.mem_limit);
-        if (engine->slabs.mem_base != NULL) {
-            engine->slabs.mem_current = engine->slabs.mem_base;
-            engine->slabs.mem_avail = engine->slabs.mem_limit;
-        } else {
-            return ENGINE_ENOMEM;
-        }
-    }
-
     memset(engine->slabs.slabclass, 0, sizeof(engine->slabs.slabclass));
 
-    while (++i < POWER_LARGEST && size <= engine->config.item_size_max / factor) {
+    while (++i < POWER_LARGEST && size <= chunk_max / factor) {
         /* Make sure items are always n-byte aligned */
         if (size % CHUNK_ALIGN_BYTES)
             size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
 
         engine->slabs.slabclass[i].size = size;
-        engine->slabs.slabclass[i].perslab = (unsigned int)engine->config.item_size_max / engine->slabs.slabclass[i].size;
+        engine->slabs.slabclass[i].perslab = (unsigned int)engine->config.slab_page_size / engine->slabs.slabclass[i].size;
         size = (unsigned int)(size * factor);
         if (engine->config.verbose > 1) {
             EXTENSION_LOGGER_DESCRIPTOR *logger;
@@ -125,8 +123,8 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
     }
 
     engine->slabs.power_largest = i;
-    engine->slabs.slabclass[engine->slabs.power_largest].size = (unsigned int)engine->config.item_size_max;
-    engine->slabs.slabclass[engine->slabs.power_largest].perslab = 1;
+    engine->slabs.slabclass[engine->slabs.power_largest].size = chunk_max;
+    engine->slabs.slabclass[engine->slabs.power_largest].perslab = 2;
     if (engine->config.verbose > 1) {
         EXTENSION_LOGGER_DESCRIPTOR *logger;
         logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
@@ -136,6 +134,54 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
                     engine->slabs.slabclass[i].perslab);
     }
 
+    for (jj = POWER_SMALLEST; jj <= engine->slabs.power_largest; jj++) {
+        slabclass_t *p = &engine->slabs.slabclass[jj];
+        p->cache_limit = p->perslab / 4;
+        if (p->cache_limit > SLABS_CACHE_SIZE) {
+            p->cache_limit = SLABS_CACHE_SIZE;
+        } else if (p->cache_limit < 2) {
+            p->cache_limit = 0;
+        }
+        cb_mutex_initialize(&p->lock);
+    }
+
+    /* The cache in shm_file must have the same slab classes */
+    err = slab_memory_init(engine, limit, prealloc);
+    if (err != ENGINE_SUCCESS) {
+        return err;
+    }
+
+    if (engine->slabs.memory.base != NULL) {
+        /* Carve the pages out of the mapping */
+        engine->slabs.mem_base = engine->slabs.memory.base;
+        engine->slabs.mem_current = engine->slabs.mem_base;
+        engine->slabs.mem_avail = engine->slabs.memory.size;
+    } else if (prealloc) {
+        /* Allocate everything in a big chunk with malloc */
+        engine->slabs.mem_base = my_allocate(engine, engine->slabs.mem_limit);
+        if (engine->slabs.mem_base != NULL) {
+            engine->slabs.mem_current = engine->slabs.mem_base;
+            engine->slabs.mem_avail = engine->slabs.mem_limit;
+        } else {
+            return ENGINE_ENOMEM;
+        }
+    }
+
+    engine->slabs.caches = calloc(SLABS_CACHE_SLOTS,
+                                  sizeof(struct slabs_cache));
+    if (engine->slabs.caches == NULL) {
+        return ENGINE_ENOMEM;
+    }
+    for (jj = 0; jj < SLABS_CACHE_SLOTS; jj++) {
+        struct slabs_cache *cache = &engine->slabs.caches[jj];
+        cache->classes = calloc(engine->slabs.power_largest + 1,
+                                sizeof(struct slabs_cache_class));
+        if (cache->classes == NULL) {
+            return ENGINE_ENOMEM;
+        }
+        cb_mutex_initialize(&cache->lock);
+    }
+
     /* for the test suite:  faking of how much we've already malloc'd */
     {
         char *t_initial_malloc = getenv("T_MEMD_INITIAL_MALLOC");
@@ -155,6 +201,24 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
     }
 #endif
 
+#ifndef USE_SYSTEM_MALLOC
+    {
+        int ret;
+        engine->slabs.rebalance.shutdown = false;
+        if ((ret = cb_create_named_thread(&engine->slabs.rebalance.tid,
+                                          slabs_rebalancer_main,
+                                          engine, 0, "mc:slab_rebal")) != 0) {
+            EXTENSION_LOGGER_DESCRIPTOR *logger;
+            logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create slab rebalancer thread: %s\n",
+                        strerror(ret));
+            return ENGINE_FAILED;
+        }
+        engine->slabs.rebalance.running = true;
+    }
+#endif
+
     return ENGINE_SUCCESS;
 }
 
@@ -190,57 +254,55 @@ static int grow_slab_list (struct default_engine *engine, const unsigned int id)
     return 1;
 }
 
+/* Called with the class lock, slabs.lock is acquired for the accounting */
 static int do_slabs_newslab(struct default_engine *engine, const unsigned int id) {
     slabclass_t *p = &engine->slabs.slabclass[id];
-    int len = p->size * p->perslab;
-    char *ptr;
-
-    if ((engine->slabs.mem_limit && engine->slabs.mem_malloced + len > engine->slabs.mem_limit && p->slabs > 0) ||
-        (grow_slab_list(engine, id) == 0) ||
-        ((ptr = memory_allocate(engine, (size_t)len)) == 0)) {
+    int len = (int)engine->config.slab_page_size;
+    char *ptr = NULL;
+
+    if (grow_slab_list(engine, id) != 0) {
+        cb_mutex_enter(&engine->slabs.lock);
+        if (!engine->slabs.mem_limit ||
+            engine->slabs.mem_malloced + len <= engine->slabs.mem_limit ||
+            p->slabs == 0) {
+            ptr = memory_allocate(engine, (size_t)len + SLAB_PAGE_GUARD_BYTES);
+            if (ptr != NULL) {
+                engine->slabs.mem_malloced += len;
+            }
+        }
+        cb_mutex_exit(&engine->slabs.lock);
+    }
 
+    if (ptr == NULL) {
         MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED(id);
         return 0;
     }
 
-    memset(ptr, 0, (size_t)len);
+    memset(ptr, 0, (size_t)len + SLAB_PAGE_GUARD_BYTES);
+    slab_memory_set_page_class(engine, ptr, id);
     p->end_page_ptr = ptr;
     p->end_page_free = p->perslab;
 
     p->slab_list[p->slabs++] = ptr;
-    engine->slabs.mem_malloced += len;
     MEMCACHED_SLABS_SLABCLASS_ALLOCATE(id);
 
     return 1;
 }
 
+/*
+ * Get a free chunk from the slab class (with the class lock held). A new
+ * slab page is only allocated if newslab is set.
+ */
 /*@null@*/
-static void *do_slabs_alloc(struct default_engine *engine, const size_t size, unsigned int id) {
-    slabclass_t *p;
+static void *do_slabs_alloc(struct default_engine *engine, unsigned int id,
+                            bool newslab) {
+    slabclass_t *p = &engine->slabs.slabclass[id];
     void *ret = NULL;
 
-    if (id < POWER_SMALLEST || id > engine->slabs.power_largest) {
-        MEMCACHED_SLABS_ALLOCATE_FAILED(size, 0);
-        return NULL;
-    }
-
-    p = &engine->slabs.slabclass[id];
-
-#ifdef USE_SYSTEM_MALLOC
-    if (engine->slabs.mem_limit && engine->slabs.mem_malloced + size > engine->slabs.mem_limit) {
-        MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
-        return 0;
-    }
-    engine->slabs.mem_malloced += size;
-    ret = calloc(1, size);
-    MEMCACHED_SLABS_ALLOCATE(size, id, 0, ret);
-    return ret;
-#endif
-
     /* fail unless we have space at the end of a recently allocated page,
        we have something on our freelist, or we could allocate a new page */
     if (! (p->end_page_ptr != 0 || p->sl_curr != 0 ||
-           do_slabs_newslab(engine, id) != 0)) {
+           (newslab && do_slabs_newslab(engine, id) != 0))) {
         /* We don't have more memory available */
         ret = NULL;
     } else if (p->sl_curr != 0) {
@@ -257,42 +319,79 @@ static void *do_slabs_alloc(struct default_engine *engine, const size_t size, un
         }
     }
 
-    if (ret) {
-        p->requested += size;
-        MEMCACHED_SLABS_ALLOCATE(size, id, p->size, ret);
-    } else {
-        MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
-    }
-
     return ret;
 }
 
-static void do_slabs_free(struct default_engine *engine, void *ptr, const size_t size, unsigned int id) {
-    slabclass_t *p;
-
-    if (id < POWER_SMALLEST || id > engine->slabs.power_largest)
-        return;
-
-    MEMCACHED_SLABS_FREE(size, id, ptr);
-    p = &engine->slabs.slabclass[id];
-
-#ifdef USE_SYSTEM_MALLOC
-    engine->slabs.mem_malloced -= size;
-    free(ptr);
-    return;
-#endif
+/*
+ * Is the chunk located in the page being moved away from the class? This
+ * is also called with just a thread cache locked.
+ */
+static bool slabs_chunk_is_killed(struct default_engine *engine,
+                                  slabclass_t *p, void *ptr) {
+    char *page = de_atomic_load(&p->killing_page);
+    return page != NULL && (char*)ptr >= page &&
+           (char*)ptr < page + engine->config.slab_page_size;
+}
 
+/* Put a free chunk on the freelist of the slab class */
+static bool do_slabs_push_free(slabclass_t *p, void *ptr) {
     if (p->sl_curr == p->sl_total) { /* need more space on the free list */
         int new_size = (p->sl_total != 0) ? p->sl_total * 2 : 16;  /* 16 is arbitrary */
         void **new_slots = realloc(p->slots, new_size * sizeof(void *));
         if (new_slots == 0)
-            return;
+            return false;
         p->slots = new_slots;
         p->sl_total = new_size;
     }
     p->slots[p->sl_curr++] = ptr;
-    p->requested -= size;
-    return;
+    return true;
+}
+
+/* Give a free chunk back to the slab class (with the class lock held) */
+static void do_slabs_free(struct default_engine *engine, void *ptr,
+                          unsigned int id) {
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    /* chunks in a page which is being moved are simply forgotten */
+    if (!slabs_chunk_is_killed(engine, p, ptr)) {
+        do_slabs_push_free(p, ptr);
+    }
+}
+
+/* Get the cache of free chunks used by the calling thread */
+static struct slabs_cache *slabs_get_cache(struct default_engine *engine) {
+    uintptr_t id = (uintptr_t)cb_thread_self();
+    return &engine->slabs.caches[((id >> 4) ^ (id >> 12)) & (SLABS_CACHE_SLOTS - 1)];
+}
+
+/*
+ * Move the free chunks of the slab class held by the thread caches back
+ * to the slab class. Returns the number of chunks moved.
+ */
+static unsigned int slabs_drain_caches(struct default_engine *engine,
+                                       unsigned int id) {
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    unsigned int moved = 0;
+    int ii;
+
+    if (p->cache_limit == 0) {
+        return 0;
+    }
+
+    for (ii = 0; ii < SLABS_CACHE_SLOTS; ++ii) {
+        struct slabs_cache *cache = &engine->slabs.caches[ii];
+        struct slabs_cache_class *c = &cache->classes[id];
+        cb_mutex_enter(&cache->lock);
+        if (c->count != 0) {
+            cb_mutex_enter(&p->lock);
+            while (c->count != 0) {
+                do_slabs_free(engine, c->chunks[--c->count], id);
+                ++moved;
+            }
+            cb_mutex_exit(&p->lock);
+        }
+        cb_mutex_exit(&cache->lock);
+    }
+    return moved;
 }
 
 void add_statistics(const void *cookie, ADD_STAT add_stats,
@@ -346,13 +445,27 @@ void add_statistics(const void *cookie, ADD_STAT add_stats,
 static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *cookie) {
     unsigned int i;
     unsigned int total = 0;
+    char numa[32];
 
     for(i = POWER_SMALLEST; i <= engine->slabs.power_largest; i++) {
         slabclass_t *p = &engine->slabs.slabclass[i];
+        uint32_t perslab, slabs, cached = 0;
+        int64_t requested = 0;
+        int ii;
+
+        for (ii = 0; ii < SLABS_CACHE_SLOTS; ++ii) {
+            struct slabs_cache *cache = &engine->slabs.caches[ii];
+            cb_mutex_enter(&cache->lock);
+            cached += cache->classes[i].count;
+            requested += cache->classes[i].requested;
+            cb_mutex_exit(&cache->lock);
+        }
+
+        cb_mutex_enter(&p->lock);
         if (p->slabs != 0) {
-            uint32_t perslab, slabs;
             slabs = p->slabs;
             perslab = p->perslab;
+            requested += (int64_t)p->requested;
 
             add_statistics(cookie, add_stats, NULL, i, "chunk_size", "%u",
                            p->size);
@@ -363,22 +476,58 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
             add_statistics(cookie, add_stats, NULL, i, "total_chunks", "%u",
                            slabs * perslab);
             add_statistics(cookie, add_stats, NULL, i, "used_chunks", "%u",
-                           slabs*perslab - p->sl_curr - p->end_page_free);
+                           slabs*perslab - p->sl_curr - p->end_page_free - cached);
             add_statistics(cookie, add_stats, NULL, i, "free_chunks", "%u",
                            p->sl_curr);
             add_statistics(cookie, add_stats, NULL, i, "free_chunks_end", "%u",
                            p->end_page_free);
+            add_statistics(cookie, add_stats, NULL, i, "cached_chunks", "%u",
+                           cached);
             add_statistics(cookie, add_stats, NULL, i, "mem_requested", "%"PRIu64,
-                           (uint64_t)p->requested);
+                           (uint64_t)requested);
             total++;
         }
+        cb_mutex_exit(&p->lock);
     }
 
     /* add overall slab stats and append terminator */
 
+    cb_mutex_enter(&engine->slabs.lock);
     add_statistics(cookie, add_stats, NULL, -1, "active_slabs", "%d", total);
     add_statistics(cookie, add_stats, NULL, -1, "total_malloced", "%"PRIu64,
                    (uint64_t)engine->slabs.mem_malloced);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_memory_mapped",
+                   "%"PRIu64, (uint64_t)engine->slabs.memory.size);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_huge_pages", "%s",
+                   slab_memory_backing(engine));
+    slab_memory_numa_policy(engine, numa, sizeof(numa));
+    add_statistics(cookie, add_stats, NULL, -1, "slab_numa_policy", "%s",
+                   numa);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_shm_attached", "%d",
+                   engine->slabs.memory.attach.attached ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_shm_items", "%"PRIu64,
+                   engine->slabs.memory.attach.items);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_shm_expired", "%"PRIu64,
+                   engine->slabs.memory.attach.expired);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_shm_dropped", "%"PRIu64,
+                   engine->slabs.memory.attach.dropped);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_shm_attach_ms", "%"PRIu64,
+                   engine->slabs.memory.attach.ms);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_automove", "%d",
+                   engine->config.slab_automove ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_running",
+                   "%d", engine->slabs.rebalance.busy ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "slabs_moved", "%"PRIu64,
+                   engine->slabs.rebalance.pages_moved);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_bytes",
+                   "%"PRIu64, engine->slabs.rebalance.bytes_moved);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_evictions",
+                   "%"PRIu64, engine->slabs.rebalance.evictions);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_busy_items",
+                   "%"PRIu64, engine->slabs.rebalance.busy_retries);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_aborted",
+                   "%"PRIu64, engine->slabs.rebalance.aborted);
+    cb_mutex_exit(&engine->slabs.lock);
 }
 
 static void *memory_allocate(struct default_engine *engine, size_t size) {
@@ -411,30 +560,156 @@ static void *memory_allocate(struct default_engine *engine, size_t size) {
 }
 
 void *slabs_alloc(struct default_engine *engine, size_t size, unsigned int id) {
-    void *ret;
+    slabclass_t *p;
+    void *ret = NULL;
+
+    if (id < POWER_SMALLEST || id > engine->slabs.power_largest) {
+        MEMCACHED_SLABS_ALLOCATE_FAILED(size, 0);
+        return NULL;
+    }
 
+    p = &engine->slabs.slabclass[id];
+
+#ifdef USE_SYSTEM_MALLOC
     cb_mutex_enter(&engine->slabs.lock);
-    ret = do_slabs_alloc(engine, size, id);
+    if (engine->slabs.mem_limit && engine->slabs.mem_malloced + size > engine->slabs.mem_limit) {
+        cb_mutex_exit(&engine->slabs.lock);
+        MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
+        return 0;
+    }
+    engine->slabs.mem_malloced += size;
     cb_mutex_exit(&engine->slabs.lock);
+    ret = calloc(1, size);
+    MEMCACHED_SLABS_ALLOCATE(size, id, 0, ret);
+    return ret;
+#endif
+
+    if (p->cache_limit != 0) {
+        struct slabs_cache *cache = slabs_get_cache(engine);
+        struct slabs_cache_class *c = &cache->classes[id];
+
+        cb_mutex_enter(&cache->lock);
+        if (c->count == 0) {
+            /* refill the cache, but only grab a new page if we must */
+            void *chunk;
+            cb_mutex_enter(&p->lock);
+            while (c->count < p->cache_limit / 2 &&
+                   (chunk = do_slabs_alloc(engine, id, c->count == 0)) != NULL) {
+                c->chunks[c->count++] = chunk;
+            }
+            cb_mutex_exit(&p->lock);
+        }
+        if (c->count != 0) {
+            ret = c->chunks[--c->count];
+            c->requested += size;
+        }
+        cb_mutex_exit(&cache->lock);
+    }
+
+    /*
+     * The slab class may be out of memory while other threads are sitting
+     * on free chunks in their caches, so take them back before giving up.
+     */
+    if (ret == NULL &&
+        (p->cache_limit == 0 || slabs_drain_caches(engine, id) != 0)) {
+        cb_mutex_enter(&p->lock);
+        ret = do_slabs_alloc(engine, id, true);
+        if (ret != NULL) {
+            p->requested += size;
+        }
+        cb_mutex_exit(&p->lock);
+    }
+
+    if (ret) {
+        MEMCACHED_SLABS_ALLOCATE(size, id, p->size, ret);
+    } else {
+        MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
+    }
+
     return ret;
 }
 
+/* xorshift32, good enough to pick eviction candidates */
+static uint32_t slabs_random(uint32_t *seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+int slabs_sample(struct default_engine *engine, unsigned int id,
+                 void **chunks, int n, uint32_t *seed) {
+    slabclass_t *p;
+    int ii;
+
+    if (id < POWER_SMALLEST || id > engine->slabs.power_largest) {
+        return 0;
+    }
+    p = &engine->slabs.slabclass[id];
+
+    cb_mutex_enter(&p->lock);
+    if (p->slabs == 0) {
+        n = 0;
+    }
+    for (ii = 0; ii < n; ++ii) {
+        char *page = p->slab_list[slabs_random(seed) % p->slabs];
+        chunks[ii] = page + (slabs_random(seed) % p->perslab) * p->size;
+    }
+    cb_mutex_exit(&p->lock);
+    return n;
+}
+
 void slabs_free(struct default_engine *engine, void *ptr, size_t size, unsigned int id) {
+    slabclass_t *p;
+
+    if (id < POWER_SMALLEST || id > engine->slabs.power_largest)
+        return;
+
+    MEMCACHED_SLABS_FREE(size, id, ptr);
+    p = &engine->slabs.slabclass[id];
+
+#ifdef USE_SYSTEM_MALLOC
     cb_mutex_enter(&engine->slabs.lock);
-    do_slabs_free(engine, ptr, size, id);
+    engine->slabs.mem_malloced -= size;
     cb_mutex_exit(&engine->slabs.lock);
+    free(ptr);
+    return;
+#endif
+
+    if (p->cache_limit == 0) {
+        cb_mutex_enter(&p->lock);
+        do_slabs_free(engine, ptr, id);
+        p->requested -= size;
+        cb_mutex_exit(&p->lock);
+    } else {
+        struct slabs_cache *cache = slabs_get_cache(engine);
+        struct slabs_cache_class *c = &cache->classes[id];
+
+        cb_mutex_enter(&cache->lock);
+        c->requested -= size;
+        if (!slabs_chunk_is_killed(engine, p, ptr)) {
+            if (c->count == p->cache_limit) {
+                /* give half of the cached chunks back to the slab class */
+                cb_mutex_enter(&p->lock);
+                while (c->count > p->cache_limit / 2) {
+                    do_slabs_free(engine, c->chunks[--c->count], id);
+                }
+                cb_mutex_exit(&p->lock);
+            }
+            c->chunks[c->count++] = ptr;
+        }
+        cb_mutex_exit(&cache->lock);
+    }
 }
 
 void slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c) {
-    cb_mutex_enter(&engine->slabs.lock);
     do_slabs_stats(engine, add_stats, c);
-    cb_mutex_exit(&engine->slabs.lock);
 }
 
 void slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id, size_t old, size_t ntotal)
 {
     slabclass_t *p;
-    cb_mutex_enter(&engine->slabs.lock);
     if (id < POWER_SMALLEST || id > engine->slabs.power_largest) {
         EXTENSION_LOGGER_DESCRIPTOR *logger;
         logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
@@ -444,8 +719,402 @@ void slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id,
     }
 
     p = &engine->slabs.slabclass[id];
+    cb_mutex_enter(&p->lock);
     p->requested = p->requested - old + ntotal;
+    cb_mutex_exit(&p->lock);
+}
+
+/* Does the slab class have a page to spare for another class? */
+static bool slabs_can_spare(struct default_engine *engine, int id) {
+    slabclass_t *p;
+    bool ret;
+
+    if (id < POWER_SMALLEST || id > (int)engine->slabs.power_largest) {
+        return false;
+    }
+    p = &engine->slabs.slabclass[id];
+    cb_mutex_enter(&p->lock);
+    ret = p->slabs > 1;
+    cb_mutex_exit(&p->lock);
+    return ret;
+}
+
+/*
+ * Pick the class to take a page from when the user didn't tell us: the
+ * one with the most free chunks (measured in pages) which can spare one.
+ */
+static int slabs_pick_any(struct default_engine *engine, unsigned int dst) {
+    unsigned int ii;
+    int ret = -1;
+    double best = -1;
+
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        slabclass_t *p = &engine->slabs.slabclass[ii];
+        double free_pages = -1;
+        if (ii == dst) {
+            continue;
+        }
+        cb_mutex_enter(&p->lock);
+        if (p->slabs > 1) {
+            free_pages = (double)(p->sl_curr + p->end_page_free) / p->perslab;
+        }
+        cb_mutex_exit(&p->lock);
+        if (free_pages > best) {
+            best = free_pages;
+            ret = ii;
+        }
+    }
+    return ret;
+}
+
+enum reassign_result_type slabs_reassign(struct default_engine *engine,
+                                         int src, unsigned int dst) {
+    enum reassign_result_type ret = REASSIGN_OK;
+
+    if (!engine->slabs.rebalance.running ||
+        dst < POWER_SMALLEST || dst > engine->slabs.power_largest ||
+        (src != -1 && (src < POWER_SMALLEST ||
+                       src > (int)engine->slabs.power_largest))) {
+        return REASSIGN_BADCLASS;
+    } else if (src == (int)dst) {
+        return REASSIGN_SRC_DST_SAME;
+    } else if (src == -1 ? slabs_pick_any(engine, dst) == -1 :
+                           !slabs_can_spare(engine, src)) {
+        return REASSIGN_NOSPARE;
+    }
+
+    cb_mutex_enter(&engine->slabs.lock);
+    if (engine->slabs.rebalance.busy ||
+        engine->slabs.rebalance.dst != 0) {
+        ret = REASSIGN_RUNNING;
+    } else {
+        engine->slabs.rebalance.src = src;
+        engine->slabs.rebalance.dst = dst;
+        cb_cond_signal(&engine->slabs.rebalance.cond);
+    }
     cb_mutex_exit(&engine->slabs.lock);
+    return ret;
+}
+
+/*
+ * Move the first page of the slab class src to the slab class dst.
+ *
+ * This is done in steps so that we never block the front end threads:
+ *  1. Mark the page as dying so that the allocator stops handing out its
+ *     chunks (and drops them as they're freed), take back the chunks held
+ *     by the thread caches and wait for the threads which got a chunk in
+ *     the page before that to initialize their item.
+ *  2. Evict the items in the page, until nobody references them.
+ *  3. Wait for the optimistic readers which may still look at the page.
+ *  4. Give the page to the new class and carve it into chunks.
+ */
+static void slabs_reassign_page(struct default_engine *engine,
+                                int src, unsigned int dst) {
+    const size_t page_size = engine->config.slab_page_size;
+    slabclass_t *s = &engine->slabs.slabclass[src];
+    slabclass_t *d = &engine->slabs.slabclass[dst];
+    unsigned int evicted = 0;
+    unsigned int ii;
+    int tries = 0;
+    int busy;
+    char *page;
+
+    cb_mutex_enter(&d->lock);
+    busy = !grow_slab_list(engine, dst);
+    cb_mutex_exit(&d->lock);
+    if (busy) {
+        return;
+    }
+
+    cb_mutex_enter(&s->lock);
+    if (s->slabs < 2) {
+        cb_mutex_exit(&s->lock);
+        return;
+    }
+    page = s->slab_list[0];
+    de_atomic_store(&s->killing_page, page);
+    if (slabs_chunk_is_killed(engine, s, s->end_page_ptr)) {
+        s->end_page_ptr = NULL;
+        s->end_page_free = 0;
+    }
+    ii = 0;
+    while (ii < s->sl_curr) {
+        if (slabs_chunk_is_killed(engine, s, s->slots[ii])) {
+            s->slots[ii] = s->slots[--s->sl_curr];
+        } else {
+            ++ii;
+        }
+    }
+    cb_mutex_exit(&s->lock);
+    slabs_drain_caches(engine, src);
+    /* item_alloc initializes the chunk it got as an assoc reader */
+    assoc_wait_for_readers(engine);
+
+    while ((busy = item_clear_slab_page(engine, page, s->size, s->perslab,
+                                        &evicted)) != 0 &&
+           tries++ < SLAB_REASSIGN_MAX_RETRIES) {
+        usleep(SLAB_REASSIGN_RETRY_SLEEP);
+    }
+
+    if (busy == 0) {
+        assoc_wait_for_readers(engine);
+    }
+
+    /* lock order: items before slabs (item_free calls slabs_free) */
+    cb_mutex_enter(&engine->items.lock);
+    cb_mutex_enter(&s->lock);
+    if (busy != 0) {
+        /* Give up, and let the class have its free chunks back */
+        de_atomic_store(&s->killing_page, NULL);
+        for (ii = 0; ii < s->perslab; ++ii) {
+            hash_item *it = (hash_item*)(page + (size_t)ii * s->size);
+            if ((item_iflag(it) & ITEM_SLABBED) != 0) {
+                do_slabs_push_free(s, it);
+            }
+        }
+        cb_mutex_exit(&s->lock);
+    } else {
+        s->slab_list[0] = s->slab_list[--s->slabs];
+        de_atomic_store(&s->killing_page, NULL);
+        cb_mutex_exit(&s->lock);
+        memset(page, 0, page_size);
+        slab_memory_set_page_class(engine, page, dst);
+        cb_mutex_enter(&d->lock);
+        d->slab_list[d->slabs++] = page;
+        for (ii = 0; ii < d->perslab; ++ii) {
+            hash_item *it = (hash_item*)(page + (size_t)ii * d->size);
+            de_atomic_store(&it->iflag, ITEM_SLABBED);
+            do_slabs_push_free(d, it);
+        }
+        cb_mutex_exit(&d->lock);
+    }
+    cb_mutex_exit(&engine->items.lock);
+
+    cb_mutex_enter(&engine->slabs.lock);
+    engine->slabs.rebalance.evictions += evicted;
+    engine->slabs.rebalance.busy_retries += tries;
+    if (busy != 0) {
+        engine->slabs.rebalance.aborted++;
+    } else {
+        engine->slabs.rebalance.pages_moved++;
+        engine->slabs.rebalance.bytes_moved += page_size;
+    }
+    cb_mutex_exit(&engine->slabs.lock);
+
+    if (engine->config.verbose > 1) {
+        EXTENSION_LOGGER_DESCRIPTOR *logger;
+        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+        logger->log(EXTENSION_LOG_INFO, NULL,
+                    "%s slab page from class %d to %u (%u items evicted)\n",
+                    busy == 0 ? "Moved" : "Failed to move", src, dst,
+                    evicted);
+    }
+}
+
+/*
+ * Called by the rebalancer (without the slabs lock) to decide if a page
+ * should be moved. Returns true and sets src and dst if so.
+ */
+static bool slabs_automove_decision(struct default_engine *engine,
+                                    int *src, unsigned int *dst) {
+    uint64_t evicted[MAX_NUMBER_OF_SLAB_CLASSES];
+    unsigned int pages[MAX_NUMBER_OF_SLAB_CLASSES];
+    rel_time_t now = engine->server.core->get_current_time();
+    uint64_t highest = 0;
+    unsigned int highest_id = 0;
+    unsigned int source = 0;
+    unsigned int ii;
+
+    cb_mutex_enter(&engine->slabs.lock);
+    if (now - engine->slabs.rebalance.last_window < SLAB_AUTOMOVE_WINDOW) {
+        cb_mutex_exit(&engine->slabs.lock);
+        return false;
+    }
+    engine->slabs.rebalance.last_window = now;
+    cb_mutex_exit(&engine->slabs.lock);
+
+    item_get_evictions(engine, evicted);
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        slabclass_t *p = &engine->slabs.slabclass[ii];
+        cb_mutex_enter(&p->lock);
+        pages[ii] = p->slabs;
+        cb_mutex_exit(&p->lock);
+    }
+
+    cb_mutex_enter(&engine->slabs.lock);
+    for (ii = POWER_SMALLEST; ii <= engine->slabs.power_largest; ++ii) {
+        uint64_t *prev = &engine->slabs.rebalance.evicted[ii];
+        /* the counters go backwards if the stats are reset */
+        uint64_t diff = evicted[ii] >= *prev ? evicted[ii] - *prev : evicted[ii];
+        *prev = evicted[ii];
+
+        if (diff == 0 && pages[ii] > 2) {
+            if (++engine->slabs.rebalance.zero_windows[ii] >= SLAB_AUTOMOVE_WINS &&
+                source == 0) {
+                source = ii;
+            }
+        } else {
+            engine->slabs.rebalance.zero_windows[ii] = 0;
+        }
+
+        if (diff > highest) {
+            highest = diff;
+            highest_id = ii;
+        }
+    }
+
+    if (highest_id != 0 && highest_id == engine->slabs.rebalance.winner) {
+        engine->slabs.rebalance.wins++;
+    } else {
+        engine->slabs.rebalance.winner = highest_id;
+        engine->slabs.rebalance.wins = highest_id != 0 ? 1 : 0;
+    }
+
+    if (source != 0 &&
+        engine->slabs.rebalance.wins >= SLAB_AUTOMOVE_WINS) {
+        engine->slabs.rebalance.wins = 0;
+        engine->slabs.rebalance.zero_windows[source] = 0;
+        *src = source;
+        *dst = engine->slabs.rebalance.winner;
+        cb_mutex_exit(&engine->slabs.lock);
+        return true;
+    }
+    cb_mutex_exit(&engine->slabs.lock);
+    return false;
+}
+
+static void slabs_rebalancer_main(void *arg) {
+    struct default_engine *engine = arg;
+
+    cb_mutex_enter(&engine->slabs.lock);
+    while (!engine->slabs.rebalance.shutdown) {
+        int src;
+        unsigned int dst;
+
+        if (engine->slabs.rebalance.dst == 0) {
+            cb_cond_timedwait(&engine->slabs.rebalance.cond,
+                              &engine->slabs.lock, 1000);
+            if (engine->slabs.rebalance.shutdown) {
+                break;
+            }
+        }
+
+        if (engine->slabs.rebalance.dst != 0) {
+            src = engine->slabs.rebalance.src;
+            dst = engine->slabs.rebalance.dst;
+            engine->slabs.rebalance.busy = true;
+            cb_mutex_exit(&engine->slabs.lock);
+            if (src == -1) {
+                src = slabs_pick_any(engine, dst);
+            }
+        } else {
+            bool move;
+            cb_mutex_exit(&engine->slabs.lock);
+            move = engine->config.slab_automove &&
+                   slabs_automove_decision(engine, &src, &dst);
+            cb_mutex_enter(&engine->slabs.lock);
+            if (!move) {
+                continue;
+            }
+            engine->slabs.rebalance.busy = true;
+            cb_mutex_exit(&engine->slabs.lock);
+        }
+
+        if (src != -1) {
+            slabs_reassign_page(engine, src, dst);
+        }
+        cb_mutex_enter(&engine->slabs.lock);
+        engine->slabs.rebalance.busy = false;
+        engine->slabs.rebalance.dst = 0;
+    }
+    cb_mutex_exit(&engine->slabs.lock);
+}
+
+void slabs_attach(struct default_engine *engine) {
+    const size_t page_size = engine->config.slab_page_size;
+    const size_t npages = slab_memory_pages(engine);
+    const hrtime_t start = gethrtime();
+    struct item_attach attach;
+    size_t used = 0;
+    size_t ii;
+    unsigned int id;
+
+    if (!slab_memory_attach_state(engine, &attach)) {
+        return;
+    }
+    engine->items.generation = attach.generation;
+
+    /*
+     * Carve the pages out of the mapping just like the last time, and give
+     * them back to the classes they were handed out to.
+     */
+    for (ii = 0; ii < npages; ++ii) {
+        char *page;
+        if (slab_memory_page(engine, ii, &page) != 0) {
+            used = ii + 1;
+        }
+    }
+    for (ii = 0; ii < used; ++ii) {
+        char *page;
+        char *ptr = memory_allocate(engine, page_size + SLAB_PAGE_GUARD_BYTES);
+        id = slab_memory_page(engine, ii, &page);
+        cb_assert(ptr == page);
+        if (id == 0) {
+            continue;
+        }
+        if (id > engine->slabs.power_largest || !grow_slab_list(engine, id)) {
+            slab_memory_set_page_class(engine, page, 0);
+            continue;
+        }
+        engine->slabs.slabclass[id].slab_list[engine->slabs.slabclass[id].slabs++] = page;
+        engine->slabs.mem_malloced += page_size;
+    }
+
+    /*
+     * Link the items, and then drop the chunks which don't belong to any
+     * of them (a chunk may live in any class).
+     */
+    for (id = POWER_SMALLEST; id <= engine->slabs.power_largest; ++id) {
+        slabclass_t *p = &engine->slabs.slabclass[id];
+        for (ii = 0; ii < p->slabs; ++ii) {
+            item_attach_slab_page(engine, p->slab_list[ii], id, &attach);
+        }
+    }
+    for (id = POWER_SMALLEST; id <= engine->slabs.power_largest; ++id) {
+        slabclass_t *p = &engine->slabs.slabclass[id];
+        for (ii = 0; ii < p->slabs; ++ii) {
+            item_attach_slab_chunks(engine, p->slab_list[ii], id);
+        }
+    }
+
+    /* Everything else is free */
+    for (id = POWER_SMALLEST; id <= engine->slabs.power_largest; ++id) {
+        slabclass_t *p = &engine->slabs.slabclass[id];
+        cb_mutex_enter(&p->lock);
+        for (ii = 0; ii < p->slabs; ++ii) {
+            unsigned int jj;
+            for (jj = 0; jj < p->perslab; ++jj) {
+                hash_item *it = (hash_item*)((char*)p->slab_list[ii] +
+                                             (size_t)jj * p->size);
+                if ((item_iflag(it) & ITEM_SLABBED) != 0) {
+                    do_slabs_push_free(p, it);
+                }
+            }
+        }
+        cb_mutex_exit(&p->lock);
+    }
+
+    slab_memory_attach_done(engine, &attach);
+    engine->slabs.memory.attach.ms = (gethrtime() - start) / 1000000;
+    {
+        EXTENSION_LOGGER_DESCRIPTOR *logger;
+        logger = (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+        logger->log(EXTENSION_LOG_NOTICE, NULL,
+                    "Re-attached to the cache in %s: %"PRIu64" items "
+                    "(%"PRIu64" expired, %"PRIu64" dropped) in %"PRIu64" ms\n",
+                    engine->config.shm_file, attach.linked, attach.expired,
+                    attach.dropped, engine->slabs.memory.attach.ms);
+    }
 }
 
 void slabs_destroy(struct default_engine *e)
@@ -454,15 +1123,37 @@ void slabs_destroy(struct default_engine *e)
     size_t ii;
     unsigned int jj;
 
+    if (e->slabs.rebalance.running) {
+        cb_mutex_enter(&e->slabs.lock);
+        e->slabs.rebalance.shutdown = true;
+        cb_cond_signal(&e->slabs.rebalance.cond);
+        cb_mutex_exit(&e->slabs.lock);
+        cb_join_thread(e->slabs.rebalance.tid);
+        e->slabs.rebalance.running = false;
+    }
+
     for (ii = 0; ii < e->slabs.allocs.next; ++ii) {
         free(e->slabs.allocs.ptrs[ii]);
     }
     free(e->slabs.allocs.ptrs);
+    slab_memory_destroy(e);
+
+    /* Release the thread caches */
+    if (e->slabs.caches != NULL) {
+        for (jj = 0; jj < SLABS_CACHE_SLOTS; jj++) {
+            if (e->slabs.caches[jj].classes != NULL) {
+                free(e->slabs.caches[jj].classes);
+                cb_mutex_destroy(&e->slabs.caches[jj].lock);
+            }
+        }
+        free(e->slabs.caches);
+    }
 
     /* Release the freelists */
     for (jj = POWER_SMALLEST; jj <= e->slabs.power_largest; jj++) {
         slabclass_t *p = &e->slabs.slabclass[jj];
         free(p->slots);
         free(p->slab_list);
+        cb_mutex_destroy(&p->lock);
     }
 }
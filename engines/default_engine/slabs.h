@@ -4,6 +4,109 @@
 
 #include "default_engine_internal.h"
 
+/*
+ * Optimistic readers of the hash table may look at the key of a chunk
+ * which is concurrently freed and reused (possibly as a smaller item).
+ * Every slab page is followed by this many bytes so that such a read
+ * can never go past the end of the allocation.
+ */
+#define SLAB_PAGE_GUARD_BYTES (sizeof(hash_item) + sizeof(uint64_t) + sizeof(hash_key))
+
+/*
+ * Slab pages may be moved from one slab class to another (see
+ * slabs_reassign). Items which are still referenced when their page is
+ * moved are retried every SLAB_REASSIGN_RETRY_SLEEP us, and the move is
+ * abandoned after SLAB_REASSIGN_MAX_RETRIES attempts.
+ */
+#define SLAB_REASSIGN_RETRY_SLEEP 1000
+#define SLAB_REASSIGN_MAX_RETRIES 1000
+
+/*
+ * The automove policy looks at the evictions in each slab class every
+ * SLAB_AUTOMOVE_WINDOW seconds. A page is moved to the class with the
+ * most evictions once it has been the worst off for SLAB_AUTOMOVE_WINS
+ * windows in a row, from a class without any evictions for as long.
+ */
+#define SLAB_AUTOMOVE_WINDOW 10
+#define SLAB_AUTOMOVE_WINS 3
+
+enum reassign_result_type {
+    REASSIGN_OK = 0,
+    REASSIGN_RUNNING,
+    REASSIGN_BADCLASS,
+    REASSIGN_NOSPARE,
+    REASSIGN_SRC_DST_SAME
+};
+
+/*
+ * Every thread has a small cache of free chunks for each slab class (the
+ * thread picks one of SLABS_CACHE_SLOTS caches by its thread id), so that
+ * most allocations and frees don't need the lock of the slab class. The
+ * cache is refilled with (and flushed down to) half of its capacity at
+ * the time. It holds at most SLABS_CACHE_SIZE chunks, and at most a
+ * quarter of a slab page (classes with larger chunks aren't cached).
+ */
+#define SLABS_CACHE_SLOTS 16
+#define SLABS_CACHE_SIZE 16
+
+struct slabs_cache_class {
+    unsigned int count;
+    /* bytes requested from the slab class through this cache */
+    int64_t requested;
+    void *chunks[SLABS_CACHE_SIZE];
+};
+
+struct slabs_cache {
+    cb_mutex_t lock;
+    /* indexed by the slab class id */
+    struct slabs_cache_class *classes;
+};
+
+/*
+ * The slab pages may be carved out of a single mapping of the whole cache
+ * instead of being allocated with malloc, so that the memory can be backed
+ * by huge pages and placed on given NUMA nodes, or by a file (shm_file)
+ * which the cache is re-attached from after a restart (see slab_memory.c).
+ */
+enum slab_huge_pages {
+    SLAB_HUGE_PAGES_OFF = 0,
+    SLAB_HUGE_PAGES_TRANSPARENT,
+    SLAB_HUGE_PAGES_EXPLICIT
+};
+
+enum slab_numa_policy {
+    SLAB_NUMA_DEFAULT = 0,
+    SLAB_NUMA_INTERLEAVE,
+    SLAB_NUMA_BIND
+};
+
+struct slab_memory {
+    /* as configured */
+    enum slab_huge_pages huge_pages;
+    /* the kind of pages we actually got */
+    enum slab_huge_pages backing;
+    /* the NUMA policy in effect (and node for SLAB_NUMA_BIND) */
+    enum slab_numa_policy numa;
+    int numa_node;
+    /* the mapping, or NULL if the pages are allocated with malloc */
+    void *base;
+    size_t size;
+
+    /* the header in front of base if the cache is mapped from shm_file */
+    struct slab_shm_header *shm;
+    size_t shm_header_size;
+    int shm_fd;
+
+    /* what we found when the cache was re-attached */
+    struct {
+        bool attached;
+        uint64_t items;
+        uint64_t expired;
+        uint64_t dropped;
+        uint64_t ms;
+    } attach;
+};
+
 /* powers-of-N allocation structures */
 
 typedef struct {
@@ -22,8 +125,13 @@ typedef struct {
     void **slab_list;       /* array of slab pointers */
     unsigned int list_size; /* size of prev array */
 
-    unsigned int killing;  /* index+1 of dying slab, or zero if none */
+    void *killing_page;     /* page being moved to another class, or NULL */
     size_t requested; /* The number of requested bytes */
+
+    unsigned int cache_limit; /* max chunks in a thread cache, 0 if none */
+
+    /* protects everything above (but not the thread caches) */
+    cb_mutex_t lock;
 } slabclass_t;
 
 struct slabs {
@@ -42,10 +150,49 @@ struct slabs {
       size_t size;
    } allocs;
 
+   struct slabs_cache *caches;
+
+   struct slab_memory memory;
+
    /**
-    * Access to the slab allocator is protected by this lock
+    * Every slab class has its own lock. This lock protects the memory
+    * accounting (the allocation of new pages) and the rebalancer state.
+    * The locks are acquired in the order: items.lock, a thread cache, a
+    * slab class and finally this one.
     */
    cb_mutex_t lock;
+
+   /*
+    * The rebalancer thread moves slab pages between the slab classes.
+    * It sleeps on cond (with the slabs lock) while it has nothing to do.
+    * Everything in here is protected by the slabs lock.
+    */
+   struct {
+      cb_cond_t cond;
+      cb_thread_t tid;
+      bool running;
+      bool shutdown;
+
+      /* A requested move (src is -1 for any class), or dst is zero */
+      int src;
+      unsigned int dst;
+      /* Set while a page is being moved */
+      bool busy;
+
+      /* automove state */
+      rel_time_t last_window;
+      uint64_t evicted[MAX_NUMBER_OF_SLAB_CLASSES];
+      unsigned int zero_windows[MAX_NUMBER_OF_SLAB_CLASSES];
+      unsigned int winner;
+      unsigned int wins;
+
+      /* statistics */
+      uint64_t pages_moved;
+      uint64_t bytes_moved;
+      uint64_t evictions;
+      uint64_t busy_retries;
+      uint64_t aborted;
+   } rebalance;
 };
 
 
@@ -64,6 +211,77 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
 
 void slabs_destroy(struct default_engine *engine);
 
+/**
+ * Map the memory for the whole cache (limit bytes) if the configuration
+ * asks for huge pages or a NUMA policy. If populate is set the memory is
+ * faulted in up front. Returns ENGINE_SUCCESS without mapping anything
+ * if the pages should be allocated with malloc.
+ */
+ENGINE_ERROR_CODE slab_memory_init(struct default_engine *engine,
+                                   size_t limit, bool populate);
+
+void slab_memory_destroy(struct default_engine *engine);
+
+/**
+ * Get what we need to know about the items of the cache we re-attached to
+ * (see item_attach_slab_page). Returns false if the cache wasn't mapped
+ * from a shm_file holding a cache we may re-attach to.
+ */
+bool slab_memory_attach_state(struct default_engine *engine,
+                              struct item_attach *attach);
+
+/** Record that the items of the re-attached cache are linked again */
+void slab_memory_attach_done(struct default_engine *engine,
+                             const struct item_attach *attach);
+
+/** The number of pages the mapping of the cache from shm_file holds */
+size_t slab_memory_pages(struct default_engine *engine);
+
+/**
+ * Get the n'th page of the mapping. Returns the slab class it was given
+ * to, or 0 if it wasn't handed out.
+ */
+unsigned int slab_memory_page(struct default_engine *engine, size_t n,
+                              char **page);
+
+/** Record which slab class the page now belongs to (for re-attaching) */
+void slab_memory_set_page_class(struct default_engine *engine, void *page,
+                                unsigned int id);
+
+/**
+ * Get the slab class of the chunk at ptr in the mapping of the cache,
+ * or 0 if ptr doesn't point at a chunk of a page handed out to a class.
+ */
+unsigned int slab_memory_chunk_class(struct default_engine *engine,
+                                     const void *ptr);
+
+/** Record the generation of the items which are still alive (flush_all) */
+void slab_memory_set_generation(struct default_engine *engine,
+                                uint32_t generation);
+
+/**
+ * Give the pages of a cache re-attached from shm_file back to their slab
+ * classes and link the items found in them again. Must be called before
+ * anyone else gets to use the items (see item_init).
+ */
+void slabs_attach(struct default_engine *engine);
+
+/** The kind of pages backing the cache ("off", "transparent" or "explicit") */
+const char *slab_memory_backing(struct default_engine *engine);
+
+/** Format the NUMA policy in effect the way it is configured */
+void slab_memory_numa_policy(struct default_engine *engine,
+                             char *buffer, size_t size);
+
+/**
+ * Request that a slab page is moved from the slab class src (or any class
+ * which can spare a page if src is -1) to the slab class dst. The items
+ * in the page are evicted, and the move is performed asynchronously by
+ * the rebalancer thread.
+ */
+enum reassign_result_type slabs_reassign(struct default_engine *engine,
+                                         int src, unsigned int dst);
+
 /**
  * Given object size, return id to use when allocating/freeing memory for object
  * 0 means error: can't store such a large object
@@ -74,6 +292,20 @@ unsigned int slabs_clsid(struct default_engine *engine, const size_t size);
 /** Allocate object of given length. 0 on error */ /*@null@*/
 void *slabs_alloc(struct default_engine *engine, size_t size, unsigned int id);
 
+/**
+ * Pick chunks of a slab class at random (for do_item_evict_sampled). The
+ * caller must hold items.lock, which keeps the pages from being moved to
+ * another slab class (the chunks may be in any state).
+ * @param engine handle to the storage engine
+ * @param id the slab class
+ * @param chunks where to store the chunks
+ * @param n the number of chunks to pick
+ * @param seed the state of the random number generator
+ * @return the number of chunks picked (0 if the class has no pages)
+ */
+int slabs_sample(struct default_engine *engine, unsigned int id,
+                 void **chunks, int n, uint32_t *seed);
+
 /** Free previously allocated object */
 void slabs_free(struct default_engine *engine, void *ptr, size_t size, unsigned int id);
 
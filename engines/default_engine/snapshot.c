@@ -0,0 +1,741 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Snapshots of the items of a bucket (see snapshot.h)
+ *
+ * The file is written in the byte order of the host:
+ *
+ *   struct snapshot_header
+ *   blocks of:
+ *     struct snapshot_block
+ *     struct snapshot_record, key, value (nitems times)
+ *   the offset of each block (uint64_t)
+ *   struct snapshot_footer
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <platform/crc32c.h>
+#include "default_engine_internal.h"
+
+#ifdef WIN32
+#define snapshot_seek _fseeki64
+#define snapshot_tell _ftelli64
+#else
+#define snapshot_seek fseeko
+#define snapshot_tell ftello
+#endif
+
+/* "MCSN", which also tells us if the byte order is different */
+#define SNAPSHOT_MAGIC 0x4d43534e
+#define SNAPSHOT_BLOCK_MAGIC 0x424c4f4b
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    /* When the snapshot was started (wall clock) */
+    uint64_t created;
+};
+
+struct snapshot_block {
+    uint32_t magic;
+    uint32_t nitems;
+    /* The number of bytes following the block header */
+    uint32_t length;
+    uint32_t crc;
+};
+
+struct snapshot_record {
+    /* Absolute expiry time, 0 for none */
+    uint64_t exptime;
+    uint32_t flags;
+    uint32_t nbytes;
+    uint16_t nkey;
+    uint8_t datatype;
+    uint8_t padding[5];
+};
+
+struct snapshot_footer {
+    uint64_t nitems;
+    uint64_t nblocks;
+    uint64_t index_offset;
+    uint32_t index_crc;
+    uint32_t magic;
+};
+
+static EXTENSION_LOGGER_DESCRIPTOR *get_logger(struct default_engine *engine) {
+    return (void*)engine->server.extension->get_extension(EXTENSION_LOGGER);
+}
+
+static time_t snapshot_now(struct default_engine *engine) {
+    return engine->server.core->abstime(engine->server.core->get_current_time());
+}
+
+/*
+ * Writing the snapshot
+ */
+struct snapshot_writer {
+    struct default_engine *engine;
+    FILE *fp;
+    uint64_t offset;
+    /* The block being filled */
+    char *block;
+    size_t used;
+    size_t size;
+    uint32_t nitems;
+    /* The offsets of the blocks written so far */
+    uint64_t *index;
+    uint64_t nblocks;
+    uint64_t index_size;
+    uint64_t items;
+};
+
+static bool snapshot_write_raw(struct snapshot_writer *w, const void *data,
+                               size_t len) {
+    if (fwrite(data, 1, len, w->fp) != len) {
+        return false;
+    }
+    w->offset += len;
+    return true;
+}
+
+static bool snapshot_flush_block(struct snapshot_writer *w) {
+    struct snapshot_block block;
+
+    if (w->nitems == 0) {
+        return true;
+    }
+
+    if (w->nblocks == w->index_size) {
+        uint64_t size = w->index_size ? w->index_size * 2 : 1024;
+        uint64_t *index = realloc(w->index, size * sizeof(*index));
+        if (index == NULL) {
+            return false;
+        }
+        w->index = index;
+        w->index_size = size;
+    }
+    w->index[w->nblocks++] = w->offset;
+
+    block.magic = SNAPSHOT_BLOCK_MAGIC;
+    block.nitems = w->nitems;
+    block.length = (uint32_t)w->used;
+    block.crc = crc32c((const uint8_t*)w->block, w->used, 0);
+    if (!snapshot_write_raw(w, &block, sizeof(block)) ||
+        !snapshot_write_raw(w, w->block, w->used)) {
+        return false;
+    }
+    w->used = 0;
+    w->nitems = 0;
+    return true;
+}
+
+static bool snapshot_add_item(struct snapshot_writer *w, const hash_item *it) {
+    struct default_engine *engine = w->engine;
+    struct snapshot_record record;
+    size_t needed = sizeof(record) + it->nkey + it->nbytes;
+    char *ptr;
+
+    if (w->used + needed > w->size) {
+        size_t size = w->used + needed;
+        char *block;
+        if (size < SNAPSHOT_BLOCK_SIZE) {
+            size = SNAPSHOT_BLOCK_SIZE;
+        }
+        block = realloc(w->block, size);
+        if (block == NULL) {
+            return false;
+        }
+        w->block = block;
+        w->size = size;
+    }
+
+    memset(&record, 0, sizeof(record));
+    if (it->exptime != 0) {
+        record.exptime = engine->server.core->abstime(it->exptime);
+    }
+    record.flags = it->flags;
+    record.nbytes = it->nbytes;
+    record.nkey = it->nkey;
+    record.datatype = it->datatype;
+
+    ptr = w->block + w->used;
+    memcpy(ptr, &record, sizeof(record));
+    memcpy(ptr + sizeof(record), item_get_key(it), it->nkey);
+    item_copy_value_out(engine, it, ptr + sizeof(record) + it->nkey);
+    w->used += needed;
+    w->nitems++;
+    w->items++;
+
+    if (w->used >= SNAPSHOT_BLOCK_SIZE) {
+        return snapshot_flush_block(w);
+    }
+    return true;
+}
+
+static bool snapshot_write_items(struct snapshot_writer *w) {
+    struct default_engine *engine = w->engine;
+    struct snapshot_header header;
+    struct snapshot_footer footer;
+    struct item_walker walker;
+    hash_item *items[SNAPSHOT_BATCH];
+    bool ok = true;
+    int n;
+
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.created = (uint64_t)time(NULL);
+    if (!snapshot_write_raw(w, &header, sizeof(header))) {
+        return false;
+    }
+
+    item_walker_init(&walker);
+    while (ok && !engine->snapshot.abort &&
+           (n = item_walker_next(engine, &walker, items, SNAPSHOT_BATCH)) > 0) {
+        int ii;
+        for (ii = 0; ii < n; ++ii) {
+            if (ok) {
+                ok = snapshot_add_item(w, items[ii]);
+            }
+            item_release(engine, items[ii]);
+        }
+
+        cb_mutex_enter(&engine->snapshot.lock);
+        engine->snapshot.items = w->items;
+        engine->snapshot.bytes = w->offset + w->used;
+        cb_mutex_exit(&engine->snapshot.lock);
+    }
+    if (walker.list >= 0) {
+        item_walker_stop(engine, &walker);
+        ok = false;
+    }
+
+    if (!ok || !snapshot_flush_block(w)) {
+        return false;
+    }
+
+    footer.nitems = w->items;
+    footer.nblocks = w->nblocks;
+    footer.index_offset = w->offset;
+    footer.index_crc = crc32c((const uint8_t*)w->index,
+                              w->nblocks * sizeof(*w->index), 0);
+    footer.magic = SNAPSHOT_MAGIC;
+    return snapshot_write_raw(w, w->index, w->nblocks * sizeof(*w->index)) &&
+           snapshot_write_raw(w, &footer, sizeof(footer));
+}
+
+/*
+ * Write the snapshot to a temporary file and move it in place once it's
+ * complete. engine->snapshot.running must be set by the caller, and is
+ * cleared when we're done.
+ */
+static bool snapshot_do_write(struct default_engine *engine) {
+    const char *file = engine->config.snapshot_file;
+    struct snapshot_writer w;
+    char *tmp;
+    bool ok = false;
+
+    memset(&w, 0, sizeof(w));
+    w.engine = engine;
+
+    tmp = malloc(strlen(file) + sizeof(".tmp"));
+    if (tmp != NULL) {
+        sprintf(tmp, "%s.tmp", file);
+        w.fp = fopen(tmp, "wb");
+        if (w.fp == NULL) {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Failed to create snapshot \"%s\": %s",
+                                    tmp, strerror(errno));
+        } else {
+            ok = snapshot_write_items(&w);
+            if (fclose(w.fp) != 0) {
+                ok = false;
+            }
+#ifdef WIN32
+            /* rename doesn't replace an existing file */
+            if (ok) {
+                remove(file);
+            }
+#endif
+            if (ok && rename(tmp, file) != 0) {
+                ok = false;
+            }
+            if (!ok) {
+                if (!engine->snapshot.abort) {
+                    get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                            "Failed to write snapshot \"%s\"",
+                                            file);
+                }
+                remove(tmp);
+            }
+        }
+        free(tmp);
+    }
+
+    if (ok) {
+        get_logger(engine)->log(EXTENSION_LOG_NOTICE, NULL,
+                                "Wrote %"PRIu64" items to snapshot \"%s\"",
+                                w.items, file);
+    }
+
+    cb_mutex_enter(&engine->snapshot.lock);
+    engine->snapshot.items = w.items;
+    engine->snapshot.bytes = w.offset;
+    engine->snapshot.failed = !ok;
+    engine->snapshot.stopped = time(NULL);
+    engine->snapshot.running = false;
+    cb_mutex_exit(&engine->snapshot.lock);
+
+    free(w.block);
+    free(w.index);
+    return ok;
+}
+
+static void snapshot_main(void *arg) {
+    snapshot_do_write(arg);
+}
+
+/* Called with snapshot.lock held */
+static void snapshot_begin(struct default_engine *engine) {
+    engine->snapshot.running = true;
+    engine->snapshot.abort = false;
+    engine->snapshot.failed = false;
+    engine->snapshot.started = time(NULL);
+    engine->snapshot.stopped = 0;
+    engine->snapshot.items = 0;
+    engine->snapshot.bytes = 0;
+}
+
+/* Called with snapshot.lock held, which is dropped while we wait */
+static void snapshot_join(struct default_engine *engine) {
+    if (engine->snapshot.joinable) {
+        cb_thread_t tid = engine->snapshot.tid;
+        engine->snapshot.joinable = false;
+        cb_mutex_exit(&engine->snapshot.lock);
+        cb_join_thread(tid);
+        cb_mutex_enter(&engine->snapshot.lock);
+    }
+}
+
+bool snapshot_start(struct default_engine *engine) {
+    bool ret = false;
+
+    if (engine->config.snapshot_file == NULL) {
+        return false;
+    }
+
+    cb_mutex_enter(&engine->snapshot.lock);
+    if (!engine->snapshot.running) {
+        snapshot_join(engine);
+    }
+    if (!engine->snapshot.running) {
+        snapshot_begin(engine);
+        if (cb_create_named_thread(&engine->snapshot.tid, snapshot_main,
+                                   engine, 0, "mc:snapshot") == 0) {
+            engine->snapshot.joinable = true;
+            ret = true;
+        } else {
+            engine->snapshot.running = false;
+        }
+    }
+    cb_mutex_exit(&engine->snapshot.lock);
+
+    return ret;
+}
+
+bool snapshot_write(struct default_engine *engine) {
+    if (engine->config.snapshot_file == NULL) {
+        return false;
+    }
+
+    cb_mutex_enter(&engine->snapshot.lock);
+    snapshot_join(engine);
+    if (engine->snapshot.running) {
+        /* Someone else is writing one in the foreground */
+        cb_mutex_exit(&engine->snapshot.lock);
+        return false;
+    }
+    snapshot_begin(engine);
+    cb_mutex_exit(&engine->snapshot.lock);
+
+    return snapshot_do_write(engine);
+}
+
+void snapshot_destroy(struct default_engine *engine) {
+    cb_mutex_enter(&engine->snapshot.lock);
+    engine->snapshot.abort = true;
+    snapshot_join(engine);
+    cb_mutex_exit(&engine->snapshot.lock);
+
+    free(engine->snapshot.index);
+    engine->snapshot.index = NULL;
+    engine->snapshot.nblocks = 0;
+}
+
+/*
+ * Loading the snapshot
+ */
+void snapshot_init(struct default_engine *engine) {
+    const char *file = engine->config.snapshot_file;
+    struct snapshot_header header;
+    struct snapshot_footer footer;
+    uint64_t *index = NULL;
+    int64_t size;
+    FILE *fp;
+
+    if (file == NULL) {
+        return;
+    }
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        if (errno != ENOENT) {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Failed to open snapshot \"%s\": %s",
+                                    file, strerror(errno));
+        }
+        return;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != SNAPSHOT_MAGIC ||
+        header.version != SNAPSHOT_VERSION ||
+        snapshot_seek(fp, -(int64_t)sizeof(footer), SEEK_END) != 0 ||
+        (size = snapshot_tell(fp)) < 0 ||
+        fread(&footer, sizeof(footer), 1, fp) != 1 ||
+        footer.magic != SNAPSHOT_MAGIC ||
+        footer.index_offset + footer.nblocks * sizeof(*index) != (uint64_t)size) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Ignoring invalid snapshot \"%s\"", file);
+        fclose(fp);
+        return;
+    }
+
+    if (engine->config.snapshot_max_age != 0 &&
+        header.created + engine->config.snapshot_max_age < (uint64_t)time(NULL)) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Ignoring snapshot \"%s\" older than %"PRIu64
+                                " seconds", file,
+                                (uint64_t)engine->config.snapshot_max_age);
+        fclose(fp);
+        return;
+    }
+
+    if (footer.nblocks > 0) {
+        index = malloc(footer.nblocks * sizeof(*index));
+        if (index == NULL ||
+            snapshot_seek(fp, (int64_t)footer.index_offset, SEEK_SET) != 0 ||
+            fread(index, sizeof(*index), footer.nblocks, fp) != footer.nblocks ||
+            crc32c((const uint8_t*)index, footer.nblocks * sizeof(*index),
+                   0) != footer.index_crc) {
+            get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                    "Failed to read the index of snapshot"
+                                    " \"%s\"", file);
+            free(index);
+            fclose(fp);
+            return;
+        }
+    }
+    fclose(fp);
+
+    engine->snapshot.index = index;
+    engine->snapshot.nblocks = footer.nblocks;
+    if (footer.nitems > engine->config.expected_items) {
+        engine->config.expected_items = (size_t)footer.nitems;
+    }
+}
+
+struct snapshot_loader {
+    struct default_engine *engine;
+    cb_mutex_t lock;
+    uint64_t next;
+    uint64_t loaded;
+    uint64_t skipped;
+    bool failed;
+};
+
+/*
+ * Create the item of the record (to be stored by snapshot_store_items),
+ * or return NULL if it's skipped
+ */
+static hash_item *snapshot_load_item(struct default_engine *engine,
+                                     const struct snapshot_record *record,
+                                     const char *key, const char *value,
+                                     time_t now) {
+    size_t ntotal = sizeof(hash_item) + record->nkey + record->nbytes;
+    rel_time_t exptime = 0;
+    hash_item *it;
+
+    if (engine->config.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+    if (ntotal > engine->config.item_size_max) {
+        return NULL;
+    }
+
+    if (record->exptime != 0) {
+        if (record->exptime <= (uint64_t)now) {
+            return NULL;
+        }
+        exptime = engine->server.core->realtime((time_t)record->exptime);
+    }
+
+    it = item_alloc(engine, key, record->nkey, record->flags, exptime,
+                    record->nbytes, NULL, record->datatype);
+    if (it != NULL) {
+        item_copy_value_in(engine, it, value);
+    }
+    return it;
+}
+
+/*
+ * Store the items created so far. They're stored a batch at the time, so
+ * that the loader threads only take items.lock once per batch.
+ */
+static void snapshot_store_items(struct default_engine *engine,
+                                 hash_item **items, int *nitems,
+                                 uint64_t *loaded, uint64_t *skipped) {
+    bool stored[STORE_ITEMS_MAX];
+    int ii;
+
+    store_items(engine, items, *nitems, stored);
+    for (ii = 0; ii < *nitems; ++ii) {
+        if (stored[ii]) {
+            ++*loaded;
+        } else {
+            ++*skipped;
+        }
+        item_release(engine, items[ii]);
+    }
+    *nitems = 0;
+}
+
+static bool snapshot_load_block(struct snapshot_loader *loader, FILE *fp,
+                                uint64_t offset, char **buffer, size_t *size,
+                                uint64_t *loaded, uint64_t *skipped) {
+    struct default_engine *engine = loader->engine;
+    const time_t now = snapshot_now(engine);
+    struct snapshot_block block;
+    hash_item *items[STORE_ITEMS_MAX];
+    int nitems = 0;
+    uint32_t ii;
+    char *ptr;
+    char *end;
+
+    if (snapshot_seek(fp, (int64_t)offset, SEEK_SET) != 0 ||
+        fread(&block, sizeof(block), 1, fp) != 1 ||
+        block.magic != SNAPSHOT_BLOCK_MAGIC) {
+        return false;
+    }
+
+    if (block.length > *size) {
+        char *buf = realloc(*buffer, block.length);
+        if (buf == NULL) {
+            return false;
+        }
+        *buffer = buf;
+        *size = block.length;
+    }
+
+    if (fread(*buffer, 1, block.length, fp) != block.length ||
+        crc32c((const uint8_t*)*buffer, block.length, 0) != block.crc) {
+        return false;
+    }
+
+    ptr = *buffer;
+    end = *buffer + block.length;
+    for (ii = 0; ii < block.nitems; ++ii) {
+        struct snapshot_record record;
+        hash_item *it;
+        if ((size_t)(end - ptr) < sizeof(record)) {
+            break;
+        }
+        memcpy(&record, ptr, sizeof(record));
+        ptr += sizeof(record);
+        if (record.nkey == 0 ||
+            (size_t)(end - ptr) < (size_t)record.nkey + record.nbytes) {
+            break;
+        }
+        it = snapshot_load_item(engine, &record, ptr, ptr + record.nkey, now);
+        if (it == NULL) {
+            ++*skipped;
+        } else {
+            items[nitems++] = it;
+            if (nitems == STORE_ITEMS_MAX) {
+                snapshot_store_items(engine, items, &nitems, loaded, skipped);
+            }
+        }
+        ptr += record.nkey + record.nbytes;
+
+        if (loader->failed) {
+            /* Someone else gave up */
+            break;
+        }
+    }
+    snapshot_store_items(engine, items, &nitems, loaded, skipped);
+    return ii == block.nitems || loader->failed;
+}
+
+static void snapshot_load_main(void *arg) {
+    struct snapshot_loader *loader = arg;
+    struct default_engine *engine = loader->engine;
+    uint64_t loaded = 0;
+    uint64_t skipped = 0;
+    char *buffer = NULL;
+    size_t size = 0;
+    bool ok = true;
+    FILE *fp;
+
+    fp = fopen(engine->config.snapshot_file, "rb");
+    if (fp == NULL) {
+        ok = false;
+    }
+
+    while (ok) {
+        uint64_t block;
+
+        cb_mutex_enter(&loader->lock);
+        block = loader->next;
+        if (loader->failed || block == engine->snapshot.nblocks) {
+            cb_mutex_exit(&loader->lock);
+            break;
+        }
+        loader->next++;
+        cb_mutex_exit(&loader->lock);
+
+        ok = snapshot_load_block(loader, fp, engine->snapshot.index[block],
+                                 &buffer, &size, &loaded, &skipped);
+    }
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    free(buffer);
+
+    cb_mutex_enter(&loader->lock);
+    loader->loaded += loaded;
+    loader->skipped += skipped;
+    if (!ok) {
+        loader->failed = true;
+    }
+    cb_mutex_exit(&loader->lock);
+}
+
+void snapshot_load(struct default_engine *engine) {
+    const char *file = engine->config.snapshot_file;
+    struct snapshot_loader loader;
+    cb_thread_t *tids;
+    hrtime_t start = gethrtime();
+    uint64_t nthreads = engine->config.snapshot_threads;
+    uint64_t started = 0;
+    uint64_t ii;
+
+    if (engine->snapshot.index == NULL) {
+        return;
+    }
+
+    /* The cache we re-attached to is newer (see slab_memory.c) */
+    if (engine->slabs.memory.attach.attached) {
+        get_logger(engine)->log(EXTENSION_LOG_NOTICE, NULL,
+                                "Not loading snapshot \"%s\", the cache was "
+                                "re-attached from shm_file", file);
+        free(engine->snapshot.index);
+        engine->snapshot.index = NULL;
+        engine->snapshot.nblocks = 0;
+        return;
+    }
+
+    memset(&loader, 0, sizeof(loader));
+    loader.engine = engine;
+    cb_mutex_initialize(&loader.lock);
+
+    if (nthreads > engine->snapshot.nblocks) {
+        nthreads = engine->snapshot.nblocks;
+    }
+    /* This thread does its share of the work as well */
+    tids = nthreads > 1 ? calloc(nthreads - 1, sizeof(*tids)) : NULL;
+    if (tids != NULL) {
+        for (; started < nthreads - 1; ++started) {
+            if (cb_create_named_thread(&tids[started], snapshot_load_main,
+                                       &loader, 0, "mc:snap_load") != 0) {
+                break;
+            }
+        }
+    }
+    snapshot_load_main(&loader);
+    for (ii = 0; ii < started; ++ii) {
+        cb_join_thread(tids[ii]);
+    }
+    free(tids);
+    cb_mutex_destroy(&loader.lock);
+
+    engine->snapshot.loaded_items = loader.loaded;
+    engine->snapshot.load_skipped = loader.skipped;
+    engine->snapshot.load_ms = (gethrtime() - start) / 1000000;
+
+    if (loader.failed) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Failed to load all of snapshot \"%s\"",
+                                file);
+    }
+    get_logger(engine)->log(EXTENSION_LOG_NOTICE, NULL,
+                            "Loaded %"PRIu64" items from snapshot \"%s\" in"
+                            " %"PRIu64" ms (%"PRIu64" skipped)",
+                            loader.loaded, file, engine->snapshot.load_ms,
+                            loader.skipped);
+
+    /* A snapshot is only good for one restart */
+    if (remove(file) != 0) {
+        get_logger(engine)->log(EXTENSION_LOG_WARNING, NULL,
+                                "Failed to remove snapshot \"%s\": %s",
+                                file, strerror(errno));
+    }
+
+    free(engine->snapshot.index);
+    engine->snapshot.index = NULL;
+    engine->snapshot.nblocks = 0;
+}
+
+void snapshot_stats(struct default_engine *engine,
+                    ADD_STAT add_stat, const void *cookie) {
+    char val[128];
+    int len;
+
+    cb_mutex_enter(&engine->snapshot.lock);
+    if (engine->snapshot.running) {
+        add_stat("snapshot:status", 15, "running", 7, cookie);
+    } else {
+        add_stat("snapshot:status", 15, "stopped", 7, cookie);
+    }
+
+    if (engine->snapshot.started != 0) {
+        if (engine->snapshot.stopped != 0) {
+            time_t diff = engine->snapshot.stopped - engine->snapshot.started;
+            len = sprintf(val, "%"PRIu64, (uint64_t)diff);
+            add_stat("snapshot:last_run", 17, val, len, cookie);
+            if (engine->snapshot.failed) {
+                add_stat("snapshot:last_status", 20, "failed", 6, cookie);
+            } else {
+                add_stat("snapshot:last_status", 20, "ok", 2, cookie);
+            }
+        }
+        len = sprintf(val, "%"PRIu64, engine->snapshot.items);
+        add_stat("snapshot:items", 14, val, len, cookie);
+        len = sprintf(val, "%"PRIu64, engine->snapshot.bytes);
+        add_stat("snapshot:bytes", 14, val, len, cookie);
+    }
+
+    len = sprintf(val, "%"PRIu64, engine->snapshot.loaded_items);
+    add_stat("snapshot:loaded_items", 21, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, engine->snapshot.load_skipped);
+    add_stat("snapshot:load_skipped", 21, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, engine->snapshot.load_ms);
+    add_stat("snapshot:load_ms", 16, val, len, cookie);
+    cb_mutex_exit(&engine->snapshot.lock);
+}
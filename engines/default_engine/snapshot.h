@@ -0,0 +1,116 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "default_engine_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The items of a bucket may be written to a snapshot file (snapshot_file)
+ * and loaded back when the bucket is created again, so that a restart
+ * doesn't start out with a cold cache.
+ *
+ * The snapshot is written by a background thread walking the LRU lists
+ * (see item_walker_next), a batch of SNAPSHOT_BATCH items at the time.
+ * Every item is copied as it was when we got to it, and the items
+ * changed while the snapshot is written may or may not make it. It is
+ * written to "<snapshot_file>.tmp" and renamed when it's complete, so the
+ * snapshot file is always a complete snapshot.
+ *
+ * The file holds the items in blocks of (at least) SNAPSHOT_BLOCK_SIZE
+ * bytes, each with a crc32c of its content, followed by the offsets of
+ * all of the blocks and a footer. The blocks are loaded in parallel by
+ * snapshot_threads threads, which read, check and copy the items in
+ * parallel but store them under items.lock (once per STORE_ITEMS_MAX
+ * items, see store_items). The stores take about 0.5us an item, so the
+ * load levels off at about 2M items/s however many threads are used: a
+ * 64GB cache of 1k items loads in about half a minute, while one of
+ * smaller items takes longer. A snapshot is only loaded once (the file is
+ * removed once it's loaded), so that a crash later on doesn't bring back
+ * the items as they were back then. Snapshots older than
+ * snapshot_max_age seconds (if set) are ignored, and so is the snapshot
+ * if the cache was re-attached from shm_file (see slab_memory.c).
+ */
+#define SNAPSHOT_BATCH 64
+#define SNAPSHOT_BLOCK_SIZE (4 * 1024 * 1024)
+
+struct snapshot {
+    cb_mutex_t lock;
+    cb_thread_t tid;
+    /* A snapshot is being written (by tid if joinable) */
+    bool running;
+    bool joinable;
+    /* Tell the writer to give up */
+    volatile bool abort;
+
+    /* The last snapshot written (or being written) */
+    time_t started;
+    time_t stopped;
+    uint64_t items;
+    uint64_t bytes;
+    bool failed;
+
+    /* The snapshot loaded when the bucket was created */
+    uint64_t loaded_items;
+    uint64_t load_skipped;
+    uint64_t load_ms;
+
+    /* The block index of the snapshot to load (see snapshot_init) */
+    uint64_t *index;
+    uint64_t nblocks;
+};
+
+/**
+ * Look for a snapshot to load, and make sure the hash table is created
+ * large enough for it. Must be called before assoc_init.
+ * @param engine handle to the storage engine
+ */
+void snapshot_init(struct default_engine *engine);
+
+/**
+ * Load the snapshot found by snapshot_init (if any). A snapshot which
+ * can't be loaded only means that we start out with fewer items, so
+ * the errors are logged and otherwise ignored.
+ * @param engine handle to the storage engine
+ */
+void snapshot_load(struct default_engine *engine);
+
+/**
+ * Start writing a snapshot in the background
+ * @param engine handle to the storage engine
+ * @return false if a snapshot is already being written
+ */
+bool snapshot_start(struct default_engine *engine);
+
+/**
+ * Write a snapshot and wait for it to complete (waits for a snapshot
+ * being written in the background to complete first)
+ * @param engine handle to the storage engine
+ * @return true if the snapshot was written
+ */
+bool snapshot_write(struct default_engine *engine);
+
+/**
+ * Stop a snapshot being written and release the resources used
+ * @param engine handle to the storage engine
+ */
+void snapshot_destroy(struct default_engine *engine);
+
+/**
+ * Get the statistics of the snapshots
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void snapshot_stats(struct default_engine *engine,
+                    ADD_STAT add_stat, const void *cookie);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
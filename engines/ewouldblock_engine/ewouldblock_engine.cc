@@ -209,6 +209,12 @@ public:
             ewb->ENGINE_HANDLE_V1::get_stats_struct = ewb->real_engine->get_stats_struct;
             ewb->ENGINE_HANDLE_V1::item_set_cas = ewb->real_engine->item_set_cas;
             ewb->ENGINE_HANDLE_V1::set_item_info = ewb->real_engine->set_item_info;
+
+            // Let the daemon fall back to unknown_command for GAT if the
+            // real engine doesn't implement it.
+            if (ewb->real_engine->get_and_touch == NULL) {
+                ewb->ENGINE_HANDLE_V1::get_and_touch = NULL;
+            }
         }
         return res;
     }
@@ -275,6 +281,22 @@ public:
         }
     }
 
+    static ENGINE_ERROR_CODE get_and_touch(ENGINE_HANDLE* handle,
+                                           const void* cookie, item** item,
+                                           const void* key, const int nkey,
+                                           const rel_time_t exptime,
+                                           uint16_t vbucket) {
+        EWB_Engine* ewb = to_engine(handle);
+        ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
+        if (ewb->should_inject_error(Cmd::GET, cookie, err)) {
+            return err;
+        } else {
+            return ewb->real_engine->get_and_touch(ewb->real_handle, cookie,
+                                                   item, key, nkey, exptime,
+                                                   vbucket);
+        }
+    }
+
     static ENGINE_ERROR_CODE store(ENGINE_HANDLE* handle, const void *cookie,
                                    item* item, uint64_t *cas,
                                    ENGINE_STORE_OPERATION operation,
@@ -750,6 +772,7 @@ EWB_Engine::EWB_Engine(GET_SERVER_API gsa_)
     ENGINE_HANDLE_V1::get_engine_vb_map = get_engine_vb_map;
     ENGINE_HANDLE_V1::get_stats_struct = NULL;
     ENGINE_HANDLE_V1::set_log_level = NULL;
+    ENGINE_HANDLE_V1::get_and_touch = get_and_touch;
 
     ENGINE_HANDLE_V1::dcp = {};
     ENGINE_HANDLE_V1::dcp.step = dcp_step;
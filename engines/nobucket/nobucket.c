@@ -98,6 +98,17 @@ static ENGINE_ERROR_CODE get(ENGINE_HANDLE* handle,
     return ENGINE_NO_BUCKET;
 }
 
+static ENGINE_ERROR_CODE get_and_touch(ENGINE_HANDLE* handle,
+                                       const void* cookie,
+                                       item** item,
+                                       const void* key,
+                                       const int nkey,
+                                       const rel_time_t exptime,
+                                       uint16_t vbucket)
+{
+    return ENGINE_NO_BUCKET;
+}
+
 static ENGINE_ERROR_CODE get_stats(ENGINE_HANDLE* handle,
                                    const void* cookie,
                                    const char* stat_key,
@@ -370,6 +381,7 @@ static ENGINE_HANDLE_V1 *create(void)
     engine->engine.remove = item_delete;
     engine->engine.release = item_release;
     engine->engine.get = get;
+    engine->engine.get_and_touch = get_and_touch;
     engine->engine.get_stats = get_stats;
     engine->engine.reset_stats = reset_stats;
     engine->engine.store = store;
@@ -861,6 +861,7 @@ struct EngineGlue {
         interface.get_item_info = get_item_info;
         interface.set_item_info = set_item_info;
         interface.set_log_level = NULL;
+        interface.get_and_touch = NULL;
     }
 
     ENGINE_HANDLE_V1 interface;
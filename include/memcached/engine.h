@@ -585,6 +585,29 @@ extern "C" {
          * @param level the current log level
          */
         void (*set_log_level)(ENGINE_HANDLE* handle, EXTENSION_LOG_LEVEL level);
+
+        /**
+         * Retrieve an item and update its expiration time (GAT) with a
+         * single lookup. Engines which don't provide this (NULL) get the
+         * GAT commands through unknown_command.
+         *
+         * @param handle the engine handle
+         * @param cookie The cookie provided by the frontend
+         * @param item output variable that will receive the located item
+         * @param key the key to look up
+         * @param nkey the length of the key
+         * @param exptime the new expiration time of the item
+         * @param vbucket the virtual bucket id
+         *
+         * @return ENGINE_SUCCESS if all goes well
+         */
+        ENGINE_ERROR_CODE (*get_and_touch)(ENGINE_HANDLE* handle,
+                                           const void* cookie,
+                                           item** item,
+                                           const void* key,
+                                           const int nkey,
+                                           const rel_time_t exptime,
+                                           uint16_t vbucket);
     } ENGINE_HANDLE_V1;
 
     /**
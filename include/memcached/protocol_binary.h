@@ -458,6 +458,12 @@ extern "C"
         /* ns_server - memcached internal communication */
         PROTOCOL_BINARY_CMD_INIT_COMPLETE = 0xf6,
 
+        /* Move a slab page between two slab classes */
+        PROTOCOL_BINARY_CMD_SLAB_REASSIGN = 0xf7,
+
+        /* Write a snapshot of the items of the bucket */
+        PROTOCOL_BINARY_CMD_SNAPSHOT = 0xf8,
+
         /* Reserved for being able to signal invalid opcode */
         PROTOCOL_BINARY_CMD_INVALID = 0xff
     } protocol_binary_command;
@@ -1202,6 +1208,27 @@ extern "C"
      */
     typedef protocol_binary_response_no_extras protocol_binary_response_scrub;
 
+    /**
+     * Definition of the packet used by the slab reassign command. The
+     * source slab class may be 0xffffffff to let the engine pick a class
+     * which can spare a page.
+     */
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint32_t src;
+                uint32_t dst;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 8];
+    } protocol_binary_request_slab_reassign;
+
+    /**
+     * Definition of the packet returned from slab reassign.
+     */
+    typedef protocol_binary_response_no_extras protocol_binary_response_slab_reassign;
+
 
     /**
      * Definition of the packet used by set vbucket
@@ -231,6 +231,25 @@ static ENGINE_ERROR_CODE mock_get(ENGINE_HANDLE* handle,
     return ret;
 }
 
+static ENGINE_ERROR_CODE mock_get_and_touch(ENGINE_HANDLE* handle,
+                                            const void* cookie,
+                                            item** item,
+                                            const void* key,
+                                            const int nkey,
+                                            const rel_time_t exptime,
+                                            uint16_t vbucket) {
+    struct mock_connstruct *c = get_or_create_mock_connstruct(cookie);
+    auto engine_fn = std::bind(get_engine_v1_from_handle(handle)->get_and_touch,
+                               get_engine_from_handle(handle),
+                               static_cast<const void*>(c),
+                               item, key, nkey, exptime, vbucket);
+
+    ENGINE_ERROR_CODE ret = call_engine_and_handle_EWOULDBLOCK(handle, c, engine_fn);
+
+    check_and_destroy_mock_connstruct(c, cookie);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE mock_get_stats(ENGINE_HANDLE* handle,
                                         const void* cookie,
                                         const char* stat_key,
@@ -782,6 +801,7 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         mock_engine->me.remove = mock_remove;
         mock_engine->me.release = mock_release;
         mock_engine->me.get = mock_get;
+        mock_engine->me.get_and_touch = mock_get_and_touch;
         mock_engine->me.store = mock_store;
         mock_engine->me.arithmetic = mock_arithmetic;
         mock_engine->me.flush = mock_flush;
@@ -825,6 +845,9 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         if (mock_engine->the_engine->get_tap_iterator == NULL) {
             mock_engine->me.get_tap_iterator = NULL;
         }
+        if (mock_engine->the_engine->get_and_touch == NULL) {
+            mock_engine->me.get_and_touch = NULL;
+        }
 
         if (initialize) {
             if(!init_engine_instance(handle, cfg, logger_descriptor)) {
@@ -40,6 +40,7 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <algorithm>
 #include <platform/platform.h>
 
 
@@ -51,10 +52,11 @@ static void thread_main(Connection *c);
 class Connection {
 public:
     Connection(const std::string &_host, const std::string &_port,
-               uint8_t *sndbuf, size_t sndbufsz) :
+               uint8_t *sndbuf, size_t sndbufsz, bool _latency) :
         sendBuffer(sndbuf), sendBufferSize(sndbufsz),
         sendBufferOffset(0),
-        sock(INVALID_SOCKET), host(_host), port(_port), currentOps(0)
+        sock(INVALID_SOCKET), host(_host), port(_port), currentOps(0),
+        latency(_latency)
     {
         currentOps.store(0, std::memory_order_release);
         recvBuffer.reserve(2 * 1024 * 1024);
@@ -99,6 +101,19 @@ public:
         return currentOps.load(std::memory_order_acquire);
     }
 
+    /**
+     * Get the latency (in usec) of the given percentile of the requests
+     * (only recorded in latency mode, and the connection must be stopped)
+     */
+    double getLatency(double percentile) {
+        if (latencies.empty()) {
+            return 0;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        size_t idx = size_t(percentile / 100 * (latencies.size() - 1));
+        return latencies[idx] / 1000.0;
+    }
+
     ~Connection() {
         if (sock != INVALID_SOCKET) {
             closesocket(sock);
@@ -117,6 +132,14 @@ protected:
                 connect();
             }
 
+            if (latency) {
+                while (sock != INVALID_SOCKET &&
+                       running.load(std::memory_order_acquire)) {
+                    doPingPong();
+                }
+                continue;
+            }
+
             while (sock != INVALID_SOCKET && running.load(std::memory_order_acquire)) {
                 struct pollfd fds[1];
                 fds[0].fd = sock;
@@ -244,6 +267,73 @@ protected:
         }
     }
 
+    /**
+     * Send the next request in the send buffer and wait for the response
+     * (so there is only one request in flight), and record the latency
+     */
+    void doPingPong(void) {
+        protocol_binary_request_header *req;
+        req = reinterpret_cast<protocol_binary_request_header *>(
+            sendBuffer + sendBufferOffset);
+        size_t len = 24 + ntohl(req->request.bodylen);
+        const auto start = std::chrono::steady_clock::now();
+
+        size_t offset = 0;
+        while (offset < len) {
+            ssize_t nw = send(sock, sendBuffer + sendBufferOffset + offset,
+                              len - offset, 0);
+            if (nw > 0) {
+                offset += nw;
+            } else if (nw == -1 && errno == EWOULDBLOCK) {
+                waitFor(POLLOUT);
+            } else {
+                close(sock);
+                sock = -1;
+                return;
+            }
+        }
+
+        sendBufferOffset += len;
+        if (sendBufferOffset == sendBufferSize) {
+            sendBufferOffset = 0;
+        }
+
+        recvBuffer.resize(24);
+        offset = 0;
+        while (offset < recvBuffer.size()) {
+            ssize_t nr = recv(sock, recvBuffer.data() + offset,
+                              recvBuffer.size() - offset, 0);
+            if (nr > 0) {
+                offset += nr;
+                if (offset == 24) {
+                    protocol_binary_response_no_extras *res;
+                    res = reinterpret_cast<protocol_binary_response_no_extras *>(recvBuffer.data());
+                    cb_assert(res->message.header.response.magic == 0x81);
+                    recvBuffer.resize(24 + ntohl(res->message.header.response.bodylen));
+                }
+            } else if (nr == -1 && errno == EWOULDBLOCK) {
+                waitFor(POLLIN);
+            } else {
+                close(sock);
+                sock = -1;
+                return;
+            }
+        }
+        recvBuffer.resize(0);
+
+        using namespace std::chrono;
+        latencies.push_back(
+            duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        currentOps.fetch_add(1, std::memory_order_release);
+    }
+
+    void waitFor(short events) {
+        struct pollfd fds[1];
+        fds[0].fd = sock;
+        fds[0].events = events;
+        cb_assert(poll(fds, 1, -1) != -1);
+    }
+
     uint8_t *sendBuffer;
     size_t toSend;
     size_t sendBufferSize;
@@ -258,6 +348,9 @@ protected:
     std::atomic<size_t> currentOps;
     std::thread tid;
     std::atomic<bool> running;
+    /** Only send a request when the previous one completed */
+    const bool latency;
+    std::vector<uint64_t> latencies;
 };
 
 static void thread_main(Connection *c)
@@ -265,20 +358,51 @@ static void thread_main(Connection *c)
     c->run();
 }
 
+static void addSetRequest(std::vector<uint8_t> &vector, size_t size) {
+    protocol_binary_request_set req;
+    memset(&req, 0, sizeof(req));
+
+    req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    req.message.header.request.opcode = PROTOCOL_BINARY_CMD_SET;
+    req.message.header.request.keylen = htons(3);
+    req.message.header.request.extlen = 8;
+    req.message.header.request.bodylen = htonl(11 + size);
+    req.message.body.flags = 0;
+    req.message.body.expiration = 0;
+
+    for (size_t ii = 0; ii < sizeof(req.bytes); ++ii) {
+        vector.push_back(req.bytes[ii]);
+    }
+
+    vector.push_back('f');
+    vector.push_back('o');
+    vector.push_back('o');
+
+    vector.resize(vector.size() + size, ' ');
+}
+
 static void buildSetStream(std::vector<uint8_t> &vector, size_t size) {
     /* preformat a buffer that's roughly 2MB big */
     vector.reserve(2 * 1024 * 1024);
     while (vector.size() < (2 * 1024 * 1024)) {
-        protocol_binary_request_set req;
+        addSetRequest(vector, size);
+    }
+}
+
+static void buildGatStream(std::vector<uint8_t> &vector, size_t size) {
+    /* Store the object once, and keep touching it for the rest of ~2MB */
+    vector.reserve(2 * 1024 * 1024);
+    addSetRequest(vector, size);
+    while (vector.size() < (2 * 1024 * 1024)) {
+        protocol_binary_request_gat req;
         memset(&req, 0, sizeof(req));
 
         req.message.header.request.magic = PROTOCOL_BINARY_REQ;
-        req.message.header.request.opcode = PROTOCOL_BINARY_CMD_SET;
+        req.message.header.request.opcode = PROTOCOL_BINARY_CMD_GAT;
         req.message.header.request.keylen = htons(3);
-        req.message.header.request.extlen = 8;
-        req.message.header.request.bodylen = htonl(11 + size);
-        req.message.body.flags = 0;
-        req.message.body.expiration = 0;
+        req.message.header.request.extlen = 4;
+        req.message.header.request.bodylen = htonl(7);
+        req.message.body.expiration = htonl(3600);
 
         for (size_t ii = 0; ii < sizeof(req.bytes); ++ii) {
             vector.push_back(req.bytes[ii]);
@@ -287,12 +411,12 @@ static void buildSetStream(std::vector<uint8_t> &vector, size_t size) {
         vector.push_back('f');
         vector.push_back('o');
         vector.push_back('o');
-
-        vector.resize(vector.size() + size, ' ');
     }
 }
 
-static void set_test(const std::string &host, const std::string &port, int duration) {
+static void run_test(const std::string &host, const std::string &port,
+                     int duration, bool latency, const std::string &name,
+                     void (*build)(std::vector<uint8_t> &, size_t)) {
     std::list<int> sizes;
     sizes.push_back(256);
     sizes.push_back(512);
@@ -305,15 +429,15 @@ static void set_test(const std::string &host, const std::string &port, int durat
 
     for (auto iter = sizes.begin(); iter != sizes.end(); ++iter) {
         std::vector<uint8_t> message;
-        buildSetStream(message, *iter);
-        Connection c(host, port, message.data(), message.size());
+        build(message, *iter);
+        Connection c(host, port, message.data(), message.size(), latency);
 
         int end = time(NULL) + duration;
         c.start();
 
         while (time(NULL) < (end)) {
-            std::cout << "\rSet test with objects of " << *iter << " bytes: "
-                      << c.getOpsPerSec() << " set/sec";
+            std::cout << "\r" << name << " test with objects of " << *iter
+                      << " bytes: " << c.getOpsPerSec() << " ops/sec";
             std::cout.flush();
             sleep(1);
         }
@@ -324,7 +448,13 @@ static void set_test(const std::string &host, const std::string &port, int durat
         std::cout << "\r " << *iter << " bytes: "
                   << "Duration " << c.getDuration()
                   << "s Total ops " << c.getTotalOps()
-                  << " avg: " << c.getOpsPerSec() << std::endl;
+                  << " avg: " << c.getOpsPerSec();
+        if (latency) {
+            std::cout << " latency (usec) p50: " << c.getLatency(50)
+                      << " p99: " << c.getLatency(99)
+                      << " p99.9: " << c.getLatency(99.9);
+        }
+        std::cout << std::endl;
         std::cout.flush();
     }
 }
@@ -342,12 +472,14 @@ int main(int argc, char **argv)
     std::string host("localhost");
     std::string port("12000");
     int duration = 60;
+    std::string test("set");
+    bool latency = false;
     char *ptr;
 
     /* Initialize the socket subsystem */
     cb_initialize_sockets();
 
-    while ((cmd = getopt(argc, argv, "h:p:d:")) != EOF) {
+    while ((cmd = getopt(argc, argv, "h:p:d:t:l")) != EOF) {
         switch (cmd) {
         case 'h' :
             ptr = strchr(optarg, ':');
@@ -363,14 +495,28 @@ int main(int argc, char **argv)
         case 'd':
             duration = atoi(optarg);
             break;
+        case 't':
+            test.assign(optarg);
+            break;
+        case 'l':
+            latency = true;
+            break;
         default:
             fprintf(stderr,
-                    "Usage mcbench [-h host[:port]] [-p port] [-d duration]\n");
+                    "Usage mcbench [-h host[:port]] [-p port] [-d duration]"
+                    " [-t set|gat] [-l]\n");
             return 1;
         }
     }
 
-    set_test(host, port, duration);
+    if (test == "set") {
+        run_test(host, port, duration, latency, "Set", buildSetStream);
+    } else if (test == "gat") {
+        run_test(host, port, duration, latency, "Get and touch", buildGatStream);
+    } else {
+        fprintf(stderr, "Unknown test: %s\n", test.c_str());
+        return 1;
+    }
 
     return 0;
 }
@@ -303,6 +303,7 @@ TEST_F(SettingsTest, Interfaces) {
     cJSON_AddStringToObject(obj.get(), "host", "*");
     cJSON_AddStringToObject(obj.get(), "protocol", "memcached");
     cJSON_AddTrueToObject(obj.get(), "management");
+    cJSON_AddTrueToObject(obj.get(), "reuseport");
 
     unique_cJSON_ptr ssl(cJSON_CreateObject());
     cJSON_AddStringToObject(ssl.get(), "key", key_pattern);
@@ -340,6 +341,7 @@ TEST_F(SettingsTest, Interfaces) {
         EXPECT_EQ("*", ifc0.host);
         EXPECT_EQ(Protocol::Memcached, ifc0.protocol);
         EXPECT_TRUE(ifc0.management);
+        EXPECT_TRUE(ifc0.reuseport);
 
         const auto& ifc1 = settings.getInterfaces()[1];
         EXPECT_EQ(0, ifc1.port);
@@ -350,6 +352,7 @@ TEST_F(SettingsTest, Interfaces) {
         EXPECT_EQ("*", ifc1.host);
         EXPECT_EQ(Protocol::Greenstack, ifc1.protocol);
         EXPECT_TRUE(ifc1.management);
+        EXPECT_FALSE(ifc1.reuseport);
 
 
     } catch (std::exception& exception) {
@@ -886,6 +889,58 @@ TEST_F(SettingsTest, DedupeNmvbMaps) {
     }
 }
 
+TEST_F(SettingsTest, ConnectionMigration) {
+    nonBooleanValuesShouldFail("connection_migration");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "connection_migration");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isConnectionMigration());
+        EXPECT_TRUE(settings.has.connection_migration);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "connection_migration");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isConnectionMigration());
+        EXPECT_TRUE(settings.has.connection_migration);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, IoBackend) {
+    nonStringValuesShouldFail("io_backend");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddStringToObject(obj.get(), "io_backend", "libevent");
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(IoBackend::Libevent, settings.getIoBackend());
+        EXPECT_TRUE(settings.has.io_backend);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddStringToObject(obj.get(), "io_backend", "io_uring");
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(IoBackend::IoUring, settings.getIoBackend());
+        EXPECT_TRUE(settings.has.io_backend);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddStringToObject(obj.get(), "io_backend", "epoll");
+    expectFail(obj);
+}
+
 TEST(SettingsUpdateTest, EmptySettingsShouldWork) {
     Settings updated;
     Settings settings;
@@ -1097,6 +1152,16 @@ TEST(SettingsUpdateTest, InterfaceSomeValuesMayNotChange) {
         EXPECT_THROW(settings.updateSettings(updated, false),
                      std::invalid_argument);
     }
+
+    {
+        Settings updated;
+        interface myifc;
+        myifc.reuseport = true;
+        updated.addInterface(myifc);
+
+        EXPECT_THROW(settings.updateSettings(updated, false),
+                     std::invalid_argument);
+    }
 }
 
 TEST(SettingsUpdateTest, InterfaceDifferentArraySizeShouldFail) {
@@ -1454,3 +1519,34 @@ TEST(SettingsUpdateTest, DedupeNmvbMapsIsDynamic) {
     EXPECT_NO_THROW(settings.updateSettings(updated, true));
     EXPECT_FALSE(settings.isDedupeNmvbMaps());
 }
+
+TEST(SettingsUpdateTest, ConnectionMigrationIsDynamic) {
+    Settings settings;
+    Settings updated;
+    // setting it to the same value should work
+    settings.setConnectionMigration(true);
+    updated.setConnectionMigration(settings.isConnectionMigration());
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // Changing it should also work
+    updated.setConnectionMigration(!settings.isConnectionMigration());
+    EXPECT_TRUE(settings.isConnectionMigration());
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_TRUE(settings.isConnectionMigration());
+    EXPECT_NO_THROW(settings.updateSettings(updated, true));
+    EXPECT_FALSE(settings.isConnectionMigration());
+}
+
+TEST(SettingsUpdateTest, IoBackendIsNotDynamic) {
+    Settings settings;
+    Settings updated;
+    // setting it to the same value should work
+    settings.setIoBackend(IoBackend::Libevent);
+    updated.setIoBackend(settings.getIoBackend());
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should not work
+    updated.setIoBackend(IoBackend::IoUring);
+    EXPECT_THROW(settings.updateSettings(updated, false),
+                 std::invalid_argument);
+}
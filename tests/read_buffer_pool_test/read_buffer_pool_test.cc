@@ -0,0 +1,95 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "daemon/read_buffer_pool.h"
+
+TEST(ReadBufferPoolTest, RoundUp) {
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE, ReadBufferPool::roundUp(0));
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE, ReadBufferPool::roundUp(1));
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE,
+              ReadBufferPool::roundUp(READ_BUFFER_POOL_MIN_SIZE));
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE * 2,
+              ReadBufferPool::roundUp(READ_BUFFER_POOL_MIN_SIZE + 1));
+    EXPECT_EQ(READ_BUFFER_POOL_MAX_SIZE * 2,
+              ReadBufferPool::roundUp(READ_BUFFER_POOL_MAX_SIZE + 1));
+}
+
+TEST(ReadBufferPoolTest, ReuseBuffer) {
+    ReadBufferPool pool;
+    bool pooled = true;
+    size_t size = 5000;
+
+    char* buf = pool.get(size, pooled);
+    ASSERT_NE(nullptr, buf);
+    EXPECT_FALSE(pooled);
+    EXPECT_EQ(8192, size);
+
+    pool.put(buf, size);
+    EXPECT_EQ(8192, pool.getBytes());
+
+    // A smaller buffer doesn't take the one in the pool
+    size_t small = 100;
+    char* other = pool.get(small, pooled);
+    EXPECT_FALSE(pooled);
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE, small);
+    pool.put(other, small);
+
+    size = 8000;
+    EXPECT_EQ(buf, pool.get(size, pooled));
+    EXPECT_TRUE(pooled);
+    EXPECT_EQ(8192, size);
+    EXPECT_EQ(READ_BUFFER_POOL_MIN_SIZE, pool.getBytes());
+    pool.put(buf, size);
+}
+
+TEST(ReadBufferPoolTest, LargeBuffersAreFreed) {
+    ReadBufferPool pool;
+    bool pooled;
+    size_t size = READ_BUFFER_POOL_MAX_SIZE + 1;
+
+    char* buf = pool.get(size, pooled);
+    ASSERT_NE(nullptr, buf);
+    EXPECT_FALSE(pooled);
+    pool.put(buf, size);
+    EXPECT_EQ(0, pool.getBytes());
+}
+
+TEST(ReadBufferPoolTest, ClassIsBounded) {
+    ReadBufferPool pool;
+    std::vector<char*> buffers;
+    const size_t max = READ_BUFFER_POOL_CLASS_BYTES / READ_BUFFER_POOL_MIN_SIZE;
+    bool pooled;
+
+    for (size_t ii = 0; ii < max + 10; ++ii) {
+        size_t size = READ_BUFFER_POOL_MIN_SIZE;
+        buffers.push_back(pool.get(size, pooled));
+        ASSERT_NE(nullptr, buffers.back());
+    }
+    for (auto* buf : buffers) {
+        pool.put(buf, READ_BUFFER_POOL_MIN_SIZE);
+    }
+    EXPECT_EQ(READ_BUFFER_POOL_CLASS_BYTES, pool.getBytes());
+
+    // A buffer of a size which isn't a class can't be pooled
+    char* buf = reinterpret_cast<char*>(malloc(3000));
+    pool.put(buf, 3000);
+    EXPECT_EQ(READ_BUFFER_POOL_CLASS_BYTES, pool.getBytes());
+}
@@ -753,7 +753,52 @@ void reconnect_to_server() {
     }
 }
 
+/**
+ * Move all of the members of from into the object to (replacing the ones
+ * with the same names)
+ */
+static void move_config(cJSON* to, cJSON* from) {
+    while (from->child != nullptr) {
+        std::string key(from->child->string);
+        cJSON* item = cJSON_DetachItemFromObject(from, key.c_str());
+        cJSON_DeleteItemFromObject(to, key.c_str());
+        cJSON_AddItemToObject(to, key.c_str(), item);
+    }
+}
+
+/**
+ * Add the settings in the MEMCACHED_TESTAPP_EXTRA_CONFIG environment
+ * variable (a JSON object) to the configuration, so that the tests may be
+ * run with other settings than the defaults. The members of its
+ * "interface" member are added to every interface.
+ */
+static void add_extra_config(cJSON* config) {
+    const char* extra = getenv("MEMCACHED_TESTAPP_EXTRA_CONFIG");
+    if (extra == nullptr) {
+        return;
+    }
+
+    unique_cJSON_ptr json(cJSON_Parse(extra));
+    ASSERT_NE(nullptr, json.get())
+        << "Invalid MEMCACHED_TESTAPP_EXTRA_CONFIG: " << extra;
+    unique_cJSON_ptr iface(cJSON_DetachItemFromObject(json.get(),
+                                                      "interface"));
+    move_config(config, json.get());
+
+    if (iface.get() != nullptr) {
+        auto* interfaces = cJSON_GetObjectItem(config, "interfaces");
+        for (auto* obj = interfaces->child; obj != nullptr; obj = obj->next) {
+            // Every interface needs a copy of its own
+            unique_cJSON_ptr copy(cJSON_Parse(extra));
+            unique_cJSON_ptr attrs(cJSON_DetachItemFromObject(copy.get(),
+                                                              "interface"));
+            move_config(obj, attrs.get());
+        }
+    }
+}
+
 void TestappTest::start_memcached_server(cJSON* config) {
+    add_extra_config(config);
 
     char config_file_pattern [] = CFG_FILE_PATTERN;
     strncpy(config_file_pattern, CFG_FILE_PATTERN, sizeof(config_file_pattern));
@@ -1475,6 +1520,84 @@ TEST_P(McdTestappTest, GetKQ) {
               test_getq_impl("test_getkq", PROTOCOL_BINARY_CMD_GETKQ));
 }
 
+static size_t mcbp_gat_command(char* buf, size_t bufsz, uint8_t cmd,
+                               const char* key, uint32_t exptime) {
+    size_t keylen = strlen(key);
+    protocol_binary_request_gat* request =
+        reinterpret_cast<protocol_binary_request_gat*>(buf);
+    cb_assert(bufsz > sizeof(*request) + keylen);
+
+    memset(request, 0, sizeof(*request));
+    request->message.header.request.magic = PROTOCOL_BINARY_REQ;
+    request->message.header.request.opcode = cmd;
+    request->message.header.request.keylen = htons((uint16_t)keylen);
+    request->message.header.request.extlen = 4;
+    request->message.header.request.bodylen = htonl((uint32_t)(keylen + 4));
+    request->message.header.request.opaque = 0xdeadbeef;
+    request->message.body.expiration = htonl(exptime);
+    memcpy(buf + sizeof(*request), key, keylen);
+    return sizeof(*request) + keylen;
+}
+
+TEST_P(McdTestappTest, GetAndTouch) {
+    const char* key = "test_gat";
+    union {
+        protocol_binary_request_no_extras request;
+        protocol_binary_response_no_extras response;
+        protocol_binary_response_get get;
+        char bytes[1024];
+    } send, receive;
+
+    size_t len = mcbp_gat_command(send.bytes, sizeof(send.bytes),
+                                  PROTOCOL_BINARY_CMD_GAT, key, 10);
+    safe_send(send.bytes, len, false);
+    safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+    mcbp_validate_response_header(&receive.response, PROTOCOL_BINARY_CMD_GAT,
+                                  PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+
+    len = mcbp_storage_command(send.bytes, sizeof(send.bytes),
+                               PROTOCOL_BINARY_CMD_ADD,
+                               key, strlen(key), "value", 5, 0xcaffee, 0);
+    safe_send(send.bytes, len, false);
+    safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+    mcbp_validate_response_header(&receive.response, PROTOCOL_BINARY_CMD_ADD,
+                                  PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
+    len = mcbp_gat_command(send.bytes, sizeof(send.bytes),
+                           PROTOCOL_BINARY_CMD_GAT, key, 10);
+    safe_send(send.bytes, len, false);
+    safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+    mcbp_validate_response_header(&receive.response, PROTOCOL_BINARY_CMD_GAT,
+                                  PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    EXPECT_EQ(4, receive.response.message.header.response.extlen);
+    EXPECT_EQ(9u, ntohl(receive.response.message.header.response.bodylen));
+    EXPECT_EQ(0xcaffee, ntohl(receive.get.message.body.flags));
+    EXPECT_EQ(0, memcmp(receive.bytes + sizeof(receive.get), "value", 5));
+
+    // The quiet version should only say something on a hit
+    const char* missing = "test_gat_missing";
+    len = mcbp_gat_command(send.bytes, sizeof(send.bytes),
+                           PROTOCOL_BINARY_CMD_GATQ, missing, 10);
+    len += mcbp_gat_command(send.bytes + len, sizeof(send.bytes) - len,
+                            PROTOCOL_BINARY_CMD_GATQ, key, 0);
+    safe_send(send.bytes, len, false);
+    safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+    mcbp_validate_response_header(&receive.response, PROTOCOL_BINARY_CMD_GATQ,
+                                  PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
+    // GAT requires the expiration time
+    len = mcbp_raw_command(send.bytes, sizeof(send.bytes),
+                           PROTOCOL_BINARY_CMD_GAT, key, strlen(key),
+                           NULL, 0);
+    safe_send(send.bytes, len, false);
+    safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+    mcbp_validate_response_header(&receive.response, PROTOCOL_BINARY_CMD_GAT,
+                                  PROTOCOL_BINARY_RESPONSE_EINVAL);
+
+    reconnect_to_server();
+    delete_object(key);
+}
+
 static enum test_return test_incr_impl(const char* key, uint8_t cmd) {
     union {
         protocol_binary_request_no_extras request;
@@ -3592,6 +3715,49 @@ TEST_P(McdTestappTest, PipelineSetDel) {
                        5000, 256);
 }
 
+/*
+ * Keep ewouldblock_engine in its default mode, where every command which
+ * isn't the same as the previous one blocks, and pipeline alternating
+ * sets and gets. Every command is then resumed by a notification from
+ * the engine's background thread while the worker thread may be busy
+ * with the previous one, so a lost wakeup shows up as the test hanging.
+ */
+TEST_P(McdTestappTest, PipelineEWouldBlock) {
+    const char key[] = "key_ewouldblock_pipe";
+    const int count = 500;
+    uint64_t value = 0xdeadbeefdeadcafe;
+    std::vector<char> buffer(count * 2 * 256);
+    size_t offset = 0;
+
+    for (int ii = 0; ii < count; ++ii) {
+        offset += mcbp_storage_command(buffer.data() + offset,
+                                       buffer.size() - offset,
+                                       PROTOCOL_BINARY_CMD_SET,
+                                       key, strlen(key),
+                                       &value, sizeof(value), 0, 0);
+        offset += mcbp_raw_command(buffer.data() + offset,
+                                   buffer.size() - offset,
+                                   PROTOCOL_BINARY_CMD_GET,
+                                   key, strlen(key), NULL, 0);
+    }
+    safe_send(buffer.data(), offset, false);
+
+    union {
+        protocol_binary_response_no_extras response;
+        char bytes[1024];
+    } receive;
+    for (int ii = 0; ii < count; ++ii) {
+        safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+        mcbp_validate_response_header(&receive.response,
+                                      PROTOCOL_BINARY_CMD_SET,
+                                      PROTOCOL_BINARY_RESPONSE_SUCCESS);
+        safe_recv_packet(receive.bytes, sizeof(receive.bytes));
+        mcbp_validate_response_header(&receive.response,
+                                      PROTOCOL_BINARY_CMD_GET,
+                                      PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    }
+}
+
 /* Send one character to the SSL port, then check memcached correctly closes
  * the connection (and doesn't hold it open for ever trying to read) more bytes
  * which will never come.
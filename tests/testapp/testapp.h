@@ -245,6 +245,12 @@ void safe_send(const void* buf, size_t len, bool hickup);
  */
 bool safe_recv_packet(void *buf, size_t size);
 
+/* Send a pipeline of messages_in_stream set, get or delete commands (for
+ * the keys key_root00000, key_root00001, ...) and validate the responses.
+ */
+void test_pipeline_impl(int cmd, int result, const char* key_root,
+                        uint32_t messages_in_stream, size_t value_size);
+
 int write_config_to_file(const std::string& config, const std::string& fname);
 
 
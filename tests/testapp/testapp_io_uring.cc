@@ -0,0 +1,181 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <string.h>
+#include <vector>
+#include "testapp.h"
+
+/**
+ * Smoke tests for the io_uring network io backend (io_backend=io_uring).
+ * The worker threads fall back to libevent if the kernel doesn't let us
+ * create a ring, so check the output of the IoBackend test to see which
+ * of the backends the tests ran against.
+ */
+class IoUringTest : public TestappTest {
+public:
+    static void SetUpTestCase() {
+        memcached_cfg.reset(generate_config(0));
+        cJSON_AddStringToObject(memcached_cfg.get(), "io_backend",
+                                "io_uring");
+
+        start_memcached_server(memcached_cfg.get());
+
+        if (HasFailure()) {
+            server_pid = reinterpret_cast<pid_t>(-1);
+        } else {
+            CreateTestBucket();
+        }
+
+        ASSERT_NE(reinterpret_cast<pid_t>(-1), server_pid);
+    }
+
+protected:
+    void SetUp() {
+        TestappTest::SetUp();
+        // These are large tests, don't make them any slower
+        ewouldblock_engine_disable();
+    }
+
+    unique_cJSON_ptr getThreadStats() {
+        auto& conn = connectionMap.getConnection(Protocol::Memcached, false);
+        conn.reconnect();
+        return conn.stats("threads");
+    }
+
+    /**
+     * Send the pipeline of get commands for the key on a connection of
+     * its own, and close it without reading any of the responses
+     */
+    void sendGetsAndClose(const char* key, int count) {
+        SOCKET client = connect_to_server_plain(port);
+        ASSERT_NE(INVALID_SOCKET, client);
+
+        std::vector<char> buffer(count * 1024);
+        size_t offset = 0;
+        for (int ii = 0; ii < count; ++ii) {
+            offset += mcbp_raw_command(buffer.data() + offset,
+                                       buffer.size() - offset,
+                                       PROTOCOL_BINARY_CMD_GET,
+                                       key, strlen(key), nullptr, 0);
+        }
+
+        SOCKET saved = sock;
+        sock = client;
+        safe_send(buffer.data(), offset, false);
+        sock = saved;
+        closesocket(client);
+    }
+};
+
+TEST_F(IoUringTest, IoBackend) {
+    unique_cJSON_ptr stats;
+    ASSERT_NO_THROW(stats = getThreadStats());
+    auto* backend = cJSON_GetObjectItem(stats.get(), "worker_0_io_backend");
+    ASSERT_NE(nullptr, backend);
+    ASSERT_EQ(cJSON_String, backend->type);
+    if (strcmp(backend->valuestring, "io_uring") != 0) {
+        std::cerr << "NOTE: io_uring isn't available, the worker threads "
+                  << "use " << backend->valuestring << std::endl;
+    }
+}
+
+TEST_F(IoUringTest, PipelinedSetGet) {
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_pipe",
+                       5000, 256);
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_GET,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_pipe",
+                       5000, 256);
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_DELETE,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_pipe",
+                       5000, 256);
+}
+
+/*
+ * The responses larger than a send buffer of the ring are sent from the
+ * memory of the connection (once the write in flight completes), so they
+ * must come back in order with the small ones
+ */
+TEST_F(IoUringTest, LargeValues) {
+    const size_t sizes[] = { 16 * 1024 - 100, 16 * 1024 + 100, 64 * 1024,
+                             512 * 1024 };
+    for (auto size : sizes) {
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_large",
+                           50, size);
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_GET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_large",
+                           50, size);
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_DELETE,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_large",
+                           50, size);
+    }
+}
+
+/*
+ * Clients disconnecting while their responses are being written must not
+ * have the rest of them written to anyone else (the descriptors of the
+ * closed sockets are reused by the next clients)
+ */
+TEST_F(IoUringTest, DisconnectWithWriteInFlight) {
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_close",
+                       1, 8 * 1024);
+
+    for (int ii = 0; ii < 50; ++ii) {
+        sendGetsAndClose("uring_close00000", 500);
+
+        // The next client (which may get the same descriptor) only gets
+        // its own responses
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_next",
+                           10, 100);
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_GET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_next",
+                           10, 100);
+    }
+
+    // ... and the server is still serving new clients
+    unique_cJSON_ptr stats;
+    ASSERT_NO_THROW(stats = getThreadStats());
+    EXPECT_NE(nullptr, stats.get());
+}
+
+/*
+ * The same for the responses sent from the memory of the connection,
+ * which are cancelled when the client disconnects (the connection is
+ * about to release the items they refer to)
+ */
+TEST_F(IoUringTest, DisconnectWithLargeWriteInFlight) {
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_close",
+                       1, 256 * 1024);
+
+    for (int ii = 0; ii < 50; ++ii) {
+        sendGetsAndClose("uring_close00000", 50);
+
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_next",
+                           10, 100);
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_GET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "uring_next",
+                           10, 100);
+    }
+
+    unique_cJSON_ptr stats;
+    ASSERT_NO_THROW(stats = getThreadStats());
+    EXPECT_NE(nullptr, stats.get());
+}
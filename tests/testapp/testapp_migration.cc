@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <chrono>
+#include <string>
+#include <vector>
+#include "testapp.h"
+
+/**
+ * Tests for moving idle clients away from a busy worker thread
+ * (connection_migration), using the per worker counters in
+ * "stats threads".
+ */
+class ConnectionMigrationTest : public TestappTest {
+public:
+    static void SetUpTestCase() {
+        memcached_cfg.reset(generate_config(0));
+        // With two worker threads the idle clients are spread over the
+        // busy thread and the one they may be moved to
+        cJSON_AddNumberToObject(memcached_cfg.get(), "threads", 2);
+        cJSON_AddTrueToObject(memcached_cfg.get(), "connection_migration");
+
+        start_memcached_server(memcached_cfg.get());
+
+        if (HasFailure()) {
+            server_pid = reinterpret_cast<pid_t>(-1);
+        } else {
+            CreateTestBucket();
+        }
+
+        ASSERT_NE(reinterpret_cast<pid_t>(-1), server_pid);
+    }
+
+protected:
+    void SetUp() {
+        TestappTest::SetUp();
+        ewouldblock_engine_disable();
+    }
+
+    struct MigrationCounters {
+        uint64_t migrated_in;
+        uint64_t migrated_out;
+    };
+
+    /**
+     * Get the sum of the migration counters of all of the worker threads
+     */
+    MigrationCounters getMigrationCounters() {
+        auto& conn = connectionMap.getConnection(Protocol::Memcached, false);
+        conn.reconnect();
+        unique_cJSON_ptr stats = conn.stats("threads");
+        EXPECT_NE(nullptr, stats.get());
+
+        MigrationCounters ret = {0, 0};
+        for (int ii = 0;; ++ii) {
+            const std::string prefix = "worker_" + std::to_string(ii);
+            auto* in = cJSON_GetObjectItem(stats.get(),
+                                           (prefix + "_migrated_in").c_str());
+            auto* out = cJSON_GetObjectItem(stats.get(),
+                                            (prefix + "_migrated_out").c_str());
+            if (in == nullptr) {
+                EXPECT_EQ(nullptr, out);
+                break;
+            }
+            EXPECT_EQ(cJSON_Number, in->type);
+            EXPECT_NE(nullptr, out);
+            if (out != nullptr) {
+                EXPECT_EQ(cJSON_Number, out->type);
+                ret.migrated_out += out->valueint;
+            }
+            ret.migrated_in += in->valueint;
+        }
+        return ret;
+    }
+
+    /**
+     * Send a noop on the socket and wait for the response
+     */
+    void noop(SOCKET client) {
+        union {
+            protocol_binary_request_no_extras request;
+            protocol_binary_response_no_extras response;
+            char bytes[1024];
+        } buffer;
+
+        size_t len = mcbp_raw_command(buffer.bytes, sizeof(buffer.bytes),
+                                      PROTOCOL_BINARY_CMD_NOOP,
+                                      NULL, 0, NULL, 0);
+        SOCKET saved = sock;
+        sock = client;
+        safe_send(buffer.bytes, len, false);
+        safe_recv_packet(buffer.bytes, sizeof(buffer.bytes));
+        sock = saved;
+        mcbp_validate_response_header(&buffer.response,
+                                      PROTOCOL_BINARY_CMD_NOOP,
+                                      PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    }
+};
+
+/*
+ * Keep one of the worker threads busy (well above the 1000 ops/sec a
+ * thread needs before it moves clients away) until it moves one of the
+ * idle clients over to the other thread, and check that all of the
+ * clients still work.
+ */
+TEST_F(ConnectionMigrationTest, MoveIdleClients) {
+    const int nclients = 8;
+    std::vector<SOCKET> clients;
+    for (int ii = 0; ii < nclients; ++ii) {
+        SOCKET client = connect_to_server_plain(port);
+        ASSERT_NE(INVALID_SOCKET, client);
+        clients.push_back(client);
+        noop(client);
+    }
+
+    const MigrationCounters before = getMigrationCounters();
+    MigrationCounters after = before;
+
+    // The threads measure their ops rate and look for a client to move
+    // once a second
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::seconds(30);
+    while (after.migrated_out == before.migrated_out &&
+           std::chrono::steady_clock::now() < deadline) {
+        test_pipeline_impl(PROTOCOL_BINARY_CMD_SET,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS, "migrate",
+                           1000, 16);
+        after = getMigrationCounters();
+    }
+
+    EXPECT_LT(before.migrated_out, after.migrated_out)
+        << "No clients were moved between the worker threads";
+    EXPECT_EQ(after.migrated_out - before.migrated_out,
+              after.migrated_in - before.migrated_in);
+
+    // The clients (including the ones that were moved) are still served
+    for (auto client : clients) {
+        noop(client);
+        closesocket(client);
+    }
+    test_pipeline_impl(PROTOCOL_BINARY_CMD_DELETE,
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS, "migrate", 1000, 16);
+}
@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <string>
+#include <vector>
+#include "testapp.h"
+
+/**
+ * Tests for the SO_REUSEPORT listen sockets owned by the worker threads
+ * (the "reuseport" interface attribute), using the per worker counters
+ * in "stats accepts".
+ */
+class ReuseportTest : public TestappTest {
+public:
+    static void SetUpTestCase() {
+        memcached_cfg.reset(generate_config(0));
+        auto* interfaces = cJSON_GetObjectItem(memcached_cfg.get(),
+                                               "interfaces");
+        for (auto* obj = interfaces->child; obj != nullptr; obj = obj->next) {
+            cJSON_AddTrueToObject(obj, "reuseport");
+        }
+
+        start_memcached_server(memcached_cfg.get());
+
+        if (HasFailure()) {
+            server_pid = reinterpret_cast<pid_t>(-1);
+        } else {
+            CreateTestBucket();
+        }
+
+        ASSERT_NE(reinterpret_cast<pid_t>(-1), server_pid);
+    }
+
+protected:
+    struct AcceptCounters {
+        uint64_t accepted;
+        uint64_t reuseport_accepted;
+    };
+
+    /**
+     * Get the sum of the accept counters of all of the worker threads
+     */
+    AcceptCounters getAcceptCounters() {
+        auto& conn = connectionMap.getConnection(Protocol::Memcached, false);
+        conn.reconnect();
+        unique_cJSON_ptr stats = conn.stats("accepts");
+        EXPECT_NE(nullptr, stats.get());
+
+        AcceptCounters ret = {0, 0};
+        for (int ii = 0;; ++ii) {
+            const std::string prefix = "worker_" + std::to_string(ii);
+            auto* accepted = cJSON_GetObjectItem(stats.get(),
+                                                 (prefix + "_accepted").c_str());
+            auto* reuseport = cJSON_GetObjectItem(stats.get(),
+                                                  (prefix + "_reuseport_accepted").c_str());
+            if (accepted == nullptr) {
+                EXPECT_EQ(nullptr, reuseport);
+                break;
+            }
+            EXPECT_EQ(cJSON_Number, accepted->type);
+            EXPECT_NE(nullptr, reuseport);
+            if (reuseport != nullptr) {
+                EXPECT_EQ(cJSON_Number, reuseport->type);
+                ret.reuseport_accepted += reuseport->valueint;
+            }
+            ret.accepted += accepted->valueint;
+        }
+        return ret;
+    }
+
+    /**
+     * Send a noop on the socket and wait for the response, so that we know
+     * the server created the connection
+     */
+    void noop(SOCKET client) {
+        union {
+            protocol_binary_request_no_extras request;
+            protocol_binary_response_no_extras response;
+            char bytes[1024];
+        } buffer;
+
+        size_t len = mcbp_raw_command(buffer.bytes, sizeof(buffer.bytes),
+                                      PROTOCOL_BINARY_CMD_NOOP,
+                                      NULL, 0, NULL, 0);
+        SOCKET saved = sock;
+        sock = client;
+        safe_send(buffer.bytes, len, false);
+        safe_recv_packet(buffer.bytes, sizeof(buffer.bytes));
+        sock = saved;
+        mcbp_validate_response_header(&buffer.response,
+                                      PROTOCOL_BINARY_CMD_NOOP,
+                                      PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    }
+};
+
+/*
+ * All of the clients are accepted by the workers themselves, and each of
+ * them is counted once by the worker it ended up on
+ */
+TEST_F(ReuseportTest, WorkersAcceptClients) {
+    const AcceptCounters before = getAcceptCounters();
+
+    const int nclients = 32;
+    std::vector<SOCKET> clients;
+    for (int ii = 0; ii < nclients; ++ii) {
+        SOCKET client = connect_to_server_plain(port);
+        ASSERT_NE(INVALID_SOCKET, client);
+        clients.push_back(client);
+        noop(client);
+    }
+
+    const AcceptCounters after = getAcceptCounters();
+    for (auto client : clients) {
+        closesocket(client);
+    }
+
+    // The stats connection is reconnected for each of the calls, so it
+    // adds one to the counters as well
+    EXPECT_EQ(before.accepted + nclients + 1, after.accepted);
+#ifdef SO_REUSEPORT
+    EXPECT_EQ(before.reuseport_accepted + nclients + 1,
+              after.reuseport_accepted);
+    EXPECT_EQ(after.accepted, after.reuseport_accepted);
+#else
+    EXPECT_EQ(before.reuseport_accepted, after.reuseport_accepted);
+#endif
+}
@@ -0,0 +1,559 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2015 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * The throughput and hit rate benchmarks of the default engine. They take
+ * too long to run with the basic engine tests (they run as the
+ * engine_benchmarks target) and only assert that the engine keeps working
+ * while they run.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include "basic_engine_testsuite.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct test_harness test_harness;
+
+static std::map<std::string, std::string> stat_values;
+
+static void collect_stat(const char *key, const uint16_t klen,
+                         const char *val, const uint32_t vlen,
+                         const void *cookie) {
+    stat_values[std::string(key, klen)] = std::string(val, vlen);
+}
+
+/* Keep the cache in memory (where it belongs) if we can */
+static std::string bench_shm_file() {
+    if (access("/dev/shm", W_OK) == 0) {
+        return "/dev/shm/basic_engine_benchsuite.shm";
+    }
+    return "basic_engine_benchsuite.shm";
+}
+
+/*
+ * Context used by the multithreaded throughput benchmarks. Every thread
+ * performs "ops" operations on keys picked from the preloaded key space,
+ * where "write_percent" percent of them are SETs and the rest GETs.
+ * The SETs store 32 byte values, or values of "bench_value_sizes" sizes
+ * if "mixed_sizes" is set.
+ */
+struct bench_context {
+    ENGINE_HANDLE *h;
+    ENGINE_HANDLE_V1 *h1;
+    int nkeys;
+    /* the keys of the key space, built by bench_run and shared read-only */
+    std::vector<std::string> keys;
+    int ops;
+    int write_percent;
+    bool mixed_sizes;
+};
+
+static const size_t bench_value_sizes[] = { 32, 256, 2048, 16384 };
+
+static std::string bench_key(int ii) {
+    std::stringstream ss;
+    ss << "bench_key_" << ii;
+    return ss.str();
+}
+
+static void bench_preload(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                          int nkeys) {
+    for (int ii = 0; ii < nkeys; ++ii) {
+        const std::string key = bench_key(ii);
+        item *it = NULL;
+        uint64_t cas = 0;
+        cb_assert(h1->allocate(h, NULL, &it, key.c_str(), key.length(), 32,
+                               0, 0, PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, it);
+    }
+}
+
+static void bench_main(void *arg) {
+    struct bench_context *ctx = static_cast<struct bench_context*>(arg);
+    const std::vector<std::string>& keys = ctx->keys;
+
+    /* seed with the address of the (per thread) stack */
+    unsigned int next = (unsigned int)(uintptr_t)&next;
+    for (int ii = 0; ii < ctx->ops; ++ii) {
+        next = next * 1103515245 + 12345;
+        const std::string& key = keys[(next >> 8) % keys.size()];
+        item *it = NULL;
+        if ((int)((next >> 4) % 100) < ctx->write_percent) {
+            uint64_t cas = 0;
+            size_t nbytes = 32;
+            if (ctx->mixed_sizes) {
+                nbytes = bench_value_sizes[(next >> 16) % 4];
+            }
+            cb_assert(ctx->h1->allocate(ctx->h, NULL, &it, key.c_str(),
+                                        key.length(), nbytes, 0, 0,
+                                        PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+            cb_assert(ctx->h1->store(ctx->h, NULL, it, &cas, OPERATION_SET,
+                                     0) == ENGINE_SUCCESS);
+        } else {
+            cb_assert(ctx->h1->get(ctx->h, NULL, &it, key.c_str(),
+                                   (int)key.length(), 0) == ENGINE_SUCCESS);
+        }
+        ctx->h1->release(ctx->h, NULL, it);
+    }
+}
+
+/*
+ * Count the data TLB misses of the benchmark threads with the hardware
+ * performance counters, when they are available (they often aren't in
+ * virtual machines and containers).
+ */
+class TlbMissCounter {
+public:
+    TlbMissCounter() : fd(-1) {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        // Count the threads we create as well
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~TlbMissCounter() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool available() const {
+        return fd != -1;
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // The threads must have exited for their counts to be included
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+/*
+ * Run the given benchmark function with an increasing number of threads
+ * and report the achieved operations per second for each thread count
+ * (and the data TLB misses per operation if we can count them).
+ */
+static void bench_run(const char *name, void (*func)(void*),
+                      struct bench_context *ctx) {
+    const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    TlbMissCounter tlb_misses;
+
+    /* Build the keys up front so that it isn't part of the timing */
+    ctx->keys.clear();
+    for (int ii = 0; ii < ctx->nkeys; ++ii) {
+        ctx->keys.push_back(bench_key(ii));
+    }
+
+    for (auto nthreads : thread_counts) {
+        std::vector<cb_thread_t> tids(nthreads);
+        tlb_misses.start();
+        hrtime_t start = gethrtime();
+        for (int ii = 0; ii < nthreads; ++ii) {
+            cb_assert(cb_create_thread(&tids[ii], func, ctx, 0) == 0);
+        }
+        for (int ii = 0; ii < nthreads; ++ii) {
+            cb_assert(cb_join_thread(tids[ii]) == 0);
+        }
+        hrtime_t elapsed = gethrtime() - start;
+        uint64_t misses = tlb_misses.stop();
+        if (elapsed == 0) {
+            elapsed = 1;
+        }
+        uint64_t total = uint64_t(nthreads) * ctx->ops;
+        std::cout << "    " << name << ": " << nthreads << " thread(s) "
+                  << (total * 1000000000ULL) / elapsed << " ops/sec";
+        if (tlb_misses.available()) {
+            std::cout << ", " << double(misses) / total
+                      << " dTLB misses/op";
+        }
+        std::cout << std::endl;
+    }
+}
+
+/*
+ * Microbenchmark for the read path: measure GET throughput as the number
+ * of threads accessing a single bucket increases.
+ */
+static enum test_result mt_get_bench_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    struct bench_context ctx;
+    ctx.h = h;
+    ctx.h1 = h1;
+    ctx.nkeys = 10000;
+    ctx.ops = 100000;
+    ctx.write_percent = 0;
+    ctx.mixed_sizes = false;
+
+    bench_preload(h, h1, ctx.nkeys);
+    bench_run("get", bench_main, &ctx);
+    return SUCCESS;
+}
+
+/*
+ * Microbenchmark for a read mostly workload (95% GET, 5% SET) where the
+ * readers run concurrently with writers modifying the same keys.
+ */
+static enum test_result mt_mixed_bench_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    struct bench_context ctx;
+    ctx.h = h;
+    ctx.h1 = h1;
+    ctx.nkeys = 10000;
+    ctx.ops = 100000;
+    ctx.write_percent = 5;
+    ctx.mixed_sizes = false;
+
+    bench_preload(h, h1, ctx.nkeys);
+    bench_run("get/set 95/5", bench_main, &ctx);
+    return SUCCESS;
+}
+
+/*
+ * Microbenchmark for the allocation path: every thread stores items of
+ * different sizes (so they hit different slab classes) as fast as it can.
+ */
+static enum test_result mt_set_bench_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    struct bench_context ctx;
+    ctx.h = h;
+    ctx.h1 = h1;
+    ctx.nkeys = 10000;
+    ctx.ops = 100000;
+    ctx.write_percent = 100;
+    ctx.mixed_sizes = true;
+
+    bench_preload(h, h1, ctx.nkeys);
+    bench_run("set (mixed sizes)", bench_main, &ctx);
+    return SUCCESS;
+}
+
+/*
+ * The GET microbenchmark with a larger data set, run both with the slab
+ * memory from malloc and with huge pages (see slab_memory.c) to compare
+ * the TLB misses.
+ */
+static void mt_get_big_bench(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                             const char *name) {
+    struct bench_context ctx;
+    ctx.h = h;
+    ctx.h1 = h1;
+    ctx.nkeys = 200000;
+    ctx.ops = 100000;
+    ctx.write_percent = 0;
+    ctx.mixed_sizes = false;
+
+    bench_preload(h, h1, ctx.nkeys);
+    bench_run(name, bench_main, &ctx);
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "slabs", 5, collect_stat) == ENGINE_SUCCESS);
+    std::cout << "    slab memory mapped: " << stat_values["slab_memory_mapped"]
+              << " huge pages: " << stat_values["slab_huge_pages"]
+              << " numa policy: " << stat_values["slab_numa_policy"]
+              << std::endl;
+}
+
+static enum test_result mt_get_big_bench_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    mt_get_big_bench(h, h1, "get (malloc)");
+    cb_assert(stat_values["slab_memory_mapped"] == "0");
+    return SUCCESS;
+}
+
+static enum test_result mt_get_huge_pages_bench_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    mt_get_big_bench(h, h1, "get (huge pages)");
+    // The OS may not give us huge pages, but the cache is always mapped
+    cb_assert(stat_values["slab_memory_mapped"] != "0");
+    return SUCCESS;
+}
+
+/*
+ * Benchmark how long it takes to get the items of a bucket back after a
+ * restart, from a snapshot written as we shut down and by re-attaching
+ * to the cache in shm_file.
+ */
+static enum test_result restart_bench_test(engine_test_t *test) {
+    const int nkeys = 200000;
+    const std::string shm = bench_shm_file();
+    const std::string snapshot = "basic_engine_benchsuite.snapshot";
+    const std::pair<std::string, std::string> modes[] = {
+        { "snapshot", ";snapshot_on_shutdown=true;snapshot_file=" + snapshot },
+        { "shm_file", ";shm_file=" + shm }
+    };
+
+    for (const auto& mode : modes) {
+        const std::string cfg = std::string(test->cfg) + mode.second;
+        remove(shm.c_str());
+        remove(snapshot.c_str());
+
+        ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, cfg.c_str());
+        ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+        bench_preload(h, h1, nkeys);
+
+        hrtime_t start = gethrtime();
+        test_harness.destroy_bucket(h, h1, false);
+        hrtime_t shutdown = gethrtime() - start;
+
+        start = gethrtime();
+        h1 = test_harness.create_bucket(true, cfg.c_str());
+        h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+        hrtime_t startup = gethrtime() - start;
+
+        for (int ii = 0; ii < nkeys; ii += nkeys / 100) {
+            const std::string key = bench_key(ii);
+            item *it = NULL;
+            cb_assert(h1->get(h, NULL, &it, key.c_str(), (int)key.length(),
+                              0) == ENGINE_SUCCESS);
+            h1->release(h, NULL, it);
+        }
+        std::cout << "    restart (" << mode.first << "): " << nkeys
+                  << " items, shutdown " << shutdown / 1000000 << " ms,"
+                  << " startup " << startup / 1000000 << " ms" << std::endl;
+        test_harness.destroy_bucket(h, h1, true);
+    }
+
+    remove(shm.c_str());
+    remove(snapshot.c_str());
+    return SUCCESS;
+}
+
+/*
+ * Benchmark how fast a snapshot of 200MB (200k items of 1k) is loaded,
+ * with 1, 2 and 4 loader threads. The snapshot is removed once it's
+ * loaded, so we keep a copy of it around to put back for the next run.
+ */
+static enum test_result snapshot_load_bench_test(engine_test_t *test) {
+    const int nkeys = 200000;
+    const size_t nbytes = 1000;
+    const std::string snapshot = "basic_engine_benchsuite.snapshot";
+    const std::string cfg = std::string(test->cfg) + ";snapshot_file=" +
+                            snapshot;
+    remove(snapshot.c_str());
+
+    ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(
+        true, (cfg + ";snapshot_on_shutdown=true").c_str());
+    ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    for (int ii = 0; ii < nkeys; ++ii) {
+        const std::string key = bench_key(ii);
+        item *it = NULL;
+        uint64_t cas = 0;
+        cb_assert(h1->allocate(h, NULL, &it, key.c_str(), key.length(),
+                               nbytes, 0, 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, it);
+    }
+    test_harness.destroy_bucket(h, h1, false);
+
+    std::string content;
+    {
+        std::ifstream file(snapshot, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+    }
+    cb_assert(!content.empty());
+
+    for (int nthreads = 1; nthreads <= 4; nthreads *= 2) {
+        {
+            std::ofstream file(snapshot, std::ios::binary);
+            file.write(content.data(), content.size());
+        }
+
+        const std::string threads = ";snapshot_threads=" +
+                                    std::to_string(nthreads);
+        h1 = test_harness.create_bucket(true, (cfg + threads).c_str());
+        h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, "snapshot", 8, collect_stat) == ENGINE_SUCCESS);
+        cb_assert(stat_values["snapshot:loaded_items"] == std::to_string(nkeys));
+        const uint64_t ms = std::stoull(stat_values["snapshot:load_ms"]);
+        std::cout << "    snapshot load (" << nthreads << " threads): "
+                  << content.size() / (1024 * 1024) << " MB in " << ms
+                  << " ms (" << (ms ? content.size() * 1000 / ms / (1024 * 1024) : 0)
+                  << " MB/s)" << std::endl;
+        test_harness.destroy_bucket(h, h1, true);
+    }
+
+    remove(snapshot.c_str());
+    return SUCCESS;
+}
+
+struct eviction_request {
+    std::string key;
+    size_t nbytes;
+};
+
+/*
+ * The requests replayed by the eviction bench: the trace in the file
+ * named by EVICTION_TRACE (a "<key> [<size>]" line per request), or else
+ * 1M requests for 100k keys of 1k with a Zipf (0.99) distribution.
+ */
+static std::vector<eviction_request> eviction_trace() {
+    std::vector<eviction_request> trace;
+    const char *path = getenv("EVICTION_TRACE");
+
+    if (path != NULL) {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            eviction_request request;
+            request.nbytes = 1024;
+            if (fields >> request.key) {
+                fields >> request.nbytes;
+                trace.push_back(request);
+            }
+        }
+        cb_assert(!trace.empty());
+        return trace;
+    }
+
+    const int nkeys = 100000;
+    std::vector<double> cdf(nkeys);
+    double sum = 0;
+    for (int ii = 0; ii < nkeys; ++ii) {
+        sum += 1.0 / pow(ii + 1, 0.99);
+        cdf[ii] = sum;
+    }
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    for (int ii = 0; ii < 1000000; ++ii) {
+        const int rank = int(std::lower_bound(cdf.begin(), cdf.end(),
+                                              uniform(rng)) - cdf.begin());
+        /* Don't let the popular keys sort together in the hash table */
+        eviction_request request = { bench_key(rank * 7919 % nkeys), 1024 };
+        trace.push_back(request);
+    }
+    return trace;
+}
+
+/*
+ * The hit rate of a cache too small for the working set with the LRU
+ * and the sampled eviction policies, replaying the same requests (a get,
+ * and a set if it misses).
+ */
+static enum test_result eviction_bench_test(engine_test_t *test) {
+    const std::vector<eviction_request> trace = eviction_trace();
+    const char *policies[] = { "lru", "sampled" };
+
+    for (const char *policy : policies) {
+        const std::string cfg = std::string(test->cfg) +
+                                ";eviction_policy=" + policy;
+        ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, cfg.c_str());
+        ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+        uint64_t hits = 0;
+
+        hrtime_t start = gethrtime();
+        for (const auto& request : trace) {
+            item *it = NULL;
+            uint64_t cas = 0;
+            if (h1->get(h, NULL, &it, request.key.c_str(),
+                        (int)request.key.length(), 0) == ENGINE_SUCCESS) {
+                ++hits;
+            } else if (h1->allocate(h, NULL, &it, request.key.c_str(),
+                                    request.key.length(), request.nbytes,
+                                    0, 0, PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS) {
+                cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+            } else {
+                continue;
+            }
+            h1->release(h, NULL, it);
+        }
+        hrtime_t elapsed = gethrtime() - start;
+
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+        std::cout << "    eviction (" << policy << "): " << trace.size()
+                  << " requests, hit rate "
+                  << 100.0 * hits / trace.size() << "%, "
+                  << stat_values["evictions"] << " evictions, "
+                  << elapsed / trace.size() << " ns/request" << std::endl;
+        test_harness.destroy_bucket(h, h1, true);
+    }
+    return SUCCESS;
+}
+
+MEMCACHED_PUBLIC_API
+engine_test_t* get_tests(void) {
+    static engine_test_t tests[]  = {
+        TEST_CASE("mt get bench", mt_get_bench_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("mt mixed bench", mt_mixed_bench_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("mt set bench", mt_set_bench_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("mt get bench (malloc)", mt_get_big_bench_test, NULL, NULL, "cache_size=134217728", NULL, NULL),
+        TEST_CASE("mt get bench (huge pages)", mt_get_huge_pages_bench_test, NULL, NULL, "cache_size=134217728;huge_pages=transparent;numa_policy=interleave", NULL, NULL),
+        TEST_CASE_V2("restart bench", restart_bench_test, NULL, NULL, "cache_size=268435456", NULL, NULL),
+        TEST_CASE_V2("snapshot load bench", snapshot_load_bench_test, NULL, NULL, "cache_size=536870912", NULL, NULL),
+        TEST_CASE_V2("eviction bench", eviction_bench_test, NULL, NULL, "cache_size=33554432", NULL, NULL),
+        TEST_CASE(NULL, NULL, NULL, NULL, NULL, NULL, NULL)
+    };
+    return tests;
+}
+
+MEMCACHED_PUBLIC_API
+bool setup_suite(struct test_harness *th) {
+    test_harness = *th;
+    return true;
+}
@@ -22,7 +22,12 @@
 #include <platform/platform.h>
 #include "basic_engine_testsuite.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <random>
+#include <set>
 #include <vector>
 #include <sstream>
 
@@ -527,6 +532,93 @@ static enum test_result item_set_cas_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1
     return SUCCESS;
 }
 
+/*
+ * Values larger than the largest slab class are stored in a chain of
+ * chunks, and get_item_info returns one iovec per chunk.
+ */
+union large_item_info {
+    item_info info;
+    char bytes[sizeof(item_info) + 31 * sizeof(struct iovec)];
+};
+
+static void large_item_fill(item_info *info, size_t offset) {
+    for (uint16_t ii = 0; ii < info->nvalue; ++ii) {
+        char *ptr = static_cast<char*>(info->value[ii].iov_base);
+        for (size_t jj = 0; jj < info->value[ii].iov_len; ++jj) {
+            ptr[jj] = char((offset++) % 251);
+        }
+    }
+}
+
+static bool large_item_check(const item_info *info, size_t offset,
+                             size_t nbytes) {
+    size_t total = 0;
+    for (uint16_t ii = 0; ii < info->nvalue; ++ii) {
+        const char *ptr = static_cast<const char*>(info->value[ii].iov_base);
+        for (size_t jj = 0; jj < info->value[ii].iov_len; ++jj, ++total) {
+            if (ptr[jj] != char((offset + total) % 251)) {
+                return false;
+            }
+        }
+    }
+    return total == nbytes;
+}
+
+static enum test_result large_item_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const char *key = "large_item_test_key";
+    const size_t nbytes = 3 * 1024 * 1024 + 17;
+    union large_item_info holder;
+    item_info *info = &holder.info;
+    item *it = NULL;
+    uint64_t cas = 0;
+
+    /* Too large for the configured item_size_max */
+    cb_assert(h1->allocate(h, NULL, &it, key, strlen(key), 5 * 1024 * 1024,
+                           0, 0, PROTOCOL_BINARY_RAW_BYTES) == ENGINE_E2BIG);
+
+    cb_assert(h1->allocate(h, NULL, &it, key, strlen(key), nbytes, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    /* A single iovec can't describe the value */
+    info->nvalue = 1;
+    cb_assert(h1->get_item_info(h, NULL, it, info) == false);
+    info->nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, info) == true);
+    cb_assert(info->nvalue > 1);
+    assert_equal(uint32_t(nbytes), info->nbytes);
+    large_item_fill(info, 0);
+    cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+
+    cb_assert(h1->get(h, NULL, &it, key, (int)strlen(key), 0) == ENGINE_SUCCESS);
+    info->nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, info) == true);
+    cb_assert(large_item_check(info, 0, nbytes));
+    h1->release(h, NULL, it);
+
+    /* Append a small value, which has to be copied into a new chain */
+    cb_assert(h1->allocate(h, NULL, &it, key, strlen(key), 100, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    info->nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, info) == true);
+    assert_equal(uint16_t(1), info->nvalue);
+    large_item_fill(info, nbytes);
+    cb_assert(h1->store(h, NULL, it, &cas, OPERATION_APPEND, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+
+    cb_assert(h1->get(h, NULL, &it, key, (int)strlen(key), 0) == ENGINE_SUCCESS);
+    info->nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, info) == true);
+    cb_assert(large_item_check(info, 0, nbytes + 100));
+    h1->release(h, NULL, it);
+
+    /* The chunks are given back when the item is removed */
+    mutation_descr_t mut_info;
+    cas = 0;
+    cb_assert(h1->remove(h, NULL, key, strlen(key), &cas, 0, &mut_info) == ENGINE_SUCCESS);
+    cb_assert(h1->get(h, NULL, &it, key, (int)strlen(key), 0) == ENGINE_KEY_ENOENT);
+    return SUCCESS;
+}
+
 uint32_t evictions;
 static void eviction_stats_handler(const char *key, const uint16_t klen,
                                    const char *val, const uint32_t vlen,
@@ -608,6 +700,413 @@ static enum test_result aggregate_stats_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1
     return PENDING;
 }
 
+static std::map<std::string, std::string> stat_values;
+
+static void collect_stat(const char *key, const uint16_t klen,
+                         const char *val, const uint32_t vlen,
+                         const void *cookie) {
+    stat_values[std::string(key, klen)] = std::string(val, vlen);
+}
+
+/*
+ * With huge_pages set the slab memory is mapped from the OS up front
+ * instead of coming from malloc (the OS may not give us huge pages, but
+ * the cache is always mapped).
+ */
+static enum test_result huge_pages_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    item *it = NULL;
+    uint64_t cas = 0;
+    char key[32];
+    size_t keylen;
+    int ii;
+
+    for (ii = 0; ii < 1000; ++ii) {
+        keylen = snprintf(key, sizeof(key), "huge_pages_%d", ii);
+        cb_assert(h1->allocate(h, NULL, &it, key, keylen, 100, 0, 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, it);
+    }
+    for (ii = 0; ii < 1000; ++ii) {
+        keylen = snprintf(key, sizeof(key), "huge_pages_%d", ii);
+        cb_assert(h1->get(h, NULL, &it, key, (int)keylen, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, it);
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "slabs", 5, collect_stat) == ENGINE_SUCCESS);
+    cb_assert(stat_values["slab_memory_mapped"] != "0");
+    return SUCCESS;
+}
+
+/*
+ * The hash table should be sized for the expected number of items up
+ * front (the test runs with expected_items=1000000)
+ */
+static enum test_result hash_stats_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "hash", 4, collect_stat) == ENGINE_SUCCESS);
+    cb_assert(stat_values["hash_power_level"] == "18");
+    cb_assert(stat_values["hash_is_expanding"] == "0");
+    cb_assert(stat_values["hash_expansions"] == "0");
+    return SUCCESS;
+}
+
+/*
+ * The key is stored inline after the item header; make sure keys of all
+ * lengths survive, and that the overhead stats add up.
+ */
+static enum test_result overhead_stats_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nitems = 250;
+    std::string key;
+
+    for (int ii = 1; ii <= nitems; ++ii) {
+        item *test_item = NULL;
+        uint64_t cas = 0;
+        key.assign(ii, 'a' + (ii % 26));
+        cb_assert(h1->allocate(h, NULL, &test_item, key.data(), key.length(),
+                               ii, 0, 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, test_item, &cas, OPERATION_SET,
+                            0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+
+    for (int ii = 1; ii <= nitems; ++ii) {
+        item *test_item = NULL;
+        item_info info;
+        info.nvalue = 1;
+        key.assign(ii, 'a' + (ii % 26));
+        cb_assert(h1->get(h, NULL, &test_item, key.data(), (int)key.length(),
+                          0) == ENGINE_SUCCESS);
+        cb_assert(h1->get_item_info(h, NULL, test_item, &info));
+        assert_equal(uint16_t(ii), info.nkey);
+        cb_assert(memcmp(info.key, key.data(), ii) == 0);
+        assert_equal(uint32_t(ii), info.nbytes);
+        h1->release(h, NULL, test_item);
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "overhead", 8, collect_stat) == ENGINE_SUCCESS);
+    const int header = atoi(stat_values["overhead:header_bytes"].c_str());
+    const int legacy = atoi(stat_values["overhead:legacy_header_bytes"].c_str());
+    const int saved = atoi(stat_values["overhead:bytes_saved_per_item"].c_str());
+    cb_assert(header > 0 && saved > 0);
+    assert_equal(legacy, header + saved);
+    assert_equal(nitems, atoi(stat_values["overhead:items"].c_str()));
+    assert_equal(nitems * saved,
+                 atoi(stat_values["overhead:bytes_saved"].c_str()));
+    cb_assert(stat_values.find("overhead:chunk_bytes_saved") != stat_values.end());
+    return SUCCESS;
+}
+
+/*
+ * Expired items should be reclaimed in the background (by the expiry
+ * wheel) without anyone asking for them.
+ */
+static enum test_result expiry_wheel_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nexpiring = 1000;
+    const int nlive = 100;
+    int ii;
+
+    for (ii = 0; ii < nexpiring + nlive; ++ii) {
+        item *test_item = NULL;
+        uint64_t cas = 0;
+        std::stringstream ss;
+        ss << "expiry_wheel_" << ii;
+        const std::string key = ss.str();
+        cb_assert(h1->allocate(h, NULL, &test_item, key.data(), key.length(),
+                               1, 0, ii < nexpiring ? 10 : 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, test_item, &cas, OPERATION_SET,
+                            0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(nexpiring, atoi(stat_values["expiry_wheel_items"].c_str()));
+
+    test_harness.time_travel(11);
+
+    /* The LRU maintainer runs (at least) once a second. curr_items is
+     * collected before the expiry stats (and not under items.lock), so
+     * the wheel may run in between: wait for all of the stats we check. */
+    for (ii = 0; ii < 10000; ++ii) {
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+        if (atoi(stat_values["expired_reclaimed"].c_str()) == nexpiring &&
+            atoi(stat_values["curr_items"].c_str()) == nlive &&
+            stat_values["expiry_wheel_items"] == "0") {
+            break;
+        }
+        usleep(1000);
+    }
+    assert_equal(nexpiring, atoi(stat_values["expired_reclaimed"].c_str()));
+    assert_equal(nlive, atoi(stat_values["curr_items"].c_str()));
+    assert_equal(std::string("0"), stat_values["expiry_wheel_items"]);
+    return SUCCESS;
+}
+
+struct cas_test_ctx {
+    ENGINE_HANDLE *h;
+    int id;
+    std::vector<uint64_t> cas;
+};
+
+static void cas_test_main(void *arg) {
+    struct cas_test_ctx *ctx = static_cast<struct cas_test_ctx*>(arg);
+    ENGINE_HANDLE_V1 *h1 = reinterpret_cast<ENGINE_HANDLE_V1*>(ctx->h);
+    int ii;
+
+    for (ii = 0; ii < 1000; ++ii) {
+        item *test_item = NULL;
+        uint64_t cas = 0;
+        std::stringstream ss;
+        ss << "cas_test_" << ctx->id << "_" << ii;
+        const std::string key = ss.str();
+        cb_assert(h1->allocate(ctx->h, NULL, &test_item, key.data(),
+                               key.length(), 1, 0, 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(ctx->h, NULL, test_item, &cas, OPERATION_SET,
+                            0) == ENGINE_SUCCESS);
+        h1->release(ctx->h, NULL, test_item);
+        ctx->cas.push_back(cas);
+    }
+}
+
+/*
+ * The CAS ids are handed out to the threads in batches, and the stats
+ * are counted per thread. Make sure the CAS ids are still unique and the
+ * stats add up.
+ */
+static enum test_result mt_cas_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nthreads = 8;
+    std::vector<cb_thread_t> tids(nthreads);
+    std::vector<struct cas_test_ctx> ctx(nthreads);
+    std::set<uint64_t> seen;
+    int ii;
+
+    for (ii = 0; ii < nthreads; ++ii) {
+        ctx[ii].h = h;
+        ctx[ii].id = ii;
+        cb_assert(cb_create_thread(&tids[ii], cas_test_main, &ctx[ii], 0) == 0);
+    }
+    for (ii = 0; ii < nthreads; ++ii) {
+        cb_assert(cb_join_thread(tids[ii]) == 0);
+        for (auto cas : ctx[ii].cas) {
+            cb_assert(cas != 0);
+            cb_assert(seen.insert(cas).second);
+        }
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(nthreads * 1000, atoi(stat_values["curr_items"].c_str()));
+    assert_equal(nthreads * 1000, atoi(stat_values["total_items"].c_str()));
+    return SUCCESS;
+}
+
+static void update_store(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                         const char *key, const std::string &value,
+                         ENGINE_STORE_OPERATION operation) {
+    item *it = NULL;
+    uint64_t cas = 0;
+    item_info info;
+    info.nvalue = 1;
+    cb_assert(h1->allocate(h, NULL, &it, key, strlen(key), value.length(),
+                           0, 0, PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, it, &info) == true);
+    memcpy(info.value[0].iov_base, value.data(), value.length());
+    cb_assert(h1->store(h, NULL, it, &cas, operation, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+}
+
+static std::string update_get(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                              const char *key) {
+    item *it = NULL;
+    item_info info;
+    info.nvalue = 1;
+    cb_assert(h1->get(h, NULL, &it, key, (int)strlen(key), 0) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, it, &info) == true);
+    std::string ret(static_cast<char*>(info.value[0].iov_base),
+                    info.value[0].iov_len);
+    h1->release(h, NULL, it);
+    return ret;
+}
+
+/*
+ * Append, prepend and incr/decr modify the item in place as long as it
+ * fits in its slab chunk, and allocate a new item when it doesn't.
+ */
+static enum test_result update_in_place_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const std::string big(2000, 'z');
+    item *it = NULL;
+    uint64_t res = 0;
+    int ii;
+
+    update_store(h, h1, "update_log", "a", OPERATION_SET);
+    for (ii = 0; ii < 8; ++ii) {
+        update_store(h, h1, "update_log", "b", OPERATION_APPEND);
+    }
+    update_store(h, h1, "update_log", "c", OPERATION_PREPEND);
+    assert_equal(std::string("cabbbbbbbb"), update_get(h, h1, "update_log"));
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(std::string("9"), stat_values["updates_in_place"]);
+    assert_equal(std::string("0"), stat_values["updates_realloc"]);
+
+    /* Doesn't fit in the chunk */
+    update_store(h, h1, "update_log", big, OPERATION_APPEND);
+    assert_equal(std::string("cabbbbbbbb") + big,
+                 update_get(h, h1, "update_log"));
+
+    /* The counter grows into the slack of the chunk */
+    update_store(h, h1, "update_counter", "9", OPERATION_SET);
+    cb_assert(h1->arithmetic(h, NULL, "update_counter", 14, true, false, 1, 0,
+                             0, &it, PROTOCOL_BINARY_RAW_BYTES,
+                             &res, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+    assert_equal(uint64_t(10), res);
+    assert_equal(std::string("10"), update_get(h, h1, "update_counter"));
+    cb_assert(h1->arithmetic(h, NULL, "update_counter", 14, false, false, 5, 0,
+                             0, &it, PROTOCOL_BINARY_RAW_BYTES,
+                             &res, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+    assert_equal(std::string("5 "), update_get(h, h1, "update_counter"));
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(std::string("11"), stat_values["updates_in_place"]);
+    assert_equal(std::string("1"), stat_values["updates_realloc"]);
+    return SUCCESS;
+}
+
+/*
+ * flush_all only bumps the generation, and the LRU maintainer sweeps the
+ * flushed items out in the background. Items stored after the flush
+ * must survive the sweep.
+ */
+static enum test_result flush_sweep_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nflushed = 1000;
+    const int nlive = 100;
+    item *test_item = NULL;
+    uint64_t cas = 0;
+    int ii;
+
+    for (ii = 0; ii < nflushed + nlive; ++ii) {
+        std::stringstream ss;
+        ss << "flush_sweep_" << ii;
+        const std::string key = ss.str();
+        if (ii == nflushed) {
+            cb_assert(h1->flush(h, NULL, 0) == ENGINE_SUCCESS);
+        }
+        cb_assert(h1->allocate(h, NULL, &test_item, key.data(), key.length(),
+                               1, 0, 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, test_item, &cas, OPERATION_SET,
+                            0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+
+    test_item = NULL;
+    cb_assert(h1->get(h, NULL, &test_item, "flush_sweep_0", 13,
+                      0) == ENGINE_KEY_ENOENT);
+
+    for (ii = 0; ii < 5000; ++ii) {
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+        if (stat_values["flush_sweep"] == "stopped") {
+            break;
+        }
+        usleep(1000);
+    }
+    assert_equal(std::string("stopped"), stat_values["flush_sweep"]);
+    assert_equal(nlive, atoi(stat_values["curr_items"].c_str()));
+
+    for (ii = nflushed; ii < nflushed + nlive; ++ii) {
+        std::stringstream ss;
+        ss << "flush_sweep_" << ii;
+        const std::string key = ss.str();
+        cb_assert(h1->get(h, NULL, &test_item, key.data(), (int)key.length(),
+                          0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+    return SUCCESS;
+}
+
+static void lru_scan_store(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                           const char *key, size_t keylen) {
+    item *test_item = NULL;
+    uint64_t cas = 0;
+    cb_assert(h1->allocate(h, NULL, &test_item, key, keylen, 4096, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    cb_assert(h1->store(h, NULL, test_item,
+                        &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, test_item);
+}
+
+/*
+ * Writing a lot of keys which are never read shouldn't push the keys
+ * being read out of the cache (the test runs with a single slab page
+ * per class, so the scan is ~10 times the size of the cache)
+ */
+static enum test_result lru_scan_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int hot_keys = 32;
+    item *test_item = NULL;
+    char key[1024];
+    size_t keylen;
+    uint64_t moves = 0;
+    int ii;
+    int jj;
+
+    for (ii = 0; ii < hot_keys; ++ii) {
+        keylen = snprintf(key, sizeof(key), "lru_hot_key_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+    }
+
+    for (ii = 0; ii < 2000; ++ii) {
+        if ((ii % 64) == 0) {
+            for (jj = 0; jj < hot_keys; ++jj) {
+                keylen = snprintf(key, sizeof(key), "lru_hot_key_%08d", jj);
+                cb_assert(h1->get(h, NULL, &test_item,
+                                  key, (int)keylen, 0) == ENGINE_SUCCESS);
+                h1->release(h, NULL, test_item);
+            }
+        }
+        keylen = snprintf(key, sizeof(key), "lru_scan_key_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+    }
+
+    for (ii = 0; ii < hot_keys; ++ii) {
+        keylen = snprintf(key, sizeof(key), "lru_hot_key_%08d", ii);
+        cb_assert(h1->get(h, NULL, &test_item,
+                          key, (int)keylen, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+
+    cb_assert(h1->get_stats(h, NULL, NULL, 0,
+                            eviction_stats_handler) == ENGINE_SUCCESS);
+    cb_assert(evictions > 0);
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "items", 5,
+                            collect_stat) == ENGINE_SUCCESS);
+    for (std::map<std::string, std::string>::iterator iter = stat_values.begin();
+         iter != stat_values.end(); ++iter) {
+        const std::string &name = iter->first;
+        const std::string suffix(":moves_to_warm");
+        if (name.length() > suffix.length() &&
+            name.compare(name.length() - suffix.length(),
+                         suffix.length(), suffix) == 0) {
+            moves += strtoull(iter->second.c_str(), NULL, 10);
+        }
+    }
+    cb_assert(moves >= (uint64_t)hot_keys);
+    return SUCCESS;
+}
+
 static protocol_binary_response_header *last_response;
 
 static void release_last_response(void) {
@@ -870,6 +1369,205 @@ static enum test_result gatq_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     return SUCCESS;
 }
 
+/*
+ * The daemon uses get_and_touch for GAT/GATQ instead of going through
+ * unknown_command
+ */
+static enum test_result get_and_touch_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    item *item = NULL;
+    const char* key = "get_test_key";
+    int keylen = (int)strlen(key);
+    item_info info;
+
+    cb_assert(h1->get_and_touch != NULL);
+    cb_assert(h1->get_and_touch(h, NULL, &item, key, keylen, 10, 0) ==
+              ENGINE_KEY_ENOENT);
+
+    /* store and get a key */
+    cb_assert(get_test(h, h1) == SUCCESS);
+
+    /* Set expiry time to 10 secs, and we should get the item back */
+    cb_assert(h1->get_and_touch(h, NULL, &item, key, keylen, 10, 0) ==
+              ENGINE_SUCCESS);
+    info.nvalue = 1;
+    cb_assert(h1->get_item_info(h, NULL, item, &info));
+    cb_assert(info.nkey == keylen);
+    cb_assert(memcmp(info.key, key, keylen) == 0);
+    cb_assert(info.exptime != 0);
+    h1->release(h, NULL, item);
+
+    /* time-travel 11 secs.. */
+    test_harness.time_travel(11);
+
+    /* The item should have expired now... */
+    cb_assert(h1->get(h, NULL, &item, key, keylen, 0) == ENGINE_KEY_ENOENT);
+    cb_assert(h1->get_and_touch(h, NULL, &item, key, keylen, 10, 0) ==
+              ENGINE_KEY_ENOENT);
+
+    return SUCCESS;
+}
+
+static uint16_t slab_reassign(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                              uint32_t src, uint32_t dst) {
+    protocol_binary_request_slab_reassign r;
+    uint16_t status;
+
+    memset(&r, 0, sizeof(r));
+    r.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    r.message.header.request.opcode = PROTOCOL_BINARY_CMD_SLAB_REASSIGN;
+    r.message.header.request.extlen = 8;
+    r.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    r.message.header.request.bodylen = htonl(8);
+    r.message.body.src = htonl(src);
+    r.message.body.dst = htonl(dst);
+
+    cb_assert(h1->unknown_command(h, NULL, &r.message.header,
+                                  response_handler) == ENGINE_SUCCESS);
+    cb_assert(last_response != NULL);
+    status = ntohs(last_response->response.status);
+    release_last_response();
+    return status;
+}
+
+/*
+ * The scrub is split up by slab class, and its progress is reported in
+ * the scrub stats. The expired items may be reclaimed by either the
+ * scrubber or the LRU maintainer.
+ */
+static enum test_result scrub_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nexpiring = 500;
+    const int nlive = 100;
+    protocol_binary_request_no_extras r;
+    int ii;
+
+    for (ii = 0; ii < nexpiring + nlive; ++ii) {
+        item *test_item = NULL;
+        uint64_t cas = 0;
+        std::stringstream ss;
+        ss << "scrub_" << ii;
+        const std::string key = ss.str();
+        /* Spread the items over a few slab classes */
+        cb_assert(h1->allocate(h, NULL, &test_item, key.data(), key.length(),
+                               1 + (ii % 4) * 1000, 0, ii < nexpiring ? 1 : 0,
+                               PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+        cb_assert(h1->store(h, NULL, test_item, &cas, OPERATION_SET,
+                            0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+    test_harness.time_travel(3);
+
+    memset(&r, 0, sizeof(r));
+    r.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    r.message.header.request.opcode = PROTOCOL_BINARY_CMD_SCRUB;
+    r.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    cb_assert(h1->unknown_command(h, NULL, &r.message.header,
+                                  response_handler) == ENGINE_SUCCESS);
+    cb_assert(last_response != NULL);
+    cb_assert(ntohs(last_response->response.status) ==
+              PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    release_last_response();
+
+    for (ii = 0; ii < 10000; ++ii) {
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, "scrub", 5,
+                                collect_stat) == ENGINE_SUCCESS);
+        if (stat_values["scrubber:status"] == "stopped") {
+            break;
+        }
+        usleep(1000);
+    }
+    assert_equal(std::string("stopped"), stat_values["scrubber:status"]);
+    cb_assert(stat_values["scrubber:classes_total"] != "0");
+    assert_equal(stat_values["scrubber:classes_total"],
+                 stat_values["scrubber:classes_done"]);
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(nlive, atoi(stat_values["curr_items"].c_str()));
+    return SUCCESS;
+}
+
+/*
+ * Move a slab page from the class holding our items to the smallest
+ * slab class, and verify that the items in it are evicted and that the
+ * page may be used by the new class.
+ */
+static enum test_result slab_reassign_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int nitems = 1000;
+    item *test_item = NULL;
+    char key[1024];
+    size_t keylen;
+    unsigned int src = 0;
+    unsigned int pages = 0;
+    uint64_t evicted;
+    int found = 0;
+    int ii;
+
+    for (ii = 0; ii < nitems; ++ii) {
+        keylen = snprintf(key, sizeof(key), "slab_reassign_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "slabs", 5,
+                            collect_stat) == ENGINE_SUCCESS);
+    for (ii = 2; ii < 200 && src == 0; ++ii) {
+        std::stringstream ss;
+        ss << ii << ":total_pages";
+        if (stat_values.find(ss.str()) != stat_values.end()) {
+            src = ii;
+            pages = atoi(stat_values[ss.str()].c_str());
+        }
+    }
+    cb_assert(src != 0 && pages > 2);
+    cb_assert(stat_values.find("1:total_pages") == stat_values.end());
+
+    cb_assert(slab_reassign(h, h1, src, src) == PROTOCOL_BINARY_RESPONSE_EINVAL);
+    cb_assert(slab_reassign(h, h1, src, 1000) == PROTOCOL_BINARY_RESPONSE_EINVAL);
+    cb_assert(slab_reassign(h, h1, 1, src) == PROTOCOL_BINARY_RESPONSE_ENOMEM);
+    cb_assert(slab_reassign(h, h1, src, 1) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
+    /* The move is performed in the background */
+    for (ii = 0; ii < 10000; ++ii) {
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, "slabs", 5,
+                                collect_stat) == ENGINE_SUCCESS);
+        if (stat_values["slabs_moved"] == "1") {
+            break;
+        }
+        usleep(1000);
+    }
+    cb_assert(stat_values["slabs_moved"] == "1");
+    cb_assert(stat_values["slab_reassign_bytes"] == "1048576");
+    cb_assert(stat_values["1:total_pages"] == "1");
+    cb_assert(stat_values["1:free_chunks"] == stat_values["1:chunks_per_page"]);
+    {
+        std::stringstream ss;
+        ss << src << ":total_pages";
+        cb_assert(atoi(stat_values[ss.str()].c_str()) == (int)pages - 1);
+    }
+    evicted = strtoull(stat_values["slab_reassign_evictions"].c_str(), NULL, 10);
+    cb_assert(evicted > 0);
+
+    for (ii = 0; ii < nitems; ++ii) {
+        keylen = snprintf(key, sizeof(key), "slab_reassign_%08d", ii);
+        if (h1->get(h, NULL, &test_item, key, (int)keylen, 0) == ENGINE_SUCCESS) {
+            h1->release(h, NULL, test_item);
+            ++found;
+        }
+    }
+    cb_assert(found + evicted == (uint64_t)nitems);
+
+    /* The small items should be stored in the page we moved */
+    cb_assert(store_test(h, h1) == SUCCESS);
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "slabs", 5,
+                            collect_stat) == ENGINE_SUCCESS);
+    cb_assert(stat_values["1:total_pages"] == "1");
+    cb_assert(stat_values["1:used_chunks"] == "1");
+    return SUCCESS;
+}
+
 static enum test_result test_datatype(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     item *test_item = NULL;
     const char* key = "{foo:1}";
@@ -959,6 +1657,465 @@ static enum test_result test_bucket_destroy_interleaved(engine_test_t *test) {
     return SUCCESS;
 }
 
+static void snapshot_store(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                           const std::string &key, size_t nbytes,
+                           int flags, rel_time_t exptime) {
+    union large_item_info holder;
+    item *it = NULL;
+    uint64_t cas = 0;
+
+    cb_assert(h1->allocate(h, NULL, &it, key.c_str(), key.length(), nbytes,
+                           flags, exptime,
+                           PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    holder.info.nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, &holder.info));
+    large_item_fill(&holder.info, flags);
+    cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+}
+
+static bool snapshot_check(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                           const std::string &key, size_t nbytes, int flags) {
+    union large_item_info holder;
+    item *it = NULL;
+
+    if (h1->get(h, NULL, &it, key.c_str(), (int)key.length(), 0) != ENGINE_SUCCESS) {
+        return false;
+    }
+    holder.info.nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, &holder.info));
+    cb_assert(holder.info.flags == (uint32_t)flags);
+    cb_assert(large_item_check(&holder.info, flags, nbytes));
+    h1->release(h, NULL, it);
+    return true;
+}
+
+static void snapshot_wait(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    do {
+        usleep(1000);
+        stat_values.clear();
+        cb_assert(h1->get_stats(h, NULL, "snapshot", 8, collect_stat) == ENGINE_SUCCESS);
+    } while (stat_values["snapshot:status"] != "stopped");
+}
+
+/*
+ * The items written to the snapshot should be there when the bucket is
+ * created again, and the snapshot should only be loaded once.
+ */
+static enum test_result snapshot_test(engine_test_t *test) {
+    const int n_keys = 1000;
+    const std::string file = "basic_engine_testsuite.snapshot";
+    const std::string cfg = std::string(test->cfg) + ";snapshot_file=" + file;
+    protocol_binary_request_no_extras request;
+
+    remove(file.c_str());
+    ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, cfg.c_str());
+    ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+
+    for (int ii = 0; ii < n_keys; ii++) {
+        std::stringstream ss;
+        ss << "KEY" << ii;
+        snapshot_store(h, h1, ss.str(), ii, ii, 0);
+    }
+    /* A chunked item, and one which will have expired when we load */
+    snapshot_store(h, h1, "large", 3 * 1024 * 1024, 7, 0);
+    snapshot_store(h, h1, "expiring", 10, 1, 10);
+
+    memset(&request, 0, sizeof(request));
+    request.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    request.message.header.request.opcode = PROTOCOL_BINARY_CMD_SNAPSHOT;
+    request.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    cb_assert(h1->unknown_command(h, NULL, &request.message.header,
+                                  response_handler) == ENGINE_SUCCESS);
+    cb_assert(last_response != NULL);
+    cb_assert(ntohs(last_response->response.status) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    release_last_response();
+
+    snapshot_wait(h, h1);
+    cb_assert(stat_values["snapshot:last_status"] == "ok");
+    cb_assert(stat_values["snapshot:items"] == std::to_string(n_keys + 2));
+    test_harness.destroy_bucket(h, h1, true);
+
+    test_harness.time_travel(11);
+
+    /* Write it again when we shut down */
+    h1 = test_harness.create_bucket(true, (cfg + ";snapshot_on_shutdown=true").c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "snapshot", 8, collect_stat) == ENGINE_SUCCESS);
+    cb_assert(stat_values["snapshot:loaded_items"] == std::to_string(n_keys + 1));
+    cb_assert(stat_values["snapshot:load_skipped"] == "1");
+    for (int ii = 0; ii < n_keys; ii++) {
+        std::stringstream ss;
+        ss << "KEY" << ii;
+        cb_assert(snapshot_check(h, h1, ss.str(), ii, ii));
+    }
+    cb_assert(snapshot_check(h, h1, "large", 3 * 1024 * 1024, 7));
+    cb_assert(!snapshot_check(h, h1, "expiring", 10, 1));
+    test_harness.destroy_bucket(h, h1, false);
+
+    h1 = test_harness.create_bucket(true, cfg.c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    cb_assert(snapshot_check(h, h1, "KEY10", 10, 10));
+    cb_assert(snapshot_check(h, h1, "large", 3 * 1024 * 1024, 7));
+    test_harness.destroy_bucket(h, h1, true);
+
+    /* It's gone once it's loaded */
+    h1 = test_harness.create_bucket(true, cfg.c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    cb_assert(!snapshot_check(h, h1, "KEY10", 10, 10));
+    test_harness.destroy_bucket(h, h1, true);
+
+    return SUCCESS;
+}
+
+/* Keep the cache in memory (where it belongs) if we can */
+static std::string shm_test_file() {
+    if (access("/dev/shm", W_OK) == 0) {
+        return "/dev/shm/basic_engine_testsuite.shm";
+    }
+    return "basic_engine_testsuite.shm";
+}
+
+static void shm_stats(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "slabs", 5, collect_stat) == ENGINE_SUCCESS);
+}
+
+/*
+ * The cache in shm_file should be re-attached to when the bucket is
+ * created again with the same configuration, without the items which
+ * expired or were flushed in the meantime.
+ */
+static enum test_result shm_test(engine_test_t *test) {
+    const int n_keys = 1000;
+    const std::string file = shm_test_file();
+    const std::string cfg = std::string(test->cfg) + ";shm_file=" + file;
+
+    remove(file.c_str());
+    ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, cfg.c_str());
+    ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    shm_stats(h, h1);
+    assert_equal(std::string("0"), stat_values["slab_shm_attached"]);
+
+    for (int ii = 0; ii < n_keys; ii++) {
+        std::stringstream ss;
+        ss << "KEY" << ii;
+        snapshot_store(h, h1, ss.str(), ii, ii, 0);
+    }
+    /* A chunked item, and one which will have expired when we come back */
+    snapshot_store(h, h1, "large", 3 * 1024 * 1024, 7, 0);
+    snapshot_store(h, h1, "expiring", 10, 1, 10);
+    test_harness.destroy_bucket(h, h1, false);
+
+    test_harness.time_travel(11);
+
+    h1 = test_harness.create_bucket(true, cfg.c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    shm_stats(h, h1);
+    assert_equal(std::string("1"), stat_values["slab_shm_attached"]);
+    assert_equal(std::to_string(n_keys + 1), stat_values["slab_shm_items"]);
+    assert_equal(std::string("1"), stat_values["slab_shm_expired"]);
+    assert_equal(std::string("0"), stat_values["slab_shm_dropped"]);
+    for (int ii = 0; ii < n_keys; ii++) {
+        std::stringstream ss;
+        ss << "KEY" << ii;
+        cb_assert(snapshot_check(h, h1, ss.str(), ii, ii));
+    }
+    cb_assert(snapshot_check(h, h1, "large", 3 * 1024 * 1024, 7));
+    cb_assert(!snapshot_check(h, h1, "expiring", 10, 1));
+
+    /* The items flushed stay flushed, even if we don't shut down cleanly */
+    cb_assert(h1->flush(h, NULL, 0) == ENGINE_SUCCESS);
+    snapshot_store(h, h1, "after flush", 100, 3, 0);
+    test_harness.destroy_bucket(h, h1, true);
+
+    h1 = test_harness.create_bucket(true, cfg.c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    shm_stats(h, h1);
+    assert_equal(std::string("1"), stat_values["slab_shm_items"]);
+    cb_assert(!snapshot_check(h, h1, "KEY10", 10, 10));
+    cb_assert(!snapshot_check(h, h1, "large", 3 * 1024 * 1024, 7));
+    cb_assert(snapshot_check(h, h1, "after flush", 100, 3));
+    test_harness.destroy_bucket(h, h1, false);
+
+    /* The cache is discarded if the slab classes don't match */
+    h1 = test_harness.create_bucket(true, (cfg + ";factor=1.5").c_str());
+    h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    shm_stats(h, h1);
+    assert_equal(std::string("0"), stat_values["slab_shm_attached"]);
+    cb_assert(!snapshot_check(h, h1, "after flush", 100, 3));
+    test_harness.destroy_bucket(h, h1, false);
+
+    remove(file.c_str());
+    return SUCCESS;
+}
+
+static void compress_store(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                           const std::string &key, size_t nbytes,
+                           size_t offset, uint8_t datatype,
+                           ENGINE_STORE_OPERATION operation,
+                           bool random = false) {
+    union large_item_info holder;
+    item *it = NULL;
+    uint64_t cas = 0;
+
+    cb_assert(h1->allocate(h, NULL, &it, key.c_str(), key.length(), nbytes,
+                           0, 0, datatype) == ENGINE_SUCCESS);
+    holder.info.nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, &holder.info));
+    large_item_fill(&holder.info, offset);
+    if (random) {
+        for (uint16_t ii = 0; ii < holder.info.nvalue; ++ii) {
+            char *ptr = static_cast<char*>(holder.info.value[ii].iov_base);
+            for (size_t jj = 0; jj < holder.info.value[ii].iov_len; ++jj) {
+                ptr[jj] = char(rand());
+            }
+        }
+    }
+    cb_assert(h1->store(h, NULL, it, &cas, operation, 0) == ENGINE_SUCCESS);
+    h1->release(h, NULL, it);
+}
+
+/* Get the value of the item as it is stored */
+static void compress_get(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
+                         const std::string &key,
+                         union large_item_info *holder) {
+    item *it = NULL;
+
+    cb_assert(h1->get(h, NULL, &it, key.c_str(), (int)key.length(), 0) == ENGINE_SUCCESS);
+    holder->info.nvalue = 32;
+    cb_assert(h1->get_item_info(h, NULL, it, &holder->info));
+    h1->release(h, NULL, it);
+}
+
+/*
+ * Values of at least compression_min_size bytes which compress well are
+ * stored compressed, and inflated by the engine to append to them.
+ */
+static enum test_result compression_test(engine_test_t *test) {
+    ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, test->cfg);
+    ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    union large_item_info holder;
+    item *it = NULL;
+    uint64_t cas = 0;
+
+    compress_store(h, h1, "append", 8192, 0, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_SET);
+    compress_get(h, h1, "append", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_DATATYPE_COMPRESSED),
+                 holder.info.datatype);
+    cb_assert(holder.info.nbytes < 8192 / 4);
+    compress_store(h, h1, "append", 100, 8192, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_APPEND);
+    compress_get(h, h1, "append", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_RAW_BYTES), holder.info.datatype);
+    cb_assert(large_item_check(&holder.info, 0, 8292));
+
+    compress_store(h, h1, "prepend", 8192, 100, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_SET);
+    compress_store(h, h1, "prepend", 100, 0, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_PREPEND);
+    compress_get(h, h1, "prepend", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_RAW_BYTES), holder.info.datatype);
+    cb_assert(large_item_check(&holder.info, 0, 8292));
+
+    compress_store(h, h1, "json", 8192, 0, PROTOCOL_BINARY_DATATYPE_JSON,
+                   OPERATION_SET);
+    compress_get(h, h1, "json", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_DATATYPE_COMPRESSED_JSON),
+                 holder.info.datatype);
+
+    /* Too small, and doesn't compress */
+    compress_store(h, h1, "small", 1000, 0, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_SET);
+    compress_get(h, h1, "small", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_RAW_BYTES), holder.info.datatype);
+    cb_assert(large_item_check(&holder.info, 0, 1000));
+    compress_store(h, h1, "random", 8192, 0, PROTOCOL_BINARY_RAW_BYTES,
+                   OPERATION_SET, true);
+    compress_get(h, h1, "random", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_RAW_BYTES), holder.info.datatype);
+    assert_equal(uint32_t(8192), holder.info.nbytes);
+
+    /* A chunked value fits in a single chunk once it's compressed */
+    compress_store(h, h1, "large", 3 * 1024 * 1024, 0,
+                   PROTOCOL_BINARY_RAW_BYTES, OPERATION_SET);
+    compress_get(h, h1, "large", &holder);
+    assert_equal(uint8_t(PROTOCOL_BINARY_DATATYPE_COMPRESSED),
+                 holder.info.datatype);
+    assert_equal(uint16_t(1), holder.info.nvalue);
+
+    /* The CAS of the item stored is the one of the compressed copy */
+    cb_assert(h1->allocate(h, NULL, &it, "large", 5, 8192, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS);
+    h1->item_set_cas(h, NULL, it, holder.info.cas);
+    cb_assert(h1->store(h, NULL, it, &cas, OPERATION_CAS, 0) == ENGINE_SUCCESS);
+    cb_assert(cas != holder.info.cas);
+    cb_assert(h1->store(h, NULL, it, &cas, OPERATION_CAS, 0) == ENGINE_KEY_EEXISTS);
+    h1->release(h, NULL, it);
+    compress_get(h, h1, "large", &holder);
+    assert_equal(cas, holder.info.cas);
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "compression", 11, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(std::string("snappy"), stat_values["compression"]);
+    /* The value is compressed before we know if the CAS matches */
+    assert_equal(std::string("6"), stat_values["total_compressed"]);
+    assert_equal(std::string("1"), stat_values["total_rejected"]);
+    cb_assert(atof(stat_values["total_ratio"].c_str()) > 4);
+    /* To append and prepend */
+    assert_equal(std::string("2"), stat_values["total_inflated"]);
+
+    h1->reset_stats(h, NULL);
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "compression", 11, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(std::string("0"), stat_values["total_compressed"]);
+    assert_equal(std::string("0"), stat_values["total_inflated"]);
+
+    test_harness.destroy_bucket(h, h1, false);
+    return SUCCESS;
+}
+
+/*
+ * With eviction_policy=sampled a store never fails because the items at
+ * the tail of the LRU are in use, and the keys being read stay in the
+ * cache while it is flooded with keys which are never read (the test
+ * runs with a single slab page per class).
+ */
+static enum test_result sampled_eviction_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    const int pinned_keys = 64;
+    const int hot_keys = 32;
+    std::vector<item*> pinned;
+    item *test_item = NULL;
+    char key[1024];
+    size_t keylen;
+    uint64_t samples = 0;
+    int ii;
+    int jj;
+
+    for (ii = 0; ii < pinned_keys; ++ii) {
+        keylen = snprintf(key, sizeof(key), "pinned_key_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+        cb_assert(h1->get(h, NULL, &test_item,
+                          key, (int)keylen, 0) == ENGINE_SUCCESS);
+        pinned.push_back(test_item);
+    }
+    for (ii = 0; ii < hot_keys; ++ii) {
+        keylen = snprintf(key, sizeof(key), "hot_key_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+    }
+
+    for (ii = 0; ii < 2000; ++ii) {
+        if ((ii % 64) == 0) {
+            for (jj = 0; jj < hot_keys; ++jj) {
+                keylen = snprintf(key, sizeof(key), "hot_key_%08d", jj);
+                cb_assert(h1->get(h, NULL, &test_item,
+                                  key, (int)keylen, 0) == ENGINE_SUCCESS);
+                h1->release(h, NULL, test_item);
+            }
+        }
+        keylen = snprintf(key, sizeof(key), "scan_key_%08d", ii);
+        lru_scan_store(h, h1, key, keylen);
+    }
+
+    for (ii = 0; ii < hot_keys; ++ii) {
+        keylen = snprintf(key, sizeof(key), "hot_key_%08d", ii);
+        cb_assert(h1->get(h, NULL, &test_item,
+                          key, (int)keylen, 0) == ENGINE_SUCCESS);
+        h1->release(h, NULL, test_item);
+    }
+    for (ii = 0; ii < pinned_keys; ++ii) {
+        h1->release(h, NULL, pinned[ii]);
+    }
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, NULL, 0, collect_stat) == ENGINE_SUCCESS);
+    assert_equal(std::string("sampled"), stat_values["eviction_policy"]);
+    cb_assert(atoi(stat_values["evictions"].c_str()) > 0);
+
+    stat_values.clear();
+    cb_assert(h1->get_stats(h, NULL, "items", 5,
+                            collect_stat) == ENGINE_SUCCESS);
+    for (const auto& stat : stat_values) {
+        if (stat.first.find(":evict_samples") != std::string::npos) {
+            samples += strtoull(stat.second.c_str(), NULL, 10);
+        }
+        if (stat.first.find(":outofmemory") != std::string::npos) {
+            assert_equal(std::string("0"), stat.second);
+        }
+    }
+    cb_assert(samples > 0);
+    return SUCCESS;
+}
+
+/*
+ * Replay the keys with the given configuration (a get, and a set of a 1k
+ * value if it misses) and return the number of hits.
+ */
+static uint64_t eviction_hits(const std::string &cfg,
+                              const std::vector<std::string> &trace) {
+    ENGINE_HANDLE_V1* h1 = test_harness.create_bucket(true, cfg.c_str());
+    ENGINE_HANDLE* h = reinterpret_cast<ENGINE_HANDLE*>(h1);
+    uint64_t hits = 0;
+
+    for (const auto& key : trace) {
+        item *it = NULL;
+        uint64_t cas = 0;
+        if (h1->get(h, NULL, &it, key.c_str(), (int)key.length(),
+                    0) == ENGINE_SUCCESS) {
+            ++hits;
+        } else if (h1->allocate(h, NULL, &it, key.c_str(), key.length(),
+                                1024, 0, 0,
+                                PROTOCOL_BINARY_RAW_BYTES) == ENGINE_SUCCESS) {
+            cb_assert(h1->store(h, NULL, it, &cas, OPERATION_SET, 0) == ENGINE_SUCCESS);
+        } else {
+            continue;
+        }
+        h1->release(h, NULL, it);
+    }
+    test_harness.destroy_bucket(h, h1, true);
+    return hits;
+}
+
+/*
+ * The sampled eviction policy should keep more of the popular keys than
+ * the LRU in a cache too small for them, when a Zipf (0.99) distributed
+ * workload is mixed with keys which are only used once. See the
+ * eviction bench in basic_engine_benchsuite.cc for the actual hit rates.
+ */
+static enum test_result sampled_eviction_hit_rate_test(engine_test_t *test) {
+    const int nkeys = 20000;
+    std::vector<double> cdf(nkeys);
+    std::vector<std::string> trace;
+    double sum = 0;
+
+    for (int ii = 0; ii < nkeys; ++ii) {
+        sum += 1.0 / pow(ii + 1, 0.99);
+        cdf[ii] = sum;
+    }
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    for (int ii = 0; ii < 200000; ++ii) {
+        std::stringstream ss;
+        if ((ii % 4) == 3) {
+            ss << "once_" << ii;
+        } else {
+            const int rank = int(std::lower_bound(cdf.begin(), cdf.end(),
+                                                  uniform(rng)) - cdf.begin());
+            ss << "zipf_" << rank;
+        }
+        trace.push_back(ss.str());
+    }
+
+    const std::string cfg(test->cfg);
+    const uint64_t lru = eviction_hits(cfg + ";eviction_policy=lru", trace);
+    const uint64_t sampled = eviction_hits(cfg + ";eviction_policy=sampled",
+                                           trace);
+    assert_ge(sampled, lru);
+    return SUCCESS;
+}
+
 MEMCACHED_PUBLIC_API
 engine_test_t* get_tests(void) {
     static engine_test_t tests[]  = {
@@ -974,28 +2131,46 @@ engine_test_t* get_tests(void) {
         TEST_CASE("store test", store_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("get test", get_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("expiry test", expiry_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("expiry wheel test", expiry_wheel_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("remove test", remove_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("release test", release_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("incr test", incr_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("mt incr test", mt_incr_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("mt cas test", mt_cas_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("update in place test", update_in_place_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("decr test", decr_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("huge pages test", huge_pages_test, NULL, NULL, "huge_pages=transparent;numa_policy=interleave", NULL, NULL),
         TEST_CASE("flush test", flush_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("flush sweep test", flush_sweep_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("get item info test", get_item_info_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("set cas test", item_set_cas_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("large item test", large_item_test, NULL, NULL, "item_size_max=4194304", NULL, NULL),
 #ifndef VALGRIND
         // this test is disabled for VALGRIND because cache_size=48 and using malloc don't work.
         TEST_CASE("LRU test", lru_test, NULL, NULL, "cache_size=48", NULL, NULL),
+        TEST_CASE("LRU scan test", lru_scan_test, NULL, NULL, "cache_size=48", NULL, NULL),
+        // there are no slab pages to move around when using malloc
+        TEST_CASE("slab reassign test", slab_reassign_test, NULL, NULL, "slab_automove=false", NULL, NULL),
+        TEST_CASE("scrub test", scrub_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("sampled eviction test", sampled_eviction_test, NULL, NULL, "cache_size=48;eviction_policy=sampled", NULL, NULL),
 #endif
         TEST_CASE("get stats test", get_stats_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("reset stats test", reset_stats_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("get stats struct test", get_stats_struct_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("aggregate stats test", aggregate_stats_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("hash stats test", hash_stats_test, NULL, NULL, "expected_items=1000000", NULL, NULL),
+        TEST_CASE("overhead stats test", overhead_stats_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("touch", touch_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("Get And Touch", gat_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("Get And Touch Quiet", gatq_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("get and touch", get_and_touch_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("Test datatype", test_datatype, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE_V2("Bucket destroy", test_n_bucket_destroy, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE_V2("Bucket destroy interleaved", test_bucket_destroy_interleaved, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE_V2("snapshot test", snapshot_test, NULL, NULL, "item_size_max=4194304", NULL, NULL),
+        TEST_CASE_V2("shm test", shm_test, NULL, NULL, "item_size_max=4194304", NULL, NULL),
+        TEST_CASE_V2("compression test", compression_test, NULL, NULL, "compression=snappy;compression_min_size=1024;item_size_max=4194304", NULL, NULL),
+        TEST_CASE_V2("sampled eviction hit rate test", sampled_eviction_hit_rate_test, NULL, NULL, "cache_size=8388608", NULL, NULL),
         TEST_CASE(NULL, NULL, NULL, NULL, NULL, NULL, NULL)
     };
     return tests;
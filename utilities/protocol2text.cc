@@ -165,7 +165,9 @@ static const std::map<uint8_t, std::string> commandmap {
     {PROTOCOL_BINARY_CMD_GET_CMD_TIMER,"GET_CMD_TIMER"},
     {PROTOCOL_BINARY_CMD_SET_CTRL_TOKEN,"SET_CTRL_TOKEN"},
     {PROTOCOL_BINARY_CMD_GET_CTRL_TOKEN,"GET_CTRL_TOKEN"},
-    {PROTOCOL_BINARY_CMD_INIT_COMPLETE,"INIT_COMPLETE"}
+    {PROTOCOL_BINARY_CMD_INIT_COMPLETE,"INIT_COMPLETE"},
+    {PROTOCOL_BINARY_CMD_SLAB_REASSIGN,"SLAB_REASSIGN"},
+    {PROTOCOL_BINARY_CMD_SNAPSHOT,"SNAPSHOT"}
 };
 
 const char *memcached_opcode_2_text(uint8_t opcode) {